@@ -3,5 +3,5 @@ COMPONENT_ADD_INCLUDEDIRS = .
 ifdef CONFIG_IDF_TARGET_ESP8266
 COMPONENT_DEPENDS = esp8266 freertos
 else
-COMPONENT_DEPENDS = driver esp32 freertos
+COMPONENT_DEPENDS = driver esp32 esp_timer freertos
 endif
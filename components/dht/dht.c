@@ -11,16 +11,41 @@
  * BSD Licensed as described in the file LICENSE
  */
 #include "dht.h"
+#include "dht_decode.h"
 
 #include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <stdbool.h>
 #include <string.h>
 #include <esp_log.h>
 #include <esp_idf_lib_helpers.h>
 
+#if HELPER_TARGET_IS_ESP32
+#include <esp_timer.h>
+#endif
+
 // DHT timer precision in microseconds
 #define DHT_TIMER_INTERVAL 2
-#define DHT_DATA_BITS 40
-#define DHT_DATA_BYTES (DHT_DATA_BITS / 8)
+
+// Length of start pulse of each sensor type
+#define DHT11_START_MS 20
+#define DHT_AM2301_START_US 1500
+#define DHT_SI7021_START_US 500
+
+#if HELPER_TARGET_IS_ESP32
+// RMT tick is 1 us with 80 MHz APB clock
+#define DHT_RMT_CLK_DIV 80
+// Frame is finished when the line stays idle longer than this number of ticks
+#define DHT_RMT_IDLE_THRESHOLD 200
+// Glitches shorter than this number of APB cycles are ignored
+#define DHT_RMT_FILTER_THRESHOLD 100
+#define DHT_RMT_RINGBUF_SIZE 1024
+// Whole transmission takes less than 5 ms
+#define DHT_RMT_RECEIVE_TIMEOUT_MS 20
+// Maximal wait for all edges of the response in GPIO interrupt mode
+#define DHT_EDGE_CAPTURE_TIMEOUT_MS 20
+#endif
 
 /*
  *  Note:
@@ -33,7 +58,8 @@
  *
  *  Initializing communications with the DHT requires four 'phases' as follows:
  *
- *  Phase A - MCU pulls signal low for at least 18000 us
+ *  Phase A - MCU pulls signal low for at least 18000 us (DHT11), 1000 - 20000 us (AM2301)
+ *            or 500 us (Si7021)
  *  Phase B - MCU allows signal to float back up and waits 20-40us for DHT to pull it low
  *  Phase C - DHT pulls signal low for ~80us
  *  Phase D - DHT lets signal float back up for ~80us
@@ -53,11 +79,13 @@
 static const char *TAG = "DHTxx";
 
 #if HELPER_TARGET_IS_ESP32
-static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+// Spinlock is local to each transaction, so sensors can be read on both cores at the same time
+#define PORT_DECLARE_MUX portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED
 #define PORT_ENTER_CRITICAL portENTER_CRITICAL(&mux)
 #define PORT_EXIT_CRITICAL portEXIT_CRITICAL(&mux)
 
 #elif HELPER_TARGET_IS_ESP8266
+#define PORT_DECLARE_MUX
 #define PORT_ENTER_CRITICAL portENTER_CRITICAL()
 #define PORT_EXIT_CRITICAL portEXIT_CRITICAL()
 #endif
@@ -103,19 +131,34 @@ static esp_err_t dht_await_pin_state(gpio_num_t pin, uint32_t timeout,
 }
 
 /**
- * Request data from DHT and read raw bit stream.
+ * Phase 'A' pulling signal low to initiate read sequence. It is not protected
+ * from task switching, preemption can only make the pulse longer.
+ * DHT11 needs at least 18 ms with no upper limit, so the task sleeps. AM2301
+ * accepts 1 - 20 ms and tick quantized sleep can exceed it, so the pulse is
+ * timed by busy waiting.
+ * The signal is released by the caller.
+ */
+static void dht_start_signal(dht_sensor_type_t sensor_type, gpio_num_t pin)
+{
+    gpio_set_level(pin, 0);
+    if (sensor_type == DHT_TYPE_DHT11)
+        vTaskDelay(pdMS_TO_TICKS(DHT11_START_MS) + 1); // at least DHT11_START_MS regardless of tick phase
+    else if (sensor_type == DHT_TYPE_SI7021)
+        ets_delay_us(DHT_SI7021_START_US);
+    else
+        ets_delay_us(DHT_AM2301_START_US);
+}
+
+/**
+ * Release the signal after phase 'A' and read raw bit stream.
  * The function call should be protected from task switching.
  * Return false if error occurred.
  */
-static inline esp_err_t dht_fetch_data(dht_sensor_type_t sensor_type, gpio_num_t pin, uint8_t data[DHT_DATA_BYTES])
+static inline esp_err_t dht_fetch_data(gpio_num_t pin, uint8_t data[DHT_DATA_BYTES])
 {
     uint32_t low_duration;
     uint32_t high_duration;
 
-    // Phase 'A' pulling signal low to initiate read sequence
-    gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
-    gpio_set_level(pin, 0);
-    ets_delay_us(sensor_type == DHT_TYPE_SI7021 ? 500 : 20000);
     gpio_set_level(pin, 1);
 
     // Step through Phase 'B', 40us
@@ -147,6 +190,219 @@ static inline esp_err_t dht_fetch_data(dht_sensor_type_t sensor_type, gpio_num_t
     return ESP_OK;
 }
 
+#if HELPER_TARGET_IS_ESP32
+/**
+ * RMT receiver installed on the channel. The driver is installed on the first read and kept,
+ * so each transaction only routes the pin and starts and stops the receiver.
+ */
+typedef struct
+{
+    bool installed;
+    gpio_num_t pin;
+    RingbufHandle_t ringbuf;
+} dht_rmt_channel_t;
+
+static dht_rmt_channel_t dht_rmt_channels[RMT_CHANNEL_MAX];
+
+/**
+ * Install RX driver on the channel if it is not installed yet and route the pin to it.
+ */
+static esp_err_t dht_rmt_prepare(rmt_channel_t channel, gpio_num_t pin)
+{
+    dht_rmt_channel_t *rmt = &dht_rmt_channels[channel];
+    if (!rmt->installed)
+    {
+        rmt_config_t config = {
+            .rmt_mode = RMT_MODE_RX,
+            .channel = channel,
+            .gpio_num = pin,
+            .clk_div = DHT_RMT_CLK_DIV,
+            .mem_block_num = 1,
+            .rx_config = {
+                .filter_en = true,
+                .filter_ticks_thresh = DHT_RMT_FILTER_THRESHOLD,
+                .idle_threshold = DHT_RMT_IDLE_THRESHOLD,
+            },
+        };
+        CHECK_LOGE(rmt_config(&config), "Cannot configure RMT channel %d", channel);
+        CHECK_LOGE(rmt_driver_install(channel, DHT_RMT_RINGBUF_SIZE, 0),
+                "Cannot install RMT driver on channel %d", channel);
+        esp_err_t result = rmt_get_ringbuf_handle(channel, &rmt->ringbuf);
+        if (result != ESP_OK)
+        {
+            rmt_driver_uninstall(channel);
+            return result;
+        }
+        rmt->installed = true;
+        rmt->pin = pin;
+    }
+    else if (rmt->pin != pin)
+    {
+        // Sensors sharing the channel are read one after another, only the input is switched
+        CHECK_LOGE(rmt_set_pin(channel, RMT_MODE_RX, pin), "Cannot route pin %d to RMT channel %d",
+                pin, channel);
+        rmt->pin = pin;
+    }
+    return ESP_OK;
+}
+
+esp_err_t dht_rmt_release(rmt_channel_t channel)
+{
+    CHECK_ARG(channel < RMT_CHANNEL_MAX);
+
+    dht_rmt_channel_t *rmt = &dht_rmt_channels[channel];
+    if (!rmt->installed)
+        return ESP_OK;
+    esp_err_t result = rmt_driver_uninstall(channel);
+    if (result == ESP_OK)
+        rmt->installed = false;
+    return result;
+}
+
+/**
+ * Request data from DHT and capture the response with RMT peripheral.
+ * Interrupts stay enabled and the task sleeps during the whole transaction.
+ */
+static esp_err_t dht_fetch_data_rmt(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        rmt_channel_t channel, uint8_t data[DHT_DATA_BYTES])
+{
+    esp_err_t result = dht_rmt_prepare(channel, pin);
+    if (result != ESP_OK)
+        return result;
+    RingbufHandle_t ringbuf = dht_rmt_channels[channel].ringbuf;
+
+    // Drop frames received after the previous transaction timed out
+    size_t size = 0;
+    rmt_item32_t *items;
+    while ((items = (rmt_item32_t *)xRingbufferReceive(ringbuf, &size, 0)) != NULL)
+        vRingbufferReturnItem(ringbuf, items);
+
+    // The pin is routed to RMT input, keep it connected while driving the start pulse
+    gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+
+    dht_start_signal(sensor_type, pin);
+    rmt_rx_start(channel, true);
+    gpio_set_level(pin, 1);
+
+    items = (rmt_item32_t *)xRingbufferReceive(ringbuf, &size,
+            pdMS_TO_TICKS(DHT_RMT_RECEIVE_TIMEOUT_MS));
+    rmt_rx_stop(channel);
+
+    result = ESP_ERR_TIMEOUT;
+    if (items)
+    {
+        dht_pulse_t pulses[2 * (DHT_RESPONSE_PULSES + 1)];
+        size_t count = 0;
+        for (size_t i = 0; i < size / sizeof(rmt_item32_t) && count + 2 <= sizeof(pulses) / sizeof(pulses[0]); i++)
+        {
+            // Zero duration marks the end of the frame
+            if (!items[i].duration0)
+                break;
+            pulses[count].duration = items[i].duration0;
+            pulses[count++].level = items[i].level0;
+            if (!items[i].duration1)
+                break;
+            pulses[count].duration = items[i].duration1;
+            pulses[count++].level = items[i].level1;
+        }
+        vRingbufferReturnItem(ringbuf, items);
+        result = dht_decode_pulses(pulses, count, data);
+        if (result != ESP_OK)
+            ESP_LOGE(TAG, "Invalid pulse train captured, %u pulses", (unsigned)count);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "No response captured");
+    }
+
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
+    gpio_set_level(pin, 1);
+
+    return result;
+}
+#endif
+
+#if HELPER_TARGET_IS_ESP32
+/**
+ * Edge timestamps recorded by GPIO interrupt. Completion is signalled by own semaphore,
+ * so task notifications of the calling task stay free for the application.
+ */
+typedef struct
+{
+    int64_t timestamps[DHT_TRANSACTION_EDGES];
+    volatile size_t count;
+    SemaphoreHandle_t done;
+    StaticSemaphore_t done_buffer;
+} dht_edge_capture_t;
+
+static void IRAM_ATTR dht_edge_isr(void *arg)
+{
+    dht_edge_capture_t *capture = (dht_edge_capture_t *)arg;
+    int64_t now = esp_timer_get_time();
+    if (capture->count >= DHT_TRANSACTION_EDGES)
+        return;
+
+    capture->timestamps[capture->count++] = now;
+    if (capture->count == DHT_TRANSACTION_EDGES)
+    {
+        BaseType_t task_woken = pdFALSE;
+        xSemaphoreGiveFromISR(capture->done, &task_woken);
+        if (task_woken)
+            portYIELD_FROM_ISR();
+    }
+}
+
+/**
+ * Request data from DHT and record timestamps of all edges of the response
+ * in GPIO interrupt. Bits are decoded from pulse widths after the transfer.
+ */
+static esp_err_t dht_fetch_data_isr(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        uint8_t data[DHT_DATA_BYTES])
+{
+    dht_edge_capture_t capture = {
+        .count = 0,
+    };
+
+    esp_err_t result = gpio_install_isr_service(0);
+    // The service may be already installed by other driver
+    if (result != ESP_OK && result != ESP_ERR_INVALID_STATE)
+    {
+        ESP_LOGE(TAG, "Cannot install GPIO ISR service");
+        return result;
+    }
+    // Static semaphore avoids heap allocation in each transaction
+    capture.done = xSemaphoreCreateBinaryStatic(&capture.done_buffer);
+
+    gpio_set_direction(pin, GPIO_MODE_INPUT_OUTPUT_OD);
+    dht_start_signal(sensor_type, pin);
+
+    gpio_set_intr_type(pin, GPIO_INTR_ANYEDGE);
+    result = gpio_isr_handler_add(pin, dht_edge_isr, &capture);
+    if (result != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Cannot add GPIO ISR handler");
+        vSemaphoreDelete(capture.done);
+        return result;
+    }
+
+    // Releasing the line is the first recorded edge
+    gpio_set_level(pin, 1);
+    xSemaphoreTake(capture.done, pdMS_TO_TICKS(DHT_EDGE_CAPTURE_TIMEOUT_MS));
+
+    // The handler is removed before the semaphore, so late edges cannot give deleted semaphore
+    gpio_isr_handler_remove(pin);
+    gpio_set_intr_type(pin, GPIO_INTR_DISABLE);
+    vSemaphoreDelete(capture.done);
+
+    // Decode also incomplete capture, the response is located from the last edge
+    result = dht_decode_edges(capture.timestamps, capture.count, 1, data);
+    if (result != ESP_OK)
+        ESP_LOGE(TAG, "Invalid response captured, %u edges", (unsigned)capture.count);
+
+    return result;
+}
+#endif
+
 /**
  * Pack two data bytes into single value and take into account sign bit.
  */
@@ -170,18 +426,42 @@ static inline int16_t dht_convert_data(dht_sensor_type_t sensor_type, uint8_t ms
     return data;
 }
 
+/**
+ * Verify checksum of received data and convert them to humidity and temperature.
+ */
+static esp_err_t dht_parse_data(dht_sensor_type_t sensor_type, const uint8_t data[DHT_DATA_BYTES],
+        int16_t *humidity, int16_t *temperature)
+{
+    if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF))
+    {
+        ESP_LOGE(TAG, "Checksum failed, invalid data received from sensor");
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    *humidity = dht_convert_data(sensor_type, data[0], data[1]);
+    *temperature = dht_convert_data(sensor_type, data[2], data[3]);
+
+    ESP_LOGD(TAG, "Sensor data: humidity=%d, temp=%d", *humidity, *temperature);
+
+    return ESP_OK;
+}
+
 esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
         int16_t *humidity, int16_t *temperature)
 {
     CHECK_ARG(humidity && temperature);
 
     uint8_t data[DHT_DATA_BYTES] = { 0 };
+    PORT_DECLARE_MUX;
 
     gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
     gpio_set_level(pin, 1);
 
+    dht_start_signal(sensor_type, pin);
+
+    // Only phases 'B' to 'D' and data bits are timing critical
     PORT_ENTER_CRITICAL;
-    esp_err_t result = dht_fetch_data(sensor_type, pin, data);
+    esp_err_t result = dht_fetch_data(pin, data);
     PORT_EXIT_CRITICAL;
 
     /* restore GPIO direction because, after calling dht_fetch_data(), the
@@ -192,20 +472,49 @@ esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
     if (result != ESP_OK)
         return result;
 
-    if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF))
-    {
-        ESP_LOGE(TAG, "Checksum failed, invalid data received from sensor");
-        return ESP_ERR_INVALID_CRC;
-    }
+    return dht_parse_data(sensor_type, data, humidity, temperature);
+}
 
-    *humidity = dht_convert_data(sensor_type, data[0], data[1]);
-    *temperature = dht_convert_data(sensor_type, data[2], data[3]);
+#if HELPER_TARGET_IS_ESP32
+esp_err_t dht_read_data_rmt(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        rmt_channel_t channel, int16_t *humidity, int16_t *temperature)
+{
+    CHECK_ARG(humidity && temperature);
 
-    ESP_LOGD(TAG, "Sensor data: humidity=%d, temp=%d", *humidity, *temperature);
+    uint8_t data[DHT_DATA_BYTES] = { 0 };
 
-    return ESP_OK;
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
+    gpio_set_level(pin, 1);
+
+    esp_err_t result = dht_fetch_data_rmt(sensor_type, pin, channel, data);
+    if (result != ESP_OK)
+        return result;
+
+    return dht_parse_data(sensor_type, data, humidity, temperature);
 }
 
+esp_err_t dht_read_data_isr(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        int16_t *humidity, int16_t *temperature)
+{
+    CHECK_ARG(humidity && temperature);
+
+    uint8_t data[DHT_DATA_BYTES] = { 0 };
+
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
+    gpio_set_level(pin, 1);
+
+    esp_err_t result = dht_fetch_data_isr(sensor_type, pin, data);
+
+    gpio_set_direction(pin, GPIO_MODE_OUTPUT_OD);
+    gpio_set_level(pin, 1);
+
+    if (result != ESP_OK)
+        return result;
+
+    return dht_parse_data(sensor_type, data, humidity, temperature);
+}
+#endif
+
 esp_err_t dht_read_float_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
         float *humidity, float *temperature)
 {
@@ -20,6 +20,11 @@
 
 #include <driver/gpio.h>
 #include <esp_err.h>
+#include <esp_idf_lib_helpers.h>
+
+#if HELPER_TARGET_IS_ESP32
+#include <driver/rmt.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,6 +55,50 @@ typedef enum
 esp_err_t dht_read_data(dht_sensor_type_t sensor_type, gpio_num_t pin,
         int16_t *humidity, int16_t *temperature);
 
+#if HELPER_TARGET_IS_ESP32
+/**
+ * @brief Read data from sensor on specified pin using RMT peripheral.
+ * The response is captured by hardware and decoded afterwards, so interrupts
+ * are not disabled and the calling task sleeps during the transaction.
+ * RMT driver is installed on the channel by the first call and kept for next
+ * reads, sensors on different pins can share the channel. The channel must be
+ * used by one task at a time.
+ *
+ * @param[in] sensor_type DHT11 or DHT22
+ * @param[in] pin GPIO pin connected to sensor OUT
+ * @param[in] channel Free RMT channel used for capture
+ * @param[out] humidity Humidity, percents * 10
+ * @param[out] temperature Temperature, degrees Celsius * 10
+ * @return `ESP_OK` on success
+ */
+esp_err_t dht_read_data_rmt(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        rmt_channel_t channel, int16_t *humidity, int16_t *temperature);
+
+/**
+ * @brief Uninstall RMT driver installed by dht_read_data_rmt().
+ *
+ * @param[in] channel RMT channel used for capture
+ * @return `ESP_OK` on success or if the driver is not installed
+ */
+esp_err_t dht_rmt_release(rmt_channel_t channel);
+
+/**
+ * @brief Read data from sensor on specified pin using GPIO interrupts.
+ * Timestamps of all signal edges are recorded by interrupt handler and bits
+ * are decoded from pulse widths after the transaction, so interrupts are not
+ * disabled and the calling task sleeps meanwhile. GPIO ISR service is
+ * installed if it is not installed yet.
+ *
+ * @param[in] sensor_type DHT11 or DHT22
+ * @param[in] pin GPIO pin connected to sensor OUT
+ * @param[out] humidity Humidity, percents * 10
+ * @param[out] temperature Temperature, degrees Celsius * 10
+ * @return `ESP_OK` on success
+ */
+esp_err_t dht_read_data_isr(dht_sensor_type_t sensor_type, gpio_num_t pin,
+        int16_t *humidity, int16_t *temperature);
+#endif
+
 /**
  * @brief Read data from sensor on specified pin.
  * Humidity and temperature are returned as floats.
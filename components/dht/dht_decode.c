@@ -0,0 +1,70 @@
+/**
+ * @file dht_decode.c
+ *
+ * Decoding of DHT bit stream from captured pulse widths.
+ *
+ * BSD Licensed as described in the file LICENSE
+ */
+#include "dht_decode.h"
+
+#include <string.h>
+
+// Maximal pulse widths in microseconds, sensors keep ~80 us for phases 'C' and 'D',
+// ~50 us for bit start and 26-28 us or 70 us for bit value
+#define DHT_PHASE_MAX_DURATION 120
+#define DHT_BIT_LOW_MAX_DURATION 90
+#define DHT_BIT_HIGH_MAX_DURATION 110
+
+static inline int dht_pulse_valid(const dht_pulse_t *pulse, uint8_t level, uint16_t max_duration)
+{
+    return pulse->level == level && pulse->duration > 0 && pulse->duration <= max_duration;
+}
+
+esp_err_t dht_decode_pulses(const dht_pulse_t *pulses, size_t count, uint8_t data[DHT_DATA_BYTES])
+{
+    // Drop idle line after the final low pulse
+    while (count > 0 && pulses[count - 1].level)
+        count--;
+
+    if (count < DHT_RESPONSE_PULSES)
+        return ESP_ERR_TIMEOUT;
+
+    const dht_pulse_t *response = &pulses[count - DHT_RESPONSE_PULSES];
+
+    // Phase 'C' low and phase 'D' high
+    if (!dht_pulse_valid(&response[0], 0, DHT_PHASE_MAX_DURATION)
+            || !dht_pulse_valid(&response[1], 1, DHT_PHASE_MAX_DURATION))
+        return ESP_ERR_TIMEOUT;
+
+    memset(data, 0, DHT_DATA_BYTES);
+    const dht_pulse_t *bit = &response[2];
+    for (int i = 0; i < DHT_DATA_BITS; i++, bit += 2)
+    {
+        if (!dht_pulse_valid(&bit[0], 0, DHT_BIT_LOW_MAX_DURATION)
+                || !dht_pulse_valid(&bit[1], 1, DHT_BIT_HIGH_MAX_DURATION))
+            return ESP_ERR_TIMEOUT;
+
+        data[i / 8] |= (bit[1].duration > bit[0].duration) << (7 - i % 8);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t dht_decode_edges(const int64_t *timestamps, size_t count, uint8_t first_level,
+        uint8_t data[DHT_DATA_BYTES])
+{
+    if (count > DHT_TRANSACTION_EDGES)
+        return ESP_ERR_INVALID_SIZE;
+
+    dht_pulse_t pulses[DHT_TRANSACTION_EDGES];
+    size_t pulse_count = 0;
+    for (size_t i = 1; i < count; i++)
+    {
+        int64_t duration = timestamps[i] - timestamps[i - 1];
+        // Out of order or overlong durations fail validation in dht_decode_pulses()
+        pulses[pulse_count].duration = duration < 0 || duration > UINT16_MAX ? 0 : (uint16_t)duration;
+        pulses[pulse_count++].level = (first_level ^ (i - 1)) & 1;
+    }
+
+    return dht_decode_pulses(pulses, pulse_count, data);
+}
@@ -0,0 +1,78 @@
+/**
+ * @file dht_decode.h
+ *
+ * Decoding of DHT bit stream from captured pulse widths. The decoder does not touch any
+ * hardware, so it can be shared by all capture modes and tested on the host.
+ *
+ * BSD Licensed as described in the file LICENSE
+ */
+#ifndef __DHT_DECODE_H__
+#define __DHT_DECODE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DHT_DATA_BITS 40
+#define DHT_DATA_BYTES (DHT_DATA_BITS / 8)
+
+/**
+ * Number of pulses driven by the sensor: phases 'C' and 'D', low and high pulse
+ * of every bit and the final low pulse.
+ */
+#define DHT_RESPONSE_PULSES (2 + 2 * DHT_DATA_BITS + 1)
+
+/**
+ * Number of edges of the whole transaction: releasing the line after phase 'A',
+ * start of phases 'C' and 'D', two edges of every bit and both edges of the final
+ * low pulse.
+ */
+#define DHT_TRANSACTION_EDGES (1 + DHT_RESPONSE_PULSES + 1)
+
+/**
+ * Single pulse of the captured signal
+ */
+typedef struct
+{
+    uint16_t duration;  //!< Pulse width in microseconds
+    uint8_t level;      //!< Line level during the pulse
+} dht_pulse_t;
+
+/**
+ * @brief Decode raw data bytes from captured pulses.
+ *
+ * The response is located from the end of the capture, so pulses recorded before
+ * the sensor response (end of phase 'A', phase 'B') are ignored. A trailing high
+ * pulse of the idle line is ignored too.
+ *
+ * @param[in] pulses Captured pulses in the order of reception
+ * @param[in] count Number of pulses
+ * @param[out] data Decoded bytes, checksum is not verified
+ * @return `ESP_OK` on success, `ESP_ERR_TIMEOUT` if pulses are missing or too long
+ */
+esp_err_t dht_decode_pulses(const dht_pulse_t *pulses, size_t count, uint8_t data[DHT_DATA_BYTES]);
+
+/**
+ * @brief Decode raw data bytes from timestamps of signal edges.
+ *
+ * Edges are expected to alternate, so only the level after the first edge
+ * is needed. Leading edges recorded before the sensor response are ignored.
+ *
+ * @param[in] timestamps Edge timestamps in microseconds in the order of reception
+ * @param[in] count Number of timestamps, at most DHT_TRANSACTION_EDGES
+ * @param[in] first_level Line level after the first edge
+ * @param[out] data Decoded bytes, checksum is not verified
+ * @return `ESP_OK` on success, `ESP_ERR_TIMEOUT` if edges are missing or pulses are too long
+ */
+esp_err_t dht_decode_edges(const int64_t *timestamps, size_t count, uint8_t first_level,
+        uint8_t data[DHT_DATA_BYTES]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __DHT_DECODE_H__
@@ -7,5 +7,5 @@
 # please read the ESP-IDF documents if you need to do this.
 #
 
-COMPONENT_SRCS := parson/parson.c
-COMPONENT_ADD_INCLUDEDIRS := parson
\ No newline at end of file
+COMPONENT_SRCS := parson/parson.c json_allocator.c
+COMPONENT_ADD_INCLUDEDIRS := parson .
\ No newline at end of file
@@ -0,0 +1,176 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of arena and pool allocators for parson.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "parson.h"
+#include "json_allocator.h"
+
+#define JSON_ALLOCATOR_ALIGN 8 // Values hold doubles, compact values keep tags in the low bits
+
+static json_arena_t* json_current_arena = NULL;
+static json_pool_t* json_current_pool = NULL;
+
+static void json_stats_add(json_allocator_stats_t* stats, size_t size)
+{
+	stats->used += size;
+	if (stats->used > stats->peak)
+	{
+		stats->peak = stats->used;
+	}
+}
+
+void json_arena_init(json_arena_t* arena, void* buffer, size_t size)
+{
+	arena->buffer = buffer;
+	arena->size = size;
+	arena->stats.used = 0;
+	arena->stats.peak = 0;
+	arena->stats.fallbacks = 0;
+	arena->stats.failures = 0;
+}
+
+void json_arena_reset(json_arena_t* arena)
+{
+	arena->stats.used = 0;
+}
+
+static void* json_arena_malloc(size_t size)
+{
+	json_arena_t* arena = json_current_arena;
+	size = (size + JSON_ALLOCATOR_ALIGN - 1) & ~(JSON_ALLOCATOR_ALIGN - 1);
+	if (size > arena->size - arena->stats.used)
+	{
+		arena->stats.failures++;
+		return NULL;
+	}
+	void* block = arena->buffer + arena->stats.used;
+	json_stats_add(&arena->stats, size);
+	return block;
+}
+
+static void json_arena_free(void* block)
+{
+	(void)block;
+	// Memory is released by json_arena_reset
+}
+
+void json_arena_use(json_arena_t* arena)
+{
+	json_current_arena = arena;
+	json_set_allocation_functions(json_arena_malloc, json_arena_free);
+}
+
+void json_pool_init(json_pool_t* pool, void* buffer, size_t size)
+{
+	size_t class_size = (size / JSON_POOL_CLASSES) & ~(JSON_ALLOCATOR_ALIGN - 1);
+	uint8_t* start = buffer;
+	for (size_t i = 0; i < JSON_POOL_CLASSES; i++)
+	{
+		json_pool_class_t* pool_class = &pool->classes[i];
+		pool_class->block_size = JSON_POOL_MIN_BLOCK << i;
+		size_t count = class_size / pool_class->block_size;
+		pool_class->start = start;
+		pool_class->end = start + count * pool_class->block_size;
+		pool_class->free_list = NULL;
+		// Link blocks so that they are allocated in address order
+		for (size_t j = count; j > 0; j--)
+		{
+			void** block = (void**)(start + (j - 1) * pool_class->block_size);
+			*block = pool_class->free_list;
+			pool_class->free_list = block;
+		}
+		start += class_size;
+	}
+	pool->stats.used = 0;
+	pool->stats.peak = 0;
+	pool->stats.fallbacks = 0;
+	pool->stats.failures = 0;
+}
+
+static void* json_pool_malloc(size_t size)
+{
+	json_pool_t* pool = json_current_pool;
+	for (size_t i = 0; i < JSON_POOL_CLASSES; i++)
+	{
+		json_pool_class_t* pool_class = &pool->classes[i];
+		if (size <= pool_class->block_size && pool_class->free_list != NULL)
+		{
+			void** block = pool_class->free_list;
+			pool_class->free_list = *block;
+			json_stats_add(&pool->stats, pool_class->block_size);
+			return block;
+		}
+	}
+	void* block = malloc(size);
+	if (block == NULL)
+	{
+		pool->stats.failures++;
+	}
+	else
+	{
+		pool->stats.fallbacks++;
+	}
+	return block;
+}
+
+static void json_pool_free(void* block)
+{
+	json_pool_t* pool = json_current_pool;
+	uint8_t* address = block;
+	for (size_t i = 0; i < JSON_POOL_CLASSES; i++)
+	{
+		json_pool_class_t* pool_class = &pool->classes[i];
+		if (address >= pool_class->start && address < pool_class->end)
+		{
+			*(void**)block = pool_class->free_list;
+			pool_class->free_list = block;
+			pool->stats.used -= pool_class->block_size;
+			return;
+		}
+	}
+	free(block);
+}
+
+void json_pool_use(json_pool_t* pool)
+{
+	json_current_pool = pool;
+	json_set_allocation_functions(json_pool_malloc, json_pool_free);
+}
+
+void json_allocator_use_default(void)
+{
+	json_set_allocation_functions(malloc, free);
+}
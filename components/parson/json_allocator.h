@@ -0,0 +1,146 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief This file defines allocators for parson which avoid heap fragmentation. Arena allocator
+ * serves allocations of one document from a buffer which is reset at once. Pool allocator serves
+ * allocations from fixed size classes and falls back to heap for larger blocks.
+ * Allocators are set globally by json_set_allocation_functions, so they must not be used
+ * by several tasks at the same time.
+ */
+
+#ifndef JSON_ALLOCATOR_H_
+#define JSON_ALLOCATOR_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+
+/**
+ * Number of pool size classes, the smallest class is JSON_POOL_MIN_BLOCK bytes
+ * and each next class is twice larger
+ */
+#define JSON_POOL_CLASSES 5
+#define JSON_POOL_MIN_BLOCK 16
+
+/**
+ * Allocation statistics
+ */
+typedef struct json_allocator_stats
+{
+	/**
+	 * Bytes currently allocated from arena or pool blocks
+	 */
+	size_t used;
+	/**
+	 * Maximal used bytes
+	 */
+	size_t peak;
+	/**
+	 * Number of allocations served from heap
+	 */
+	uint32_t fallbacks;
+	/**
+	 * Number of failed allocations
+	 */
+	uint32_t failures;
+} json_allocator_stats_t;
+
+/**
+ * Bump pointer allocator over caller provided buffer. Free is no-op, the memory of all
+ * values is released by json_arena_reset after the document is serialized.
+ */
+typedef struct json_arena
+{
+	uint8_t* buffer;
+	size_t size;
+	json_allocator_stats_t stats;
+} json_arena_t;
+
+/**
+ * Free list of one size class
+ */
+typedef struct json_pool_class
+{
+	uint8_t* start;
+	uint8_t* end;
+	void* free_list;
+	size_t block_size;
+} json_pool_class_t;
+
+/**
+ * Pool allocator with fixed size classes carved from caller provided buffer
+ */
+typedef struct json_pool
+{
+	json_pool_class_t classes[JSON_POOL_CLASSES];
+	json_allocator_stats_t stats;
+} json_pool_t;
+
+/**
+ * Initialize arena over buffer.
+ * @param arena   Arena to be initialized
+ * @param buffer  Memory for allocations aligned to 8 bytes
+ * @param size    Size of the buffer in bytes
+ */
+void json_arena_init(json_arena_t* arena, void* buffer, size_t size);
+
+/**
+ * Release all allocations at once. Values allocated from the arena must not be used after reset.
+ * @param arena  Arena
+ */
+void json_arena_reset(json_arena_t* arena);
+
+/**
+ * Set arena as parson allocator. Allocations fail when the arena is full.
+ * @param arena  Arena
+ */
+void json_arena_use(json_arena_t* arena);
+
+/**
+ * Initialize pool over buffer. The buffer is divided equally among size classes.
+ * @param pool    Pool to be initialized
+ * @param buffer  Memory for blocks aligned to 8 bytes
+ * @param size    Size of the buffer in bytes
+ */
+void json_pool_init(json_pool_t* pool, void* buffer, size_t size);
+
+/**
+ * Set pool as parson allocator. Allocations larger than the largest class or from exhausted
+ * classes are served from heap.
+ * @param pool  Pool
+ */
+void json_pool_use(json_pool_t* pool);
+
+/**
+ * Set standard malloc and free as parson allocator.
+ */
+void json_allocator_use_default(void);
+
+#endif /* JSON_ALLOCATOR_H_ */
@@ -36,14 +36,30 @@
 #include <ctype.h>
 #include <math.h>
 #include <errno.h>
+#if defined(PARSON_FAST_NUMBER_FORMAT) || defined(PARSON_COMPACT_VALUES)
+#include <stdint.h>
+#endif
 
 /* Apparently sscanf is not implemented in some "standard" libraries, so don't use it, if you
  * don't have to. */
 #define sscanf THINK_TWICE_ABOUT_USING_SSCANF
 
+#ifdef PARSON_COMPACT_VALUES
+#define STARTING_CAPACITY 4 /* typical objects are small, capacity still grows by doubling */
+#else
 #define STARTING_CAPACITY 16
+#endif
 #define MAX_NESTING       2048
 
+/* Objects with more members than this get a hash index of their names, 0 disables it */
+#ifndef PARSON_OBJECT_INDEX_THRESHOLD
+#define PARSON_OBJECT_INDEX_THRESHOLD 16
+#endif
+#define OBJECT_INDEX_EMPTY 0 /* slots hold member index + 1 */
+
+#define SERIALIZATION_STARTING_CAPACITY 256
+#define SERIALIZATION_CHUNK_SIZE        256
+
 #define FLOAT_FORMAT "%1.17g" /* do not increase precision without incresing NUM_BUF_SIZE */
 #define NUM_BUF_SIZE 64 /* double printed with "%1.17g" shouldn't be longer than 25 bytes so let's be paranoid and use 64 */
 
@@ -76,29 +92,101 @@ typedef union json_value_value {
     JSON_Array  *array;
     int          boolean;
     int          null;
+#ifdef PARSON_COMPACT_VALUES
+    char         inline_string[sizeof(double)];
+#endif
 } JSON_Value_Value;
 
+#ifdef PARSON_COMPACT_VALUES
+/* Type is kept in the low bits of the parent pointer, values are allocated at least 8 bytes aligned */
+struct json_value_t {
+    uintptr_t        tagged_parent;
+    JSON_Value_Value value;
+};
+
+/* Name length is not cached, names are C strings without embedded '\0' */
+typedef struct json_object_member_t {
+    char       *name;
+    JSON_Value *value;
+} JSON_Object_Member;
+
+#define VALUE_TAG_MASK         ((uintptr_t)7)
+#define VALUE_INLINE_STRING    7 /* JSONString stored in value.inline_string */
+#define VALUE_TAG(v)           ((int)((v)->tagged_parent & VALUE_TAG_MASK))
+#define VALUE_PARENT(v)        ((JSON_Value*)((v)->tagged_parent & ~VALUE_TAG_MASK))
+#define VALUE_SET_PARENT(v, p) ((v)->tagged_parent = (uintptr_t)(p) | ((v)->tagged_parent & VALUE_TAG_MASK))
+#define VALUE_INIT(v, t)       ((v)->tagged_parent = (uintptr_t)(t))
+
+/* Objects and arrays are allocated in one block after their wrapping value */
+#define CONTAINER_ALLOC_SIZE(t)  (sizeof(JSON_Value) + sizeof(t))
+#define CONTAINER_INIT(v, t)     ((t*)((v) + 1))
+#define CONTAINER_VALUE(c)       ((JSON_Value*)(c) - 1)
+#define CONTAINER_FREE(c)        ((void)0)
+
+#define OBJECT_NAME(o, i)                ((o)->members[(i)].name)
+#define OBJECT_NAME_LENGTH(o, i)         strlen(OBJECT_NAME(o, i))
+#define OBJECT_SET_NAME_LENGTH(o, i, l)  ((void)0)
+#define OBJECT_NAME_EQUALS(o, i, n, l)   (strncmp(OBJECT_NAME(o, i), (n), (l)) == 0 && OBJECT_NAME(o, i)[(l)] == '\0')
+#define OBJECT_VALUE(o, i)               ((o)->members[(i)].value)
+#else
 struct json_value_t {
     JSON_Value      *parent;
     JSON_Value_Type  type;
     JSON_Value_Value value;
 };
 
+#define VALUE_PARENT(v)        ((v)->parent)
+#define VALUE_SET_PARENT(v, p) ((v)->parent = (p))
+#define VALUE_INIT(v, t)       ((v)->parent = NULL, (v)->type = (t))
+
+#define CONTAINER_ALLOC_SIZE(t)  sizeof(JSON_Value)
+#define CONTAINER_INIT(v, t)     ((t*)parson_malloc(sizeof(t)))
+#define CONTAINER_VALUE(c)       ((c)->wrapping_value)
+#define CONTAINER_FREE(c)        parson_free(c)
+
+#define OBJECT_NAME(o, i)                ((o)->names[(i)])
+#define OBJECT_NAME_LENGTH(o, i)         ((o)->name_lengths[(i)])
+#define OBJECT_SET_NAME_LENGTH(o, i, l)  (OBJECT_NAME_LENGTH(o, i) = (l))
+#define OBJECT_NAME_EQUALS(o, i, n, l)   (OBJECT_NAME_LENGTH(o, i) == (l) && memcmp(OBJECT_NAME(o, i), (n), (l)) == 0)
+#define OBJECT_VALUE(o, i)               ((o)->values[(i)])
+#endif
+
 struct json_object_t {
+#ifdef PARSON_COMPACT_VALUES
+    JSON_Object_Member *members;
+#else
     JSON_Value  *wrapping_value;
     char       **names;
+    size_t      *name_lengths;
     JSON_Value **values;
+#endif
     size_t       count;
     size_t       capacity;
+    size_t      *index; /* open addressing with linear probing, NULL for small objects */
+    size_t       index_capacity; /* power of 2 */
 };
 
 struct json_array_t {
+#ifndef PARSON_COMPACT_VALUES
     JSON_Value  *wrapping_value;
+#endif
     JSON_Value **items;
     size_t       count;
     size_t       capacity;
 };
 
+/* Output of serialization. Without buffer only length is counted, with callback the buffer
+   is flushed to the callback when it is full, growable buffer is reallocated. */
+typedef struct json_writer_t {
+    char               *buf;
+    size_t              length;
+    size_t              capacity;
+    size_t              total;
+    int                 is_growable;
+    JSON_Write_Function write_fun;
+    void               *write_context;
+} JSON_Writer;
+
 /* Various */
 static char * read_file(const char *filename);
 static void   remove_comments(char *string, const char *start_token, const char *end_token);
@@ -117,6 +205,13 @@ static JSON_Status   json_object_add(JSON_Object *object, const char *name, JSON
 static JSON_Status   json_object_addn(JSON_Object *object, const char *name, size_t name_len, JSON_Value *value);
 static JSON_Status   json_object_resize(JSON_Object *object, size_t new_capacity);
 static JSON_Value  * json_object_getn_value(const JSON_Object *object, const char *name, size_t name_len);
+static int           json_object_find(const JSON_Object *object, const char *name, size_t name_len, size_t *position);
+static unsigned long json_object_hash(const char *name, size_t name_len);
+static void          json_object_index_insert(JSON_Object *object, size_t position);
+static void          json_object_index_build(JSON_Object *object);
+static void          json_object_index_remove(JSON_Object *object, size_t position);
+static void          json_object_index_move(JSON_Object *object, size_t from, size_t to);
+static void          json_object_index_free(JSON_Object *object);
 static JSON_Status   json_object_remove_internal(JSON_Object *object, const char *name, int free_value);
 static JSON_Status   json_object_dotremove_internal(JSON_Object *object, const char *name, int free_value);
 static void          json_object_free(JSON_Object *object);
@@ -144,10 +239,21 @@ static JSON_Value * parse_null_value(const char **string);
 static JSON_Value * parse_value(const char **string, size_t nesting);
 
 /* Serialization */
-static int    json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int level, int is_pretty, char *num_buf);
-static int    json_serialize_string(const char *string, char *buf);
-static int    append_indent(char *buf, int level);
-static int    append_string(char *buf, const char *string);
+static void   json_writer_init(JSON_Writer *writer, char *buf, size_t capacity, int is_growable);
+static int    json_writer_grow(JSON_Writer *writer, size_t needed);
+static int    json_writer_flush(JSON_Writer *writer);
+static int    json_writer_append(JSON_Writer *writer, const char *data, size_t len);
+static int    format_number(double num, char *buf);
+static int    json_serialize_to_writer_r(const JSON_Value *value, JSON_Writer *writer, int level, int is_pretty, char *num_buf);
+static int    json_serialize_string(const char *string, JSON_Writer *writer);
+static int    append_indent(JSON_Writer *writer, int level);
+static int    append_string(JSON_Writer *writer, const char *string);
+static JSON_Status json_serialize_to_writer(const JSON_Value *value, JSON_Writer *writer, int is_pretty);
+static char * json_serialize_to_string_internal(const JSON_Value *value, int is_pretty);
+static JSON_Status json_serialize_to_buffer_internal(const JSON_Value *value, char *buf, size_t buf_size_in_bytes, int is_pretty);
+static JSON_Status json_serialize_to_file_internal(const JSON_Value *value, const char *filename, int is_pretty);
+static JSON_Status json_serialize_to_callback_internal(const JSON_Value *value, JSON_Write_Function write_fun, void *context, int is_pretty);
+static JSON_Status write_to_file(void *context, const char *data, size_t len);
 
 /* Various */
 static char * parson_strndup(const char *string, size_t n) {
@@ -345,15 +451,22 @@ static void remove_comments(char *string, const char *start_token, const char *e
 
 /* JSON Object */
 static JSON_Object * json_object_init(JSON_Value *wrapping_value) {
-    JSON_Object *new_obj = (JSON_Object*)parson_malloc(sizeof(JSON_Object));
+    JSON_Object *new_obj = CONTAINER_INIT(wrapping_value, JSON_Object);
     if (new_obj == NULL) {
         return NULL;
     }
+#ifdef PARSON_COMPACT_VALUES
+    new_obj->members = (JSON_Object_Member*)NULL;
+#else
     new_obj->wrapping_value = wrapping_value;
     new_obj->names = (char**)NULL;
+    new_obj->name_lengths = (size_t*)NULL;
     new_obj->values = (JSON_Value**)NULL;
+#endif
     new_obj->capacity = 0;
     new_obj->count = 0;
+    new_obj->index = (size_t*)NULL;
+    new_obj->index_capacity = 0;
     return new_obj;
 }
 
@@ -369,7 +482,7 @@ static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_
     if (object == NULL || name == NULL || value == NULL) {
         return JSONFailure;
     }
-    if (json_object_getn_value(object, name, name_len) != NULL) {
+    if (json_object_find(object, name, name_len, &index)) {
         return JSONFailure;
     }
     if (object->count >= object->capacity) {
@@ -379,18 +492,44 @@ static JSON_Status json_object_addn(JSON_Object *object, const char *name, size_
         }
     }
     index = object->count;
-    object->names[index] = parson_strndup(name, name_len);
-    if (object->names[index] == NULL) {
+    OBJECT_NAME(object, index) = parson_strndup(name, name_len);
+    if (OBJECT_NAME(object, index) == NULL) {
         return JSONFailure;
     }
-    value->parent = json_object_get_wrapping_value(object);
-    object->values[index] = value;
+    OBJECT_SET_NAME_LENGTH(object, index, name_len);
+    VALUE_SET_PARENT(value, json_object_get_wrapping_value(object));
+    OBJECT_VALUE(object, index) = value;
     object->count++;
+    if (object->index != NULL && object->count * 2 <= object->index_capacity) {
+        json_object_index_insert(object, index);
+    } else if (PARSON_OBJECT_INDEX_THRESHOLD > 0 && object->count > PARSON_OBJECT_INDEX_THRESHOLD) {
+        json_object_index_build(object);
+    }
     return JSONSuccess;
 }
 
+#ifdef PARSON_COMPACT_VALUES
+static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity) {
+    JSON_Object_Member *temp_members = NULL;
+    if (new_capacity == 0) {
+        return JSONFailure;
+    }
+    temp_members = (JSON_Object_Member*)parson_malloc(new_capacity * sizeof(JSON_Object_Member));
+    if (temp_members == NULL) {
+        return JSONFailure;
+    }
+    if (object->members != NULL && object->count > 0) {
+        memcpy(temp_members, object->members, object->count * sizeof(JSON_Object_Member));
+    }
+    parson_free(object->members);
+    object->members = temp_members;
+    object->capacity = new_capacity;
+    return JSONSuccess;
+}
+#else
 static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity) {
     char **temp_names = NULL;
+    size_t *temp_name_lengths = NULL;
     JSON_Value **temp_values = NULL;
 
     if ((object->names == NULL && object->values != NULL) ||
@@ -402,58 +541,170 @@ static JSON_Status json_object_resize(JSON_Object *object, size_t new_capacity)
     if (temp_names == NULL) {
         return JSONFailure;
     }
+    temp_name_lengths = (size_t*)parson_malloc(new_capacity * sizeof(size_t));
+    if (temp_name_lengths == NULL) {
+        parson_free(temp_names);
+        return JSONFailure;
+    }
     temp_values = (JSON_Value**)parson_malloc(new_capacity * sizeof(JSON_Value*));
     if (temp_values == NULL) {
         parson_free(temp_names);
+        parson_free(temp_name_lengths);
         return JSONFailure;
     }
     if (object->names != NULL && object->values != NULL && object->count > 0) {
         memcpy(temp_names, object->names, object->count * sizeof(char*));
+        memcpy(temp_name_lengths, object->name_lengths, object->count * sizeof(size_t));
         memcpy(temp_values, object->values, object->count * sizeof(JSON_Value*));
     }
     parson_free(object->names);
+    parson_free(object->name_lengths);
     parson_free(object->values);
     object->names = temp_names;
+    object->name_lengths = temp_name_lengths;
     object->values = temp_values;
     object->capacity = new_capacity;
     return JSONSuccess;
 }
+#endif
 
 static JSON_Value * json_object_getn_value(const JSON_Object *object, const char *name, size_t name_len) {
-    size_t i, name_length;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        name_length = strlen(object->names[i]);
-        if (name_length != name_len) {
-            continue;
+    size_t i = 0;
+    if (!json_object_find(object, name, name_len, &i)) {
+        return NULL;
+    }
+    return OBJECT_VALUE(object, i);
+}
+
+static int json_object_find(const JSON_Object *object, const char *name, size_t name_len, size_t *position) {
+    size_t i, slot, mask;
+    if (object == NULL) {
+        return 0;
+    }
+    if (object->index != NULL) {
+        mask = object->index_capacity - 1;
+        slot = json_object_hash(name, name_len) & mask;
+        while (object->index[slot] != OBJECT_INDEX_EMPTY) {
+            i = object->index[slot] - 1;
+            if (OBJECT_NAME_EQUALS(object, i, name, name_len)) {
+                *position = i;
+                return 1;
+            }
+            slot = (slot + 1) & mask;
         }
-        if (strncmp(object->names[i], name, name_len) == 0) {
-            return object->values[i];
+        return 0;
+    }
+    for (i = 0; i < object->count; i++) {
+        if (OBJECT_NAME_EQUALS(object, i, name, name_len)) {
+            *position = i;
+            return 1;
         }
     }
-    return NULL;
+    return 0;
+}
+
+static unsigned long json_object_hash(const char *name, size_t name_len) {
+    unsigned long hash = 2166136261UL; /* FNV-1a */
+    size_t i;
+    for (i = 0; i < name_len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+static void json_object_index_insert(JSON_Object *object, size_t position) {
+    size_t mask = object->index_capacity - 1;
+    size_t slot = json_object_hash(OBJECT_NAME(object, position), OBJECT_NAME_LENGTH(object, position)) & mask;
+    while (object->index[slot] != OBJECT_INDEX_EMPTY) {
+        slot = (slot + 1) & mask;
+    }
+    object->index[slot] = position + 1;
+}
+
+static void json_object_index_build(JSON_Object *object) {
+    size_t i, new_capacity = STARTING_CAPACITY;
+    size_t *new_index = NULL;
+    while (new_capacity < object->count * 4) {
+        new_capacity *= 2;
+    }
+    new_index = (size_t*)parson_malloc(new_capacity * sizeof(size_t));
+    json_object_index_free(object);
+    if (new_index == NULL) {
+        return; /* lookups fall back to linear search */
+    }
+    for (i = 0; i < new_capacity; i++) {
+        new_index[i] = OBJECT_INDEX_EMPTY;
+    }
+    object->index = new_index;
+    object->index_capacity = new_capacity;
+    for (i = 0; i < object->count; i++) {
+        json_object_index_insert(object, i);
+    }
+}
+
+static void json_object_index_remove(JSON_Object *object, size_t position) {
+    size_t mask = object->index_capacity - 1;
+    size_t hole = json_object_hash(OBJECT_NAME(object, position), OBJECT_NAME_LENGTH(object, position)) & mask;
+    size_t slot = 0, home = 0, item = 0;
+    while (object->index[hole] != position + 1) {
+        hole = (hole + 1) & mask;
+    }
+    /* Shift back the rest of the probe cluster, so no entry becomes unreachable */
+    slot = hole;
+    for (;;) {
+        slot = (slot + 1) & mask;
+        if (object->index[slot] == OBJECT_INDEX_EMPTY) {
+            break;
+        }
+        item = object->index[slot] - 1;
+        home = json_object_hash(OBJECT_NAME(object, item), OBJECT_NAME_LENGTH(object, item)) & mask;
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            object->index[hole] = object->index[slot];
+            hole = slot;
+        }
+    }
+    object->index[hole] = OBJECT_INDEX_EMPTY;
+}
+
+static void json_object_index_move(JSON_Object *object, size_t from, size_t to) {
+    size_t mask = object->index_capacity - 1;
+    size_t slot = json_object_hash(OBJECT_NAME(object, from), OBJECT_NAME_LENGTH(object, from)) & mask;
+    while (object->index[slot] != from + 1) {
+        slot = (slot + 1) & mask;
+    }
+    object->index[slot] = to + 1;
+}
+
+static void json_object_index_free(JSON_Object *object) {
+    parson_free(object->index);
+    object->index = NULL;
+    object->index_capacity = 0;
 }
 
 static JSON_Status json_object_remove_internal(JSON_Object *object, const char *name, int free_value) {
     size_t i = 0, last_item_index = 0;
-    if (object == NULL || json_object_get_value(object, name) == NULL) {
+    if (object == NULL || name == NULL || !json_object_find(object, name, strlen(name), &i)) {
         return JSONFailure;
     }
     last_item_index = json_object_get_count(object) - 1;
-    for (i = 0; i < json_object_get_count(object); i++) {
-        if (strcmp(object->names[i], name) == 0) {
-            parson_free(object->names[i]);
-            if (free_value) {
-                json_value_free(object->values[i]);
-            }
-            if (i != last_item_index) { /* Replace key value pair with one from the end */
-                object->names[i] = object->names[last_item_index];
-                object->values[i] = object->values[last_item_index];
-            }
-            object->count -= 1;
-            return JSONSuccess;
+    if (object->index != NULL) {
+        json_object_index_remove(object, i);
+        if (i != last_item_index) {
+            json_object_index_move(object, last_item_index, i);
         }
     }
-    return JSONFailure; /* No execution path should end here */
+    parson_free(OBJECT_NAME(object, i));
+    if (free_value) {
+        json_value_free(OBJECT_VALUE(object, i));
+    }
+    if (i != last_item_index) { /* Replace key value pair with one from the end */
+        OBJECT_NAME(object, i) = OBJECT_NAME(object, last_item_index);
+        OBJECT_SET_NAME_LENGTH(object, i, OBJECT_NAME_LENGTH(object, last_item_index));
+        OBJECT_VALUE(object, i) = OBJECT_VALUE(object, last_item_index);
+    }
+    object->count -= 1;
+    return JSONSuccess;
 }
 
 static JSON_Status json_object_dotremove_internal(JSON_Object *object, const char *name, int free_value) {
@@ -474,21 +725,29 @@ static JSON_Status json_object_dotremove_internal(JSON_Object *object, const cha
 static void json_object_free(JSON_Object *object) {
     size_t i;
     for (i = 0; i < object->count; i++) {
-        parson_free(object->names[i]);
-        json_value_free(object->values[i]);
+        parson_free(OBJECT_NAME(object, i));
+        json_value_free(OBJECT_VALUE(object, i));
     }
+#ifdef PARSON_COMPACT_VALUES
+    parson_free(object->members);
+#else
     parson_free(object->names);
+    parson_free(object->name_lengths);
     parson_free(object->values);
-    parson_free(object);
+#endif
+    parson_free(object->index);
+    CONTAINER_FREE(object);
 }
 
 /* JSON Array */
 static JSON_Array * json_array_init(JSON_Value *wrapping_value) {
-    JSON_Array *new_array = (JSON_Array*)parson_malloc(sizeof(JSON_Array));
+    JSON_Array *new_array = CONTAINER_INIT(wrapping_value, JSON_Array);
     if (new_array == NULL) {
         return NULL;
     }
+#ifndef PARSON_COMPACT_VALUES
     new_array->wrapping_value = wrapping_value;
+#endif
     new_array->items = (JSON_Value**)NULL;
     new_array->capacity = 0;
     new_array->count = 0;
@@ -502,7 +761,7 @@ static JSON_Status json_array_add(JSON_Array *array, JSON_Value *value) {
             return JSONFailure;
         }
     }
-    value->parent = json_array_get_wrapping_value(array);
+    VALUE_SET_PARENT(value, json_array_get_wrapping_value(array));
     array->items[array->count] = value;
     array->count++;
     return JSONSuccess;
@@ -532,17 +791,31 @@ static void json_array_free(JSON_Array *array) {
         json_value_free(array->items[i]);
     }
     parson_free(array->items);
-    parson_free(array);
+    CONTAINER_FREE(array);
 }
 
 /* JSON Value */
 static JSON_Value * json_value_init_string_no_copy(char *string) {
+#ifdef PARSON_COMPACT_VALUES
+    size_t i = 0;
+#endif
     JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
     if (!new_value) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONString;
+#ifdef PARSON_COMPACT_VALUES
+    /* Short strings are moved into the value, so they don't need a heap block */
+    while (i < sizeof(new_value->value.inline_string) && string[i] != '\0') {
+        i++;
+    }
+    if (i < sizeof(new_value->value.inline_string)) {
+        VALUE_INIT(new_value, VALUE_INLINE_STRING);
+        memcpy(new_value->value.inline_string, string, i + 1);
+        parson_free(string);
+        return new_value;
+    }
+#endif
+    VALUE_INIT(new_value, JSONString);
     new_value->value.string = string;
     return new_value;
 }
@@ -865,18 +1138,374 @@ static JSON_Value * parse_null_value(const char **string) {
     return NULL;
 }
 
+#ifdef PARSON_FAST_NUMBER_FORMAT
+/* Shortest round-trip formatting of doubles by Grisu2 algorithm (Florian Loitsch, "Printing
+   Floating-Point Numbers Quickly and Accurately with Integers", 2010) following the
+   implementation of Milo Yip. Integral values are printed directly. Requires C99 for uint64_t.
+   Output always round-trips, under 0.1% of random doubles get one digit more than shortest. */
+typedef struct parson_diy_fp_t {
+    uint64_t f;
+    int e;
+} parson_diy_fp;
+
+static const uint64_t parson_cached_powers_f[] = {
+    UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76),
+    UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+    UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f), UINT64_C(0xbe5691ef416bd60c),
+    UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+    UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57),
+    UINT64_C(0xc21094364dfb5637), UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+    UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5), UINT64_C(0xb23867fb2a35b28e),
+    UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+    UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126),
+    UINT64_C(0xb5b5ada8aaff80b8), UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+    UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd), UINT64_C(0xa6dfbd9fb8e5b88f),
+    UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+    UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06),
+    UINT64_C(0xaa242499697392d3), UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+    UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c), UINT64_C(0x9c40000000000000),
+    UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+    UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068),
+    UINT64_C(0x9f4f2726179a2245), UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+    UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a), UINT64_C(0x924d692ca61be758),
+    UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+    UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d),
+    UINT64_C(0x952ab45cfa97a0b3), UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+    UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece), UINT64_C(0x88fcf317f22241e2),
+    UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+    UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410),
+    UINT64_C(0x8bab8eefb6409c1a), UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+    UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429), UINT64_C(0x80444b5e7aa7cf85),
+    UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+    UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b)
+};
+
+static const short parson_cached_powers_e[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066
+};
+
+static const uint64_t parson_pow10[] = {
+    UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000), UINT64_C(10000), UINT64_C(100000),
+    UINT64_C(1000000), UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+    UINT64_C(10000000000), UINT64_C(100000000000), UINT64_C(1000000000000),
+    UINT64_C(10000000000000), UINT64_C(100000000000000), UINT64_C(1000000000000000),
+    UINT64_C(10000000000000000), UINT64_C(100000000000000000), UINT64_C(1000000000000000000),
+    UINT64_C(10000000000000000000)
+};
+
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS    (0x3FF + DP_SIGNIFICAND_SIZE)
+#define DP_EXPONENT_MASK    UINT64_C(0x7FF0000000000000)
+#define DP_SIGNIFICAND_MASK UINT64_C(0x000FFFFFFFFFFFFF)
+#define DP_HIDDEN_BIT       UINT64_C(0x0010000000000000)
+#define DP_MAX_INTEGER      9007199254740992.0 /* 2^53 */
+
+static parson_diy_fp diy_fp_from_double(double value) {
+    parson_diy_fp result;
+    uint64_t bits = 0;
+    int biased_e = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    biased_e = (int)((bits & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+    result.f = bits & DP_SIGNIFICAND_MASK;
+    if (biased_e != 0) {
+        result.f += DP_HIDDEN_BIT;
+        result.e = biased_e - DP_EXPONENT_BIAS;
+    } else {
+        result.e = 1 - DP_EXPONENT_BIAS;
+    }
+    return result;
+}
+
+static parson_diy_fp diy_fp_normalize(parson_diy_fp value) {
+    while (!(value.f & (UINT64_C(1) << 63))) {
+        value.f <<= 1;
+        value.e--;
+    }
+    return value;
+}
+
+static parson_diy_fp diy_fp_multiply(parson_diy_fp x, parson_diy_fp y) {
+    const uint64_t m32 = UINT64_C(0xFFFFFFFF);
+    uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & m32) + (bc & m32);
+    parson_diy_fp result;
+    tmp += UINT64_C(1) << 31; /* round */
+    result.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    result.e = x.e + y.e + 64;
+    return result;
+}
+
+/* Boundaries m- and m+ of the value, normalized to the same exponent */
+static void diy_fp_normalized_boundaries(parson_diy_fp value, parson_diy_fp *minus, parson_diy_fp *plus) {
+    parson_diy_fp pl, mi;
+    pl.f = (value.f << 1) + 1;
+    pl.e = value.e - 1;
+    while (!(pl.f & (DP_HIDDEN_BIT << 1))) {
+        pl.f <<= 1;
+        pl.e--;
+    }
+    pl.f <<= 64 - DP_SIGNIFICAND_SIZE - 2;
+    pl.e -= 64 - DP_SIGNIFICAND_SIZE - 2;
+    if (value.f == DP_HIDDEN_BIT) {
+        mi.f = (value.f << 2) - 1;
+        mi.e = value.e - 2;
+    } else {
+        mi.f = (value.f << 1) - 1;
+        mi.e = value.e - 1;
+    }
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+    *minus = mi;
+    *plus = pl;
+}
+
+/* Cached power 10^-k, product with value of binary exponent e has exponent in [-60, -32] */
+static parson_diy_fp get_cached_power(int e, int *k) {
+    parson_diy_fp result;
+    double dk = (-61 - e) * 0.30102999566398114 + 347; /* dk is positive, so ceiling can be done by cast */
+    int ik = (int)dk;
+    unsigned int index = 0;
+    if (dk - ik > 0.0) {
+        ik++;
+    }
+    index = (unsigned int)((ik >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    result.f = parson_cached_powers_f[index];
+    result.e = parson_cached_powers_e[index];
+    return result;
+}
+
+static void grisu_round(char *buffer, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buffer[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int count_decimal_digits(uint32_t n) {
+    int digits = 1;
+    while (digits < 10 && n >= parson_pow10[digits]) {
+        digits++;
+    }
+    return digits;
+}
+
+static void grisu_digit_gen(parson_diy_fp w, parson_diy_fp mp, uint64_t delta, char *buffer, int *len, int *k) {
+    const int shift = -mp.e;
+    const uint64_t one = UINT64_C(1) << shift;
+    const uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> shift);
+    uint64_t p2 = mp.f & (one - 1);
+    int kappa = count_decimal_digits(p1);
+    uint32_t d = 0;
+    uint64_t tmp = 0;
+    *len = 0;
+    while (kappa > 0) {
+        d = p1 / (uint32_t)parson_pow10[kappa - 1];
+        p1 %= (uint32_t)parson_pow10[kappa - 1];
+        if (d || *len) {
+            buffer[(*len)++] = (char)('0' + d);
+        }
+        kappa--;
+        tmp = ((uint64_t)p1 << shift) + p2;
+        if (tmp <= delta) {
+            *k += kappa;
+            grisu_round(buffer, *len, delta, tmp, parson_pow10[kappa] << shift, wp_w);
+            return;
+        }
+    }
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        d = (uint32_t)(p2 >> shift);
+        if (d || *len) {
+            buffer[(*len)++] = (char)('0' + d);
+        }
+        p2 &= one - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            grisu_round(buffer, *len, delta, p2, one, wp_w * parson_pow10[-kappa]);
+            return;
+        }
+    }
+}
+
+/* Shortest digits of positive value, value = digits * 10^k */
+static int grisu2(double value, char *buffer, int *k) {
+    parson_diy_fp v = diy_fp_from_double(value);
+    parson_diy_fp w_m, w_p, c_mk, w, wp, wm;
+    int length = 0;
+    diy_fp_normalized_boundaries(v, &w_m, &w_p);
+    c_mk = get_cached_power(w_p.e, k);
+    w = diy_fp_multiply(diy_fp_normalize(v), c_mk);
+    wp = diy_fp_multiply(w_p, c_mk);
+    wm = diy_fp_multiply(w_m, c_mk);
+    wm.f++;
+    wp.f--;
+    grisu_digit_gen(w, wp, wp.f - wm.f, buffer, &length, k);
+    return length;
+}
+
+static int write_exponent(int k, char *buffer) {
+    char *start = buffer;
+    if (k < 0) {
+        *buffer++ = '-';
+        k = -k;
+    } else {
+        *buffer++ = '+';
+    }
+    if (k >= 100) {
+        *buffer++ = (char)('0' + k / 100);
+        k %= 100;
+        *buffer++ = (char)('0' + k / 10);
+    } else if (k >= 10) {
+        *buffer++ = (char)('0' + k / 10);
+    }
+    *buffer++ = (char)('0' + k % 10);
+    return (int)(buffer - start);
+}
+
+/* Place decimal point or exponent into digits, returns length of result */
+static int prettify_number(char *buffer, int length, int k) {
+    const int kk = length + k; /* 10^(kk-1) <= v < 10^kk */
+    int i = 0, offset = 0;
+    if (length <= kk && kk <= 21) {
+        /* 1234e7 -> 12340000000 */
+        for (i = length; i < kk; i++) {
+            buffer[i] = '0';
+        }
+        return kk;
+    } else if (0 < kk && kk <= 21) {
+        /* 1234e-2 -> 12.34 */
+        memmove(&buffer[kk + 1], &buffer[kk], (size_t)(length - kk));
+        buffer[kk] = '.';
+        return length + 1;
+    } else if (-6 < kk && kk <= 0) {
+        /* 1234e-6 -> 0.001234 */
+        offset = 2 - kk;
+        memmove(&buffer[offset], &buffer[0], (size_t)length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        for (i = 2; i < offset; i++) {
+            buffer[i] = '0';
+        }
+        return length + offset;
+    } else if (length == 1) {
+        /* 1e30 */
+        buffer[1] = 'e';
+        return 2 + write_exponent(kk - 1, &buffer[2]);
+    }
+    /* 1234e30 -> 1.234e33 */
+    memmove(&buffer[2], &buffer[1], (size_t)(length - 1));
+    buffer[1] = '.';
+    buffer[length + 1] = 'e';
+    return length + 2 + write_exponent(kk - 1, &buffer[length + 2]);
+}
+
+static int format_integer(uint64_t value, char *buffer) {
+    char digits[20];
+    int count = 0, i = 0;
+    do {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    for (i = 0; i < count; i++) {
+        buffer[i] = digits[count - i - 1];
+    }
+    return count;
+}
+
+static int format_number(double num, char *buf) {
+    int length = 0, k = 0, sign = 0;
+    if (num < 0.0 || (num == 0.0 && 1.0 / num < 0.0)) {
+        buf[0] = '-';
+        num = -num;
+        sign = 1;
+    }
+    if (num < DP_MAX_INTEGER && num == (double)(uint64_t)num) {
+        length = format_integer((uint64_t)num, buf + sign);
+    } else {
+        length = grisu2(num, buf + sign, &k);
+        length = prettify_number(buf + sign, length, k);
+    }
+    buf[sign + length] = '\0';
+    return sign + length;
+}
+#else
+static int format_number(double num, char *buf) {
+    return sprintf(buf, FLOAT_FORMAT, num);
+}
+#endif
+
 /* Serialization */
-#define APPEND_STRING(str) do { written = append_string(buf, (str));\
-                                if (written < 0) { return -1; }\
-                                if (buf != NULL) { buf += written; }\
-                                written_total += written; } while(0)
+static void json_writer_init(JSON_Writer *writer, char *buf, size_t capacity, int is_growable) {
+    writer->buf = buf;
+    writer->length = 0;
+    writer->capacity = capacity;
+    writer->total = 0;
+    writer->is_growable = is_growable;
+    writer->write_fun = NULL;
+    writer->write_context = NULL;
+}
+
+static int json_writer_grow(JSON_Writer *writer, size_t needed) {
+    size_t new_capacity = MAX(writer->capacity * 2, writer->length + needed);
+    char *new_buf = (char*)parson_malloc(new_capacity);
+    if (new_buf == NULL) {
+        return -1;
+    }
+    memcpy(new_buf, writer->buf, writer->length);
+    parson_free(writer->buf);
+    writer->buf = new_buf;
+    writer->capacity = new_capacity;
+    return 0;
+}
+
+static int json_writer_flush(JSON_Writer *writer) {
+    if (writer->length > 0 && writer->write_fun(writer->write_context, writer->buf, writer->length) != JSONSuccess) {
+        return -1;
+    }
+    writer->length = 0;
+    return 0;
+}
+
+static int json_writer_append(JSON_Writer *writer, const char *data, size_t len) {
+    writer->total += len;
+    if (writer->buf == NULL) {
+        return 0;
+    }
+    if (writer->capacity - writer->length < len) {
+        if (writer->write_fun != NULL) {
+            if (json_writer_flush(writer) < 0) {
+                return -1;
+            }
+            if (len > writer->capacity) {
+                return writer->write_fun(writer->write_context, data, len) == JSONSuccess ? 0 : -1;
+            }
+        } else if (!writer->is_growable || json_writer_grow(writer, len) < 0) {
+            return -1;
+        }
+    }
+    memcpy(writer->buf + writer->length, data, len);
+    writer->length += len;
+    return 0;
+}
 
-#define APPEND_INDENT(level) do { written = append_indent(buf, (level));\
-                                  if (written < 0) { return -1; }\
-                                  if (buf != NULL) { buf += written; }\
-                                  written_total += written; } while(0)
+#define APPEND_STRING(str) do { if (append_string(writer, (str)) < 0) { return -1; } } while(0)
 
-static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int level, int is_pretty, char *num_buf)
+#define APPEND_INDENT(level) do { if (append_indent(writer, (level)) < 0) { return -1; } } while(0)
+
+static int json_serialize_to_writer_r(const JSON_Value *value, JSON_Writer *writer, int level, int is_pretty, char *num_buf)
 {
     const char *key = NULL, *string = NULL;
     JSON_Value *temp_value = NULL;
@@ -884,7 +1513,7 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
     JSON_Object *object = NULL;
     size_t i = 0, count = 0;
     double num = 0.0;
-    int written = -1, written_total = 0;
+    int written = -1;
 
     switch (json_value_get_type(value)) {
         case JSONArray:
@@ -899,14 +1528,9 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
                     APPEND_INDENT(level+1);
                 }
                 temp_value = json_array_get_value(array, i);
-                written = json_serialize_to_buffer_r(temp_value, buf, level+1, is_pretty, num_buf);
-                if (written < 0) {
+                if (json_serialize_to_writer_r(temp_value, writer, level+1, is_pretty, num_buf) < 0) {
                     return -1;
                 }
-                if (buf != NULL) {
-                    buf += written;
-                }
-                written_total += written;
                 if (i < (count - 1)) {
                     APPEND_STRING(",");
                 }
@@ -918,7 +1542,7 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
                 APPEND_INDENT(level);
             }
             APPEND_STRING("]");
-            return written_total;
+            return 0;
         case JSONObject:
             object = json_value_get_object(value);
             count  = json_object_get_count(object);
@@ -934,27 +1558,17 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
                 if (is_pretty) {
                     APPEND_INDENT(level+1);
                 }
-                written = json_serialize_string(key, buf);
-                if (written < 0) {
+                if (json_serialize_string(key, writer) < 0) {
                     return -1;
                 }
-                if (buf != NULL) {
-                    buf += written;
-                }
-                written_total += written;
                 APPEND_STRING(":");
                 if (is_pretty) {
                     APPEND_STRING(" ");
                 }
-                temp_value = json_object_get_value(object, key);
-                written = json_serialize_to_buffer_r(temp_value, buf, level+1, is_pretty, num_buf);
-                if (written < 0) {
+                temp_value = json_object_get_value_at(object, i);
+                if (json_serialize_to_writer_r(temp_value, writer, level+1, is_pretty, num_buf) < 0) {
                     return -1;
                 }
-                if (buf != NULL) {
-                    buf += written;
-                }
-                written_total += written;
                 if (i < (count - 1)) {
                     APPEND_STRING(",");
                 }
@@ -966,45 +1580,30 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
                 APPEND_INDENT(level);
             }
             APPEND_STRING("}");
-            return written_total;
+            return 0;
         case JSONString:
             string = json_value_get_string(value);
             if (string == NULL) {
                 return -1;
             }
-            written = json_serialize_string(string, buf);
-            if (written < 0) {
-                return -1;
-            }
-            if (buf != NULL) {
-                buf += written;
-            }
-            written_total += written;
-            return written_total;
+            return json_serialize_string(string, writer);
         case JSONBoolean:
             if (json_value_get_boolean(value)) {
                 APPEND_STRING("true");
             } else {
                 APPEND_STRING("false");
             }
-            return written_total;
+            return 0;
         case JSONNumber:
             num = json_value_get_number(value);
-            if (buf != NULL) {
-                num_buf = buf;
-            }
-            written = sprintf(num_buf, FLOAT_FORMAT, num);
+            written = format_number(num, num_buf);
             if (written < 0) {
                 return -1;
             }
-            if (buf != NULL) {
-                buf += written;
-            }
-            written_total += written;
-            return written_total;
+            return json_writer_append(writer, num_buf, (size_t)written);
         case JSONNull:
             APPEND_STRING("null");
-            return written_total;
+            return 0;
         case JSONError:
             return -1;
         default:
@@ -1012,13 +1611,20 @@ static int json_serialize_to_buffer_r(const JSON_Value *value, char *buf, int le
     }
 }
 
-static int json_serialize_string(const char *string, char *buf) {
-    size_t i = 0, len = strlen(string);
+static int json_serialize_string(const char *string, JSON_Writer *writer) {
+    const char *run = string;
     char c = '\0';
-    int written = -1, written_total = 0;
     APPEND_STRING("\"");
-    for (i = 0; i < len; i++) {
-        c = string[i];
+    for (; *string != '\0'; string++) {
+        c = *string;
+        if ((unsigned char)c >= 0x20 && c != '\"' && c != '\\' && c != '/') {
+            continue;
+        }
+        /* Characters without escaping are appended at once */
+        if (json_writer_append(writer, run, (size_t)(string - run)) < 0) {
+            return -1;
+        }
+        run = string + 1;
         switch (c) {
             case '\"': APPEND_STRING("\\\""); break;
             case '\\': APPEND_STRING("\\\\"); break;
@@ -1027,7 +1633,6 @@ static int json_serialize_string(const char *string, char *buf) {
             case '\n': APPEND_STRING("\\n"); break;
             case '\r': APPEND_STRING("\\r"); break;
             case '\t': APPEND_STRING("\\t"); break;
-            case '\x00': APPEND_STRING("\\u0000"); break;
             case '\x01': APPEND_STRING("\\u0001"); break;
             case '\x02': APPEND_STRING("\\u0002"); break;
             case '\x03': APPEND_STRING("\\u0003"); break;
@@ -1067,37 +1672,105 @@ static int json_serialize_string(const char *string, char *buf) {
                 }
                 break;
             default:
-                if (buf != NULL) {
-                    buf[0] = c;
-                    buf += 1;
-                }
-                written_total += 1;
                 break;
         }
     }
+    if (json_writer_append(writer, run, (size_t)(string - run)) < 0) {
+        return -1;
+    }
     APPEND_STRING("\"");
-    return written_total;
+    return 0;
 }
 
-static int append_indent(char *buf, int level) {
+static int append_indent(JSON_Writer *writer, int level) {
     int i;
-    int written = -1, written_total = 0;
     for (i = 0; i < level; i++) {
         APPEND_STRING("    ");
     }
-    return written_total;
+    return 0;
 }
 
-static int append_string(char *buf, const char *string) {
-    if (buf == NULL) {
-        return (int)strlen(string);
-    }
-    return sprintf(buf, "%s", string);
+static int append_string(JSON_Writer *writer, const char *string) {
+    return json_writer_append(writer, string, strlen(string));
 }
 
 #undef APPEND_STRING
 #undef APPEND_INDENT
 
+static JSON_Status json_serialize_to_writer(const JSON_Value *value, JSON_Writer *writer, int is_pretty) {
+    char num_buf[NUM_BUF_SIZE]; /* recursively allocating buffer on stack is a bad idea, so let's do it only once */
+    if (json_serialize_to_writer_r(value, writer, 0, is_pretty, num_buf) < 0) {
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+static char * json_serialize_to_string_internal(const JSON_Value *value, int is_pretty) {
+    JSON_Writer writer;
+    char *buf = (char*)parson_malloc(SERIALIZATION_STARTING_CAPACITY);
+    if (buf == NULL) {
+        return NULL;
+    }
+    json_writer_init(&writer, buf, SERIALIZATION_STARTING_CAPACITY, 1);
+    if (json_serialize_to_writer(value, &writer, is_pretty) == JSONFailure
+        || json_writer_append(&writer, "", 1) < 0) { /* terminating null character */
+        parson_free(writer.buf);
+        return NULL;
+    }
+    return writer.buf;
+}
+
+static JSON_Status json_serialize_to_buffer_internal(const JSON_Value *value, char *buf, size_t buf_size_in_bytes, int is_pretty) {
+    JSON_Writer writer;
+    if (buf == NULL || buf_size_in_bytes == 0) {
+        return JSONFailure;
+    }
+    json_writer_init(&writer, buf, buf_size_in_bytes, 0);
+    if (json_serialize_to_writer(value, &writer, is_pretty) == JSONFailure
+        || json_writer_append(&writer, "", 1) < 0) { /* terminating null character */
+        buf[0] = '\0'; /* partial output is not left in buf */
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+static JSON_Status json_serialize_to_callback_internal(const JSON_Value *value, JSON_Write_Function write_fun, void *context, int is_pretty) {
+    JSON_Writer writer;
+    char chunk[SERIALIZATION_CHUNK_SIZE];
+    if (write_fun == NULL) {
+        return JSONFailure;
+    }
+    json_writer_init(&writer, chunk, sizeof(chunk), 0);
+    writer.write_fun = write_fun;
+    writer.write_context = context;
+    if (json_serialize_to_writer(value, &writer, is_pretty) == JSONFailure
+        || json_writer_flush(&writer) < 0) {
+        return JSONFailure;
+    }
+    return JSONSuccess;
+}
+
+static JSON_Status write_to_file(void *context, const char *data, size_t len) {
+    return fwrite(data, 1, len, (FILE*)context) == len ? JSONSuccess : JSONFailure;
+}
+
+static JSON_Status json_serialize_to_file_internal(const JSON_Value *value, const char *filename, int is_pretty) {
+    JSON_Status return_code = JSONSuccess;
+    FILE *fp = NULL;
+    if (json_value_get_type(value) == JSONError) { /* invalid value does not truncate the file */
+        return JSONFailure;
+    }
+    fp = fopen(filename, "w");
+    if (fp == NULL) {
+        return JSONFailure;
+    }
+    return_code = json_serialize_to_callback_internal(value, write_to_file, fp, is_pretty);
+    if (fclose(fp) == EOF) {
+        return_code = JSONFailure;
+    }
+    return return_code;
+}
+
 /* Parser API */
 JSON_Value * json_parse_file(const char *filename) {
     char *file_contents = read_file(filename);
@@ -1212,18 +1885,18 @@ const char * json_object_get_name(const JSON_Object *object, size_t index) {
     if (object == NULL || index >= json_object_get_count(object)) {
         return NULL;
     }
-    return object->names[index];
+    return OBJECT_NAME(object, index);
 }
 
 JSON_Value * json_object_get_value_at(const JSON_Object *object, size_t index) {
     if (object == NULL || index >= json_object_get_count(object)) {
         return NULL;
     }
-    return object->values[index];
+    return OBJECT_VALUE(object, index);
 }
 
 JSON_Value *json_object_get_wrapping_value(const JSON_Object *object) {
-    return object->wrapping_value;
+    return CONTAINER_VALUE(object);
 }
 
 int json_object_has_value (const JSON_Object *object, const char *name) {
@@ -1277,12 +1950,19 @@ size_t json_array_get_count(const JSON_Array *array) {
 }
 
 JSON_Value * json_array_get_wrapping_value(const JSON_Array *array) {
-    return array->wrapping_value;
+    return CONTAINER_VALUE(array);
 }
 
 /* JSON Value API */
 JSON_Value_Type json_value_get_type(const JSON_Value *value) {
+#ifdef PARSON_COMPACT_VALUES
+    if (value == NULL) {
+        return JSONError;
+    }
+    return VALUE_TAG(value) == VALUE_INLINE_STRING ? JSONString : (JSON_Value_Type)VALUE_TAG(value);
+#else
     return value ? value->type : JSONError;
+#endif
 }
 
 JSON_Object * json_value_get_object(const JSON_Value *value) {
@@ -1294,6 +1974,11 @@ JSON_Array * json_value_get_array(const JSON_Value *value) {
 }
 
 const char * json_value_get_string(const JSON_Value *value) {
+#ifdef PARSON_COMPACT_VALUES
+    if (value != NULL && VALUE_TAG(value) == VALUE_INLINE_STRING) {
+        return value->value.inline_string;
+    }
+#endif
     return json_value_get_type(value) == JSONString ? value->value.string : NULL;
 }
 
@@ -1306,7 +1991,7 @@ int json_value_get_boolean(const JSON_Value *value) {
 }
 
 JSON_Value * json_value_get_parent (const JSON_Value *value) {
-    return value ? value->parent : NULL;
+    return value ? VALUE_PARENT(value) : NULL;
 }
 
 void json_value_free(JSON_Value *value) {
@@ -1315,6 +2000,11 @@ void json_value_free(JSON_Value *value) {
             json_object_free(value->value.object);
             break;
         case JSONString:
+#ifdef PARSON_COMPACT_VALUES
+            if (VALUE_TAG(value) == VALUE_INLINE_STRING) {
+                break;
+            }
+#endif
             parson_free(value->value.string);
             break;
         case JSONArray:
@@ -1327,12 +2017,11 @@ void json_value_free(JSON_Value *value) {
 }
 
 JSON_Value * json_value_init_object(void) {
-    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value*)parson_malloc(CONTAINER_ALLOC_SIZE(JSON_Object));
     if (!new_value) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONObject;
+    VALUE_INIT(new_value, JSONObject);
     new_value->value.object = json_object_init(new_value);
     if (!new_value->value.object) {
         parson_free(new_value);
@@ -1342,12 +2031,11 @@ JSON_Value * json_value_init_object(void) {
 }
 
 JSON_Value * json_value_init_array(void) {
-    JSON_Value *new_value = (JSON_Value*)parson_malloc(sizeof(JSON_Value));
+    JSON_Value *new_value = (JSON_Value*)parson_malloc(CONTAINER_ALLOC_SIZE(JSON_Array));
     if (!new_value) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONArray;
+    VALUE_INIT(new_value, JSONArray);
     new_value->value.array = json_array_init(new_value);
     if (!new_value->value.array) {
         parson_free(new_value);
@@ -1387,8 +2075,7 @@ JSON_Value * json_value_init_number(double number) {
     if (new_value == NULL) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONNumber;
+    VALUE_INIT(new_value, JSONNumber);
     new_value->value.number = number;
     return new_value;
 }
@@ -1398,8 +2085,7 @@ JSON_Value * json_value_init_boolean(int boolean) {
     if (!new_value) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONBoolean;
+    VALUE_INIT(new_value, JSONBoolean);
     new_value->value.boolean = boolean ? 1 : 0;
     return new_value;
 }
@@ -1409,8 +2095,7 @@ JSON_Value * json_value_init_null(void) {
     if (!new_value) {
         return NULL;
     }
-    new_value->parent = NULL;
-    new_value->type = JSONNull;
+    VALUE_INIT(new_value, JSONNull);
     return new_value;
 }
 
@@ -1494,123 +2179,53 @@ JSON_Value * json_value_deep_copy(const JSON_Value *value) {
 }
 
 size_t json_serialization_size(const JSON_Value *value) {
-    char num_buf[NUM_BUF_SIZE]; /* recursively allocating buffer on stack is a bad idea, so let's do it only once */
-    int res = json_serialize_to_buffer_r(value, NULL, 0, 0, num_buf);
-    return res < 0 ? 0 : (size_t)(res + 1);
+    JSON_Writer writer;
+    json_writer_init(&writer, NULL, 0, 0);
+    if (json_serialize_to_writer(value, &writer, 0) == JSONFailure) {
+        return 0;
+    }
+    return writer.total + 1;
 }
 
 JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes) {
-    int written = -1;
-    size_t needed_size_in_bytes = json_serialization_size(value);
-    if (needed_size_in_bytes == 0 || buf_size_in_bytes < needed_size_in_bytes) {
-        return JSONFailure;
-    }
-    written = json_serialize_to_buffer_r(value, buf, 0, 0, NULL);
-    if (written < 0) {
-        return JSONFailure;
-    }
-    return JSONSuccess;
+    return json_serialize_to_buffer_internal(value, buf, buf_size_in_bytes, 0);
 }
 
 JSON_Status json_serialize_to_file(const JSON_Value *value, const char *filename) {
-    JSON_Status return_code = JSONSuccess;
-    FILE *fp = NULL;
-    char *serialized_string = json_serialize_to_string(value);
-    if (serialized_string == NULL) {
-        return JSONFailure;
-    }
-    fp = fopen(filename, "w");
-    if (fp == NULL) {
-        json_free_serialized_string(serialized_string);
-        return JSONFailure;
-    }
-    if (fputs(serialized_string, fp) == EOF) {
-        return_code = JSONFailure;
-    }
-    if (fclose(fp) == EOF) {
-        return_code = JSONFailure;
-    }
-    json_free_serialized_string(serialized_string);
-    return return_code;
+    return json_serialize_to_file_internal(value, filename, 0);
 }
 
 char * json_serialize_to_string(const JSON_Value *value) {
-    JSON_Status serialization_result = JSONFailure;
-    size_t buf_size_bytes = json_serialization_size(value);
-    char *buf = NULL;
-    if (buf_size_bytes == 0) {
-        return NULL;
-    }
-    buf = (char*)parson_malloc(buf_size_bytes);
-    if (buf == NULL) {
-        return NULL;
-    }
-    serialization_result = json_serialize_to_buffer(value, buf, buf_size_bytes);
-    if (serialization_result == JSONFailure) {
-        json_free_serialized_string(buf);
-        return NULL;
-    }
-    return buf;
+    return json_serialize_to_string_internal(value, 0);
+}
+
+JSON_Status json_serialize_to_callback(const JSON_Value *value, JSON_Write_Function write_fun, void *context) {
+    return json_serialize_to_callback_internal(value, write_fun, context, 0);
 }
 
 size_t json_serialization_size_pretty(const JSON_Value *value) {
-    char num_buf[NUM_BUF_SIZE]; /* recursively allocating buffer on stack is a bad idea, so let's do it only once */
-    int res = json_serialize_to_buffer_r(value, NULL, 0, 1, num_buf);
-    return res < 0 ? 0 : (size_t)(res + 1);
+    JSON_Writer writer;
+    json_writer_init(&writer, NULL, 0, 0);
+    if (json_serialize_to_writer(value, &writer, 1) == JSONFailure) {
+        return 0;
+    }
+    return writer.total + 1;
 }
 
 JSON_Status json_serialize_to_buffer_pretty(const JSON_Value *value, char *buf, size_t buf_size_in_bytes) {
-    int written = -1;
-    size_t needed_size_in_bytes = json_serialization_size_pretty(value);
-    if (needed_size_in_bytes == 0 || buf_size_in_bytes < needed_size_in_bytes) {
-        return JSONFailure;
-    }
-    written = json_serialize_to_buffer_r(value, buf, 0, 1, NULL);
-    if (written < 0) {
-        return JSONFailure;
-    }
-    return JSONSuccess;
+    return json_serialize_to_buffer_internal(value, buf, buf_size_in_bytes, 1);
 }
 
 JSON_Status json_serialize_to_file_pretty(const JSON_Value *value, const char *filename) {
-    JSON_Status return_code = JSONSuccess;
-    FILE *fp = NULL;
-    char *serialized_string = json_serialize_to_string_pretty(value);
-    if (serialized_string == NULL) {
-        return JSONFailure;
-    }
-    fp = fopen(filename, "w");
-    if (fp == NULL) {
-        json_free_serialized_string(serialized_string);
-        return JSONFailure;
-    }
-    if (fputs(serialized_string, fp) == EOF) {
-        return_code = JSONFailure;
-    }
-    if (fclose(fp) == EOF) {
-        return_code = JSONFailure;
-    }
-    json_free_serialized_string(serialized_string);
-    return return_code;
+    return json_serialize_to_file_internal(value, filename, 1);
 }
 
 char * json_serialize_to_string_pretty(const JSON_Value *value) {
-    JSON_Status serialization_result = JSONFailure;
-    size_t buf_size_bytes = json_serialization_size_pretty(value);
-    char *buf = NULL;
-    if (buf_size_bytes == 0) {
-        return NULL;
-    }
-    buf = (char*)parson_malloc(buf_size_bytes);
-    if (buf == NULL) {
-        return NULL;
-    }
-    serialization_result = json_serialize_to_buffer_pretty(value, buf, buf_size_bytes);
-    if (serialization_result == JSONFailure) {
-        json_free_serialized_string(buf);
-        return NULL;
-    }
-    return buf;
+    return json_serialize_to_string_internal(value, 1);
+}
+
+JSON_Status json_serialize_to_callback_pretty(const JSON_Value *value, JSON_Write_Function write_fun, void *context) {
+    return json_serialize_to_callback_internal(value, write_fun, context, 1);
 }
 
 void json_free_serialized_string(char *string) {
@@ -1630,11 +2245,11 @@ JSON_Status json_array_remove(JSON_Array *array, size_t ix) {
 }
 
 JSON_Status json_array_replace_value(JSON_Array *array, size_t ix, JSON_Value *value) {
-    if (array == NULL || value == NULL || value->parent != NULL || ix >= json_array_get_count(array)) {
+    if (array == NULL || value == NULL || VALUE_PARENT(value) != NULL || ix >= json_array_get_count(array)) {
         return JSONFailure;
     }
     json_value_free(json_array_get_value(array, ix));
-    value->parent = json_array_get_wrapping_value(array);
+    VALUE_SET_PARENT(value, json_array_get_wrapping_value(array));
     array->items[ix] = value;
     return JSONSuccess;
 }
@@ -1700,7 +2315,7 @@ JSON_Status json_array_clear(JSON_Array *array) {
 }
 
 JSON_Status json_array_append_value(JSON_Array *array, JSON_Value *value) {
-    if (array == NULL || value == NULL || value->parent != NULL) {
+    if (array == NULL || value == NULL || VALUE_PARENT(value) != NULL) {
         return JSONFailure;
     }
     return json_array_add(array, value);
@@ -1756,20 +2371,14 @@ JSON_Status json_array_append_null(JSON_Array *array) {
 
 JSON_Status json_object_set_value(JSON_Object *object, const char *name, JSON_Value *value) {
     size_t i = 0;
-    JSON_Value *old_value;
-    if (object == NULL || name == NULL || value == NULL || value->parent != NULL) {
+    if (object == NULL || name == NULL || value == NULL || VALUE_PARENT(value) != NULL) {
         return JSONFailure;
     }
-    old_value = json_object_get_value(object, name);
-    if (old_value != NULL) { /* free and overwrite old value */
-        json_value_free(old_value);
-        for (i = 0; i < json_object_get_count(object); i++) {
-            if (strcmp(object->names[i], name) == 0) {
-                value->parent = json_object_get_wrapping_value(object);
-                object->values[i] = value;
-                return JSONSuccess;
-            }
-        }
+    if (json_object_find(object, name, strlen(name), &i)) { /* free and overwrite old value */
+        json_value_free(OBJECT_VALUE(object, i));
+        VALUE_SET_PARENT(value, json_object_get_wrapping_value(object));
+        OBJECT_VALUE(object, i) = value;
+        return JSONSuccess;
     }
     /* add new key value pair */
     return json_object_add(object, name, value);
@@ -1895,10 +2504,11 @@ JSON_Status json_object_clear(JSON_Object *object) {
         return JSONFailure;
     }
     for (i = 0; i < json_object_get_count(object); i++) {
-        parson_free(object->names[i]);
-        json_value_free(object->values[i]);
+        parson_free(OBJECT_NAME(object, i));
+        json_value_free(OBJECT_VALUE(object, i));
     }
     object->count = 0;
+    json_object_index_free(object);
     return JSONSuccess;
 }
 
@@ -58,6 +58,9 @@ typedef int JSON_Status;
 typedef void * (*JSON_Malloc_Function)(size_t);
 typedef void   (*JSON_Free_Function)(void *);
 
+/* Receives serialized output in chunks, returns JSONSuccess or JSONFailure to stop serialization */
+typedef JSON_Status (*JSON_Write_Function)(void *context, const char *data, size_t len);
+
 /* Call only once, before calling any other function from parson API. If not called, malloc and free
    from stdlib will be used for all allocations */
 void json_set_allocation_functions(JSON_Malloc_Function malloc_fun, JSON_Free_Function free_fun);
@@ -82,15 +85,20 @@ JSON_Value * json_parse_string_with_comments(const char *string);
 
 /* Serialization */
 size_t      json_serialization_size(const JSON_Value *value); /* returns 0 on fail */
+/* Serializes in one pass. On failure buf holds an empty string and the file may hold partial output.
+   String from json_serialize_to_string may occupy up to twice its length. */
 JSON_Status json_serialize_to_buffer(const JSON_Value *value, char *buf, size_t buf_size_in_bytes);
 JSON_Status json_serialize_to_file(const JSON_Value *value, const char *filename);
 char *      json_serialize_to_string(const JSON_Value *value);
+/* Serializes in one pass through a small stack buffer, output is passed to write_fun without null character */
+JSON_Status json_serialize_to_callback(const JSON_Value *value, JSON_Write_Function write_fun, void *context);
 
 /* Pretty serialization */
 size_t      json_serialization_size_pretty(const JSON_Value *value); /* returns 0 on fail */
 JSON_Status json_serialize_to_buffer_pretty(const JSON_Value *value, char *buf, size_t buf_size_in_bytes);
 JSON_Status json_serialize_to_file_pretty(const JSON_Value *value, const char *filename);
 char *      json_serialize_to_string_pretty(const JSON_Value *value);
+JSON_Status json_serialize_to_callback_pretty(const JSON_Value *value, JSON_Write_Function write_fun, void *context);
 
 void        json_free_serialized_string(char *string); /* frees string from json_serialize_to_string and json_serialize_to_string_pretty */
 
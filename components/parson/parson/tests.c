@@ -32,6 +32,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#ifdef PARSON_FAST_NUMBER_FORMAT
+#include <stdint.h>
+#endif
+#ifdef PARSON_TEST_ALLOCATORS
+#include "json_allocator.h"
+#endif
 
 #define TEST(A) printf("%d %-72s-", __LINE__, #A);\
                 if(A){puts(" OK");tests_passed++;}\
@@ -52,6 +58,16 @@ void test_suite_8(void); /* Test serialization */
 void test_suite_9(void); /* Test serialization (pretty) */
 void test_suite_10(void); /* Testing for memory leaks */
 void test_suite_11(void); /* Additional things that require testing */
+void test_suite_12(void); /* Test serialization to buffer and callback */
+#ifdef PARSON_FAST_NUMBER_FORMAT
+void test_suite_13(void); /* Test shortest number formatting */
+#endif
+void test_suite_14(void); /* Test objects with many members */
+void test_suite_15(void); /* Test strings around inline string size and value parents */
+#ifdef PARSON_TEST_ALLOCATORS
+void test_suite_16(void); /* Test arena allocator */
+void test_suite_17(void); /* Test pool allocator */
+#endif
 
 void print_commits_info(const char *username, const char *repo);
 void persistence_example(void);
@@ -63,6 +79,14 @@ static void counted_free(void *ptr);
 
 static char * read_file(const char * filename);
 
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t calls;
+    size_t fail_after;
+} write_sink;
+static JSON_Status sink_write(void *context, const char *data, size_t len);
+
 static int tests_passed;
 static int tests_failed;
 
@@ -84,6 +108,17 @@ int main() {
     test_suite_9();
     test_suite_10();
     test_suite_11();
+    test_suite_12();
+#ifdef PARSON_FAST_NUMBER_FORMAT
+    test_suite_13();
+#endif
+    test_suite_14();
+    test_suite_15();
+#ifdef PARSON_TEST_ALLOCATORS
+    test_suite_16();
+    test_suite_17();
+    json_set_allocation_functions(counted_malloc, counted_free);
+#endif
 
     printf("Tests failed: %d\n", tests_failed);
     printf("Tests passed: %d\n", tests_passed);
@@ -515,7 +550,11 @@ void test_suite_9(void) {
     serialized = json_serialize_to_string_pretty(a);
     TEST((strlen(serialized)+1) == serialization_size);
 
+#ifdef PARSON_FAST_NUMBER_FORMAT
+    file_contents = read_file("tests/test_2_pretty_shortest.txt");
+#else
     file_contents = read_file(filename);
+#endif
 
     TEST(STREQ(file_contents, serialized));
 }
@@ -561,6 +600,424 @@ void test_suite_11() {
     TEST(STREQ(array_with_escaped_slashes, serialized));
 }
 
+void test_suite_12(void) {
+    JSON_Value *val = json_parse_file("tests/test_2.txt");
+    char *serialized = NULL;
+    char *buf = NULL;
+    size_t size = 0;
+    write_sink sink;
+
+    serialized = json_serialize_to_string(val);
+    sink.buf = (char*)malloc(strlen(serialized) + 1);
+    sink.len = 0;
+    sink.calls = 0;
+    sink.fail_after = 0;
+    TEST(json_serialize_to_callback(val, sink_write, &sink) == JSONSuccess);
+    sink.buf[sink.len] = '\0';
+    TEST(STREQ(sink.buf, serialized));
+    TEST(sink.calls > 1); /* longer than one chunk */
+    free(sink.buf);
+
+    size = json_serialization_size(val);
+    buf = (char*)malloc(size);
+    memset(buf, 'x', size);
+    TEST(json_serialize_to_buffer(val, buf, size - 1) == JSONFailure);
+    TEST(buf[0] == '\0'); /* partial output is cleared on failure */
+    TEST(json_serialize_to_buffer(val, buf, size) == JSONSuccess);
+    TEST(STREQ(buf, serialized));
+    free(buf);
+    json_free_serialized_string(serialized);
+
+    /* file is streamed in chunks, invalid value keeps its content */
+    TEST(json_serialize_to_file(val, "tests/test_12_output.txt") == JSONSuccess);
+    TEST(json_serialize_to_file(NULL, "tests/test_12_output.txt") == JSONFailure);
+    serialized = read_file("tests/test_12_output.txt");
+    buf = json_serialize_to_string(val);
+    TEST(serialized != NULL && STREQ(serialized, buf));
+    free(serialized);
+    json_free_serialized_string(buf);
+    remove("tests/test_12_output.txt");
+
+    serialized = json_serialize_to_string_pretty(val);
+    sink.buf = (char*)malloc(strlen(serialized) + 1);
+    sink.len = 0;
+    sink.calls = 0;
+    TEST(json_serialize_to_callback_pretty(val, sink_write, &sink) == JSONSuccess);
+    sink.buf[sink.len] = '\0';
+    TEST(STREQ(sink.buf, serialized));
+    sink.len = 0;
+    sink.calls = 0;
+    sink.fail_after = 1;
+    TEST(json_serialize_to_callback_pretty(val, sink_write, &sink) == JSONFailure);
+    TEST(sink.calls == 1);
+    free(sink.buf);
+    json_free_serialized_string(serialized);
+
+    TEST(json_serialize_to_callback(val, NULL, NULL) == JSONFailure);
+    json_value_free(val);
+}
+
+#ifdef PARSON_FAST_NUMBER_FORMAT
+static int number_round_trips(double number) {
+    JSON_Value *val = json_value_init_number(number);
+    char *serialized = json_serialize_to_string(val);
+    double parsed = strtod(serialized, NULL);
+    int result = parsed == number && (number != 0.0 || (1.0 / parsed < 0.0) == (1.0 / number < 0.0));
+    json_free_serialized_string(serialized);
+    json_value_free(val);
+    return result;
+}
+
+static int number_serializes_to(double number, const char *expected) {
+    JSON_Value *val = json_value_init_number(number);
+    char *serialized = json_serialize_to_string(val);
+    int result = STREQ(serialized, expected);
+    json_free_serialized_string(serialized);
+    json_value_free(val);
+    return result;
+}
+
+void test_suite_13(void) {
+    uint64_t state = UINT64_C(88172645463325252);
+    uint64_t bits = 0;
+    double number = 0.0;
+    long i = 0, failed = 0, tested = 0;
+
+    TEST(number_serializes_to(0.1, "0.1"));
+    TEST(number_serializes_to(21.5, "21.5"));
+    TEST(number_serializes_to(-3.0, "-3"));
+    TEST(number_serializes_to(0.0, "0"));
+    TEST(number_serializes_to(-0.0, "-0"));
+    TEST(number_serializes_to(1e-7, "1e-7"));
+    TEST(number_serializes_to(0.000001, "0.000001"));
+    TEST(number_serializes_to(1e21, "1e+21"));
+    TEST(number_serializes_to(123456789012345678.0, "123456789012345680"));
+    TEST(number_serializes_to(9007199254740991.0, "9007199254740991"));
+    TEST(number_serializes_to(5e-324, "5e-324"));
+    TEST(number_serializes_to(1.7976931348623157e308, "1.7976931348623157e+308"));
+    TEST(number_round_trips(2.2250738585072014e-308)); /* smallest normal */
+    TEST(number_round_trips(2.2250738585072009e-308)); /* largest subnormal */
+    TEST(number_round_trips(9007199254740993.0));
+
+    /* Random bit patterns cover all exponents, the result must be parsed back by strtod exactly */
+    for (i = 0; i < 100000; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        bits = state;
+        memcpy(&number, &bits, sizeof(number));
+        if (number != number || number - number != 0.0) {
+            continue; /* NaN and infinity are not valid JSON numbers */
+        }
+        tested++;
+        if (!number_round_trips(number)) {
+            failed++;
+        }
+    }
+    TEST(tested > 0 && failed == 0);
+    /* Values converted from float, as measured temperatures */
+    failed = 0;
+    for (i = -4000; i < 4000; i++) {
+        if (!number_round_trips((float)(i / 10.0)) || !number_round_trips(i / 10.0)) {
+            failed++;
+        }
+    }
+    TEST(failed == 0);
+}
+#endif
+
+void test_suite_14(void) {
+    JSON_Value *root_value = NULL, *copy = NULL;
+    JSON_Object *root_object = NULL;
+    char name[32];
+    int i = 0, failed = 0;
+    const int count = 2000;
+
+    malloc_count = 0;
+    root_value = json_value_init_object();
+    root_object = json_value_get_object(root_value);
+    for (i = 0; i < count; i++) {
+        sprintf(name, "key%d", i);
+        if (json_object_set_number(root_object, name, i) != JSONSuccess) {
+            failed++;
+        }
+    }
+    TEST(failed == 0);
+    TEST(json_object_get_count(root_object) == (size_t)count);
+    for (i = 0; i < count; i++) {
+        sprintf(name, "key%d", i);
+        if (json_object_get_number(root_object, name) != i) {
+            failed++;
+        }
+    }
+    TEST(failed == 0);
+    TEST(json_object_get_value(root_object, "key") == NULL);
+    TEST(json_object_get_value(root_object, "key20000") == NULL);
+
+    /* Overwriting keeps the member count */
+    TEST(json_object_set_string(root_object, "key7", "seven") == JSONSuccess);
+    TEST(STREQ(json_object_get_string(root_object, "key7"), "seven"));
+    TEST(json_object_get_count(root_object) == (size_t)count);
+
+    /* Removed members are moved from the end, all others must stay reachable */
+    for (i = 0; i < count; i += 3) {
+        sprintf(name, "key%d", i);
+        if (json_object_remove(root_object, name) != JSONSuccess) {
+            failed++;
+        }
+    }
+    TEST(failed == 0);
+    TEST(json_object_remove(root_object, "key0") == JSONFailure);
+    for (i = 0; i < count; i++) {
+        sprintf(name, "key%d", i);
+        if (json_object_has_value(root_object, name) != (i % 3 != 0)) {
+            failed++;
+        }
+    }
+    TEST(failed == 0);
+    TEST(json_object_get_count(root_object) == (size_t)(count - (count + 2) / 3));
+    for (i = 0; i < (int)json_object_get_count(root_object); i++) {
+        if (json_object_get_value(root_object, json_object_get_name(root_object, i)) !=
+            json_object_get_value_at(root_object, i)) {
+            failed++;
+        }
+    }
+    TEST(failed == 0);
+
+    TEST(json_object_dotset_number(root_object, "key1.nested", 1) == JSONFailure);
+    TEST(json_object_dotset_number(root_object, "nested.value", 1) == JSONSuccess);
+    TEST(json_object_dotget_number(root_object, "nested.value") == 1);
+
+    copy = json_value_deep_copy(root_value);
+    TEST(json_value_equals(root_value, copy));
+    json_value_free(copy);
+
+    TEST(json_object_clear(root_object) == JSONSuccess);
+    TEST(json_object_get_value(root_object, "key1") == NULL);
+    for (i = 0; i < count; i++) {
+        sprintf(name, "key%d", i);
+        if (json_object_set_boolean(root_object, name, 1) != JSONSuccess) {
+            failed++;
+        }
+    }
+    TEST(failed == 0);
+    TEST(json_object_get_boolean(root_object, "key1999") == 1);
+    json_value_free(root_value);
+    TEST(malloc_count == 0);
+}
+
+void test_suite_15(void) {
+    const char *strings[] = { "", "a", "1234567", "12345678", "string longer than a pointer" };
+    const size_t strings_count = sizeof(strings) / sizeof(strings[0]);
+    JSON_Value *root_value = NULL, *copy = NULL, *parsed = NULL;
+    JSON_Object *root_object = NULL;
+    JSON_Array *array = NULL;
+    char *serialized = NULL;
+    char name[32];
+    size_t i = 0;
+    int failed = 0;
+
+    malloc_count = 0;
+    root_value = json_value_init_object();
+    root_object = json_value_get_object(root_value);
+    TEST(json_object_set_value(root_object, "array", json_value_init_array()) == JSONSuccess);
+    array = json_object_get_array(root_object, "array");
+    for (i = 0; i < strings_count; i++) {
+        sprintf(name, "s%d", (int)i);
+        if (json_object_set_string(root_object, name, strings[i]) != JSONSuccess ||
+            json_array_append_string(array, strings[i]) != JSONSuccess) {
+            failed++;
+        }
+    }
+    TEST(failed == 0);
+    for (i = 0; i < strings_count; i++) {
+        sprintf(name, "s%d", (int)i);
+        if (!STREQ(json_object_get_string(root_object, name), strings[i]) ||
+            !STREQ(json_array_get_string(array, i), strings[i]) ||
+            json_value_get_type(json_array_get_value(array, i)) != JSONString ||
+            json_value_get_parent(json_object_get_value(root_object, name)) != root_value ||
+            json_value_get_parent(json_array_get_value(array, i)) != json_array_get_wrapping_value(array)) {
+            failed++;
+        }
+    }
+    TEST(failed == 0);
+    TEST(json_value_get_parent(root_value) == NULL);
+    TEST(json_value_get_parent(json_object_get_wrapping_value(root_object)) == NULL);
+
+    serialized = json_serialize_to_string(root_value);
+    parsed = json_parse_string(serialized);
+    TEST(json_value_equals(root_value, parsed));
+    TEST(STREQ(json_object_get_string(json_object(parsed), "s2"), "1234567"));
+    json_free_serialized_string(serialized);
+    json_value_free(parsed);
+
+    copy = json_value_deep_copy(root_value);
+    TEST(json_value_equals(root_value, copy));
+    TEST(json_object_set_number(json_object(copy), "s2", 7) == JSONSuccess);
+    TEST(json_value_equals(root_value, copy) == 0);
+    json_value_free(copy);
+
+    TEST(json_array_replace_string(array, 1, "b") == JSONSuccess);
+    TEST(STREQ(json_array_get_string(array, 1), "b"));
+    TEST(json_array_remove(array, 0) == JSONSuccess);
+    TEST(json_object_remove(root_object, "s3") == JSONSuccess);
+    json_value_free(root_value);
+    TEST(malloc_count == 0);
+}
+
+#ifdef PARSON_TEST_ALLOCATORS
+/* Measurement document as published by the device, long_string does not fit the largest pool class */
+static JSON_Value * build_measurement(const char *long_string) {
+    JSON_Value *root_value = json_value_init_object();
+    JSON_Object *root_object = json_value_get_object(root_value);
+    JSON_Value *array_value = NULL;
+    size_t i = 0;
+    if (root_value == NULL) {
+        return NULL;
+    }
+    json_object_set_string(root_object, "id", "SENSOR1");
+    array_value = json_value_init_array();
+    if (array_value == NULL || json_object_set_value(root_object, "temperature", array_value) != JSONSuccess) {
+        json_value_free(array_value);
+        json_value_free(root_value);
+        return NULL;
+    }
+    for (i = 0; i < 10; i++) {
+        json_array_append_number(json_value_get_array(array_value), 21.5 + i);
+    }
+    if (long_string != NULL) {
+        json_object_set_string(root_object, "note", long_string);
+    }
+    return root_value;
+}
+
+void test_suite_16(void) {
+    double buffer[1024];
+    double small_buffer[8];
+    json_arena_t arena;
+    JSON_Value *root_value = NULL, *parsed = NULL;
+    char *expected = NULL, *serialized = NULL;
+    size_t peak = 0;
+
+    json_allocator_use_default();
+    root_value = build_measurement(NULL);
+    expected = json_serialize_to_string(root_value);
+    json_value_free(root_value);
+
+    json_arena_init(&arena, buffer, sizeof(buffer));
+    json_arena_use(&arena);
+    root_value = build_measurement(NULL);
+    TEST(root_value != NULL);
+    TEST(((size_t)root_value & 7) == 0);
+    serialized = json_serialize_to_string(root_value);
+    TEST(STREQ(serialized, expected));
+    json_free_serialized_string(serialized);
+    json_value_free(root_value);
+    /* Free does not release anything until reset */
+    TEST(arena.stats.used > 0 && arena.stats.used == arena.stats.peak);
+    TEST(arena.stats.failures == 0 && arena.stats.fallbacks == 0);
+    peak = arena.stats.peak;
+    json_arena_reset(&arena);
+    TEST(arena.stats.used == 0 && arena.stats.peak == peak);
+    /* The next document reuses the same memory */
+    TEST(build_measurement(NULL) == root_value);
+    json_arena_reset(&arena);
+
+    parsed = json_parse_string(expected);
+    TEST(parsed != NULL && json_value_equals(parsed, json_parse_string(expected)));
+    TEST(arena.stats.failures == 0);
+    json_arena_reset(&arena);
+
+    /* Full arena fails allocations instead of falling back to heap */
+    json_arena_init(&arena, small_buffer, sizeof(small_buffer));
+    json_arena_use(&arena);
+    TEST(json_parse_string(expected) == NULL);
+    TEST(build_measurement(NULL) == NULL);
+    TEST(arena.stats.failures > 0 && arena.stats.used <= sizeof(small_buffer));
+
+    json_allocator_use_default();
+    json_free_serialized_string(expected);
+}
+
+void test_suite_17(void) {
+    double buffer[1024];
+    double small_buffer[32];
+    char long_buffer[600];
+    const char *long_string = long_buffer;
+    json_pool_t pool;
+    JSON_Value *root_value = NULL, *parsed = NULL;
+    char *expected = NULL, *serialized = NULL;
+    int i = 0;
+    int failed = 0;
+
+    memset(long_buffer, 'x', sizeof(long_buffer) - 1);
+    long_buffer[sizeof(long_buffer) - 1] = '\0';
+    json_allocator_use_default();
+    root_value = build_measurement(NULL);
+    expected = json_serialize_to_string(root_value);
+    json_value_free(root_value);
+
+    json_pool_init(&pool, buffer, sizeof(buffer));
+    json_pool_use(&pool);
+    TEST(pool.classes[0].block_size == JSON_POOL_MIN_BLOCK);
+    TEST(pool.classes[JSON_POOL_CLASSES - 1].block_size == JSON_POOL_MIN_BLOCK << (JSON_POOL_CLASSES - 1));
+    root_value = build_measurement(NULL);
+    TEST(root_value != NULL);
+    TEST(((size_t)root_value & 7) == 0);
+    serialized = json_serialize_to_string(root_value);
+    TEST(STREQ(serialized, expected));
+    json_free_serialized_string(serialized);
+    json_value_free(root_value);
+    TEST(pool.stats.used == 0 && pool.stats.peak > 0);
+    TEST(pool.stats.fallbacks == 0 && pool.stats.failures == 0);
+
+    /* Blocks are returned to their classes, repeated cycles do not grow the peak */
+    for (i = 0; i < 100; i++) {
+        parsed = json_parse_string(expected);
+        serialized = json_serialize_to_string(parsed);
+        if (!STREQ(serialized, expected)) {
+            failed++;
+        }
+        json_free_serialized_string(serialized);
+        json_value_free(parsed);
+    }
+    TEST(failed == 0);
+    TEST(pool.stats.used == 0 && pool.stats.fallbacks == 0);
+
+    /* Blocks larger than the largest class are served from heap */
+    root_value = build_measurement(long_string);
+    TEST(STREQ(json_object_get_string(json_object(root_value), "note"), long_string));
+    TEST(pool.stats.fallbacks > 0);
+    json_value_free(root_value);
+    TEST(pool.stats.used == 0);
+
+    /* Exhausted classes fall back to heap as well */
+    json_pool_init(&pool, small_buffer, sizeof(small_buffer));
+    json_pool_use(&pool);
+    root_value = build_measurement(NULL);
+    serialized = json_serialize_to_string(root_value);
+    TEST(STREQ(serialized, expected));
+    TEST(pool.stats.fallbacks > 0 && pool.stats.failures == 0);
+    json_free_serialized_string(serialized);
+    json_value_free(root_value);
+    TEST(pool.stats.used == 0);
+
+    json_allocator_use_default();
+    json_free_serialized_string(expected);
+}
+#endif
+
+static JSON_Status sink_write(void *context, const char *data, size_t len) {
+    write_sink *sink = (write_sink*)context;
+    if (sink->fail_after > 0 && sink->calls >= sink->fail_after) {
+        return JSONFailure;
+    }
+    memcpy(sink->buf + sink->len, data, len);
+    sink->len += len;
+    sink->calls++;
+    return JSONSuccess;
+}
+
 void print_commits_info(const char *username, const char *repo) {
     JSON_Value *root_value;
     JSON_Array *commits;
@@ -0,0 +1,313 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Benchmark of parson allocators. Prints time of building, serializing and freeing
+ * measurement document and fragmentation of simulated device heap shared by parson with
+ * long lived application allocations.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parson.h"
+#include "json_allocator.h"
+#include "test.h"
+
+#define BENCH_CYCLES 200000
+#define POOL_SIZE 8192
+#define ARENA_SIZE 8192
+#define PAYLOAD_SIZE 2048
+
+// First fit heap with coalescing of free neighbours, similar to device heap
+#define SIM_HEAP_SIZE 16384
+#define SIM_HEADER 8
+#define SIM_MIN_BLOCK 16
+// Application allocations which live across several documents, e.g. MQTT outbox entries
+#define SIM_LIVE_BLOCKS 16
+#define SIM_CYCLES 100000
+
+typedef struct sim_block
+{
+	uint32_t size;
+	uint32_t used;
+} sim_block_t;
+
+static uint64_t sim_heap[SIM_HEAP_SIZE / sizeof(uint64_t)];
+
+static sim_block_t* sim_block_at(size_t offset)
+{
+	return (sim_block_t*)((uint8_t*)sim_heap + offset);
+}
+
+static void sim_init(void)
+{
+	sim_block_at(0)->size = SIM_HEAP_SIZE;
+	sim_block_at(0)->used = 0;
+}
+
+static void* sim_malloc(size_t size)
+{
+	uint32_t need = (uint32_t)((size + 7) & ~(size_t)7) + SIM_HEADER;
+	for (size_t offset = 0; offset < SIM_HEAP_SIZE; offset += sim_block_at(offset)->size)
+	{
+		sim_block_t* block = sim_block_at(offset);
+		if (block->used || block->size < need)
+		{
+			continue;
+		}
+		if (block->size - need >= SIM_MIN_BLOCK)
+		{
+			sim_block_t* rest = sim_block_at(offset + need);
+			rest->size = block->size - need;
+			rest->used = 0;
+			block->size = need;
+		}
+		block->used = 1;
+		return (uint8_t*)block + SIM_HEADER;
+	}
+	return NULL;
+}
+
+static void sim_free(void* pointer)
+{
+	if (pointer == NULL)
+	{
+		return;
+	}
+	((sim_block_t*)((uint8_t*)pointer - SIM_HEADER))->used = 0;
+	for (size_t offset = 0; offset < SIM_HEAP_SIZE; offset += sim_block_at(offset)->size)
+	{
+		sim_block_t* block = sim_block_at(offset);
+		while (!block->used && offset + block->size < SIM_HEAP_SIZE && !sim_block_at(offset + block->size)->used)
+		{
+			block->size += sim_block_at(offset + block->size)->size;
+		}
+	}
+}
+
+static void sim_stats(size_t* free_bytes, size_t* largest)
+{
+	*free_bytes = 0;
+	*largest = 0;
+	for (size_t offset = 0; offset < SIM_HEAP_SIZE; offset += sim_block_at(offset)->size)
+	{
+		sim_block_t* block = sim_block_at(offset);
+		if (!block->used)
+		{
+			*free_bytes += block->size - SIM_HEADER;
+			if (block->size - SIM_HEADER > *largest)
+			{
+				*largest = block->size - SIM_HEADER;
+			}
+		}
+	}
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Build document with samples as published before payload encoder.
+ */
+static JSON_Value* document_build(size_t samples)
+{
+	JSON_Value* root_value = json_value_init_object();
+	JSON_Object* root_object = json_value_get_object(root_value);
+	JSON_Value* temperature = json_value_init_array();
+	JSON_Value* humidity = json_value_init_array();
+	JSON_Value* timestamp = json_value_init_array();
+	json_object_set_string(root_object, "id", "SENSOR1");
+	json_object_set_value(root_object, "temperature", temperature);
+	json_object_set_value(root_object, "humidity", humidity);
+	json_object_set_value(root_object, "utc", timestamp);
+	for (size_t i = 0; i < samples; i++)
+	{
+		json_array_append_number(json_value_get_array(temperature), 21.5 + i / 10.0);
+		json_array_append_number(json_value_get_array(humidity), 65.0 - i / 10.0);
+		json_array_append_number(json_value_get_array(timestamp), 1572982980008.0 + i * 60000);
+	}
+	return root_value;
+}
+
+/**
+ * Serialize document into static payload buffer.
+ * @return Length of serialized document, 0 if it failed.
+ */
+static size_t document_serialize(const JSON_Value* root_value, char* payload, size_t payload_size)
+{
+	if (json_serialize_to_buffer(root_value, payload, payload_size) != JSONSuccess)
+	{
+		return 0;
+	}
+	return strlen(payload);
+}
+
+typedef enum allocator_mode
+{
+	MODE_HEAP,
+	MODE_POOL,
+	MODE_ARENA
+} allocator_mode_t;
+
+static const char* mode_names[] = { "heap", "pool", "arena" };
+
+static json_pool_t pool;
+static json_arena_t arena;
+static uint64_t pool_buffer[POOL_SIZE / sizeof(uint64_t)];
+static uint64_t arena_buffer[ARENA_SIZE / sizeof(uint64_t)];
+
+static void mode_use(allocator_mode_t mode, bool simulated_heap)
+{
+	switch (mode)
+	{
+	case MODE_HEAP:
+		if (simulated_heap)
+		{
+			json_set_allocation_functions(sim_malloc, sim_free);
+		}
+		else
+		{
+			json_allocator_use_default();
+		}
+		break;
+	case MODE_POOL:
+		json_pool_init(&pool, pool_buffer, sizeof(pool_buffer));
+		json_pool_use(&pool);
+		break;
+	case MODE_ARENA:
+		json_arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+		json_arena_use(&arena);
+		break;
+	}
+}
+
+static char payload[PAYLOAD_SIZE];
+
+static void bench_time(allocator_mode_t mode)
+{
+	uint32_t failures = 0;
+	mode_use(mode, false);
+	int64_t start = now_ns();
+	for (int i = 0; i < BENCH_CYCLES; i++)
+	{
+		JSON_Value* root_value = document_build(10);
+		if (document_serialize(root_value, payload, sizeof(payload)) == 0)
+		{
+			failures++;
+		}
+		json_value_free(root_value);
+		if (mode == MODE_ARENA)
+		{
+			json_arena_reset(&arena);
+		}
+	}
+	double cycle_ns = (double)(now_ns() - start) / BENCH_CYCLES;
+	size_t peak = mode == MODE_POOL ? pool.stats.peak : mode == MODE_ARENA ? arena.stats.peak : 0;
+	printf("%-6s %10.0f %10u %10u\n", mode_names[mode], cycle_ns, (unsigned)peak, (unsigned)failures);
+}
+
+/**
+ * Documents of random size interleave with application blocks which hold copy of serialized
+ * document for random number of cycles, as outbox keeps messages until they are acknowledged.
+ * The copy is allocated while the document still exists, so it can land between its values.
+ */
+static void bench_fragmentation(allocator_mode_t mode)
+{
+	void* live[SIM_LIVE_BLOCKS] = { NULL };
+	uint32_t state = 1;
+	uint32_t failures = 0;
+	size_t min_largest = SIM_HEAP_SIZE;
+	double sum_fragmentation = 0;
+	sim_init();
+	mode_use(mode, true);
+	for (int i = 0; i < SIM_CYCLES; i++)
+	{
+		JSON_Value* root_value = document_build(1 + test_random(&state) % 16);
+		size_t length = document_serialize(root_value, payload, sizeof(payload));
+		size_t slot = test_random(&state) % SIM_LIVE_BLOCKS;
+		sim_free(live[slot]);
+		live[slot] = length > 0 ? sim_malloc(length + 1) : NULL;
+		if (live[slot] == NULL)
+		{
+			failures++;
+		}
+		else
+		{
+			memcpy(live[slot], payload, length + 1);
+		}
+		json_value_free(root_value);
+		if (mode == MODE_ARENA)
+		{
+			json_arena_reset(&arena);
+		}
+		size_t free_bytes;
+		size_t largest;
+		sim_stats(&free_bytes, &largest);
+		if (largest < min_largest)
+		{
+			min_largest = largest;
+		}
+		sum_fragmentation += free_bytes > 0 ? 1.0 - (double)largest / free_bytes : 0;
+	}
+	uint32_t fallbacks = mode == MODE_POOL ? pool.stats.fallbacks : 0;
+	printf("%-6s %14u %16.1f %10u %10u\n", mode_names[mode], (unsigned)min_largest,
+			100 * sum_fragmentation / SIM_CYCLES, (unsigned)failures, (unsigned)fallbacks);
+	for (size_t i = 0; i < SIM_LIVE_BLOCKS; i++)
+	{
+		sim_free(live[i]);
+	}
+}
+
+int main(void)
+{
+	printf("Document with 10 samples, build + serialize + free\n");
+	printf("%-6s %10s %10s %10s\n", "alloc", "ns/cycle", "peak B", "failures");
+	for (int mode = MODE_HEAP; mode <= MODE_ARENA; mode++)
+	{
+		bench_time((allocator_mode_t)mode);
+	}
+	printf("\nSimulated %u B heap, %u cycles, %u live application blocks\n", SIM_HEAP_SIZE, SIM_CYCLES,
+			SIM_LIVE_BLOCKS);
+	printf("%-6s %14s %16s %10s %10s\n", "alloc", "min largest B", "mean frag %", "failures", "fallbacks");
+	for (int mode = MODE_HEAP; mode <= MODE_ARENA; mode++)
+	{
+		bench_fragmentation((allocator_mode_t)mode);
+	}
+	json_allocator_use_default();
+	return 0;
+}
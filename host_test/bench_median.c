@@ -0,0 +1,120 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Benchmark of median selection against the former qsort based implementation.
+ * Prints average time of one median call for typical MEDIAN_SAMPLES sizes.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "algorithm.h"
+#include "test.h"
+
+#define BENCH_ARRAYS 1024
+#define BENCH_ROUNDS 200
+#define BENCH_MAX_VALUES 64
+
+static int compare(const void* a, const void* b)
+{
+	return *(const int16_t*)a - *(const int16_t*)b;
+}
+
+/**
+ * Median as computed before selection networks were introduced.
+ */
+static int16_t median_qsort(int16_t* array, size_t n)
+{
+	qsort(array, n, sizeof(int16_t), compare);
+	return array[n / 2];
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static int16_t source[BENCH_ARRAYS][BENCH_MAX_VALUES];
+static int16_t work[BENCH_ARRAYS][BENCH_MAX_VALUES];
+
+/**
+ * Measure average ns per call. Arrays are restored before each round because both
+ * implementations reorder them, restoring is not included in the measured time.
+ */
+static double bench(int16_t (*function)(int16_t*, size_t), size_t n, int32_t* checksum)
+{
+	int64_t total_time = 0;
+	for (int round = 0; round < BENCH_ROUNDS; round++)
+	{
+		memcpy(work, source, sizeof(work));
+		int64_t start = now_ns();
+		for (size_t i = 0; i < BENCH_ARRAYS; i++)
+		{
+			*checksum += function(work[i], n);
+		}
+		int64_t end = now_ns();
+		total_time += end - start;
+	}
+	return (double)total_time / (BENCH_ROUNDS * BENCH_ARRAYS);
+}
+
+static int16_t median_new(int16_t* array, size_t n)
+{
+	return median(array, n);
+}
+
+int main(void)
+{
+	static const size_t sizes[] = { 3, 5, 7, 9, 15, 31, 63 };
+	uint32_t state = 1;
+	for (size_t i = 0; i < BENCH_ARRAYS; i++)
+	{
+		for (size_t j = 0; j < BENCH_MAX_VALUES; j++)
+		{
+			// Sensor like values: 21.5 C with noise
+			source[i][j] = (int16_t)(215 + (int32_t)(test_random(&state) % 21) - 10);
+		}
+	}
+	printf("%8s %14s %14s %8s\n", "samples", "qsort [ns]", "median [ns]", "speedup");
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		int32_t checksum_old = 0;
+		int32_t checksum_new = 0;
+		double old_ns = bench(median_qsort, sizes[i], &checksum_old);
+		double new_ns = bench(median_new, sizes[i], &checksum_new);
+		printf("%8u %14.1f %14.1f %7.1fx%s\n", (unsigned)sizes[i], old_ns, new_ns, old_ns / new_ns,
+				checksum_old == checksum_new ? "" : " MISMATCH");
+	}
+	return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Measurement of heap used by parsed parson documents, the parson test corpus and
+ * a batch of measurement records. Run both bench_parson_memory (default layout) and
+ * bench_parson_memory_compact (PARSON_COMPACT_VALUES) to compare.
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parson.h"
+
+#ifndef PARSON_CORPUS_DIR
+#define PARSON_CORPUS_DIR "tests"
+#endif
+
+#ifdef PARSON_COMPACT_VALUES
+#define LAYOUT_NAME "compact"
+#else
+#define LAYOUT_NAME "default"
+#endif
+
+#define MAX_NAME 64
+#define RECORD_COUNT 1000
+#define RECORD_SIZE 96
+
+/**
+ * Heap usage of parson, every block carries its size in header. Chunk bytes estimate heap
+ * of 64-bit glibc, request with 8 B header rounded up to 16 B and at least 32 B.
+ */
+static size_t heap_current;
+static size_t heap_blocks;
+static size_t heap_chunks;
+
+static size_t chunk_size(size_t size)
+{
+	size_t chunk = (size + 8 + 15) & ~(size_t)15;
+	return chunk < 32 ? 32 : chunk;
+}
+
+static void* counting_malloc(size_t size)
+{
+	max_align_t* block = malloc(sizeof(max_align_t) + size);
+	if (block == NULL)
+	{
+		return NULL;
+	}
+	*(size_t*)block = size;
+	heap_current += size;
+	heap_blocks++;
+	heap_chunks += chunk_size(size);
+	return block + 1;
+}
+
+static void counting_free(void* pointer)
+{
+	if (pointer == NULL)
+	{
+		return;
+	}
+	max_align_t* block = (max_align_t*)pointer - 1;
+	size_t size = *(size_t*)block;
+	heap_current -= size;
+	heap_blocks--;
+	heap_chunks -= chunk_size(size);
+	free(block);
+}
+
+typedef struct footprint
+{
+	size_t requested;
+	size_t blocks;
+	size_t chunks;
+} footprint_t;
+
+static footprint_t total;
+
+/**
+ * Print heap held by parsed document, it is measured after parsing, so temporary buffers
+ * of parser are not included.
+ */
+static bool document_measure(const char* name, JSON_Value* value)
+{
+	if (value == NULL)
+	{
+		return false;
+	}
+	footprint_t footprint = { heap_current, heap_blocks, heap_chunks };
+	printf("%-28s %10u %10u %10u\n", name, (unsigned)footprint.requested, (unsigned)footprint.blocks,
+			(unsigned)footprint.chunks);
+	total.requested += footprint.requested;
+	total.blocks += footprint.blocks;
+	total.chunks += footprint.chunks;
+	json_value_free(value);
+	return heap_current == 0 && heap_blocks == 0;
+}
+
+/**
+ * Measure all documents of the corpus in name order, files which are not valid JSON are skipped.
+ */
+static bool corpus_measure(void)
+{
+	struct dirent** entries;
+	bool result = true;
+	int count = scandir(PARSON_CORPUS_DIR, &entries, NULL, alphasort);
+	if (count < 0)
+	{
+		printf("Corpus %s not found\n", PARSON_CORPUS_DIR);
+		return false;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		char path[512];
+		const char* name = entries[i]->d_name;
+		size_t length = strlen(name);
+		if (length >= 4 && length < MAX_NAME && strcmp(&name[length - 4], ".txt") == 0)
+		{
+			snprintf(path, sizeof(path), "%s/%s", PARSON_CORPUS_DIR, name);
+			JSON_Value* value = json_parse_file(path);
+			if (value == NULL)
+			{
+				value = json_parse_file_with_comments(path);
+			}
+			if (value != NULL)
+			{
+				result &= document_measure(name, value);
+			}
+		}
+		free(entries[i]);
+	}
+	free(entries);
+	return result;
+}
+
+/**
+ * Array of records in JSON payload format of MQTT handler.
+ */
+static bool records_measure(void)
+{
+	char* text = malloc(RECORD_COUNT * RECORD_SIZE + 3);
+	if (text == NULL)
+	{
+		return false;
+	}
+	size_t length = 0;
+	text[length++] = '[';
+	for (int i = 0; i < RECORD_COUNT; i++)
+	{
+		length += (size_t)snprintf(&text[length], RECORD_SIZE,
+				"%s{\"id\":\"SENSOR%d\",\"temperature\":%.1f,\"humidity\":%.1f,\"utc\":%llu}",
+				i > 0 ? "," : "", i % 3 + 1, 21.5 + i % 50 / 10.0, 65.0 - i % 30 / 10.0,
+				1572982980000ULL + i / 3 * 60000ULL);
+	}
+	text[length++] = ']';
+	text[length] = '\0';
+	char name[MAX_NAME];
+	snprintf(name, sizeof(name), "%d records", RECORD_COUNT);
+	bool result = document_measure(name, json_parse_string(text));
+	free(text);
+	return result;
+}
+
+int main(void)
+{
+	json_set_allocation_functions(counting_malloc, counting_free);
+	JSON_Value* number = json_value_init_number(0);
+	printf("Layout: %s, number value %u B\n", LAYOUT_NAME, (unsigned)heap_current);
+	json_value_free(number);
+	printf("%-28s %10s %10s %10s\n", "document", "requested B", "blocks", "chunks B");
+	bool result = corpus_measure() && records_measure();
+	printf("%-28s %10u %10u %10u\n", "total", (unsigned)total.requested, (unsigned)total.blocks,
+			(unsigned)total.chunks);
+	return !result;
+}
@@ -0,0 +1,258 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Benchmark of parson number formatting. Prints throughput of serializing arrays of
+ * numbers and checks that every formatted number parses back to the same double, compared
+ * with "%1.17g" used by default build and with the shortest round-trip "%.*g".
+ * Run both bench_parson_numbers (sprintf) and bench_parson_numbers_fast (Grisu2).
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parson.h"
+#include "test.h"
+
+#ifdef PARSON_FAST_NUMBER_FORMAT
+#define FORMAT_NAME "grisu2"
+#else
+#define FORMAT_NAME "sprintf"
+#endif
+
+#define ARRAY_SIZE 1000
+#define BENCH_NUMBERS 4000000
+#define CHECK_NUMBERS 200000
+#define NUMBER_SIZE 64
+#define BUFFER_SIZE (ARRAY_SIZE * NUMBER_SIZE)
+
+typedef enum number_set
+{
+	SET_RANDOM,
+	SET_TENTHS,
+	SET_TIMESTAMPS,
+	SET_COUNT
+} number_set_t;
+
+static const char* set_names[] = { "random bits", "float tenths", "ms timestamps" };
+
+static char buffer[BUFFER_SIZE];
+
+static int64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static bool same_bits(double a, double b)
+{
+	return memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+/**
+ * Generate number of the set: finite double of random bits, sensor value in tenths widened
+ * from float as parsed by firmware, or UTC timestamp in ms.
+ */
+static double number_generate(number_set_t set, uint32_t* state)
+{
+	switch (set)
+	{
+	case SET_RANDOM:
+		for (;;)
+		{
+			uint64_t bits = (uint64_t)test_random(state) << 32 | test_random(state);
+			double value;
+			memcpy(&value, &bits, sizeof(value));
+			// NaN and infinity are not valid JSON numbers
+			if (value - value == 0.0)
+			{
+				return value;
+			}
+		}
+	case SET_TENTHS:
+		return (double)((float)((int32_t)(test_random(state) % 2000) - 400) / 10.0f);
+	default:
+		return 1572982980000.0 + test_random(state) % 100000000;
+	}
+}
+
+/**
+ * Format single number by parson.
+ */
+static const char* number_format(double value)
+{
+	JSON_Value* number = json_value_init_number(value);
+	if (number == NULL || json_serialize_to_buffer(number, buffer, sizeof(buffer)) != JSONSuccess)
+	{
+		buffer[0] = '\0';
+	}
+	json_value_free(number);
+	return buffer;
+}
+
+/**
+ * Count significant digits of formatted number, exponent notation differs between formats.
+ */
+static int significant_digits(const char* text)
+{
+	int digits = 0;
+	int zeros = 0;
+	for (; *text != '\0' && *text != 'e' && *text != 'E'; text++)
+	{
+		if (*text == '0')
+		{
+			zeros += digits > 0;
+		}
+		else if (*text >= '1' && *text <= '9')
+		{
+			digits += zeros + 1;
+			zeros = 0;
+		}
+	}
+	return digits;
+}
+
+/**
+ * Number of significant digits of the shortest "%.*g" representation which parses back to the value.
+ */
+static int shortest_digits(double value)
+{
+	char text[NUMBER_SIZE];
+	for (int precision = 1; precision < 17; precision++)
+	{
+		snprintf(text, sizeof(text), "%.*g", precision, value);
+		if (same_bits(strtod(text, NULL), value))
+		{
+			return significant_digits(text);
+		}
+	}
+	return 17;
+}
+
+/**
+ * Check round trip of formatted numbers, compare their length with "%1.17g" and their digits
+ * with the shortest form.
+ * @return Number of numbers which do not parse back to the same value.
+ */
+static uint32_t check_round_trip(number_set_t set)
+{
+	uint32_t state = 1 + set;
+	uint32_t failures = 0;
+	uint32_t longer_than_shortest = 0;
+	uint64_t length_sum = 0;
+	uint64_t printf_length_sum = 0;
+	char reference[NUMBER_SIZE];
+	for (int i = 0; i < CHECK_NUMBERS; i++)
+	{
+		double value = number_generate(set, &state);
+		const char* text = number_format(value);
+		size_t length = strlen(text);
+		size_t printf_length = (size_t)snprintf(reference, sizeof(reference), "%1.17g", value);
+		if (length == 0 || !same_bits(strtod(text, NULL), value)
+				|| !same_bits(strtod(reference, NULL), value))
+		{
+			if (failures++ < 5)
+			{
+				printf("Round trip failed: %s, %%1.17g %s\n", text, reference);
+			}
+		}
+		longer_than_shortest += significant_digits(text) > shortest_digits(value);
+		length_sum += length;
+		printf_length_sum += printf_length;
+	}
+	printf("%-14s %10.2f %10.2f %14.3f %10u\n", set_names[set], (double)length_sum / CHECK_NUMBERS,
+			(double)printf_length_sum / CHECK_NUMBERS, 100.0 * longer_than_shortest / CHECK_NUMBERS,
+			(unsigned)failures);
+	return failures;
+}
+
+/**
+ * Serialize arrays of numbers and compare with formatting of the same numbers by sprintf.
+ */
+static void bench_format(number_set_t set)
+{
+	uint32_t state = 100 + set;
+	JSON_Value* array_value = json_value_init_array();
+	JSON_Array* array = json_value_get_array(array_value);
+	double numbers[ARRAY_SIZE];
+	for (int i = 0; i < ARRAY_SIZE; i++)
+	{
+		numbers[i] = number_generate(set, &state);
+		json_array_append_number(array, numbers[i]);
+	}
+	int rounds = BENCH_NUMBERS / ARRAY_SIZE;
+	uint32_t failures = 0;
+	int64_t start = now_ns();
+	for (int round = 0; round < rounds; round++)
+	{
+		if (json_serialize_to_buffer(array_value, buffer, sizeof(buffer)) != JSONSuccess)
+		{
+			failures++;
+		}
+	}
+	double serialize_ns = (double)(now_ns() - start) / ((int64_t)rounds * ARRAY_SIZE);
+	size_t length = 0;
+	start = now_ns();
+	for (int round = 0; round < rounds; round++)
+	{
+		for (int i = 0; i < ARRAY_SIZE; i++)
+		{
+			length += (size_t)sprintf(buffer, "%1.17g", numbers[i]);
+		}
+	}
+	double sprintf_ns = (double)(now_ns() - start) / ((int64_t)rounds * ARRAY_SIZE);
+	printf("%-14s %12.2f %12.2f %10u\n", set_names[set], 1000 / serialize_ns, 1000 / sprintf_ns,
+			(unsigned)failures + (length == 0));
+	json_value_free(array_value);
+}
+
+int main(void)
+{
+	uint32_t failures = 0;
+	printf("Number formatting: %s\n", FORMAT_NAME);
+	printf("%-14s %12s %12s %10s\n", "numbers", "parson M/s", "%1.17g M/s", "failures");
+	for (int set = 0; set < SET_COUNT; set++)
+	{
+		bench_format((number_set_t)set);
+	}
+	printf("\nRound trip of %u numbers, mean length and share with more digits than shortest %%.*g\n",
+			CHECK_NUMBERS);
+	printf("%-14s %10s %10s %14s %10s\n", "numbers", "parson", "%1.17g", "% more digits", "failures");
+	for (int set = 0; set < SET_COUNT; set++)
+	{
+		failures += check_round_trip((number_set_t)set);
+	}
+	return failures > 0;
+}
@@ -0,0 +1,139 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Benchmark of parson object member lookup by name. Prints time of building object
+ * and looking up all its members for growing member count. Run both bench_parson_object
+ * (hash index above threshold) and bench_parson_object_linear (index disabled) to compare.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "parson.h"
+#include "test.h"
+
+// Default of parson.c, the linear build overrides it by 0
+#ifndef PARSON_OBJECT_INDEX_THRESHOLD
+#define PARSON_OBJECT_INDEX_THRESHOLD 16
+#endif
+
+#define MAX_KEYS 10000
+#define KEY_SIZE 16
+// Each phase is repeated at least this long, linear scan of large objects is quadratic
+#define BENCH_NS 200000000
+#define MIN_ROUNDS 3
+
+static const size_t key_counts[] = { 1, 2, 4, 8, 12, 16, 17, 24, 32, 48, 64, 128, 256, 1024, 4096, MAX_KEYS };
+
+static char keys[MAX_KEYS][KEY_SIZE];
+static size_t lookup_order[MAX_KEYS];
+
+static int64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static JSON_Value* object_build(size_t count)
+{
+	JSON_Value* value = json_value_init_object();
+	JSON_Object* object = json_value_get_object(value);
+	for (size_t i = 0; i < count; i++)
+	{
+		json_object_set_number(object, keys[i], (double)i);
+	}
+	return value;
+}
+
+/**
+ * Measure building and freeing of object and lookups of all its members in random order.
+ * @return Number of lookups which did not find the member.
+ */
+static uint32_t bench_object(size_t count)
+{
+	uint32_t state = (uint32_t)count;
+	size_t rounds = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		lookup_order[i] = i;
+	}
+	for (size_t i = count; i > 1; i--)
+	{
+		size_t j = test_random(&state) % i;
+		size_t swap = lookup_order[i - 1];
+		lookup_order[i - 1] = lookup_order[j];
+		lookup_order[j] = swap;
+	}
+
+	int64_t start = now_ns();
+	for (rounds = 0; rounds < MIN_ROUNDS || now_ns() - start < BENCH_NS; rounds++)
+	{
+		json_value_free(object_build(count));
+	}
+	double build_ns = (double)(now_ns() - start) / (rounds * count);
+
+	JSON_Value* value = object_build(count);
+	JSON_Object* object = json_value_get_object(value);
+	uint32_t failures = 0;
+	start = now_ns();
+	for (rounds = 0; rounds < MIN_ROUNDS || now_ns() - start < BENCH_NS; rounds++)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t key = lookup_order[i];
+			failures += json_object_get_number(object, keys[key]) != (double)key;
+		}
+	}
+	double lookup_ns = (double)(now_ns() - start) / (rounds * count);
+	json_value_free(value);
+	printf("%6u %14.1f %14.1f %10u\n", (unsigned)count, build_ns, lookup_ns, (unsigned)failures);
+	return failures;
+}
+
+int main(void)
+{
+	uint32_t failures = 0;
+	for (size_t i = 0; i < MAX_KEYS; i++)
+	{
+		snprintf(keys[i], KEY_SIZE, "sensor_%u", (unsigned)i);
+	}
+	printf("Object index threshold: %d%s\n", PARSON_OBJECT_INDEX_THRESHOLD,
+			PARSON_OBJECT_INDEX_THRESHOLD > 0 ? "" : " (linear scan)");
+	printf("%6s %14s %14s %10s\n", "keys", "build ns/key", "lookup ns", "failures");
+	for (size_t i = 0; i < sizeof(key_counts) / sizeof(key_counts[0]); i++)
+	{
+		failures += bench_object(key_counts[i]);
+	}
+	return failures > 0;
+}
@@ -0,0 +1,285 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Benchmark of parson serialization APIs on documents of parson test corpus. Prints
+ * time and throughput of each API and heap used by serialization to string and file.
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parson.h"
+
+#ifndef PARSON_CORPUS_DIR
+#define PARSON_CORPUS_DIR "tests"
+#endif
+
+// Serialized bytes of each API, repetitions of the corpus are derived from its size
+#define BENCH_BYTES (32 * 1024 * 1024)
+#define MAX_DOCUMENTS 32
+#define MAX_NAME 64
+#define OUTPUT_FILE "bench_parson_serialize.json"
+
+typedef struct document
+{
+	char name[MAX_NAME];
+	JSON_Value* value;
+	size_t size;
+} document_t;
+
+static document_t documents[MAX_DOCUMENTS];
+static size_t document_count;
+static size_t corpus_size;
+static char* output_buffer;
+
+/**
+ * Heap usage of parson, every block carries its size in header.
+ */
+static size_t heap_current;
+static size_t heap_peak;
+static size_t heap_allocations;
+
+static void* counting_malloc(size_t size)
+{
+	max_align_t* block = malloc(sizeof(max_align_t) + size);
+	if (block == NULL)
+	{
+		return NULL;
+	}
+	*(size_t*)block = size;
+	heap_current += size;
+	heap_allocations++;
+	if (heap_current > heap_peak)
+	{
+		heap_peak = heap_current;
+	}
+	return block + 1;
+}
+
+static void counting_free(void* pointer)
+{
+	if (pointer == NULL)
+	{
+		return;
+	}
+	max_align_t* block = (max_align_t*)pointer - 1;
+	heap_current -= *(size_t*)block;
+	free(block);
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Parse all documents of the corpus in name order, files which are not valid JSON are skipped.
+ */
+static bool corpus_load(void)
+{
+	struct dirent** entries;
+	int count = scandir(PARSON_CORPUS_DIR, &entries, NULL, alphasort);
+	if (count < 0)
+	{
+		printf("Corpus %s not found\n", PARSON_CORPUS_DIR);
+		return false;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		char path[512];
+		const char* name = entries[i]->d_name;
+		size_t length = strlen(name);
+		if (document_count < MAX_DOCUMENTS && length >= 4 && length < MAX_NAME
+				&& strcmp(&name[length - 4], ".txt") == 0)
+		{
+			snprintf(path, sizeof(path), "%s/%s", PARSON_CORPUS_DIR, name);
+			JSON_Value* value = json_parse_file(path);
+			if (value == NULL)
+			{
+				value = json_parse_file_with_comments(path);
+			}
+			if (value != NULL)
+			{
+				document_t* document = &documents[document_count++];
+				strcpy(document->name, name);
+				document->value = value;
+				document->size = json_serialization_size(value);
+				corpus_size += document->size;
+			}
+		}
+		free(entries[i]);
+	}
+	free(entries);
+	return document_count > 0;
+}
+
+static bool serialize_size(const JSON_Value* value)
+{
+	return json_serialization_size(value) > 0;
+}
+
+static bool serialize_buffer(const JSON_Value* value)
+{
+	return json_serialize_to_buffer(value, output_buffer, corpus_size) == JSONSuccess;
+}
+
+/**
+ * Buffer allocated by serialization size, the traversal is done twice.
+ */
+static bool serialize_size_buffer(const JSON_Value* value)
+{
+	size_t size = json_serialization_size(value);
+	return size > 0 && json_serialize_to_buffer(value, output_buffer, size) == JSONSuccess;
+}
+
+static bool serialize_string(const JSON_Value* value)
+{
+	char* string = json_serialize_to_string(value);
+	json_free_serialized_string(string);
+	return string != NULL;
+}
+
+static bool serialize_file(const JSON_Value* value)
+{
+	return json_serialize_to_file(value, OUTPUT_FILE) == JSONSuccess;
+}
+
+static JSON_Status sink_write(void* context, const char* data, size_t length)
+{
+	*(size_t*)context += length + (data[0] != '\0' ? 0 : 1);
+	return JSONSuccess;
+}
+
+static bool serialize_callback(const JSON_Value* value)
+{
+	size_t written = 0;
+	return json_serialize_to_callback(value, sink_write, &written) == JSONSuccess && written > 0;
+}
+
+typedef struct serializer
+{
+	const char* name;
+	bool (*serialize)(const JSON_Value* value);
+} serializer_t;
+
+static const serializer_t serializers[] = {
+	{ "size", serialize_size },
+	{ "buffer", serialize_buffer },
+	{ "size+buffer", serialize_size_buffer },
+	{ "string", serialize_string },
+	{ "file", serialize_file },
+	{ "callback", serialize_callback },
+};
+
+static void bench_serializer(const serializer_t* serializer)
+{
+	size_t rounds = BENCH_BYTES / corpus_size + 1;
+	uint32_t failures = 0;
+	int64_t start = now_ns();
+	for (size_t round = 0; round < rounds; round++)
+	{
+		for (size_t i = 0; i < document_count; i++)
+		{
+			if (!serializer->serialize(documents[i].value))
+			{
+				failures++;
+			}
+		}
+	}
+	int64_t elapsed = now_ns() - start;
+	printf("%-12s %12.0f %10.1f %10u\n", serializer->name, (double)elapsed / (rounds * document_count),
+			(double)rounds * corpus_size * 1000 / elapsed, (unsigned)failures);
+}
+
+static void heap_reset(void)
+{
+	heap_current = 0;
+	heap_peak = 0;
+	heap_allocations = 0;
+}
+
+/**
+ * Heap held by serialization to string compared with length of the string and heap used
+ * by serialization to file.
+ */
+static void bench_heap(const document_t* document)
+{
+	heap_reset();
+	char* string = json_serialize_to_string(document->value);
+	size_t held = heap_current;
+	json_free_serialized_string(string);
+	size_t string_peak = heap_peak;
+	size_t string_allocations = heap_allocations;
+	heap_reset();
+	json_serialize_to_file(document->value, OUTPUT_FILE);
+	printf("%-28s %8u %8u %8u %8u %8u\n", document->name, (unsigned)document->size, (unsigned)held,
+			(unsigned)string_peak, (unsigned)string_allocations, (unsigned)heap_peak);
+}
+
+int main(void)
+{
+	if (!corpus_load())
+	{
+		return 1;
+	}
+	output_buffer = malloc(corpus_size);
+	printf("Corpus %s: %u documents, %u B serialized\n", PARSON_CORPUS_DIR, (unsigned)document_count,
+			(unsigned)corpus_size);
+	printf("%-12s %12s %10s %10s\n", "api", "ns/document", "MB/s", "failures");
+	for (size_t i = 0; i < sizeof(serializers) / sizeof(serializers[0]); i++)
+	{
+		bench_serializer(&serializers[i]);
+	}
+	// Documents were allocated by default allocator, only serialization is counted
+	json_set_allocation_functions(counting_malloc, counting_free);
+	printf("\nHeap of serialization to string and file\n");
+	printf("%-28s %8s %8s %8s %8s %8s\n", "document", "length", "held B", "peak B", "allocs", "file B");
+	for (size_t i = 0; i < document_count; i++)
+	{
+		bench_heap(&documents[i]);
+	}
+	json_set_allocation_functions(malloc, free);
+	remove(OUTPUT_FILE);
+	for (size_t i = 0; i < document_count; i++)
+	{
+		json_value_free(documents[i].value);
+	}
+	free(output_buffer);
+	return 0;
+}
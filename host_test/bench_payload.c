@@ -0,0 +1,155 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Benchmark of payload formats. Prints payload size per sample and encoding and decoding
+ * time for batches of samples taken every minute with slowly changing values.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "payload_encoder.h"
+#include "payload_decoder.h"
+#include "test.h"
+
+#define MAX_SAMPLES 256
+#define BUFFER_SIZE 16384
+// Number of encoded samples for timing each format and batch size
+#define BENCH_SAMPLES 2000000
+
+static const char* DEVICE_ID = "SENSOR1";
+
+typedef size_t (*encode_t)(const measurement_values_t* values, size_t count, const char* device_id,
+		uint8_t* buffer, size_t size);
+typedef int32_t (*decode_t)(const uint8_t* payload, size_t length, char* device_id, size_t device_id_size,
+		payload_sample_t* samples, size_t max_samples);
+
+static size_t encode_json(const measurement_values_t* values, size_t count, const char* device_id,
+		uint8_t* buffer, size_t size)
+{
+	return count == 1 ? payload_encode_json(values, device_id, (char*)buffer, size)
+			: payload_encode_json_batch(values, count, device_id, (char*)buffer, size);
+}
+
+static size_t encode_cbor(const measurement_values_t* values, size_t count, const char* device_id,
+		uint8_t* buffer, size_t size)
+{
+	return count == 1 ? payload_encode_cbor(values, device_id, buffer, size)
+			: payload_encode_cbor_batch(values, count, device_id, buffer, size);
+}
+
+typedef struct format
+{
+	const char* name;
+	encode_t encode;
+	decode_t decode;
+} format_t;
+
+static const format_t formats[] = {
+	{ "json", encode_json, NULL },
+	{ "cbor", encode_cbor, payload_decode_cbor },
+	{ "binary", payload_encode_binary, payload_decode_binary },
+	{ "delta", payload_encode_delta, payload_decode_delta },
+};
+
+static measurement_values_t values[MAX_SAMPLES];
+static payload_sample_t samples[MAX_SAMPLES];
+static uint8_t buffer[BUFFER_SIZE];
+
+static int64_t now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Samples every minute with wake-up jitter, temperature and humidity walk by 0.1 steps.
+ */
+static void generate(void)
+{
+	uint32_t state = 1;
+	int32_t temperature = 215;
+	int32_t humidity = 650;
+	uint64_t utc = 1572982980008ULL;
+	for (size_t i = 0; i < MAX_SAMPLES; i++)
+	{
+		temperature += (int32_t)(test_random(&state) % 3) - 1;
+		humidity += (int32_t)(test_random(&state) % 3) - 1;
+		values[i].temperature = temperature;
+		values[i].humidity = humidity;
+		values[i].utc_timestamp = utc;
+		values[i].sensor = 0;
+		utc += 60000 + test_random(&state) % 20;
+	}
+}
+
+static void bench(const format_t* format, size_t count)
+{
+	size_t rounds = BENCH_SAMPLES / count;
+	size_t length = format->encode(values, count, DEVICE_ID, buffer, sizeof(buffer));
+	int64_t start = now_ns();
+	for (size_t i = 0; i < rounds; i++)
+	{
+		length = format->encode(values, count, DEVICE_ID, buffer, sizeof(buffer));
+	}
+	double encode_ns = (double)(now_ns() - start) / (rounds * count);
+	printf("%-8s %6u %10.1f %12.1f", format->name, (unsigned)count, (double)length / count, encode_ns);
+	if (format->decode == NULL)
+	{
+		printf(" %12s\n", "-");
+		return;
+	}
+	char device_id[16];
+	int32_t decoded = 0;
+	start = now_ns();
+	for (size_t i = 0; i < rounds; i++)
+	{
+		decoded = format->decode(buffer, length, device_id, sizeof(device_id), samples, MAX_SAMPLES);
+	}
+	double decode_ns = (double)(now_ns() - start) / (rounds * count);
+	printf(" %12.1f%s\n", decode_ns, decoded == (int32_t)count ? "" : " FAILED");
+}
+
+int main(void)
+{
+	static const size_t counts[] = { 1, 16, 64, 256 };
+	generate();
+	printf("%-8s %6s %10s %12s %12s\n", "format", "batch", "B/sample", "enc ns/smp", "dec ns/smp");
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+	{
+		for (size_t j = 0; j < sizeof(formats) / sizeof(formats[0]); j++)
+		{
+			bench(&formats[j], counts[i]);
+		}
+	}
+	return 0;
+}
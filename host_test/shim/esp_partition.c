@@ -0,0 +1,191 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of file backed flash partition. Like NOR flash, written bits can only
+ * be cleared and misaligned erase is rejected, so wrong assumptions of the flash user fail here.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+
+static esp_partition_t host_partition;
+static FILE* host_partition_file = NULL;
+
+esp_err_t host_partition_open(const char* label, const char* path, uint32_t size)
+{
+	if (size == 0 || size % SPI_FLASH_SEC_SIZE != 0 || strlen(label) >= sizeof(host_partition.label))
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	host_partition_close();
+	host_partition_file = fopen(path, "r+b");
+	if (host_partition_file == NULL)
+	{
+		host_partition_file = fopen(path, "w+b");
+	}
+	if (host_partition_file == NULL)
+	{
+		return ESP_FAIL;
+	}
+	fseek(host_partition_file, 0, SEEK_END);
+	size_t length = (size_t)ftell(host_partition_file);
+	// Missing part of the file is erased flash
+	uint8_t erased[SPI_FLASH_SEC_SIZE];
+	memset(erased, 0xFF, sizeof(erased));
+	while (length < size)
+	{
+		size_t chunk = size - length < sizeof(erased) ? size - length : sizeof(erased);
+		fwrite(erased, 1, chunk, host_partition_file);
+		length += chunk;
+	}
+	fflush(host_partition_file);
+	memset(&host_partition, 0, sizeof(host_partition));
+	host_partition.type = ESP_PARTITION_TYPE_DATA;
+	host_partition.subtype = ESP_PARTITION_SUBTYPE_ANY;
+	host_partition.size = size;
+	strcpy(host_partition.label, label);
+	return ESP_OK;
+}
+
+void host_partition_close(void)
+{
+	if (host_partition_file != NULL)
+	{
+		fclose(host_partition_file);
+		host_partition_file = NULL;
+	}
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+		const char* label)
+{
+	if (host_partition_file == NULL || type != host_partition.type
+			|| (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != host_partition.subtype)
+			|| (label != NULL && strcmp(label, host_partition.label) != 0))
+	{
+		return NULL;
+	}
+	return &host_partition;
+}
+
+static esp_err_t host_partition_check(const esp_partition_t* partition, size_t offset, size_t size)
+{
+	if (partition != &host_partition || host_partition_file == NULL)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (offset > partition->size || size > partition->size - offset)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size)
+{
+	esp_err_t result = host_partition_check(partition, src_offset, size);
+	if (result != ESP_OK)
+	{
+		return result;
+	}
+	if (fseek(host_partition_file, src_offset, SEEK_SET) != 0
+			|| fread(dst, 1, size, host_partition_file) != size)
+	{
+		return ESP_FAIL;
+	}
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size)
+{
+	esp_err_t result = host_partition_check(partition, dst_offset, size);
+	if (result != ESP_OK)
+	{
+		return result;
+	}
+	const uint8_t* data = (const uint8_t*)src;
+	while (size > 0)
+	{
+		uint8_t chunk[256];
+		size_t length = size < sizeof(chunk) ? size : sizeof(chunk);
+		result = esp_partition_read(partition, dst_offset, chunk, length);
+		if (result != ESP_OK)
+		{
+			return result;
+		}
+		// Programming flash can only clear bits
+		for (size_t i = 0; i < length; i++)
+		{
+			chunk[i] &= data[i];
+		}
+		if (fseek(host_partition_file, dst_offset, SEEK_SET) != 0
+				|| fwrite(chunk, 1, length, host_partition_file) != length)
+		{
+			return ESP_FAIL;
+		}
+		data += length;
+		dst_offset += length;
+		size -= length;
+	}
+	fflush(host_partition_file);
+	return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size)
+{
+	esp_err_t result = host_partition_check(partition, offset, size);
+	if (result != ESP_OK)
+	{
+		return result;
+	}
+	if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	uint8_t erased[SPI_FLASH_SEC_SIZE];
+	memset(erased, 0xFF, sizeof(erased));
+	if (fseek(host_partition_file, offset, SEEK_SET) != 0)
+	{
+		return ESP_FAIL;
+	}
+	for (size_t i = 0; i < size / SPI_FLASH_SEC_SIZE; i++)
+	{
+		if (fwrite(erased, 1, sizeof(erased), host_partition_file) != sizeof(erased))
+		{
+			return ESP_FAIL;
+		}
+	}
+	fflush(host_partition_file);
+	return ESP_OK;
+}
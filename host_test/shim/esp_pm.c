@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of power management lock replacement.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include <esp_pm.h>
+
+struct esp_pm_lock
+{
+	esp_pm_lock_type_t type;
+	atomic_int count;
+};
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char* name,
+		esp_pm_lock_handle_t* out_handle)
+{
+	(void)arg;
+	(void)name;
+	if (out_handle == NULL)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	esp_pm_lock_handle_t lock = malloc(sizeof(*lock));
+	if (lock == NULL)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+	lock->type = lock_type;
+	atomic_init(&lock->count, 0);
+	*out_handle = lock;
+	return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+	atomic_fetch_add(&handle->count, 1);
+	return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+	// Release without acquire is an error as in ESP-IDF
+	if (atomic_fetch_sub(&handle->count, 1) <= 0)
+	{
+		atomic_fetch_add(&handle->count, 1);
+		return ESP_ERR_INVALID_STATE;
+	}
+	return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle)
+{
+	if (atomic_load(&handle->count) != 0)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+	free(handle);
+	return ESP_OK;
+}
@@ -0,0 +1,210 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of esp_timer replacement on POSIX threads.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <esp_timer.h>
+
+struct esp_timer
+{
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	esp_timer_cb_t callback;
+	void* arg;
+	// Expiration time in us of esp_timer_get_time()
+	int64_t deadline;
+	// Period in us or 0 for one-shot timer
+	uint64_t period;
+	bool armed;
+	bool deleted;
+	// Deleted from its own callback, the thread frees the timer
+	bool detached;
+};
+
+int64_t esp_timer_get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void* esp_timer_run(void* arg)
+{
+	esp_timer_handle_t timer = (esp_timer_handle_t)arg;
+	pthread_mutex_lock(&timer->mutex);
+	while (!timer->deleted)
+	{
+		if (!timer->armed)
+		{
+			pthread_cond_wait(&timer->cond, &timer->mutex);
+			continue;
+		}
+		if (esp_timer_get_time() < timer->deadline)
+		{
+			struct timespec deadline = { timer->deadline / 1000000, (timer->deadline % 1000000) * 1000 };
+			pthread_cond_timedwait(&timer->cond, &timer->mutex, &deadline);
+			continue;
+		}
+		if (timer->period > 0)
+		{
+			timer->deadline += timer->period;
+		}
+		else
+		{
+			timer->armed = false;
+		}
+		// Callback runs unlocked, so it can start or stop the timer
+		pthread_mutex_unlock(&timer->mutex);
+		timer->callback(timer->arg);
+		pthread_mutex_lock(&timer->mutex);
+	}
+	bool detached = timer->detached;
+	pthread_mutex_unlock(&timer->mutex);
+	if (detached)
+	{
+		pthread_cond_destroy(&timer->cond);
+		pthread_mutex_destroy(&timer->mutex);
+		free(timer);
+	}
+	return NULL;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* create_args, esp_timer_handle_t* out_handle)
+{
+	if (create_args == NULL || create_args->callback == NULL || out_handle == NULL)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	esp_timer_handle_t timer = malloc(sizeof(*timer));
+	if (timer == NULL)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&timer->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_mutex_init(&timer->mutex, NULL);
+	timer->callback = create_args->callback;
+	timer->arg = create_args->arg;
+	timer->deadline = 0;
+	timer->period = 0;
+	timer->armed = false;
+	timer->deleted = false;
+	timer->detached = false;
+	if (pthread_create(&timer->thread, NULL, esp_timer_run, timer) != 0)
+	{
+		pthread_cond_destroy(&timer->cond);
+		pthread_mutex_destroy(&timer->mutex);
+		free(timer);
+		return ESP_ERR_NO_MEM;
+	}
+	*out_handle = timer;
+	return ESP_OK;
+}
+
+static esp_err_t esp_timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period)
+{
+	esp_err_t result = ESP_OK;
+	pthread_mutex_lock(&timer->mutex);
+	if (timer->armed)
+	{
+		result = ESP_ERR_INVALID_STATE;
+	}
+	else
+	{
+		timer->deadline = esp_timer_get_time() + (int64_t)timeout_us;
+		timer->period = period;
+		timer->armed = true;
+		pthread_cond_signal(&timer->cond);
+	}
+	pthread_mutex_unlock(&timer->mutex);
+	return result;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+	return esp_timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+	return esp_timer_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+	esp_err_t result = ESP_OK;
+	pthread_mutex_lock(&timer->mutex);
+	if (!timer->armed)
+	{
+		result = ESP_ERR_INVALID_STATE;
+	}
+	timer->armed = false;
+	pthread_cond_signal(&timer->cond);
+	pthread_mutex_unlock(&timer->mutex);
+	return result;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+	pthread_mutex_lock(&timer->mutex);
+	if (timer->armed)
+	{
+		pthread_mutex_unlock(&timer->mutex);
+		return ESP_ERR_INVALID_STATE;
+	}
+	timer->deleted = true;
+	if (pthread_equal(timer->thread, pthread_self()))
+	{
+		// Deleted from its own callback, the thread exits after the callback returns
+		timer->detached = true;
+		pthread_detach(timer->thread);
+		pthread_mutex_unlock(&timer->mutex);
+		return ESP_OK;
+	}
+	pthread_cond_signal(&timer->cond);
+	pthread_mutex_unlock(&timer->mutex);
+	pthread_join(timer->thread, NULL);
+	pthread_cond_destroy(&timer->cond);
+	pthread_mutex_destroy(&timer->mutex);
+	free(timer);
+	return ESP_OK;
+}
@@ -0,0 +1,432 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of FreeRTOS task, notification, semaphore and event group replacement
+ * on POSIX threads.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <freertos/event_groups.h>
+
+struct host_task
+{
+	pthread_t thread;
+	TaskFunction_t function;
+	void* parameters;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint32_t notification;
+	bool notified;
+};
+
+struct host_semaphore
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	UBaseType_t count;
+	UBaseType_t max_count;
+};
+
+struct host_event_group
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	EventBits_t bits;
+};
+
+static __thread struct host_task* host_current_task = NULL;
+
+static struct host_task* host_task_alloc(void)
+{
+	struct host_task* task = malloc(sizeof(*task));
+	if (task == NULL)
+	{
+		return NULL;
+	}
+	pthread_mutex_init(&task->mutex, NULL);
+	pthread_cond_init(&task->cond, NULL);
+	task->notification = 0;
+	task->notified = false;
+	return task;
+}
+
+static void host_task_free(struct host_task* task)
+{
+	pthread_cond_destroy(&task->cond);
+	pthread_mutex_destroy(&task->mutex);
+	free(task);
+}
+
+/**
+ * Get task of the calling thread, task of thread not created by xTaskCreate() is created now.
+ */
+static struct host_task* host_task_self(void)
+{
+	if (host_current_task == NULL)
+	{
+		host_current_task = host_task_alloc();
+		if (host_current_task == NULL)
+		{
+			abort();
+		}
+		host_current_task->thread = pthread_self();
+	}
+	return host_current_task;
+}
+
+/**
+ * Get absolute time of timeout in ticks for pthread_cond_timedwait().
+ */
+static struct timespec host_deadline(TickType_t ticks)
+{
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += ticks / 1000;
+	deadline.tv_nsec += (ticks % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	return deadline;
+}
+
+/**
+ * Wait on condition variable, returns false when the timeout expired.
+ */
+static bool host_wait(pthread_cond_t* cond, pthread_mutex_t* mutex, TickType_t ticks,
+		const struct timespec* deadline)
+{
+	if (ticks == portMAX_DELAY)
+	{
+		pthread_cond_wait(cond, mutex);
+		return true;
+	}
+	return pthread_cond_timedwait(cond, mutex, deadline) != ETIMEDOUT;
+}
+
+static void* host_task_run(void* arg)
+{
+	host_current_task = (struct host_task*)arg;
+	host_current_task->function(host_current_task->parameters);
+	host_task_free(host_current_task);
+	return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters,
+		UBaseType_t priority, TaskHandle_t* handle)
+{
+	(void)name;
+	(void)stack_depth;
+	(void)priority;
+	struct host_task* task = host_task_alloc();
+	if (task == NULL)
+	{
+		return pdFAIL;
+	}
+	task->function = function;
+	task->parameters = parameters;
+	if (handle != NULL)
+	{
+		// Set before the task runs, it may notify other tasks using this handle
+		*handle = task;
+	}
+	if (pthread_create(&task->thread, NULL, host_task_run, task) != 0)
+	{
+		host_task_free(task);
+		return pdFAIL;
+	}
+	pthread_detach(task->thread);
+	return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth,
+		void* parameters, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core)
+{
+	(void)core;
+	return xTaskCreate(function, name, stack_depth, parameters, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+	if (task != NULL && task != host_current_task)
+	{
+		// Threads cannot be cancelled safely, tested modules delete only themselves
+		abort();
+	}
+	// Handle held by the creator is invalid from now, as in FreeRTOS
+	if (host_current_task != NULL)
+	{
+		host_task_free(host_current_task);
+	}
+	host_current_task = NULL;
+	pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+	struct timespec delay = { ticks / 1000, (ticks % 1000) * 1000000L };
+	while (nanosleep(&delay, &delay) != 0 && errno == EINTR)
+	{
+	}
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (TickType_t)(now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+	return host_task_self();
+}
+
+BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action)
+{
+	BaseType_t result = pdPASS;
+	pthread_mutex_lock(&task->mutex);
+	switch (action)
+	{
+	case eSetBits:
+		task->notification |= value;
+		break;
+	case eIncrement:
+		task->notification++;
+		break;
+	case eSetValueWithOverwrite:
+		task->notification = value;
+		break;
+	case eSetValueWithoutOverwrite:
+		if (task->notified)
+		{
+			result = pdFAIL;
+		}
+		else
+		{
+			task->notification = value;
+		}
+		break;
+	default:
+		break;
+	}
+	if (result == pdPASS)
+	{
+		task->notified = true;
+		pthread_cond_signal(&task->cond);
+	}
+	pthread_mutex_unlock(&task->mutex);
+	return result;
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t* value, TickType_t ticks)
+{
+	struct host_task* task = host_task_self();
+	struct timespec deadline = host_deadline(ticks);
+	pthread_mutex_lock(&task->mutex);
+	if (!task->notified)
+	{
+		task->notification &= ~clear_on_entry;
+	}
+	while (!task->notified && host_wait(&task->cond, &task->mutex, ticks, &deadline))
+	{
+	}
+	if (value != NULL)
+	{
+		*value = task->notification;
+	}
+	BaseType_t notified = task->notified ? pdTRUE : pdFALSE;
+	if (notified)
+	{
+		task->notification &= ~clear_on_exit;
+		task->notified = false;
+	}
+	pthread_mutex_unlock(&task->mutex);
+	return notified;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+	struct host_task* task = host_task_self();
+	struct timespec deadline = host_deadline(ticks);
+	pthread_mutex_lock(&task->mutex);
+	while (task->notification == 0 && host_wait(&task->cond, &task->mutex, ticks, &deadline))
+	{
+	}
+	uint32_t value = task->notification;
+	if (value != 0)
+	{
+		task->notification = clear_on_exit ? 0 : value - 1;
+	}
+	task->notified = false;
+	pthread_mutex_unlock(&task->mutex);
+	return value;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+	struct host_semaphore* semaphore = malloc(sizeof(*semaphore));
+	if (semaphore == NULL)
+	{
+		return NULL;
+	}
+	pthread_mutex_init(&semaphore->mutex, NULL);
+	pthread_cond_init(&semaphore->cond, NULL);
+	semaphore->count = initial_count;
+	semaphore->max_count = max_count;
+	return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+	// Priority inheritance and recursion are not needed by tested modules
+	return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+	return xSemaphoreCreateCounting(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+	struct timespec deadline = host_deadline(ticks);
+	pthread_mutex_lock(&semaphore->mutex);
+	while (semaphore->count == 0 && host_wait(&semaphore->cond, &semaphore->mutex, ticks, &deadline))
+	{
+	}
+	BaseType_t taken = semaphore->count > 0 ? pdTRUE : pdFALSE;
+	if (taken)
+	{
+		semaphore->count--;
+	}
+	pthread_mutex_unlock(&semaphore->mutex);
+	return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+	pthread_mutex_lock(&semaphore->mutex);
+	BaseType_t given = semaphore->count < semaphore->max_count ? pdTRUE : pdFALSE;
+	if (given)
+	{
+		semaphore->count++;
+		pthread_cond_signal(&semaphore->cond);
+	}
+	pthread_mutex_unlock(&semaphore->mutex);
+	return given;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+	pthread_cond_destroy(&semaphore->cond);
+	pthread_mutex_destroy(&semaphore->mutex);
+	free(semaphore);
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+	struct host_event_group* group = malloc(sizeof(*group));
+	if (group == NULL)
+	{
+		return NULL;
+	}
+	pthread_mutex_init(&group->mutex, NULL);
+	pthread_cond_init(&group->cond, NULL);
+	group->bits = 0;
+	return group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+	pthread_mutex_lock(&group->mutex);
+	group->bits |= bits;
+	EventBits_t result = group->bits;
+	pthread_cond_broadcast(&group->cond);
+	pthread_mutex_unlock(&group->mutex);
+	return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+	pthread_mutex_lock(&group->mutex);
+	EventBits_t result = group->bits;
+	group->bits &= ~bits;
+	pthread_mutex_unlock(&group->mutex);
+	return result;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+	pthread_mutex_lock(&group->mutex);
+	EventBits_t result = group->bits;
+	pthread_mutex_unlock(&group->mutex);
+	return result;
+}
+
+static bool host_event_group_satisfied(EventBits_t bits, EventBits_t wait_bits, BaseType_t wait_for_all)
+{
+	return wait_for_all ? (bits & wait_bits) == wait_bits : (bits & wait_bits) != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+		BaseType_t wait_for_all, TickType_t ticks)
+{
+	struct timespec deadline = host_deadline(ticks);
+	pthread_mutex_lock(&group->mutex);
+	while (!host_event_group_satisfied(group->bits, bits, wait_for_all)
+			&& host_wait(&group->cond, &group->mutex, ticks, &deadline))
+	{
+	}
+	EventBits_t result = group->bits;
+	if (clear_on_exit && host_event_group_satisfied(result, bits, wait_for_all))
+	{
+		group->bits &= ~bits;
+	}
+	pthread_mutex_unlock(&group->mutex);
+	return result;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+	pthread_cond_destroy(&group->cond);
+	pthread_mutex_destroy(&group->mutex);
+	free(group);
+}
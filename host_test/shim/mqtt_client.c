@@ -0,0 +1,241 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of capturing MQTT client replacement.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mqtt_client.h>
+
+struct esp_mqtt_client
+{
+	mqtt_event_callback_t event_handle;
+	void* user_context;
+	bool started;
+	bool connected;
+	int next_msg_id;
+};
+
+static pthread_mutex_t host_mqtt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t host_mqtt_cond = PTHREAD_COND_INITIALIZER;
+static esp_mqtt_client_handle_t host_mqtt_client = NULL;
+static bool host_mqtt_reachable = true;
+static host_mqtt_message_t host_mqtt_messages[HOST_MQTT_MAX_MESSAGES];
+static size_t host_mqtt_count = 0;
+
+static void host_mqtt_dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event_id, int msg_id)
+{
+	esp_mqtt_event_t event = {
+		.event_id = event_id,
+		.client = client,
+		.user_context = client->user_context,
+		.msg_id = msg_id
+	};
+	if (client->event_handle != NULL)
+	{
+		client->event_handle(&event);
+	}
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* config)
+{
+	esp_mqtt_client_handle_t client = calloc(1, sizeof(*client));
+	if (client == NULL)
+	{
+		return NULL;
+	}
+	client->event_handle = config->event_handle;
+	client->user_context = config->user_context;
+	client->next_msg_id = 1;
+	pthread_mutex_lock(&host_mqtt_mutex);
+	host_mqtt_client = client;
+	pthread_mutex_unlock(&host_mqtt_mutex);
+	return client;
+}
+
+/**
+ * Update connection state of the client and dispatch the event when it changed.
+ */
+static void host_mqtt_update(esp_mqtt_client_handle_t client)
+{
+	pthread_mutex_lock(&host_mqtt_mutex);
+	bool connected = client->started && host_mqtt_reachable;
+	bool changed = connected != client->connected;
+	client->connected = connected;
+	pthread_mutex_unlock(&host_mqtt_mutex);
+	if (changed)
+	{
+		host_mqtt_dispatch(client, connected ? MQTT_EVENT_CONNECTED : MQTT_EVENT_DISCONNECTED, 0);
+	}
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+	if (client == NULL)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	pthread_mutex_lock(&host_mqtt_mutex);
+	client->started = true;
+	pthread_mutex_unlock(&host_mqtt_mutex);
+	host_mqtt_update(client);
+	return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+	if (client == NULL)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	pthread_mutex_lock(&host_mqtt_mutex);
+	client->started = false;
+	pthread_mutex_unlock(&host_mqtt_mutex);
+	host_mqtt_update(client);
+	return ESP_OK;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char* topic, const char* data, int len,
+		int qos, int retain)
+{
+	(void)retain;
+	if (client == NULL || len < 0)
+	{
+		return -1;
+	}
+	pthread_mutex_lock(&host_mqtt_mutex);
+	if (!client->connected)
+	{
+		pthread_mutex_unlock(&host_mqtt_mutex);
+		return -1;
+	}
+	if (host_mqtt_count < HOST_MQTT_MAX_MESSAGES && (size_t)len <= HOST_MQTT_MAX_PAYLOAD)
+	{
+		host_mqtt_message_t* message = &host_mqtt_messages[host_mqtt_count];
+		strncpy(message->topic, topic, sizeof(message->topic) - 1);
+		message->topic[sizeof(message->topic) - 1] = '\0';
+		memcpy(message->payload, data, len);
+		message->length = len;
+		message->qos = qos;
+	}
+	host_mqtt_count++;
+	int msg_id = client->next_msg_id++;
+	pthread_cond_broadcast(&host_mqtt_cond);
+	pthread_mutex_unlock(&host_mqtt_mutex);
+	if (qos > 0)
+	{
+		// The broker acknowledges immediately, before publishing call returns as it may on target
+		host_mqtt_dispatch(client, MQTT_EVENT_PUBLISHED, msg_id);
+	}
+	return msg_id;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+	if (client == NULL)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	pthread_mutex_lock(&host_mqtt_mutex);
+	if (host_mqtt_client == client)
+	{
+		host_mqtt_client = NULL;
+	}
+	pthread_mutex_unlock(&host_mqtt_mutex);
+	free(client);
+	return ESP_OK;
+}
+
+void host_mqtt_set_reachable(bool reachable)
+{
+	pthread_mutex_lock(&host_mqtt_mutex);
+	host_mqtt_reachable = reachable;
+	esp_mqtt_client_handle_t client = host_mqtt_client;
+	pthread_mutex_unlock(&host_mqtt_mutex);
+	if (client != NULL)
+	{
+		host_mqtt_update(client);
+	}
+}
+
+size_t host_mqtt_message_count(void)
+{
+	pthread_mutex_lock(&host_mqtt_mutex);
+	size_t count = host_mqtt_count;
+	pthread_mutex_unlock(&host_mqtt_mutex);
+	return count;
+}
+
+bool host_mqtt_message_get(size_t index, host_mqtt_message_t* message)
+{
+	pthread_mutex_lock(&host_mqtt_mutex);
+	bool found = index < host_mqtt_count && index < HOST_MQTT_MAX_MESSAGES;
+	if (found)
+	{
+		*message = host_mqtt_messages[index];
+	}
+	pthread_mutex_unlock(&host_mqtt_mutex);
+	return found;
+}
+
+bool host_mqtt_wait_messages(size_t count, uint32_t timeout_ms)
+{
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	pthread_mutex_lock(&host_mqtt_mutex);
+	int error = 0;
+	while (host_mqtt_count < count && error != ETIMEDOUT)
+	{
+		error = pthread_cond_timedwait(&host_mqtt_cond, &host_mqtt_mutex, &deadline);
+	}
+	bool reached = host_mqtt_count >= count;
+	pthread_mutex_unlock(&host_mqtt_mutex);
+	return reached;
+}
+
+void host_mqtt_clear(void)
+{
+	pthread_mutex_lock(&host_mqtt_mutex);
+	host_mqtt_count = 0;
+	pthread_mutex_unlock(&host_mqtt_mutex);
+}
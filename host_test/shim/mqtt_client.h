@@ -0,0 +1,142 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Host replacement of ESP-IDF MQTT client. Published messages are captured in memory
+ * and acknowledged immediately, connection state is driven by the test.
+ */
+
+#ifndef HOST_TEST_MQTT_CLIENT_H_
+#define HOST_TEST_MQTT_CLIENT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <esp_err.h>
+
+// Maximal number of captured messages and size of captured payload
+#define HOST_MQTT_MAX_MESSAGES 256
+#define HOST_MQTT_MAX_PAYLOAD 1024
+#define HOST_MQTT_MAX_TOPIC 64
+
+typedef struct esp_mqtt_client* esp_mqtt_client_handle_t;
+
+typedef enum
+{
+	MQTT_EVENT_ANY = -1,
+	MQTT_EVENT_ERROR = 0,
+	MQTT_EVENT_CONNECTED,
+	MQTT_EVENT_DISCONNECTED,
+	MQTT_EVENT_SUBSCRIBED,
+	MQTT_EVENT_UNSUBSCRIBED,
+	MQTT_EVENT_PUBLISHED,
+	MQTT_EVENT_DATA,
+	MQTT_EVENT_BEFORE_CONNECT
+} esp_mqtt_event_id_t;
+
+typedef struct esp_mqtt_event
+{
+	esp_mqtt_event_id_t event_id;
+	esp_mqtt_client_handle_t client;
+	void* user_context;
+	int msg_id;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t* esp_mqtt_event_handle_t;
+
+typedef esp_err_t (*mqtt_event_callback_t)(esp_mqtt_event_handle_t event);
+
+typedef struct
+{
+	mqtt_event_callback_t event_handle;
+	const char* host;
+	const char* uri;
+	uint32_t port;
+	const char* client_id;
+	int keepalive;
+	void* user_context;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* config);
+
+/**
+ * Start the client, it is connected immediately unless host_mqtt_set_reachable(false) was called.
+ */
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+
+/**
+ * Capture the message. Fails with -1 when the client is not connected.
+ */
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char* topic, const char* data, int len,
+		int qos, int retain);
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client);
+
+/**
+ * Message captured by esp_mqtt_client_publish()
+ */
+typedef struct host_mqtt_message
+{
+	char topic[HOST_MQTT_MAX_TOPIC];
+	uint8_t payload[HOST_MQTT_MAX_PAYLOAD];
+	size_t length;
+	int qos;
+} host_mqtt_message_t;
+
+/**
+ * Connect or disconnect started client and pass the event to its handler.
+ */
+void host_mqtt_set_reachable(bool reachable);
+
+/**
+ * Get number of captured messages since the last host_mqtt_clear().
+ */
+size_t host_mqtt_message_count(void);
+
+/**
+ * Copy captured message.
+ * @return false if the index is out of range or the message was not captured because of capacity.
+ */
+bool host_mqtt_message_get(size_t index, host_mqtt_message_t* message);
+
+/**
+ * Wait until at least count messages are captured.
+ * @return false on timeout
+ */
+bool host_mqtt_wait_messages(size_t count, uint32_t timeout_ms);
+
+/**
+ * Drop captured messages.
+ */
+void host_mqtt_clear(void);
+
+#endif /* HOST_TEST_MQTT_CLIENT_H_ */
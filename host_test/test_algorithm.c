@@ -0,0 +1,172 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Tests of median selection and running median filter against sorted reference.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "algorithm.h"
+#include "test.h"
+
+#define MAX_VALUES 64
+#define FILTER_WINDOW 15
+#define FILTER_SAMPLES 1000
+
+static int compare(const void* a, const void* b)
+{
+	return *(const int16_t*)a - *(const int16_t*)b;
+}
+
+static int16_t reference_median(const int16_t* values, size_t n)
+{
+	int16_t sorted[MAX_VALUES];
+	memcpy(sorted, values, n * sizeof(int16_t));
+	qsort(sorted, n, sizeof(int16_t), compare);
+	return sorted[n / 2];
+}
+
+static void fill(int16_t* values, size_t n, uint32_t* state, int32_t range)
+{
+	for (size_t i = 0; i < n; i++)
+	{
+		values[i] = (int16_t)((int32_t)(test_random(state) % range) - range / 2);
+	}
+}
+
+/**
+ * Median of all sizes with random, duplicate heavy, sorted and reversed input.
+ */
+static bool test_median_sizes(void)
+{
+	uint32_t state = 1;
+	for (size_t n = 1; n <= MAX_VALUES; n++)
+	{
+		for (int round = 0; round < 50; round++)
+		{
+			int16_t values[MAX_VALUES];
+			fill(values, n, &state, round % 2 ? 7 : 2000);
+			if (round == 2)
+			{
+				qsort(values, n, sizeof(int16_t), compare);
+			}
+			else if (round == 3)
+			{
+				for (size_t i = 0; i < n; i++)
+				{
+					values[i] = (int16_t)(n - i);
+				}
+			}
+			int16_t expected = reference_median(values, n);
+			if (median(values, n) != expected)
+			{
+				printf("median mismatch n=%u round=%d\n", (unsigned)n, round);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool test_select_kth(void)
+{
+	uint32_t state = 7;
+	for (size_t n = 1; n <= MAX_VALUES; n++)
+	{
+		int16_t values[MAX_VALUES];
+		int16_t sorted[MAX_VALUES];
+		fill(values, n, &state, 100);
+		memcpy(sorted, values, sizeof(values));
+		qsort(sorted, n, sizeof(int16_t), compare);
+		for (size_t k = 0; k < n; k++)
+		{
+			int16_t copy[MAX_VALUES];
+			memcpy(copy, values, sizeof(values));
+			if (select_kth(copy, n, k) != sorted[k])
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static bool test_median_extremes(void)
+{
+	int16_t values[] = { INT16_MAX, INT16_MIN, INT16_MAX, INT16_MIN, 0 };
+	int16_t large[] = { INT16_MIN, INT16_MAX, INT16_MIN, INT16_MAX, INT16_MIN, INT16_MAX, 0, 1, -1, 2, 3 };
+	return median(values, 5) == 0 && median(large, 11) == 1;
+}
+
+/**
+ * Running median compared with median of the last window values after every insertion.
+ */
+static bool test_median_filter(size_t window, int32_t range)
+{
+	int16_t values[FILTER_WINDOW];
+	int32_t positions[FILTER_WINDOW];
+	int32_t heap[FILTER_WINDOW];
+	int16_t history[FILTER_SAMPLES];
+	median_filter_t filter;
+	median_filter_init(&filter, values, positions, heap, window);
+	uint32_t state = 3;
+	for (size_t i = 0; i < FILTER_SAMPLES; i++)
+	{
+		history[i] = (int16_t)((int32_t)(test_random(&state) % range) - range / 2);
+		median_filter_insert(&filter, history[i]);
+		size_t count = i + 1 < window ? i + 1 : window;
+		if (median_filter_count(&filter) != count)
+		{
+			return false;
+		}
+		if (median_filter_get(&filter) != reference_median(&history[i + 1 - count], count))
+		{
+			printf("filter mismatch window=%u sample=%u\n", (unsigned)window, (unsigned)i);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(void)
+{
+	TEST(test_median_sizes());
+	TEST(test_select_kth());
+	TEST(test_median_extremes());
+	TEST(test_median_filter(1, 1000));
+	TEST(test_median_filter(2, 1000));
+	TEST(test_median_filter(5, 1000));
+	TEST(test_median_filter(FILTER_WINDOW, 1000));
+	TEST(test_median_filter(FILTER_WINDOW, 3));
+	return test_summary();
+}
@@ -0,0 +1,463 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Simulation tests of clock drift model. Local clock runs with constant skew against UTC
+ * and it is synchronized periodically with noisy offsets and occasional time jumps. Measurement
+ * cycles are scheduled through the model over a month with wandering skew.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "clock_drift.h"
+#include "measurement_task.h"
+#include "config.h"
+#include "test.h"
+
+#define UTC_START 1572982980000000LL
+// Local clock starts after some uptime
+#define LOCAL_START 86400000000LL
+#define SECOND 1000000LL
+#define MINUTE (60 * SECOND)
+#define HOUR (60 * MINUTE)
+#define DAY (24 * HOUR)
+
+#define JUMP_US (100 * 1000)
+#define MAX_DRIFT_PPM 100
+
+// Long run of measurement cycles
+#define RUN_DAYS 30
+#define SYNC_PERIOD HOUR
+#define SYNC_NOISE_US 5000
+// SNTP time jumps forward in the middle of the run
+#define SYNC_JUMP_US (2 * SECOND)
+// Remaining time in us considered as reached, the same as in measurement task
+#define WAKE_TOLERANCE 100
+#define WAKE_LATENCY_US 50
+// Skew follows daily temperature cycle around base skew and walks randomly
+#define WANDER_BASE_PPB 20000
+#define WANDER_DAILY_PPB 3000
+#define WANDER_WALK_PPB 5000
+// Maximal wake-up error in us with fitted drift, regression over CLOCK_DRIFT_SAMPLES hours lags
+// the daily skew cycle and causes most of it (about 9 ms without the cycle)
+#define MAX_ALIGNMENT_ERROR 25000
+// Maximal wake-up error in us before drift is fitted, the offset is held for one sync period
+#define MAX_UNFITTED_ERROR (MEASUREMENT_CLOCK_JUMP * 1000)
+
+/**
+ * Simulated local clock running faster by skew_ppb against UTC.
+ */
+typedef struct sim_clock
+{
+	int64_t skew_ppb;
+	uint32_t random_state;
+	/**
+	 * Maximal absolute error in us of synchronized time
+	 */
+	int64_t noise_us;
+} sim_clock_t;
+
+static int64_t sim_local(const sim_clock_t* clock, int64_t utc_us)
+{
+	int64_t elapsed = utc_us - UTC_START;
+	return LOCAL_START + elapsed + elapsed / 1000 * clock->skew_ppb / 1000000;
+}
+
+/**
+ * Synchronize the model at UTC time with random error of synchronization.
+ */
+static bool sim_sync(sim_clock_t* clock, clock_drift_t* drift, int64_t utc_us)
+{
+	int64_t noise = 0;
+	if (clock->noise_us > 0)
+	{
+		noise = (int64_t)(test_random(&clock->random_state) % (2 * clock->noise_us + 1)) - clock->noise_us;
+	}
+	return clock_drift_add(drift, sim_local(clock, utc_us), utc_us + noise);
+}
+
+static int64_t prediction_error(const sim_clock_t* clock, const clock_drift_t* drift, int64_t utc_us)
+{
+	int64_t error = clock_drift_to_utc(drift, sim_local(clock, utc_us)) - utc_us;
+	return error < 0 ? -error : error;
+}
+
+static bool test_single_sync(void)
+{
+	sim_clock_t clock = { 20000, 1, 0 };
+	clock_drift_t drift;
+	clock_drift_init(&drift, JUMP_US, MAX_DRIFT_PPM);
+	if (clock_drift_ready(&drift) || !sim_sync(&clock, &drift, UTC_START) || clock_drift_ready(&drift))
+	{
+		return false;
+	}
+	// Without fitted drift the offset is held, error grows by skew
+	int64_t error = prediction_error(&clock, &drift, UTC_START + HOUR);
+	return prediction_error(&clock, &drift, UTC_START) == 0 && error > 0 && error <= 20000LL * 3600 / 1000 + 1;
+}
+
+/**
+ * Exact synchronizations of skewed clock, drift is fitted and prediction holds between them.
+ */
+static bool test_skew(int64_t skew_ppb)
+{
+	sim_clock_t clock = { skew_ppb, 1, 0 };
+	clock_drift_t drift;
+	clock_drift_init(&drift, JUMP_US, MAX_DRIFT_PPM);
+	int64_t max_error = 0;
+	for (int i = 0; i < 3 * CLOCK_DRIFT_SAMPLES; i++)
+	{
+		int64_t utc = UTC_START + i * HOUR;
+		if (!sim_sync(&clock, &drift, utc))
+		{
+			return false;
+		}
+		for (int64_t ahead = 10 * MINUTE; ahead <= HOUR; ahead += 10 * MINUTE)
+		{
+			int64_t error = prediction_error(&clock, &drift, utc + ahead);
+			if (i > 0 && error > max_error)
+			{
+				max_error = error;
+			}
+		}
+	}
+	// Local clock is faster, so offset of UTC decreases. Drift relates to local time.
+	int64_t expected = -skew_ppb * 1000000000 / (1000000000 + skew_ppb);
+	int64_t drift_error = drift.drift_ppb - expected;
+	printf("Skew %lld ppb: fitted drift %d ppb, max error %lld us\n", (long long)skew_ppb,
+			(int)drift.drift_ppb, (long long)max_error);
+	return clock_drift_ready(&drift) && drift_error >= -2 && drift_error <= 2 && max_error <= 50;
+}
+
+/**
+ * Synchronizations with error up to +-2 ms every 15 minutes. Prediction one period ahead must
+ * be within the noise bounds, regression averages the noise.
+ */
+static bool test_noisy(void)
+{
+	sim_clock_t clock = { -35000, 7, 2000 };
+	clock_drift_t drift;
+	clock_drift_init(&drift, JUMP_US, MAX_DRIFT_PPM);
+	int64_t period = 15 * MINUTE;
+	int64_t max_error = 0;
+	int64_t max_drift_error = 0;
+	for (int i = 0; i < 24 * 4; i++)
+	{
+		int64_t utc = UTC_START + i * period;
+		if (!sim_sync(&clock, &drift, utc))
+		{
+			return false;
+		}
+		if (i < CLOCK_DRIFT_SAMPLES - 1)
+		{
+			continue;
+		}
+		int64_t error = prediction_error(&clock, &drift, utc + period);
+		if (error > max_error)
+		{
+			max_error = error;
+		}
+		int64_t drift_error = drift.drift_ppb - 35000;
+		drift_error = drift_error < 0 ? -drift_error : drift_error;
+		if (drift_error > max_drift_error)
+		{
+			max_drift_error = drift_error;
+		}
+	}
+	printf("Noise 2000 us: max drift error %lld ppb, max error %lld us\n", (long long)max_drift_error,
+			(long long)max_error);
+	// Holding the last offset without drift model would be 31.5 ms off after one period
+	return max_error <= 4000 && max_drift_error <= 2000;
+}
+
+/**
+ * Time jump restarts the model and it is fitted again from following synchronizations.
+ */
+static bool test_jump(void)
+{
+	sim_clock_t clock = { 15000, 3, 500 };
+	clock_drift_t drift;
+	clock_drift_init(&drift, JUMP_US, MAX_DRIFT_PPM);
+	int64_t utc = UTC_START;
+	for (int i = 0; i < CLOCK_DRIFT_SAMPLES; i++, utc += HOUR)
+	{
+		if (!sim_sync(&clock, &drift, utc))
+		{
+			return false;
+		}
+	}
+	// UTC is corrected by 5 s, e.g. the server was wrong before
+	if (clock_drift_add(&drift, sim_local(&clock, utc), utc + 5 * SECOND) || clock_drift_ready(&drift))
+	{
+		return false;
+	}
+	if (prediction_error(&clock, &drift, utc) != 5 * SECOND)
+	{
+		return false;
+	}
+	// Model continues from the new time base
+	for (int i = 1; i <= CLOCK_DRIFT_SAMPLES; i++)
+	{
+		int64_t local = sim_local(&clock, utc + i * HOUR);
+		if (!clock_drift_add(&drift, local, utc + i * HOUR + 5 * SECOND))
+		{
+			return false;
+		}
+	}
+	int64_t local = sim_local(&clock, utc + (CLOCK_DRIFT_SAMPLES + 1) * HOUR);
+	int64_t error = clock_drift_to_utc(&drift, local) - (utc + (CLOCK_DRIFT_SAMPLES + 1) * HOUR + 5 * SECOND);
+	return clock_drift_ready(&drift) && error > -1000 && error < 1000;
+}
+
+/**
+ * Add synchronization with given error to model fitted from two exact synchronizations.
+ */
+static bool add_with_error(int64_t error_us)
+{
+	sim_clock_t clock = { 25000, 1, 0 };
+	clock_drift_t drift;
+	clock_drift_init(&drift, JUMP_US, MAX_DRIFT_PPM);
+	sim_sync(&clock, &drift, UTC_START);
+	sim_sync(&clock, &drift, UTC_START + HOUR);
+	int64_t utc = UTC_START + 2 * HOUR;
+	return clock_drift_add(&drift, sim_local(&clock, utc), utc + error_us);
+}
+
+/**
+ * Error up to the threshold is accepted as noise, larger one is a jump in both directions.
+ */
+static bool test_jump_threshold(void)
+{
+	return add_with_error(JUMP_US - 10) && add_with_error(-JUMP_US + 10) && !add_with_error(JUMP_US + 10)
+			&& !add_with_error(-JUMP_US - 10);
+}
+
+/**
+ * Before drift is fitted, skew up to max_drift_ppm over the elapsed time is not a jump.
+ */
+static bool test_second_sync_tolerance(void)
+{
+	sim_clock_t clock = { MAX_DRIFT_PPM * 1000 - 1000, 1, 0 };
+	clock_drift_t drift;
+	clock_drift_init(&drift, JUMP_US, MAX_DRIFT_PPM);
+	sim_sync(&clock, &drift, UTC_START);
+	// 99 ppm over 6 hours is 2.1 s, far above JUMP_US
+	if (!sim_sync(&clock, &drift, UTC_START + 6 * HOUR) || !clock_drift_ready(&drift))
+	{
+		return false;
+	}
+	// Clock out of specification is considered jumping
+	clock.skew_ppb = 3 * MAX_DRIFT_PPM * 1000;
+	clock_drift_init(&drift, JUMP_US, MAX_DRIFT_PPM);
+	sim_sync(&clock, &drift, UTC_START);
+	return !sim_sync(&clock, &drift, UTC_START + 6 * HOUR);
+}
+
+/**
+ * Simulated local clock with skew wandering against UTC. The skew is constant within each
+ * minute of UTC, the clock only moves forward.
+ */
+typedef struct wander_clock
+{
+	int64_t utc_us;
+	int64_t local_us;
+	int64_t skew_ppb;
+	int64_t walk_ppb;
+	uint32_t random_state;
+} wander_clock_t;
+
+static void wander_update(wander_clock_t* clock)
+{
+	clock->walk_ppb += (int64_t)(test_random(&clock->random_state) % 41) - 20;
+	if (clock->walk_ppb > WANDER_WALK_PPB || clock->walk_ppb < -WANDER_WALK_PPB)
+	{
+		clock->walk_ppb = clock->walk_ppb > 0 ? WANDER_WALK_PPB : -WANDER_WALK_PPB;
+	}
+	// Triangle wave, coldest at midnight and warmest at noon
+	int64_t time_of_day = (clock->utc_us - UTC_START) % DAY;
+	int64_t triangle = time_of_day < DAY / 2 ? time_of_day : DAY - time_of_day;
+	clock->skew_ppb = WANDER_BASE_PPB + WANDER_DAILY_PPB * 4 * triangle / DAY - WANDER_DAILY_PPB
+			+ clock->walk_ppb;
+}
+
+static void wander_init(wander_clock_t* clock, uint32_t seed)
+{
+	clock->utc_us = UTC_START;
+	clock->local_us = LOCAL_START;
+	clock->walk_ppb = 0;
+	clock->random_state = seed;
+	wander_update(clock);
+}
+
+static int64_t wander_segment_end(const wander_clock_t* clock)
+{
+	return clock->utc_us - (clock->utc_us - UTC_START) % MINUTE + MINUTE;
+}
+
+static void wander_to_utc(wander_clock_t* clock, int64_t utc_us)
+{
+	while (clock->utc_us < utc_us)
+	{
+		int64_t segment_end = wander_segment_end(clock);
+		int64_t end = segment_end < utc_us ? segment_end : utc_us;
+		int64_t elapsed = end - clock->utc_us;
+		clock->local_us += elapsed + elapsed * clock->skew_ppb / 1000000000;
+		clock->utc_us = end;
+		if (end == segment_end)
+		{
+			wander_update(clock);
+		}
+	}
+}
+
+static void wander_to_local(wander_clock_t* clock, int64_t local_us)
+{
+	while (clock->local_us < local_us)
+	{
+		int64_t segment_end = wander_segment_end(clock);
+		int64_t elapsed = segment_end - clock->utc_us;
+		int64_t segment_local = elapsed + elapsed * clock->skew_ppb / 1000000000;
+		if (clock->local_us + segment_local > local_us)
+		{
+			clock->utc_us += (local_us - clock->local_us) * 1000000000 / (1000000000 + clock->skew_ppb);
+			clock->local_us = local_us;
+			return;
+		}
+		clock->local_us += segment_local;
+		clock->utc_us = segment_end;
+		wander_update(clock);
+	}
+}
+
+/**
+ * Measurement task over a month. Each cycle start is computed by measurement task from UTC
+ * predicted by the drift model, the task sleeps by local one-shot timer and evaluates remaining
+ * time again after each wake-up. SNTP synchronizations update the model meanwhile. Before drift
+ * is fitted the model holds the last offset, the same as system time set by SNTP. Wake-ups are
+ * compared with SNTP time, which jumps forward once.
+ */
+static bool test_cycle_alignment(void)
+{
+	measurement_config_t config = { .interval_ms = MEASUREMENT_INTERVAL, .utc_offset_ms = MEASUREMENT_OFFSET };
+	wander_clock_t clock;
+	wander_init(&clock, 11);
+	uint32_t noise_state = 5;
+	clock_drift_t drift;
+	clock_drift_init(&drift, MEASUREMENT_CLOCK_JUMP * 1000, TIME_SYNC_MAX_DRIFT);
+	int64_t sntp_offset = 0;
+	// Measurements start after the first synchronization
+	clock_drift_add(&drift, clock.local_us, UTC_START);
+	int64_t next_sync = UTC_START + SYNC_PERIOD;
+	int64_t max_error = 0;
+	int64_t max_unfitted_error = 0;
+	uint64_t last_cycle = 0;
+	size_t cycles = 0;
+	size_t jumps = 0;
+	while (clock.utc_us < UTC_START + RUN_DAYS * DAY)
+	{
+		bool jumped = false;
+		bool fitted = clock_drift_ready(&drift);
+		uint64_t utc_ms = clock_drift_to_utc(&drift, clock.local_us) / 1000;
+		int64_t target_us = (int64_t)measurement_task_next_cycle(&config, utc_ms, last_cycle) * 1000;
+		int64_t remaining_us;
+		while ((remaining_us = target_us - clock_drift_to_utc(&drift, clock.local_us)) > WAKE_TOLERANCE)
+		{
+			int64_t wake_local = clock.local_us + remaining_us
+					+ test_random(&noise_state) % (WAKE_LATENCY_US + 1);
+			for (;;)
+			{
+				wander_clock_t sync_clock = clock;
+				wander_to_utc(&sync_clock, next_sync);
+				if (sync_clock.local_us > wake_local)
+				{
+					break;
+				}
+				clock = sync_clock;
+				if (next_sync == UTC_START + RUN_DAYS / 2 * DAY)
+				{
+					sntp_offset += SYNC_JUMP_US;
+				}
+				int64_t noise = (int64_t)(test_random(&noise_state) % (2 * SYNC_NOISE_US + 1)) - SYNC_NOISE_US;
+				if (!clock_drift_add(&drift, clock.local_us, next_sync + sntp_offset + noise))
+				{
+					jumped = true;
+					jumps++;
+				}
+				fitted = fitted && clock_drift_ready(&drift);
+				next_sync += SYNC_PERIOD;
+			}
+			wander_to_local(&clock, wake_local);
+		}
+		int64_t error = clock.utc_us + sntp_offset - target_us;
+		error = error < 0 ? -error : error;
+		// Consecutive cycles are measured, the cycle with jump is late
+		if (cycles > 0 && !jumped && (uint64_t)target_us / 1000 != last_cycle + MEASUREMENT_INTERVAL)
+		{
+			printf("Cycle %u skipped or repeated\n", (unsigned)cycles);
+			return false;
+		}
+		if (jumped)
+		{
+			if (error > SYNC_JUMP_US + MAX_UNFITTED_ERROR)
+			{
+				return false;
+			}
+		}
+		else if (!fitted)
+		{
+			max_unfitted_error = error > max_unfitted_error ? error : max_unfitted_error;
+		}
+		else
+		{
+			max_error = error > max_error ? error : max_error;
+		}
+		last_cycle = target_us / 1000;
+		cycles++;
+	}
+	printf("%u cycles in %d days: max wake-up error %lld us, %lld us before drift is fitted\n",
+			(unsigned)cycles, RUN_DAYS, (long long)max_error, (long long)max_unfitted_error);
+	return jumps == 1 && cycles >= RUN_DAYS * DAY / (MEASUREMENT_INTERVAL * 1000) - 1
+			&& max_error <= MAX_ALIGNMENT_ERROR && max_unfitted_error <= MAX_UNFITTED_ERROR;
+}
+
+int main(void)
+{
+	TEST(test_single_sync());
+	TEST(test_skew(0));
+	TEST(test_skew(40000));
+	TEST(test_skew(-80000));
+	TEST(test_noisy());
+	TEST(test_jump());
+	TEST(test_jump_threshold());
+	TEST(test_second_sync_tolerance());
+	TEST(test_cycle_alignment());
+	return test_summary();
+}
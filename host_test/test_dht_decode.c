@@ -0,0 +1,225 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Tests of DHT response decoding from synthetic edge streams with interrupt latency jitter.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "dht_decode.h"
+#include "test.h"
+
+// Nominal pulse widths in us
+#define PHASE_B 30
+#define PHASE_C 80
+#define PHASE_D 80
+#define BIT_LOW 50
+#define BIT_ZERO_HIGH 27
+#define BIT_ONE_HIGH 70
+#define FINAL_LOW 50
+
+#define STREAMS 2000
+
+/**
+ * Build timestamps of the whole transaction for data bytes. Each edge is recorded late by
+ * random interrupt latency 0 - max_latency us, as GPIO interrupt would record it.
+ */
+static size_t synthesize(const uint8_t data[DHT_DATA_BYTES], int64_t* timestamps, uint32_t max_latency,
+		uint32_t* state)
+{
+	int64_t durations[DHT_TRANSACTION_EDGES - 1];
+	size_t count = 0;
+	durations[count++] = PHASE_B;
+	durations[count++] = PHASE_C;
+	durations[count++] = PHASE_D;
+	for (int i = 0; i < DHT_DATA_BITS; i++)
+	{
+		durations[count++] = BIT_LOW;
+		durations[count++] = (data[i / 8] >> (7 - i % 8)) & 1 ? BIT_ONE_HIGH : BIT_ZERO_HIGH;
+	}
+	durations[count++] = FINAL_LOW;
+
+	int64_t edge = 1000000;
+	timestamps[0] = edge;
+	for (size_t i = 0; i < count; i++)
+	{
+		edge += durations[i];
+		timestamps[i + 1] = edge + (max_latency > 0 ? test_random(state) % (max_latency + 1) : 0);
+	}
+	return count + 1;
+}
+
+static void random_data(uint8_t data[DHT_DATA_BYTES], uint32_t* state)
+{
+	for (int i = 0; i < DHT_DATA_BYTES; i++)
+	{
+		data[i] = (uint8_t)test_random(state);
+	}
+}
+
+static bool test_edge_count(void)
+{
+	uint8_t data[DHT_DATA_BYTES] = { 0 };
+	int64_t timestamps[DHT_TRANSACTION_EDGES];
+	uint32_t state = 1;
+	return synthesize(data, timestamps, 0, &state) == DHT_TRANSACTION_EDGES;
+}
+
+/**
+ * Decode random data with latency up to max_latency and return number of failures.
+ */
+static int decode_jittered(uint32_t max_latency, size_t skip)
+{
+	uint32_t state = 11 + max_latency;
+	int failures = 0;
+	for (int i = 0; i < STREAMS; i++)
+	{
+		uint8_t data[DHT_DATA_BYTES];
+		uint8_t decoded[DHT_DATA_BYTES];
+		int64_t timestamps[DHT_TRANSACTION_EDGES];
+		random_data(data, &state);
+		size_t count = synthesize(data, timestamps, max_latency, &state);
+		// Leading edges are skipped as if the interrupt handler was added late
+		uint8_t first_level = (uint8_t)((1 ^ skip) & 1);
+		if (dht_decode_edges(&timestamps[skip], count - skip, first_level, decoded) != ESP_OK
+				|| memcmp(data, decoded, sizeof(data)) != 0)
+		{
+			failures++;
+		}
+	}
+	return failures;
+}
+
+static bool test_missing_edge(void)
+{
+	uint32_t state = 5;
+	uint8_t data[DHT_DATA_BYTES];
+	uint8_t decoded[DHT_DATA_BYTES];
+	int64_t timestamps[DHT_TRANSACTION_EDGES];
+	random_data(data, &state);
+	size_t count = synthesize(data, timestamps, 5, &state);
+	// Edge lost in the middle of data merges two pulses into one too long or misaligns levels
+	memmove(&timestamps[40], &timestamps[41], (count - 41) * sizeof(int64_t));
+	return dht_decode_edges(timestamps, count - 1, 1, decoded) != ESP_OK;
+}
+
+static bool test_truncated(void)
+{
+	uint32_t state = 6;
+	uint8_t data[DHT_DATA_BYTES];
+	uint8_t decoded[DHT_DATA_BYTES];
+	int64_t timestamps[DHT_TRANSACTION_EDGES];
+	random_data(data, &state);
+	synthesize(data, timestamps, 0, &state);
+	// Capture timed out before the last bits
+	return dht_decode_edges(timestamps, DHT_TRANSACTION_EDGES / 2, 1, decoded) == ESP_ERR_TIMEOUT
+			&& dht_decode_edges(timestamps, 0, 1, decoded) == ESP_ERR_TIMEOUT;
+}
+
+static bool test_stretched_pulse(void)
+{
+	uint32_t state = 7;
+	uint8_t data[DHT_DATA_BYTES];
+	uint8_t decoded[DHT_DATA_BYTES];
+	int64_t timestamps[DHT_TRANSACTION_EDGES];
+	random_data(data, &state);
+	size_t count = synthesize(data, timestamps, 0, &state);
+	// Interrupt blocked for 200 us stretches one bit beyond the limit
+	for (size_t i = 30; i < count; i++)
+	{
+		timestamps[i] += 200;
+	}
+	return dht_decode_edges(timestamps, count, 1, decoded) == ESP_ERR_TIMEOUT;
+}
+
+static bool test_out_of_order(void)
+{
+	uint32_t state = 8;
+	uint8_t data[DHT_DATA_BYTES];
+	uint8_t decoded[DHT_DATA_BYTES];
+	int64_t timestamps[DHT_TRANSACTION_EDGES];
+	random_data(data, &state);
+	size_t count = synthesize(data, timestamps, 0, &state);
+	int64_t swap = timestamps[50];
+	timestamps[50] = timestamps[51];
+	timestamps[51] = swap;
+	return dht_decode_edges(timestamps, count, 1, decoded) == ESP_ERR_TIMEOUT;
+}
+
+static bool test_too_many_edges(void)
+{
+	uint8_t decoded[DHT_DATA_BYTES];
+	int64_t timestamps[DHT_TRANSACTION_EDGES + 1] = { 0 };
+	return dht_decode_edges(timestamps, DHT_TRANSACTION_EDGES + 1, 1, decoded) == ESP_ERR_INVALID_SIZE;
+}
+
+/**
+ * RMT capture ends with idle high line, which is ignored.
+ */
+static bool test_pulses_idle_tail(void)
+{
+	static const uint8_t data[DHT_DATA_BYTES] = { 0x02, 0x8C, 0x01, 0x5F, 0xEE };
+	dht_pulse_t pulses[DHT_RESPONSE_PULSES + 2];
+	size_t count = 0;
+	pulses[count++] = (dht_pulse_t) { PHASE_C, 0 };
+	pulses[count++] = (dht_pulse_t) { PHASE_D, 1 };
+	for (int i = 0; i < DHT_DATA_BITS; i++)
+	{
+		pulses[count++] = (dht_pulse_t) { BIT_LOW, 0 };
+		pulses[count++] = (dht_pulse_t) { (data[i / 8] >> (7 - i % 8)) & 1 ? BIT_ONE_HIGH : BIT_ZERO_HIGH, 1 };
+	}
+	pulses[count++] = (dht_pulse_t) { FINAL_LOW, 0 };
+	pulses[count++] = (dht_pulse_t) { 1000, 1 };
+	uint8_t decoded[DHT_DATA_BYTES];
+	return dht_decode_pulses(pulses, count, decoded) == ESP_OK && memcmp(data, decoded, sizeof(data)) == 0;
+}
+
+int main(void)
+{
+	TEST(test_edge_count());
+	TEST(decode_jittered(0, 0) == 0);
+	TEST(decode_jittered(5, 0) == 0);
+	// Bit value compares high and low pulse, nominal difference is 20 us, so widths may
+	// vary by less than +-10 us
+	TEST(decode_jittered(8, 0) == 0);
+	TEST(decode_jittered(8, 1) == 0);
+	// Start of phase 'C' is needed to measure its length
+	TEST(decode_jittered(8, 2) == STREAMS);
+	TEST(decode_jittered(12, 0) > 0);
+	TEST(test_missing_edge());
+	TEST(test_truncated());
+	TEST(test_stretched_pulse());
+	TEST(test_out_of_order());
+	TEST(test_too_many_edges());
+	TEST(test_pulses_idle_tail());
+	return test_summary();
+}
@@ -0,0 +1,238 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Tests of measurement on simulated sensors read by reader tasks and publishing of samples
+ * through MQTT handler to capturing MQTT client, one CBOR message per sample.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <mqtt_client.h>
+
+#include "measurement.h"
+#include "measurement_task.h"
+#include "mqtt_handler.h"
+#include "payload_decoder.h"
+#include "platform_measurement.h"
+#include "test.h"
+
+#define SENSOR_COUNT 3
+#define TOPIC "sensor/temp"
+// Short cycle, so the periodical task is tested in real time
+#define TASK_INTERVAL 50
+#define TASK_CYCLES 5
+// Maximal difference in ms between sample timestamp and cycle start
+#define TASK_ALIGNMENT 10
+// Timeout returned by callback, it is called several times without values between cycles
+#define TASK_TIMEOUT 10
+
+/**
+ * Check that value is within walk limit of simulated sensor around its base value.
+ */
+static bool check_simulated(const measurement_values_t* values)
+{
+	int16_t temperature = 215 + values->sensor * 10;
+	int16_t humidity = 650 - values->sensor * 10;
+	return values->temperature >= temperature - 50 && values->temperature <= temperature + 50
+			&& values->humidity >= humidity - 50 && values->humidity <= humidity + 50;
+}
+
+/**
+ * Decode captured message and compare it with published values.
+ */
+static bool check_message(size_t index, const measurement_values_t* values)
+{
+	host_mqtt_message_t message;
+	char device_id[16];
+	payload_sample_t sample;
+	if (!host_mqtt_message_get(index, &message) || strcmp(message.topic, TOPIC) != 0 || message.qos != 1)
+	{
+		return false;
+	}
+	if (payload_decode_cbor(message.payload, message.length, device_id, sizeof(device_id), &sample, 1) != 1)
+	{
+		return false;
+	}
+	return strcmp(device_id, measurement_sensor_id(values->sensor)) == 0
+			&& sample.temperature == values->temperature
+			&& sample.humidity == values->humidity
+			&& sample.utc_timestamp == values->utc_timestamp;
+}
+
+/**
+ * All sensors are read once by reader tasks, each of them is returned exactly once.
+ */
+static bool test_read(void)
+{
+	measurement_values_t values[PLATFORM_MEASUREMENT_MAX_SENSORS];
+	size_t count = 0;
+	if (measurement_sensor_count() != SENSOR_COUNT || measurement_read(values, &count) != ESP_OK
+			|| count != SENSOR_COUNT)
+	{
+		return false;
+	}
+	bool seen[SENSOR_COUNT] = { false };
+	for (size_t i = 0; i < count; i++)
+	{
+		if (values[i].sensor >= SENSOR_COUNT || seen[values[i].sensor] || !check_simulated(&values[i]))
+		{
+			return false;
+		}
+		seen[values[i].sensor] = true;
+	}
+	return true;
+}
+
+/**
+ * Read values are published one message per sample and the payload decodes to the same values.
+ */
+static bool test_publish(void)
+{
+	measurement_values_t values[PLATFORM_MEASUREMENT_MAX_SENSORS];
+	size_t count = 0;
+	host_mqtt_clear();
+	for (uint64_t cycle = 0; cycle < 4; cycle++)
+	{
+		if (measurement_read(values, &count) != ESP_OK)
+		{
+			return false;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			values[i].utc_timestamp = 1572982980000ULL + cycle * 60000;
+		}
+		size_t first = host_mqtt_message_count();
+		if (mqtt_handler_publish_values(values, count) != ESP_OK
+				|| host_mqtt_message_count() != first + count)
+		{
+			return false;
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!check_message(first + i, &values[i]))
+			{
+				return false;
+			}
+		}
+	}
+	return mqtt_handler_wait_published(100) == ESP_OK;
+}
+
+/**
+ * Publishing fails while the broker is not reachable, there is no offline queue.
+ */
+static bool test_publish_disconnected(void)
+{
+	measurement_values_t values[PLATFORM_MEASUREMENT_MAX_SENSORS];
+	size_t count = 0;
+	host_mqtt_clear();
+	host_mqtt_set_reachable(false);
+	bool failed = measurement_read(values, &count) == ESP_OK
+			&& mqtt_handler_publish_values(values, count) != ESP_OK
+			&& mqtt_handler_wait_connected(10) == ESP_ERR_TIMEOUT;
+	host_mqtt_set_reachable(true);
+	return failed && host_mqtt_message_count() == 0 && mqtt_handler_wait_connected(10) == ESP_OK;
+}
+
+static atomic_int task_idle_calls;
+
+static uint32_t task_publish_cb(const measurement_values_t* values, size_t count, void* context)
+{
+	(void)context;
+	if (count == 0)
+	{
+		atomic_fetch_add(&task_idle_calls, 1);
+	}
+	mqtt_handler_publish_values(values, count);
+	return TASK_TIMEOUT;
+}
+
+/**
+ * Periodical task measures all sensors at cycle starts and publisher task publishes them.
+ * Publisher calls the callback without values after the returned timeout.
+ */
+static bool test_task(void)
+{
+	measurement_config_t config = { .interval_ms = TASK_INTERVAL, .utc_offset_ms = 0 };
+	host_mqtt_clear();
+	if (measurement_task_init(config) != ESP_OK || measurement_task_start(task_publish_cb, NULL) != ESP_OK)
+	{
+		return false;
+	}
+	if (!host_mqtt_wait_messages(TASK_CYCLES * SENSOR_COUNT, TASK_CYCLES * TASK_INTERVAL * 4))
+	{
+		return false;
+	}
+	for (size_t i = 0; i < TASK_CYCLES * SENSOR_COUNT; i++)
+	{
+		host_mqtt_message_t message;
+		char device_id[16];
+		payload_sample_t sample;
+		if (!host_mqtt_message_get(i, &message) || payload_decode_cbor(message.payload, message.length,
+				device_id, sizeof(device_id), &sample, 1) != 1)
+		{
+			return false;
+		}
+		uint64_t phase = (sample.utc_timestamp + TASK_ALIGNMENT) % TASK_INTERVAL;
+		if (phase > 2 * TASK_ALIGNMENT)
+		{
+			printf("Sample %u taken %d ms from cycle start\n", (unsigned)i, (int)phase - TASK_ALIGNMENT);
+			return false;
+		}
+	}
+	measurement_jitter_t jitter;
+	measurement_task_get_jitter(&jitter);
+	printf("Wake-up jitter: min %d us, max %d us, mean %u us\n", jitter.min_us, jitter.max_us,
+			(unsigned)(jitter.sum_abs_us / jitter.count));
+	int idle_calls = atomic_load(&task_idle_calls);
+	printf("Publisher calls without values: %d\n", idle_calls);
+	return jitter.count >= TASK_CYCLES && idle_calls >= TASK_CYCLES;
+}
+
+int main(void)
+{
+	mqtt_handler_config_t config = { .host = "localhost", .topic = TOPIC };
+	TEST(measurement_init() == ESP_OK);
+	TEST(mqtt_handler_init(config) == ESP_OK);
+	TEST(mqtt_handler_start() == ESP_OK);
+	TEST(mqtt_handler_wait_connected(100) == ESP_OK);
+	TEST(test_read());
+	TEST(test_publish());
+	TEST(test_publish_disconnected());
+	// Tasks cannot be deleted by host shim, so the periodical task runs until exit
+	TEST(test_task());
+	return test_summary();
+}
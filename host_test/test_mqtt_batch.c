@@ -0,0 +1,259 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Tests of batch publishing of measured samples through MQTT handler to capturing MQTT
+ * client. Batches of MQTT_BATCH_SIZE samples per sensor are published in delta format when full
+ * or when the oldest sample reaches MQTT_BATCH_TIMEOUT.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <mqtt_client.h>
+
+#include "measurement.h"
+#include "mqtt_handler.h"
+#include "payload_decoder.h"
+#include "platform_measurement.h"
+#include "test.h"
+
+#define SENSOR_COUNT 3
+#define TOPIC "sensor/temp"
+
+#define MAX_HISTORY 32
+
+static measurement_values_t history[SENSOR_COUNT][MAX_HISTORY];
+static size_t history_count[SENSOR_COUNT];
+static payload_sample_t published[SENSOR_COUNT][MAX_HISTORY];
+static size_t published_count[SENSOR_COUNT];
+// Samples are aged against the current time, so timestamps start at the test start
+static uint64_t start_utc;
+
+/**
+ * Read all sensors as one cycle and remember the values for checking of published batches.
+ */
+static esp_err_t read_cycle(uint64_t cycle, esp_err_t* publish_result)
+{
+	measurement_values_t values[PLATFORM_MEASUREMENT_MAX_SENSORS];
+	size_t count = 0;
+	esp_err_t result = measurement_read(values, &count);
+	if (result != ESP_OK || count != SENSOR_COUNT)
+	{
+		return ESP_FAIL;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		values[i].utc_timestamp = start_utc + cycle;
+		history[values[i].sensor][history_count[values[i].sensor]++] = values[i];
+	}
+	*publish_result = mqtt_handler_publish_values(values, count);
+	return ESP_OK;
+}
+
+static void reset(void)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	start_utc = (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+	host_mqtt_clear();
+	memset(history_count, 0, sizeof(history_count));
+	memset(published_count, 0, sizeof(published_count));
+}
+
+/**
+ * Decode all captured batches into published samples of each sensor.
+ * @return false if any message is malformed or larger than the batch.
+ */
+static bool collect(void)
+{
+	memset(published_count, 0, sizeof(published_count));
+	for (size_t i = 0; i < host_mqtt_message_count(); i++)
+	{
+		host_mqtt_message_t message;
+		char device_id[16];
+		payload_sample_t samples[MQTT_BATCH_SIZE + 1];
+		if (!host_mqtt_message_get(i, &message) || strcmp(message.topic, TOPIC) != 0)
+		{
+			return false;
+		}
+		int32_t count = payload_decode_delta(message.payload, message.length, device_id, sizeof(device_id),
+				samples, MQTT_BATCH_SIZE + 1);
+		size_t sensor = 0;
+		while (sensor < SENSOR_COUNT && strcmp(device_id, measurement_sensor_id(sensor)) != 0)
+		{
+			sensor++;
+		}
+		if (count <= 0 || count > MQTT_BATCH_SIZE || sensor == SENSOR_COUNT
+				|| published_count[sensor] + count > MAX_HISTORY)
+		{
+			return false;
+		}
+		memcpy(&published[sensor][published_count[sensor]], samples, count * sizeof(payload_sample_t));
+		published_count[sensor] += count;
+	}
+	return true;
+}
+
+/**
+ * Check that published samples of each sensor are the last samples of its history in order.
+ * @param dropped  Number of the oldest samples of each sensor which were not published
+ */
+static bool check_published(size_t dropped)
+{
+	if (!collect())
+	{
+		return false;
+	}
+	for (size_t sensor = 0; sensor < SENSOR_COUNT; sensor++)
+	{
+		if (published_count[sensor] + dropped != history_count[sensor])
+		{
+			return false;
+		}
+		for (size_t i = 0; i < published_count[sensor]; i++)
+		{
+			const measurement_values_t* values = &history[sensor][dropped + i];
+			const payload_sample_t* sample = &published[sensor][i];
+			if (sample->utc_timestamp != values->utc_timestamp
+					|| sample->temperature != values->temperature
+					|| sample->humidity != values->humidity)
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Nothing is published until a batch is full, then all batches are published together.
+ */
+static bool test_batch_full(void)
+{
+	esp_err_t publish_result;
+	reset();
+	for (uint64_t cycle = 0; cycle < MQTT_BATCH_SIZE - 1; cycle++)
+	{
+		if (read_cycle(cycle, &publish_result) != ESP_OK || publish_result != ESP_OK
+				|| host_mqtt_message_count() != 0)
+		{
+			return false;
+		}
+	}
+	if (read_cycle(MQTT_BATCH_SIZE - 1, &publish_result) != ESP_OK || publish_result != ESP_OK
+			|| host_mqtt_message_count() < SENSOR_COUNT || !collect())
+	{
+		return false;
+	}
+	// Samples of sensors read after the full one may wait for the next batch
+	return mqtt_handler_flush() == ESP_OK && check_published(0) && mqtt_handler_wait_published(100) == ESP_OK;
+}
+
+/**
+ * Partial batches are published by explicit flush.
+ */
+static bool test_flush(void)
+{
+	esp_err_t publish_result;
+	reset();
+	if (read_cycle(0, &publish_result) != ESP_OK || publish_result != ESP_OK
+			|| mqtt_handler_flush() != ESP_OK || host_mqtt_message_count() != SENSOR_COUNT
+			|| !check_published(0))
+	{
+		return false;
+	}
+	// Nothing is left to flush
+	return mqtt_handler_flush() == ESP_OK && host_mqtt_message_count() == SENSOR_COUNT;
+}
+
+/**
+ * Batches are published after the timeout also when no new samples arrive.
+ */
+static bool test_timeout(void)
+{
+	esp_err_t publish_result;
+	reset();
+	if (mqtt_handler_get_flush_timeout() != UINT32_MAX || read_cycle(0, &publish_result) != ESP_OK
+			|| publish_result != ESP_OK)
+	{
+		return false;
+	}
+	uint32_t timeout = mqtt_handler_get_flush_timeout();
+	if (timeout == 0 || timeout > MQTT_BATCH_TIMEOUT || mqtt_handler_publish_values(NULL, 0) != ESP_OK
+			|| host_mqtt_message_count() != 0)
+	{
+		return false;
+	}
+	vTaskDelay(pdMS_TO_TICKS(timeout) + 1);
+	return mqtt_handler_get_flush_timeout() == 0 && mqtt_handler_publish_values(NULL, 0) == ESP_OK
+			&& host_mqtt_message_count() == SENSOR_COUNT && check_published(0)
+			&& mqtt_handler_get_flush_timeout() == UINT32_MAX;
+}
+
+/**
+ * While disconnected the batch is kept and the oldest samples are dropped when it overflows.
+ */
+static bool test_disconnected(void)
+{
+	esp_err_t publish_result;
+	reset();
+	host_mqtt_set_reachable(false);
+	for (uint64_t cycle = 0; cycle <= MQTT_BATCH_SIZE; cycle++)
+	{
+		// Publishing fails since the first batch is full, dropped samples are reported over the failure
+		if (read_cycle(cycle, &publish_result) != ESP_OK
+				|| (publish_result == ESP_OK) != (cycle < MQTT_BATCH_SIZE - 1)
+				|| (publish_result == ESP_ERR_NO_MEM) != (cycle == MQTT_BATCH_SIZE))
+		{
+			return false;
+		}
+	}
+	host_mqtt_set_reachable(true);
+	return mqtt_handler_flush() == ESP_OK && host_mqtt_message_count() == SENSOR_COUNT && check_published(1);
+}
+
+int main(void)
+{
+	mqtt_handler_config_t config = { .host = "localhost", .topic = TOPIC };
+	TEST(measurement_init() == ESP_OK);
+	TEST(mqtt_handler_init(config) == ESP_OK);
+	TEST(mqtt_handler_start() == ESP_OK);
+	TEST(test_batch_full());
+	TEST(test_flush());
+	TEST(test_timeout());
+	TEST(test_disconnected());
+	mqtt_handler_stop();
+	mqtt_handler_deinit();
+	return test_summary();
+}
@@ -0,0 +1,328 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Tests of offline queue on file backed flash partition, including restore after reboot,
+ * wrapping of the ring and removal of peeked samples while the producer drops full sectors.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#include "offline_queue.h"
+#include "test.h"
+
+#define PARTITION_LABEL "sample_log"
+#define PARTITION_FILE "offline_queue_test.bin"
+#define PARTITION_SECTORS 4
+// Record slots in sector, see offline_queue.c
+#define SECTOR_SLOTS ((SPI_FLASH_SEC_SIZE - 16) / 16)
+#define BATCH 16
+#define CONCURRENT_SAMPLES 5000
+
+static bool open_queue(bool erase)
+{
+	if (erase)
+	{
+		host_partition_close();
+		remove(PARTITION_FILE);
+	}
+	return host_partition_open(PARTITION_LABEL, PARTITION_FILE, PARTITION_SECTORS * SPI_FLASH_SEC_SIZE) == ESP_OK
+			&& offline_queue_init(PARTITION_LABEL) == ESP_OK;
+}
+
+static measurement_values_t sample(uint64_t index)
+{
+	measurement_values_t values;
+	values.temperature = (int16_t)(index % 500) - 250;
+	values.humidity = index % 1000;
+	values.utc_timestamp = index;
+	values.sensor = index % 3;
+	return values;
+}
+
+static bool push_range(uint64_t first, uint64_t last)
+{
+	for (uint64_t i = first; i <= last; i++)
+	{
+		measurement_values_t values = sample(i);
+		if (offline_queue_push(&values) != ESP_OK)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Peek expecting samples first, first + 1, ... and return number of peeked samples or -1.
+ */
+static int32_t peek_expect(uint64_t first, offline_queue_id_t* last_id)
+{
+	measurement_values_t values[BATCH];
+	size_t count;
+	if (offline_queue_peek(values, BATCH, &count, last_id) != ESP_OK)
+	{
+		return -1;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		measurement_values_t expected = sample(first + i);
+		if (values[i].utc_timestamp != expected.utc_timestamp || values[i].sensor != expected.sensor
+				|| values[i].temperature != expected.temperature || values[i].humidity != expected.humidity)
+		{
+			return -1;
+		}
+	}
+	return (int32_t)count;
+}
+
+static bool test_empty(void)
+{
+	offline_queue_id_t last_id;
+	return open_queue(true) && offline_queue_count() == 0 && peek_expect(0, &last_id) == 0;
+}
+
+static bool test_push_peek_pop(void)
+{
+	offline_queue_id_t last_id;
+	if (!open_queue(true) || !push_range(1, 40) || offline_queue_count() != 40)
+	{
+		return false;
+	}
+	if (peek_expect(1, &last_id) != BATCH || offline_queue_pop(last_id) != ESP_OK)
+	{
+		return false;
+	}
+	// Repeated pop with the same identifier does nothing
+	return offline_queue_count() == 40 - BATCH && offline_queue_pop(last_id) == ESP_OK
+			&& offline_queue_count() == 40 - BATCH && peek_expect(1 + BATCH, &last_id) == BATCH;
+}
+
+/**
+ * Pending samples are restored from flash after reboot, removed ones are not.
+ */
+static bool test_restore(void)
+{
+	offline_queue_id_t last_id;
+	if (!open_queue(true) || !push_range(1, SECTOR_SLOTS + 10))
+	{
+		return false;
+	}
+	peek_expect(1, &last_id);
+	offline_queue_pop(last_id);
+	if (!open_queue(false) || offline_queue_count() != SECTOR_SLOTS + 10 - BATCH)
+	{
+		return false;
+	}
+	return peek_expect(1 + BATCH, &last_id) == BATCH && push_range(SECTOR_SLOTS + 11, SECTOR_SLOTS + 20)
+			&& open_queue(false) && offline_queue_count() == SECTOR_SLOTS + 20 - BATCH;
+}
+
+/**
+ * When the ring is full, the oldest sector is erased and the newest samples are kept.
+ */
+static bool test_wrap(void)
+{
+	offline_queue_id_t last_id;
+	uint64_t last = 3 * PARTITION_SECTORS * SECTOR_SLOTS + 7;
+	if (!open_queue(true) || !push_range(1, last))
+	{
+		return false;
+	}
+	size_t count = offline_queue_count();
+	if (count < (PARTITION_SECTORS - 1) * SECTOR_SLOTS || count > PARTITION_SECTORS * SECTOR_SLOTS)
+	{
+		return false;
+	}
+	// Drain everything in batches, samples must continue without gaps up to the last one
+	uint64_t next = last - count + 1;
+	int32_t peeked;
+	while ((peeked = peek_expect(next, &last_id)) > 0)
+	{
+		offline_queue_pop(last_id);
+		next += peeked;
+	}
+	return peeked == 0 && next == last + 1 && offline_queue_count() == 0 && open_queue(false)
+			&& offline_queue_count() == 0;
+}
+
+/**
+ * Sector with peeked samples is dropped by producer before they are removed. Removal must not
+ * touch samples stored after the peek.
+ */
+static bool test_pop_after_drop(void)
+{
+	offline_queue_id_t last_id;
+	uint64_t last = (PARTITION_SECTORS - 1) * SECTOR_SLOTS;
+	if (!open_queue(true) || !push_range(1, last) || peek_expect(1, &last_id) != BATCH)
+	{
+		return false;
+	}
+	// Fill the last sector and start the first one again, which drops its samples
+	if (!push_range(last + 1, last + SECTOR_SLOTS + 1))
+	{
+		return false;
+	}
+	size_t count = offline_queue_count();
+	if (count != (PARTITION_SECTORS - 1) * SECTOR_SLOTS + 1 || offline_queue_pop(last_id) != ESP_OK)
+	{
+		return false;
+	}
+	return offline_queue_count() == count && peek_expect(SECTOR_SLOTS + 1, &last_id) == BATCH;
+}
+
+/**
+ * Identifier of sample in reused sector is larger than identifiers of all older samples.
+ */
+static bool test_reused_sector(void)
+{
+	offline_queue_id_t old_id;
+	offline_queue_id_t new_id;
+	uint64_t last = PARTITION_SECTORS * SECTOR_SLOTS + 1;
+	if (!open_queue(true) || !push_range(1, last))
+	{
+		return false;
+	}
+	uint64_t first = last - offline_queue_count() + 1;
+	if (peek_expect(first, &old_id) != BATCH)
+	{
+		return false;
+	}
+	measurement_values_t values[1];
+	size_t count = 0;
+	while (offline_queue_count() > 1)
+	{
+		offline_queue_peek(values, 1, &count, &new_id);
+		offline_queue_pop(new_id);
+	}
+	offline_queue_peek(values, 1, &count, &new_id);
+	return count == 1 && values[0].utc_timestamp == last && new_id > old_id;
+}
+
+typedef struct producer_context
+{
+	SemaphoreHandle_t done;
+	volatile bool failed;
+} producer_context_t;
+
+static void producer_task(void* arg)
+{
+	producer_context_t* context = (producer_context_t*)arg;
+	for (uint64_t i = 1; i <= CONCURRENT_SAMPLES; i++)
+	{
+		measurement_values_t values = sample(i);
+		if (offline_queue_push(&values) != ESP_OK)
+		{
+			context->failed = true;
+		}
+		if (i % 64 == 0)
+		{
+			vTaskDelay(1);
+		}
+	}
+	xSemaphoreGive(context->done);
+	vTaskDelete(NULL);
+}
+
+/**
+ * Producer pushes while consumer drains with slow forwarding, so sectors are dropped between
+ * peek and pop. Consumed samples must be unique and ordered and the newest one must not be lost.
+ */
+static bool test_concurrent(void)
+{
+	if (!open_queue(true))
+	{
+		return false;
+	}
+	producer_context_t context = { xSemaphoreCreateBinary(), false };
+	if (xTaskCreate(producer_task, "producer", 4096, &context, 1, NULL) != pdPASS)
+	{
+		return false;
+	}
+	bool producing = true;
+	bool ordered = true;
+	uint64_t last_consumed = 0;
+	size_t consumed = 0;
+	for (;;)
+	{
+		if (producing && xSemaphoreTake(context.done, 0) == pdTRUE)
+		{
+			producing = false;
+		}
+		measurement_values_t values[BATCH];
+		size_t count;
+		offline_queue_id_t last_id;
+		if (offline_queue_peek(values, BATCH, &count, &last_id) != ESP_OK)
+		{
+			return false;
+		}
+		if (count == 0 && !producing)
+		{
+			break;
+		}
+		// Forwarding takes time, producer may drop the peeked sector meanwhile
+		vTaskDelay(1);
+		for (size_t i = 0; i < count; i++)
+		{
+			if (values[i].utc_timestamp <= last_consumed)
+			{
+				ordered = false;
+			}
+			last_consumed = values[i].utc_timestamp;
+		}
+		consumed += count;
+		offline_queue_pop(last_id);
+	}
+	vSemaphoreDelete(context.done);
+	printf("Consumed %u of %u samples\n", (unsigned)consumed, CONCURRENT_SAMPLES);
+	return !context.failed && ordered && last_consumed == CONCURRENT_SAMPLES && offline_queue_count() == 0;
+}
+
+int main(void)
+{
+	TEST(test_empty());
+	TEST(test_push_peek_pop());
+	TEST(test_restore());
+	TEST(test_wrap());
+	TEST(test_pop_after_drop());
+	TEST(test_reused_sector());
+	TEST(test_concurrent());
+	host_partition_close();
+	remove(PARTITION_FILE);
+	return test_summary();
+}
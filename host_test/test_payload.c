@@ -0,0 +1,422 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Round-trip tests of payload encoders and decoders and tests of decoding malformed payloads.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "payload_encoder.h"
+#include "payload_decoder.h"
+#include "test.h"
+
+#define MAX_SAMPLES 64
+#define BUFFER_SIZE 2048
+#define MUTATIONS 20000
+
+static const char* DEVICE_ID = "SENSOR1";
+
+static void random_values(measurement_values_t* values, size_t count, uint32_t* state)
+{
+	uint64_t utc = 1572982980008ULL;
+	for (size_t i = 0; i < count; i++)
+	{
+		values[i].temperature = (int16_t)(test_random(state) % 1200) - 400;
+		values[i].humidity = test_random(state) % 1001;
+		values[i].utc_timestamp = utc;
+		values[i].sensor = 0;
+		// Regular interval with wake-up jitter
+		utc += 60000 + test_random(state) % 50;
+	}
+}
+
+static bool samples_match(const measurement_values_t* values, const payload_sample_t* samples, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (samples[i].temperature != values[i].temperature
+				|| samples[i].humidity != values[i].humidity
+				|| samples[i].utc_timestamp != values[i].utc_timestamp)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool test_json(void)
+{
+	measurement_values_t values[2] = {
+		{ 1572982980008ULL, 211, 709, 0 },
+		{ 1572983040008ULL, -4, 50, 0 },
+	};
+	char buffer[256];
+	size_t length = payload_encode_json(&values[0], DEVICE_ID, buffer, sizeof(buffer));
+	const char* expected = "{\"id\":\"SENSOR1\",\"temperature\":21.1,\"humidity\":70.9,\"utc\":1572982980008}";
+	if (length != strlen(expected) || strcmp(buffer, expected) != 0)
+	{
+		return false;
+	}
+	length = payload_encode_json_batch(values, 2, DEVICE_ID, buffer, sizeof(buffer));
+	expected = "{\"id\":\"SENSOR1\",\"temperature\":[21.1,-0.4],\"humidity\":[70.9,5.0],"
+			"\"utc\":[1572982980008,1572983040008]}";
+	return length == strlen(expected) && strcmp(buffer, expected) == 0;
+}
+
+static bool test_json_escape(void)
+{
+	measurement_values_t values = { 1, 200, 500, 0 };
+	char buffer[256];
+	payload_encode_json(&values, "a\"b\\c", buffer, sizeof(buffer));
+	return strstr(buffer, "\"id\":\"a\\\"b\\\\c\"") != NULL;
+}
+
+/**
+ * Every buffer shorter than the payload fails and leaves empty string.
+ */
+static bool test_json_small_buffer(void)
+{
+	measurement_values_t values = { 1572982980008ULL, 211, 709, 0 };
+	char buffer[128];
+	size_t length = payload_encode_json(&values, DEVICE_ID, buffer, sizeof(buffer));
+	for (size_t size = 1; size <= length; size++)
+	{
+		memset(buffer, 'x', sizeof(buffer));
+		if (payload_encode_json(&values, DEVICE_ID, buffer, size) != 0 || buffer[0] != '\0')
+		{
+			return false;
+		}
+	}
+	return payload_encode_json(&values, DEVICE_ID, buffer, length + 1) == length;
+}
+
+static bool test_binary_round_trip(size_t count)
+{
+	uint32_t state = 100 + count;
+	measurement_values_t values[MAX_SAMPLES];
+	payload_sample_t samples[MAX_SAMPLES];
+	uint8_t buffer[BUFFER_SIZE];
+	char device_id[16];
+	random_values(values, count, &state);
+	size_t length = payload_encode_binary(values, count, DEVICE_ID, buffer, sizeof(buffer));
+	if (length != 2 + strlen(DEVICE_ID) + 2 + count * PAYLOAD_BINARY_SAMPLE_SIZE)
+	{
+		return false;
+	}
+	int32_t decoded = payload_decode_binary(buffer, length, device_id, sizeof(device_id), samples, MAX_SAMPLES);
+	return decoded == (int32_t)count && strcmp(device_id, DEVICE_ID) == 0 && samples_match(values, samples, count);
+}
+
+static bool test_cbor_round_trip(size_t count)
+{
+	uint32_t state = 200 + count;
+	measurement_values_t values[MAX_SAMPLES];
+	payload_sample_t samples[MAX_SAMPLES];
+	uint8_t buffer[BUFFER_SIZE];
+	char device_id[16];
+	random_values(values, count, &state);
+	size_t length = count == 1 ? payload_encode_cbor(values, DEVICE_ID, buffer, sizeof(buffer))
+			: payload_encode_cbor_batch(values, count, DEVICE_ID, buffer, sizeof(buffer));
+	if (length == 0)
+	{
+		return false;
+	}
+	int32_t decoded = payload_decode_cbor(buffer, length, device_id, sizeof(device_id), samples, MAX_SAMPLES);
+	return decoded == (int32_t)count && strcmp(device_id, DEVICE_ID) == 0 && samples_match(values, samples, count);
+}
+
+static bool test_delta_round_trip(size_t count)
+{
+	uint32_t state = 250 + count;
+	measurement_values_t values[MAX_SAMPLES];
+	payload_sample_t samples[MAX_SAMPLES];
+	uint8_t buffer[BUFFER_SIZE];
+	char device_id[16];
+	random_values(values, count, &state);
+	size_t length = payload_encode_delta(values, count, DEVICE_ID, buffer, sizeof(buffer));
+	if (length == 0)
+	{
+		return false;
+	}
+	int32_t decoded = payload_decode_delta(buffer, length, device_id, sizeof(device_id), samples, MAX_SAMPLES);
+	return decoded == (int32_t)count && strcmp(device_id, DEVICE_ID) == 0 && samples_match(values, samples, count);
+}
+
+/**
+ * Irregular timestamps and extreme values use long varints, but still round trip.
+ */
+static bool test_delta_extremes(void)
+{
+	measurement_values_t values[4] = {
+		{ 0, INT16_MAX, INT16_MIN, 0 },
+		{ UINT64_MAX / 2, INT16_MIN, INT16_MAX, 0 },
+		{ UINT64_MAX / 2 + 1, 0, 0, 0 },
+		{ UINT64_MAX, INT16_MAX, INT16_MIN, 0 },
+	};
+	payload_sample_t samples[4];
+	uint8_t buffer[BUFFER_SIZE];
+	char device_id[16];
+	size_t length = payload_encode_delta(values, 4, DEVICE_ID, buffer, sizeof(buffer));
+	return length > 0 && payload_decode_delta(buffer, length, device_id, sizeof(device_id), samples, 4) == 4
+			&& samples_match(values, samples, 4);
+}
+
+/**
+ * Payload cut at any position is rejected.
+ */
+static bool test_truncated(int32_t (*decode)(const uint8_t*, size_t, char*, size_t, payload_sample_t*, size_t),
+		const uint8_t* payload, size_t length)
+{
+	payload_sample_t samples[MAX_SAMPLES];
+	char device_id[16];
+	for (size_t i = 0; i < length; i++)
+	{
+		if (decode(payload, i, device_id, sizeof(device_id), samples, MAX_SAMPLES) != -1)
+		{
+			return false;
+		}
+	}
+	return decode(payload, length, device_id, sizeof(device_id), samples, MAX_SAMPLES) > 0;
+}
+
+static bool test_binary_malformed(void)
+{
+	uint32_t state = 300;
+	measurement_values_t values[4];
+	payload_sample_t samples[MAX_SAMPLES];
+	uint8_t buffer[BUFFER_SIZE];
+	char device_id[16];
+	random_values(values, 4, &state);
+	size_t length = payload_encode_binary(values, 4, DEVICE_ID, buffer, sizeof(buffer));
+	if (!test_truncated(payload_decode_binary, buffer, length))
+	{
+		return false;
+	}
+	// Trailing garbage, too small output arrays and unknown version
+	bool valid = payload_decode_binary(buffer, length + 1, device_id, sizeof(device_id), samples, MAX_SAMPLES) == -1
+			&& payload_decode_binary(buffer, length, device_id, sizeof(device_id), samples, 3) == -1
+			&& payload_decode_binary(buffer, length, device_id, strlen(DEVICE_ID), samples, MAX_SAMPLES) == -1;
+	buffer[0] = PAYLOAD_DELTA_VERSION;
+	return valid && payload_decode_binary(buffer, length, device_id, sizeof(device_id), samples, MAX_SAMPLES) == -1;
+}
+
+static bool test_cbor_malformed(void)
+{
+	uint32_t state = 400;
+	measurement_values_t values[4];
+	payload_sample_t samples[MAX_SAMPLES];
+	uint8_t buffer[BUFFER_SIZE];
+	char device_id[16];
+	random_values(values, 4, &state);
+	size_t length = payload_encode_cbor_batch(values, 4, DEVICE_ID, buffer, sizeof(buffer));
+	return test_truncated(payload_decode_cbor, buffer, length)
+			&& payload_decode_cbor(buffer, length, device_id, sizeof(device_id), samples, 3) == -1
+			&& payload_decode_cbor(buffer, length, device_id, strlen(DEVICE_ID), samples, MAX_SAMPLES) == -1;
+}
+
+static bool test_delta_malformed(void)
+{
+	uint32_t state = 450;
+	measurement_values_t values[4];
+	payload_sample_t samples[MAX_SAMPLES];
+	uint8_t buffer[BUFFER_SIZE];
+	char device_id[16];
+	random_values(values, 4, &state);
+	size_t length = payload_encode_delta(values, 4, DEVICE_ID, buffer, sizeof(buffer));
+	return test_truncated(payload_decode_delta, buffer, length)
+			&& payload_decode_delta(buffer, length, device_id, sizeof(device_id), samples, 3) == -1
+			&& payload_decode_delta(buffer, length, device_id, strlen(DEVICE_ID), samples, MAX_SAMPLES) == -1;
+}
+
+/**
+ * Differences which would overflow int64 or leave int16 range are rejected.
+ */
+static bool test_delta_difference_range(void)
+{
+	payload_sample_t samples[2];
+	char device_id[4];
+	// Version, ID "A", two samples, the first at UTC 0 with temperature 0.1 or -0.1 and humidity 0,
+	// the second with temperature difference INT64_MAX or INT64_MIN
+	static const uint8_t max_difference[] = { 0x02, 0x01, 'A', 0x02, 0x00, 0x02, 0x00,
+			0x00, 0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00 };
+	static const uint8_t min_difference[] = { 0x02, 0x01, 'A', 0x02, 0x00, 0x01, 0x00,
+			0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01, 0x00 };
+	// Two samples, temperature 3276.7 and then difference given by the byte before humidity
+	uint8_t limit[] = { 0x02, 0x01, 'A', 0x02, 0x00, 0xFE, 0xFF, 0x03, 0x00, 0x00, 0x00, 0x00 };
+	bool valid = payload_decode_delta(max_difference, sizeof(max_difference), device_id, sizeof(device_id),
+			samples, 2) == -1
+			&& payload_decode_delta(min_difference, sizeof(min_difference), device_id, sizeof(device_id),
+			samples, 2) == -1
+			&& payload_decode_delta(limit, sizeof(limit), device_id, sizeof(device_id), samples, 2) == 2
+			&& samples[1].temperature == INT16_MAX;
+	// Zigzag 2 is difference +1
+	limit[10] = 0x02;
+	return valid && payload_decode_delta(limit, sizeof(limit), device_id, sizeof(device_id), samples, 2) == -1;
+}
+
+/**
+ * Decode CBOR map with temperature as decimal fraction given by head bytes of exponent and mantissa.
+ */
+static int32_t decode_cbor_fraction(const uint8_t* fraction, size_t fraction_length, int16_t* temperature)
+{
+	uint8_t payload[64];
+	size_t length = 0;
+	static const uint8_t head[] = { 0xA4, 0x00, 0x61, 'A', 0x01, 0xC4, 0x82 };
+	static const uint8_t tail[] = { 0x02, 0xC4, 0x82, 0x20, 0x01, 0x03, 0x05 };
+	memcpy(&payload[length], head, sizeof(head));
+	length += sizeof(head);
+	memcpy(&payload[length], fraction, fraction_length);
+	length += fraction_length;
+	memcpy(&payload[length], tail, sizeof(tail));
+	length += sizeof(tail);
+	payload_sample_t sample;
+	char device_id[4];
+	int32_t count = payload_decode_cbor(payload, length, device_id, sizeof(device_id), &sample, 1);
+	*temperature = sample.temperature;
+	return count;
+}
+
+static bool test_cbor_fraction_scaling(void)
+{
+	int16_t temperature = 0;
+	// 3e3 = 30000.0 fits, 3e4 does not
+	static const uint8_t fits[] = { 0x03, 0x03 };
+	static const uint8_t too_large[] = { 0x04, 0x03 };
+	// -32768 tenths with exponent -1
+	static const uint8_t minimum[] = { 0x20, 0x39, 0x7F, 0xFF };
+	static const uint8_t below_minimum[] = { 0x20, 0x39, 0x80, 0x00 };
+	return decode_cbor_fraction(fits, sizeof(fits), &temperature) == 1 && temperature == 30000
+			&& decode_cbor_fraction(too_large, sizeof(too_large), &temperature) == -1
+			&& decode_cbor_fraction(minimum, sizeof(minimum), &temperature) == 1 && temperature == INT16_MIN
+			&& decode_cbor_fraction(below_minimum, sizeof(below_minimum), &temperature) == -1;
+}
+
+/**
+ * Mantissas which would overflow int64 when scaled by exponent are rejected.
+ */
+static bool test_cbor_fraction_overflow(void)
+{
+	int16_t temperature;
+	static const uint8_t max_positive[] = { 0x04, 0x1B, 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+	static const uint8_t max_negative[] = { 0x04, 0x3B, 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+	static const uint8_t scaled_wrap[] = { 0x01, 0x1B, 0x19, 0x99, 0x99, 0x99, 0x99, 0x99, 0x99, 0x9A };
+	static const uint8_t huge_exponent[] = { 0x1B, 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01 };
+	return decode_cbor_fraction(max_positive, sizeof(max_positive), &temperature) == -1
+			&& decode_cbor_fraction(max_negative, sizeof(max_negative), &temperature) == -1
+			&& decode_cbor_fraction(scaled_wrap, sizeof(scaled_wrap), &temperature) == -1
+			&& decode_cbor_fraction(huge_exponent, sizeof(huge_exponent), &temperature) == -1;
+}
+
+/**
+ * Random corruptions of valid payloads are either rejected or decoded within output buffers.
+ * Run with sanitizers to detect out of bounds access and undefined behavior.
+ */
+static bool test_mutations(int32_t (*decode)(const uint8_t*, size_t, char*, size_t, payload_sample_t*, size_t),
+		const uint8_t* payload, size_t length)
+{
+	uint32_t state = 500;
+	for (int i = 0; i < MUTATIONS; i++)
+	{
+		uint8_t mutated[BUFFER_SIZE];
+		payload_sample_t samples[MAX_SAMPLES];
+		char device_id[16];
+		memcpy(mutated, payload, length);
+		int changes = 1 + test_random(&state) % 4;
+		for (int j = 0; j < changes; j++)
+		{
+			mutated[test_random(&state) % length] = (uint8_t)test_random(&state);
+		}
+		int32_t count = decode(mutated, length, device_id, sizeof(device_id), samples, MAX_SAMPLES);
+		if (count < -1 || count > MAX_SAMPLES || (count >= 0 && strlen(device_id) >= sizeof(device_id)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool test_binary_mutations(void)
+{
+	uint32_t state = 600;
+	measurement_values_t values[8];
+	uint8_t buffer[BUFFER_SIZE];
+	random_values(values, 8, &state);
+	size_t length = payload_encode_binary(values, 8, DEVICE_ID, buffer, sizeof(buffer));
+	return test_mutations(payload_decode_binary, buffer, length);
+}
+
+static bool test_cbor_mutations(void)
+{
+	uint32_t state = 700;
+	measurement_values_t values[8];
+	uint8_t buffer[BUFFER_SIZE];
+	random_values(values, 8, &state);
+	size_t length = payload_encode_cbor_batch(values, 8, DEVICE_ID, buffer, sizeof(buffer));
+	return test_mutations(payload_decode_cbor, buffer, length);
+}
+
+static bool test_delta_mutations(void)
+{
+	uint32_t state = 800;
+	measurement_values_t values[8];
+	uint8_t buffer[BUFFER_SIZE];
+	random_values(values, 8, &state);
+	size_t length = payload_encode_delta(values, 8, DEVICE_ID, buffer, sizeof(buffer));
+	return test_mutations(payload_decode_delta, buffer, length);
+}
+
+int main(void)
+{
+	TEST(test_json());
+	TEST(test_json_escape());
+	TEST(test_json_small_buffer());
+	TEST(test_binary_round_trip(0));
+	TEST(test_binary_round_trip(1));
+	TEST(test_binary_round_trip(MAX_SAMPLES));
+	TEST(test_cbor_round_trip(1));
+	TEST(test_cbor_round_trip(2));
+	TEST(test_cbor_round_trip(MAX_SAMPLES));
+	TEST(test_delta_round_trip(0));
+	TEST(test_delta_round_trip(1));
+	TEST(test_delta_round_trip(MAX_SAMPLES));
+	TEST(test_delta_extremes());
+	TEST(test_binary_malformed());
+	TEST(test_cbor_malformed());
+	TEST(test_delta_malformed());
+	TEST(test_delta_difference_range());
+	TEST(test_cbor_fraction_scaling());
+	TEST(test_cbor_fraction_overflow());
+	TEST(test_binary_mutations());
+	TEST(test_cbor_mutations());
+	TEST(test_delta_mutations());
+	return test_summary();
+}
@@ -0,0 +1,216 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Tests of single producer single consumer ring, including stress test with producer
+ * and consumer in separate threads. Build with HOST_TEST_TSAN to check memory ordering.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#include "spsc_ring.h"
+#include "test.h"
+
+#define CAPACITY 8
+#define STRESS_CAPACITY 64
+#define STRESS_ITEMS 2000000
+
+/**
+ * Record larger than machine word, so torn copy of partially written slot is detected.
+ */
+typedef struct item
+{
+	uint32_t sequence;
+	uint32_t inverted;
+	uint64_t hash;
+} item_t;
+
+static item_t make_item(uint32_t sequence)
+{
+	item_t item = { sequence, ~sequence, sequence * 0x9E3779B97F4A7C15ULL };
+	return item;
+}
+
+static bool check_item(const item_t* item, uint32_t sequence)
+{
+	item_t expected = make_item(sequence);
+	return item->sequence == expected.sequence && item->inverted == expected.inverted
+			&& item->hash == expected.hash;
+}
+
+static bool test_init(void)
+{
+	spsc_ring_t ring;
+	item_t buffer[CAPACITY];
+	return !spsc_ring_init(&ring, buffer, sizeof(item_t), 0) && !spsc_ring_init(&ring, buffer, sizeof(item_t), 6)
+			&& spsc_ring_init(&ring, buffer, sizeof(item_t), CAPACITY) && spsc_ring_count(&ring) == 0;
+}
+
+static bool test_full_empty(void)
+{
+	spsc_ring_t ring;
+	item_t buffer[CAPACITY];
+	item_t item;
+	spsc_ring_init(&ring, buffer, sizeof(item_t), CAPACITY);
+	if (spsc_ring_pop(&ring, &item))
+	{
+		return false;
+	}
+	for (uint32_t i = 0; i < CAPACITY; i++)
+	{
+		item = make_item(i);
+		if (!spsc_ring_push(&ring, &item))
+		{
+			return false;
+		}
+	}
+	item = make_item(CAPACITY);
+	if (spsc_ring_push(&ring, &item) || spsc_ring_count(&ring) != CAPACITY)
+	{
+		return false;
+	}
+	for (uint32_t i = 0; i < CAPACITY; i++)
+	{
+		if (!spsc_ring_pop(&ring, &item) || !check_item(&item, i))
+		{
+			return false;
+		}
+	}
+	return !spsc_ring_pop(&ring, &item) && spsc_ring_count(&ring) == 0;
+}
+
+/**
+ * Head and tail are free running and overflow, full and empty detection must still work.
+ */
+static bool test_counter_overflow(void)
+{
+	spsc_ring_t ring;
+	item_t buffer[CAPACITY];
+	item_t item;
+	spsc_ring_init(&ring, buffer, sizeof(item_t), CAPACITY);
+	atomic_store(&ring.head, SIZE_MAX - 2);
+	atomic_store(&ring.tail, SIZE_MAX - 2);
+	uint32_t pushed = 0;
+	uint32_t popped = 0;
+	for (int round = 0; round < 4; round++)
+	{
+		while (item = make_item(pushed), spsc_ring_push(&ring, &item))
+		{
+			pushed++;
+		}
+		if (spsc_ring_count(&ring) != CAPACITY)
+		{
+			return false;
+		}
+		while (spsc_ring_pop(&ring, &item))
+		{
+			if (!check_item(&item, popped++))
+			{
+				return false;
+			}
+		}
+	}
+	return pushed == 4 * CAPACITY && popped == pushed && atomic_load(&ring.head) < SIZE_MAX - 2;
+}
+
+typedef struct stress_context
+{
+	spsc_ring_t ring;
+	item_t buffer[STRESS_CAPACITY];
+	SemaphoreHandle_t done;
+	uint32_t full;
+} stress_context_t;
+
+static void producer_task(void* arg)
+{
+	stress_context_t* context = (stress_context_t*)arg;
+	for (uint32_t i = 0; i < STRESS_ITEMS; i++)
+	{
+		item_t item = make_item(i);
+		while (!spsc_ring_push(&context->ring, &item))
+		{
+			context->full++;
+			taskYIELD();
+		}
+	}
+	xSemaphoreGive(context->done);
+	vTaskDelete(NULL);
+}
+
+/**
+ * Producer thread pushes sequence of items while the consumer pops them. Every item must
+ * arrive exactly once, in order and not torn.
+ */
+static bool test_stress(void)
+{
+	static stress_context_t context;
+	spsc_ring_init(&context.ring, context.buffer, sizeof(item_t), STRESS_CAPACITY);
+	context.done = xSemaphoreCreateBinary();
+	if (xTaskCreate(producer_task, "producer", 4096, &context, 1, NULL) != pdPASS)
+	{
+		return false;
+	}
+	uint32_t empty = 0;
+	for (uint32_t i = 0; i < STRESS_ITEMS; i++)
+	{
+		item_t item;
+		while (!spsc_ring_pop(&context.ring, &item))
+		{
+			empty++;
+			taskYIELD();
+		}
+		if (!check_item(&item, i))
+		{
+			printf("Item %u: unexpected sequence %u\n", (unsigned)i, (unsigned)item.sequence);
+			return false;
+		}
+	}
+	xSemaphoreTake(context.done, portMAX_DELAY);
+	vSemaphoreDelete(context.done);
+	item_t item;
+	printf("Transferred %u items, producer found ring full %u times, consumer empty %u times\n",
+			STRESS_ITEMS, (unsigned)context.full, (unsigned)empty);
+	return !spsc_ring_pop(&context.ring, &item);
+}
+
+int main(void)
+{
+	TEST(test_init());
+	TEST(test_full_empty());
+	TEST(test_counter_overflow());
+	TEST(test_stress());
+	return test_summary();
+}
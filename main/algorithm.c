@@ -25,16 +25,302 @@
  *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
  *  POSSIBILITY OF SUCH DAMAGE.
  */
-#include <stdlib.h>
+#include <stdbool.h>
+
 #include "algorithm.h"
 
-static int compare(const void * a, const void * b)
+// Ranges up to this size are finished by insertion sort
+#define SELECT_INSERTION_THRESHOLD 16
+
+static inline void swap(int16_t* a, int16_t* b)
+{
+	int16_t tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+static void insertion_sort(int16_t* array, size_t n)
+{
+	for (size_t i = 1; i < n; i++)
+	{
+		int16_t value = array[i];
+		size_t j = i;
+		while (j > 0 && array[j - 1] > value)
+		{
+			array[j] = array[j - 1];
+			j--;
+		}
+		array[j] = value;
+	}
+}
+
+static void sift_down(int16_t* array, size_t root, size_t n)
+{
+	for (;;)
+	{
+		size_t child = 2 * root + 1;
+		if (child >= n)
+		{
+			return;
+		}
+		if (child + 1 < n && array[child + 1] > array[child])
+		{
+			child++;
+		}
+		if (array[root] >= array[child])
+		{
+			return;
+		}
+		swap(&array[root], &array[child]);
+		root = child;
+	}
+}
+
+/**
+ * Heap sort used as the fallback with guaranteed O(n log n) when partitioning degenerates.
+ */
+static void heap_sort(int16_t* array, size_t n)
+{
+	for (size_t i = n / 2; i > 0; i--)
+	{
+		sift_down(array, i - 1, n);
+	}
+	for (size_t i = n; i > 1; i--)
+	{
+		swap(&array[0], &array[i - 1]);
+		sift_down(array, 0, i - 1);
+	}
+}
+
+int16_t select_kth(int16_t* array, size_t n, size_t k)
+{
+	size_t left = 0;
+	size_t right = n - 1;
+	// Allow 2 * log2(n) partitioning rounds before switching to heap sort (introselect)
+	uint32_t depth_limit = 0;
+	for (size_t i = n; i > 0; i >>= 1)
+	{
+		depth_limit += 2;
+	}
+
+	while (right - left + 1 > SELECT_INSERTION_THRESHOLD)
+	{
+		if (depth_limit-- == 0)
+		{
+			heap_sort(&array[left], right - left + 1);
+			return array[k];
+		}
+		// Median of three pivot moved to array[left]
+		size_t middle = left + (right - left) / 2;
+		median_sort2(&array[left], &array[middle]);
+		median_sort2(&array[middle], &array[right]);
+		median_sort2(&array[left], &array[middle]);
+		swap(&array[left], &array[middle]);
+		int16_t pivot = array[left];
+
+		// Hoare partition, array[right] >= pivot serves as a sentinel
+		size_t i = left;
+		size_t j = right + 1;
+		for (;;)
+		{
+			while (array[++i] < pivot);
+			while (array[--j] > pivot);
+			if (i >= j)
+			{
+				break;
+			}
+			swap(&array[i], &array[j]);
+		}
+		swap(&array[left], &array[j]);
+
+		if (k == j)
+		{
+			return array[k];
+		}
+		else if (k < j)
+		{
+			right = j - 1;
+		}
+		else
+		{
+			left = j + 1;
+		}
+	}
+	insertion_sort(&array[left], right - left + 1);
+	return array[k];
+}
+
+/*
+ * Running median filter. Heap array is addressed relatively to the median at index 0, max-heap
+ * of lower values grows to negative indexes and min-heap of upper values to positive ones,
+ * so the parent of index i is i / 2 in both directions.
+ */
+
+static inline bool median_filter_less(const median_filter_t* filter, int32_t i, int32_t j)
+{
+	return filter->values[filter->heap[i]] < filter->values[filter->heap[j]];
+}
+
+static inline void median_filter_exchange(median_filter_t* filter, int32_t i, int32_t j)
+{
+	int32_t tmp = filter->heap[i];
+	filter->heap[i] = filter->heap[j];
+	filter->heap[j] = tmp;
+	filter->positions[filter->heap[i]] = i;
+	filter->positions[filter->heap[j]] = j;
+}
+
+/**
+ * Swap items i and j when heap[i] < heap[j], return true if swapped.
+ */
+static inline bool median_filter_compare_exchange(median_filter_t* filter, int32_t i, int32_t j)
+{
+	if (median_filter_less(filter, i, j))
+	{
+		median_filter_exchange(filter, i, j);
+		return true;
+	}
+	return false;
+}
+
+static void median_filter_min_sort_down(median_filter_t* filter, int32_t i)
+{
+	for (i *= 2; i <= filter->min_count; i *= 2)
+	{
+		if (i < filter->min_count && median_filter_less(filter, i + 1, i))
+		{
+			i++;
+		}
+		if (!median_filter_compare_exchange(filter, i, i / 2))
+		{
+			break;
+		}
+	}
+}
+
+static void median_filter_max_sort_down(median_filter_t* filter, int32_t i)
+{
+	for (i *= 2; i >= -filter->max_count; i *= 2)
+	{
+		if (i > -filter->max_count && median_filter_less(filter, i, i - 1))
+		{
+			i--;
+		}
+		if (!median_filter_compare_exchange(filter, i / 2, i))
+		{
+			break;
+		}
+	}
+}
+
+/**
+ * Restore min-heap above i, return true if the value reached the median.
+ */
+static bool median_filter_min_sort_up(median_filter_t* filter, int32_t i)
+{
+	while (i > 0 && median_filter_compare_exchange(filter, i, i / 2))
+	{
+		i /= 2;
+	}
+	return i == 0;
+}
+
+/**
+ * Restore max-heap above i, return true if the value reached the median.
+ */
+static bool median_filter_max_sort_up(median_filter_t* filter, int32_t i)
+{
+	while (i < 0 && median_filter_compare_exchange(filter, i / 2, i))
+	{
+		i /= 2;
+	}
+	return i == 0;
+}
+
+void median_filter_init(median_filter_t* filter, int16_t* values, int32_t* positions,
+		int32_t* heap, size_t window)
+{
+	filter->values = values;
+	filter->positions = positions;
+	filter->heap = heap + window / 2;
+	filter->window = window;
+	filter->index = 0;
+	filter->count = 0;
+	filter->min_count = 0;
+	filter->max_count = 0;
+	// Ring slots are assigned to heap positions in order: median, max, min, max, min...
+	for (int32_t i = 0; i < filter->window; i++)
+	{
+		filter->positions[i] = ((i + 1) / 2) * ((i & 1) ? -1 : 1);
+		filter->heap[filter->positions[i]] = i;
+	}
+}
+
+void median_filter_insert(median_filter_t* filter, int16_t value)
+{
+	int32_t p = filter->positions[filter->index];
+	int16_t old = filter->values[filter->index];
+	filter->values[filter->index] = value;
+	filter->index = (filter->index + 1) % filter->window;
+	if (filter->count < filter->window)
+	{
+		filter->count++;
+	}
+	if (p > 0)
+	{
+		// Replaced value is in min-heap
+		if (filter->min_count < (filter->window - 1) / 2)
+		{
+			filter->min_count++;
+		}
+		else if (value > old)
+		{
+			median_filter_min_sort_down(filter, p);
+			return;
+		}
+		if (median_filter_min_sort_up(filter, p) && median_filter_compare_exchange(filter, 0, -1))
+		{
+			median_filter_max_sort_down(filter, -1);
+		}
+	}
+	else if (p < 0)
+	{
+		// Replaced value is in max-heap
+		if (filter->max_count < filter->window / 2)
+		{
+			filter->max_count++;
+		}
+		else if (value < old)
+		{
+			median_filter_max_sort_down(filter, p);
+			return;
+		}
+		if (median_filter_max_sort_up(filter, p) && filter->min_count > 0
+				&& median_filter_compare_exchange(filter, 1, 0))
+		{
+			median_filter_min_sort_down(filter, 1);
+		}
+	}
+	else
+	{
+		// Replaced value is the median
+		if (filter->max_count > 0 && median_filter_max_sort_up(filter, -1))
+		{
+			median_filter_max_sort_down(filter, -1);
+		}
+		if (filter->min_count > 0 && median_filter_min_sort_up(filter, 1))
+		{
+			median_filter_min_sort_down(filter, 1);
+		}
+	}
+}
+
+int16_t median_filter_get(const median_filter_t* filter)
 {
-	return *(int16_t*)a - *(int16_t*)b;
+	return filter->values[filter->heap[0]];
 }
 
-int16_t median(int16_t* array, size_t n)
+size_t median_filter_count(const median_filter_t* filter)
 {
-	qsort(array, n, sizeof(int16_t), compare);
-	return array[n/2];
+	return filter->count;
 }
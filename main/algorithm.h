@@ -31,6 +31,161 @@
 #include <stdio.h>
 #include <inttypes.h>
 
-int16_t median(int16_t* array, size_t n);
+/**
+ * Order two values in place so that *a <= *b. Written as min/max to compile into
+ * conditional moves instead of branches.
+ */
+static inline void median_sort2(int16_t* a, int16_t* b)
+{
+	int16_t x = *a;
+	int16_t y = *b;
+	*a = x < y ? x : y;
+	*b = x < y ? y : x;
+}
+
+/*
+ * Minimal comparator networks for selecting median of small fixed sizes.
+ */
+
+static inline int16_t median3(int16_t* p)
+{
+	median_sort2(&p[0], &p[1]); median_sort2(&p[1], &p[2]); median_sort2(&p[0], &p[1]);
+	return p[1];
+}
+
+static inline int16_t median5(int16_t* p)
+{
+	median_sort2(&p[0], &p[1]); median_sort2(&p[3], &p[4]); median_sort2(&p[0], &p[3]);
+	median_sort2(&p[1], &p[4]); median_sort2(&p[1], &p[2]); median_sort2(&p[2], &p[3]);
+	median_sort2(&p[1], &p[2]);
+	return p[2];
+}
+
+static inline int16_t median7(int16_t* p)
+{
+	median_sort2(&p[0], &p[5]); median_sort2(&p[0], &p[3]); median_sort2(&p[1], &p[6]);
+	median_sort2(&p[2], &p[4]); median_sort2(&p[0], &p[1]); median_sort2(&p[3], &p[5]);
+	median_sort2(&p[2], &p[6]); median_sort2(&p[2], &p[3]); median_sort2(&p[3], &p[6]);
+	median_sort2(&p[4], &p[5]); median_sort2(&p[1], &p[4]); median_sort2(&p[1], &p[3]);
+	median_sort2(&p[3], &p[4]);
+	return p[3];
+}
+
+static inline int16_t median9(int16_t* p)
+{
+	median_sort2(&p[1], &p[2]); median_sort2(&p[4], &p[5]); median_sort2(&p[7], &p[8]);
+	median_sort2(&p[0], &p[1]); median_sort2(&p[3], &p[4]); median_sort2(&p[6], &p[7]);
+	median_sort2(&p[1], &p[2]); median_sort2(&p[4], &p[5]); median_sort2(&p[7], &p[8]);
+	median_sort2(&p[0], &p[3]); median_sort2(&p[5], &p[8]); median_sort2(&p[4], &p[7]);
+	median_sort2(&p[3], &p[6]); median_sort2(&p[1], &p[4]); median_sort2(&p[2], &p[5]);
+	median_sort2(&p[4], &p[7]); median_sort2(&p[4], &p[2]); median_sort2(&p[6], &p[4]);
+	median_sort2(&p[4], &p[2]);
+	return p[4];
+}
+
+/**
+ * Find k-th smallest value in the array. Array elements are reordered.
+ * @param array  Array of values
+ * @param n      Number of values in the array
+ * @param k      Zero based rank of the value to select (k < n)
+ */
+int16_t select_kth(int16_t* array, size_t n, size_t k);
+
+/**
+ * Get median value of the array. For even count the upper median is returned.
+ * Array elements are reordered. When n is a compile time constant (3, 5, 7, 9)
+ * the call is reduced to the inlined comparator network.
+ * @param array  Array of values
+ * @param n      Number of values in the array (n > 0)
+ */
+static inline int16_t median(int16_t* array, size_t n)
+{
+	switch (n)
+	{
+	case 1:
+		return array[0];
+	case 3:
+		return median3(array);
+	case 5:
+		return median5(array);
+	case 7:
+		return median7(array);
+	case 9:
+		return median9(array);
+	default:
+		return select_kth(array, n, n / 2);
+	}
+}
+
+/**
+ * Running median over sliding window of the last inserted values. Values are kept in a ring
+ * and indexed by a max-heap and a min-heap sharing one array around the median, so insertion
+ * is O(log n) and the median is available in O(1).
+ */
+typedef struct median_filter
+{
+	/**
+	 * Ring of values in insertion order
+	 */
+	int16_t* values;
+	/**
+	 * Heap position of each ring value
+	 */
+	int32_t* positions;
+	/**
+	 * Ring indexes arranged as max-heap (negative positions), median (0) and min-heap (positive positions)
+	 */
+	int32_t* heap;
+	/**
+	 * Window size
+	 */
+	int32_t window;
+	/**
+	 * Ring position for the next inserted value
+	 */
+	int32_t index;
+	/**
+	 * Number of values in the window
+	 */
+	int32_t count;
+	/**
+	 * Number of values in min-heap
+	 */
+	int32_t min_count;
+	/**
+	 * Number of values in max-heap
+	 */
+	int32_t max_count;
+} median_filter_t;
+
+/**
+ * Initialize running median filter over caller provided storage.
+ * @param filter     Filter to be initialized
+ * @param values     Storage for window values
+ * @param positions  Storage for heap positions
+ * @param heap       Storage for heap
+ * @param window     Number of elements of each storage array and window size (window > 0)
+ */
+void median_filter_init(median_filter_t* filter, int16_t* values, int32_t* positions,
+		int32_t* heap, size_t window);
+
+/**
+ * Insert new value into the window, the oldest value is dropped when the window is full.
+ * @param filter  Running median filter
+ * @param value   New value
+ */
+void median_filter_insert(median_filter_t* filter, int16_t value);
+
+/**
+ * Get median of values in the window. For even count the upper median is returned.
+ * @param filter  Running median filter with at least one value inserted
+ */
+int16_t median_filter_get(const median_filter_t* filter);
+
+/**
+ * Get number of values currently in the window.
+ * @param filter  Running median filter
+ */
+size_t median_filter_count(const median_filter_t* filter);
 
 #endif /* MAIN_ALGORITHM_H_ */
@@ -0,0 +1,119 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of clock drift model.
+ */
+
+#include "clock_drift.h"
+
+void clock_drift_init(clock_drift_t* drift, int64_t jump_us, int32_t max_drift_ppm)
+{
+	drift->index = 0;
+	drift->count = 0;
+	drift->reference_us = 0;
+	drift->offset_fit_us = 0;
+	drift->drift_ppb = 0;
+	drift->jump_us = jump_us;
+	drift->max_drift_ppm = max_drift_ppm;
+}
+
+/**
+ * Fit offset and drift by least squares. Times are relative to the oldest synchronization,
+ * so they fit into double precision.
+ */
+static void clock_drift_fit(clock_drift_t* drift)
+{
+	size_t oldest = (drift->index + CLOCK_DRIFT_SAMPLES - drift->count) % CLOCK_DRIFT_SAMPLES;
+	int64_t reference = drift->local_us[oldest];
+	int64_t offset_base = drift->offset_us[oldest];
+	double sum_x = 0, sum_y = 0;
+	for (size_t i = 0; i < drift->count; i++)
+	{
+		sum_x += (double)(drift->local_us[i] - reference);
+		sum_y += (double)(drift->offset_us[i] - offset_base);
+	}
+	double mean_x = sum_x / drift->count;
+	double mean_y = sum_y / drift->count;
+	double sxx = 0, sxy = 0;
+	for (size_t i = 0; i < drift->count; i++)
+	{
+		double dx = (double)(drift->local_us[i] - reference) - mean_x;
+		double dy = (double)(drift->offset_us[i] - offset_base) - mean_y;
+		sxx += dx * dx;
+		sxy += dx * dy;
+	}
+	double slope = sxx > 0 ? sxy / sxx : 0;
+	// Offset is related to the mean time, where its estimate has the lowest variance
+	drift->reference_us = reference + (int64_t)mean_x;
+	drift->offset_fit_us = offset_base + (int64_t)mean_y;
+	drift->drift_ppb = (int32_t)(slope * 1e9);
+}
+
+bool clock_drift_add(clock_drift_t* drift, int64_t local_us, int64_t utc_us)
+{
+	bool continuous = true;
+	if (drift->count > 0)
+	{
+		int64_t error = utc_us - clock_drift_to_utc(drift, local_us);
+		int64_t allowed = drift->jump_us;
+		if (drift->count < 2)
+		{
+			int64_t elapsed = local_us - drift->reference_us;
+			allowed += (elapsed < 0 ? -elapsed : elapsed) / 1000000 * drift->max_drift_ppm;
+		}
+		if (error > allowed || error < -allowed)
+		{
+			drift->count = 0;
+			drift->index = 0;
+			continuous = false;
+		}
+	}
+	drift->local_us[drift->index] = local_us;
+	drift->offset_us[drift->index] = utc_us - local_us;
+	drift->index = (drift->index + 1) % CLOCK_DRIFT_SAMPLES;
+	if (drift->count < CLOCK_DRIFT_SAMPLES)
+	{
+		drift->count++;
+	}
+	clock_drift_fit(drift);
+	return continuous;
+}
+
+bool clock_drift_ready(const clock_drift_t* drift)
+{
+	return drift->count >= 2;
+}
+
+int64_t clock_drift_to_utc(const clock_drift_t* drift, int64_t local_us)
+{
+	int64_t elapsed = local_us - drift->reference_us;
+	return local_us + drift->offset_fit_us + elapsed * drift->drift_ppb / 1000000000LL;
+}
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief This file defines model of local clock drift against UTC. The model is fitted by linear
+ * regression over offsets measured at SNTP synchronizations and predicts UTC time between them.
+ */
+
+#ifndef MAIN_CLOCK_DRIFT_H_
+#define MAIN_CLOCK_DRIFT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/**
+ * Number of the last synchronizations used for regression
+ */
+#ifndef CLOCK_DRIFT_SAMPLES
+#define CLOCK_DRIFT_SAMPLES 8
+#endif
+
+/**
+ * Linear model of offset between UTC and local monotonic clock:
+ * utc = local + offset + (local - reference) * drift
+ */
+typedef struct clock_drift
+{
+	/**
+	 * Local time of synchronizations in us
+	 */
+	int64_t local_us[CLOCK_DRIFT_SAMPLES];
+	/**
+	 * Measured offsets (UTC - local) in us
+	 */
+	int64_t offset_us[CLOCK_DRIFT_SAMPLES];
+	/**
+	 * Ring position for the next synchronization
+	 */
+	size_t index;
+	/**
+	 * Number of synchronizations in the ring
+	 */
+	size_t count;
+	/**
+	 * Local time in us to which fitted offset relates
+	 */
+	int64_t reference_us;
+	/**
+	 * Fitted offset in us at reference time
+	 */
+	int64_t offset_fit_us;
+	/**
+	 * Fitted drift in parts per billion
+	 */
+	int32_t drift_ppb;
+	/**
+	 * Maximal difference in us of synchronized time from prediction. Larger differences
+	 * are considered time jumps and they restart the model.
+	 */
+	int64_t jump_us;
+	/**
+	 * Maximal drift in ppm, used for detecting jumps until drift is fitted
+	 */
+	int32_t max_drift_ppm;
+} clock_drift_t;
+
+/**
+ * Initialize empty model.
+ * @param drift          Model to be initialized
+ * @param jump_us        Maximal difference in us of synchronized time from prediction
+ * @param max_drift_ppm  Maximal drift of local clock in ppm
+ */
+void clock_drift_init(clock_drift_t* drift, int64_t jump_us, int32_t max_drift_ppm);
+
+/**
+ * Add synchronization and fit the model again. The oldest synchronization is dropped when
+ * the ring is full. If UTC time differs from prediction more than allowed, the model is restarted.
+ * @param drift     Model
+ * @param local_us  Local time of synchronization in us
+ * @param utc_us    Synchronized UTC time in us
+ * @return False if the synchronization was a time jump.
+ */
+bool clock_drift_add(clock_drift_t* drift, int64_t local_us, int64_t utc_us);
+
+/**
+ * @return True if drift is fitted from at least two synchronizations.
+ */
+bool clock_drift_ready(const clock_drift_t* drift);
+
+/**
+ * Predict UTC time of local time.
+ * @param drift     Model with at least one synchronization
+ * @param local_us  Local time in us
+ * @return UTC time in us
+ */
+int64_t clock_drift_to_utc(const clock_drift_t* drift, int64_t local_us);
+
+#endif /* MAIN_CLOCK_DRIFT_H_ */
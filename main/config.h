@@ -43,6 +43,39 @@
 #define WIFI_PASSWORD "password"
 #endif
 
+/**
+ * Maximal time in ms of waiting for Wi-Fi connection before falling back from cached
+ * access point to full scan. After that waiting continues with progress logged.
+ */
+#ifndef WIFI_CONNECT_TIMEOUT
+#define WIFI_CONNECT_TIMEOUT 10000
+#endif
+
+/**
+ * Number of WIFI_CONNECT_TIMEOUT periods of waiting for Wi-Fi at boot. Then measurement starts
+ * offline if time was restored, otherwise the chip sleeps for MEASUREMENT_INTERVAL and retries.
+ */
+#ifndef WIFI_CONNECT_RETRIES
+#define WIFI_CONNECT_RETRIES 6
+#endif
+
+/**
+ * Cache channel, BSSID and DHCP lease of the last connection in RTC memory and NVS.
+ * The next connection skips scanning and DHCP and uses cached IP configuration statically
+ * until the lease expires. The cache is dropped when the cached access point cannot be connected.
+ */
+//#ifndef WIFI_FAST_RECONNECT
+//#define WIFI_FAST_RECONNECT
+//#endif
+
+/**
+ * Time in ms for which cached IP configuration is used after DHCP bind, it must not exceed
+ * DHCP lease time of the network. Used only with WIFI_FAST_RECONNECT.
+ */
+//#ifndef WIFI_CACHE_LEASE_TIME
+//#define WIFI_CACHE_LEASE_TIME 3600000
+//#endif
+
 /**
  * MQTT broker hostname or IP
  */
@@ -64,6 +97,50 @@
 #define MQTT_MEASUREMENT_TOPIC "sensor/temp"
 #endif
 
+/**
+ * Format of published payloads: PAYLOAD_FORMAT_JSON, PAYLOAD_FORMAT_CBOR, PAYLOAD_FORMAT_BINARY
+ * or PAYLOAD_FORMAT_DELTA (compressed series, efficient with MQTT_BATCH_SIZE).
+ * Binary formats are described in payload_format.h.
+ */
+#ifndef MQTT_PAYLOAD_FORMAT
+#define MQTT_PAYLOAD_FORMAT PAYLOAD_FORMAT_JSON
+#endif
+
+/**
+ * Number of measurements published together in one MQTT message. If defined, samples are
+ * buffered and published as one object with arrays of values.
+ */
+//#ifndef MQTT_BATCH_SIZE
+//#define MQTT_BATCH_SIZE 10
+//#endif
+
+/**
+ * Maximal age in ms of the oldest buffered sample, the batch is published earlier
+ * when it is reached, also when no new samples arrive. Used only with MQTT_BATCH_SIZE.
+ */
+//#ifndef MQTT_BATCH_TIMEOUT
+//#define MQTT_BATCH_TIMEOUT 600000
+//#endif
+
+/**
+ * Label of flash data partition where samples are stored while the broker is not reachable.
+ * Stored samples are forwarded in batches after reconnecting. Disabled if not defined.
+ */
+//#ifndef OFFLINE_QUEUE_PARTITION
+//#define OFFLINE_QUEUE_PARTITION "sample_log"
+//#endif
+
+/**
+ * Maximal number of stored samples forwarded in one message and minimal delay in ms
+ * between these messages. Used only with OFFLINE_QUEUE_PARTITION.
+ */
+//#ifndef OFFLINE_QUEUE_DRAIN_BATCH
+//#define OFFLINE_QUEUE_DRAIN_BATCH 20
+//#endif
+//#ifndef OFFLINE_QUEUE_DRAIN_INTERVAL
+//#define OFFLINE_QUEUE_DRAIN_INTERVAL 500
+//#endif
+
 /**
  * Unique ID of this device in the system
  */
@@ -71,6 +148,16 @@
 #define DEVICE_ID "SENSOR1"
 #endif
 
+/**
+ * Registry of connected sensors as comma separated initializers {type, GPIO pin, ID}, e.g.:
+ * {DHT_TYPE_AM2301, GPIO_NUM_18, "SENSOR1"}, {DHT_TYPE_DHT11, GPIO_NUM_19, "SENSOR2"}
+ * All sensors are read in each cycle and ID is used as device ID of their published samples.
+ * At most PLATFORM_MEASUREMENT_MAX_SENSORS sensors are supported.
+ */
+#ifndef PLATFORM_MEASUREMENT_SENSORS
+#define PLATFORM_MEASUREMENT_SENSORS {DHT_TYPE_AM2301, GPIO_NUM_18, DEVICE_ID}
+#endif
+
 /**
  * Measurement period in ms
  */
@@ -85,6 +172,60 @@
 #define MEASUREMENT_OFFSET 0
 #endif
 
+/**
+ * Priority of measurement task and sensor reader tasks. It should be higher than priority
+ * of other application tasks, so sampling is not delayed by them.
+ */
+#ifndef MEASUREMENT_TASK_PRIORITY
+#define MEASUREMENT_TASK_PRIORITY (tskIDLE_PRIORITY + 10)
+#endif
+
+/**
+ * Priority of measurement publisher task and offline queue drain task. It should be above idle
+ * task, so publishing is not starved by it, and below MEASUREMENT_TASK_PRIORITY.
+ */
+#ifndef PUBLISH_TASK_PRIORITY
+#define PUBLISH_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#endif
+
+/**
+ * Maximal difference in ms between SNTP time and time predicted by clock drift model.
+ * Larger differences are considered time jumps and the model is fitted again from scratch.
+ */
+#ifndef MEASUREMENT_CLOCK_JUMP
+#define MEASUREMENT_CLOCK_JUMP 100
+#endif
+
+/**
+ * Uncertainty in ms of time right after SNTP synchronization.
+ */
+#ifndef TIME_SYNC_BASE_UNCERTAINTY
+#define TIME_SYNC_BASE_UNCERTAINTY 20
+#endif
+
+/**
+ * Maximal drift of RTC clock in ppm. It bounds uncertainty until the drift is estimated
+ * and larger differences between SNTP synchronizations are considered time jumps.
+ */
+#ifndef TIME_SYNC_MAX_DRIFT
+#define TIME_SYNC_MAX_DRIFT 500
+#endif
+
+/**
+ * Minimal period in ms between SNTP synchronizations used for drift estimation.
+ */
+#ifndef TIME_SYNC_DRIFT_PERIOD
+#define TIME_SYNC_DRIFT_PERIOD 600000
+#endif
+
+/**
+ * Maximal uncertainty in ms of time restored after reset or deep sleep. If it is exceeded,
+ * the device waits for SNTP synchronization before measuring as after power-on.
+ */
+#ifndef TIME_SYNC_MAX_UNCERTAINTY
+#define TIME_SYNC_MAX_UNCERTAINTY 2000
+#endif
+
 /**
  * Number of samples from which median value is chosen as relevant sample,
  * it can filter out measurement errors. If not defined only one samly will be read.
@@ -100,4 +241,94 @@
 //#define MEDIAN_SAMPLES_DELAY 500
 //#endif
 
+/**
+ * Window size of running median filter. If defined the sensor is sampled continuously
+ * between measurements and median of last samples is reported at each cycle start
+ * without blocking. Cannot be combined with MEDIAN_SAMPLES.
+ */
+//#ifndef MEDIAN_FILTER_WINDOW
+//#define MEDIAN_FILTER_WINDOW 5
+//#endif
+
+/**
+ * Period in ms of sampling for running median filter. By default the window is spread
+ * over one measurement interval.
+ */
+#if defined(MEDIAN_FILTER_WINDOW) && !defined(MEDIAN_FILTER_SAMPLE_INTERVAL)
+#define MEDIAN_FILTER_SAMPLE_INTERVAL (MEASUREMENT_INTERVAL / MEDIAN_FILTER_WINDOW)
+#endif
+
+/**
+ * Enable deep sleep duty cycle mode. The chip sleeps between measurements, samples are kept
+ * in RTC memory and Wi-Fi and MQTT are started only every n-th cycle to publish them.
+ * Must not exceed MQTT_BATCH_SIZE when batching is enabled.
+ */
+//#ifndef DEEP_SLEEP_FLUSH_CYCLES
+//#define DEEP_SLEEP_FLUSH_CYCLES 10
+//#endif
+
+/**
+ * Capacity of sample buffer in RTC memory, the oldest samples are dropped when it is full.
+ * By default it fits samples of all sensors for DEEP_SLEEP_FLUSH_CYCLES cycles.
+ */
+//#ifndef DEEP_SLEEP_BUFFER_SIZE
+//#define DEEP_SLEEP_BUFFER_SIZE 80
+//#endif
+
+/**
+ * Maximal time in ms of waiting for each of Wi-Fi, SNTP and MQTT in deep sleep mode.
+ */
+//#ifndef DEEP_SLEEP_CONNECT_TIMEOUT
+//#define DEEP_SLEEP_CONNECT_TIMEOUT 15000
+//#endif
+
+/**
+ * Number of reader tasks which read sensors concurrently, readers are pinned to cores in turn
+ * and sensors are assigned to readers by their index. If not defined, sensors are read one
+ * after another by measurement task.
+ */
+//#ifndef MEASUREMENT_READER_TASKS
+//#define MEASUREMENT_READER_TASKS portNUM_PROCESSORS
+//#endif
+
+/**
+ * RMT channel used for capturing DHT sensor response. If defined the response is recorded
+ * by RMT peripheral instead of polling the pin with interrupts disabled. With
+ * MEASUREMENT_READER_TASKS each reader uses its own channel, DHT_RMT_CHANNEL + reader index.
+ */
+//#ifndef DHT_RMT_CHANNEL
+//#define DHT_RMT_CHANNEL RMT_CHANNEL_0
+//#endif
+
+/**
+ * Capture DHT sensor response by timestamping signal edges in GPIO interrupt instead
+ * of polling the pin with interrupts disabled. Not used when DHT_RMT_CHANNEL is defined.
+ */
+//#ifndef DHT_USE_GPIO_ISR
+//#define DHT_USE_GPIO_ISR
+//#endif
+
+/**
+ * Use simulated sensor instead of DHT. Samples are generated synthetically or replayed
+ * from the trace file set by PLATFORM_MEASUREMENT_SIM_TRACE.
+ */
+//#ifndef PLATFORM_MEASUREMENT_SIM
+//#define PLATFORM_MEASUREMENT_SIM
+//#endif
+
+/**
+ * Path to the recorded trace included by simulated sensor. The file contains
+ * {temperature, humidity} initializers in 0.1 units, one sample per line.
+ */
+//#ifndef PLATFORM_MEASUREMENT_SIM_TRACE
+//#define PLATFORM_MEASUREMENT_SIM_TRACE "trace.inc"
+//#endif
+
+/**
+ * Every n-th read of each simulated sensor fails with timeout.
+ */
+//#ifndef PLATFORM_MEASUREMENT_SIM_ERROR_PERIOD
+//#define PLATFORM_MEASUREMENT_SIM_ERROR_PERIOD 20
+//#endif
+
 #endif /* MAIN_CONFIG_H_ */
@@ -45,15 +45,176 @@
 #include <lwip/sys.h>
 #include <esp_sntp.h>
 #include <esp_pm.h>
+#include <esp_sleep.h>
 
 #include "measurement_task.h"
 #include "mqtt_handler.h"
+#include "time_sync.h"
 #include "config.h"
 
+#ifdef WIFI_FAST_RECONNECT
+#include "wifi_cache.h"
+#endif
+
+#if defined(DEEP_SLEEP_FLUSH_CYCLES) || defined(WIFI_FAST_RECONNECT)
+#include <string.h>
+#endif
+
+#ifdef WIFI_FAST_RECONNECT
+#include <esp_timer.h>
+#endif
+
+#ifdef DEEP_SLEEP_FLUSH_CYCLES
+#include "platform_measurement.h"
+#endif
+
 #define TAG "main"
 static EventGroupHandle_t wifi_event_group;
 const int WIFI_CONNECTED_BIT = BIT0;
 const int SNTP_SYNCHRONIZED_BIT = BIT1;
+const int MQTT_STARTED_BIT = BIT2;
+
+#ifdef WIFI_FAST_RECONNECT
+#ifndef WIFI_CACHE_LEASE_TIME
+#define WIFI_CACHE_LEASE_TIME 3600000
+#endif
+
+static esp_netif_t* wifi_netif;
+/**
+ * True while connecting directly to cached access point, cleared when the connection succeeds
+ */
+static bool wifi_cached = false;
+/**
+ * True while cached IP configuration is used statically instead of DHCP
+ */
+static bool wifi_static_ip = false;
+/**
+ * Switches from cached IP configuration to DHCP when the cached lease expires
+ */
+static esp_timer_handle_t wifi_lease_timer = NULL;
+#endif
+
+#ifdef DEEP_SLEEP_FLUSH_CYCLES
+#ifndef DEEP_SLEEP_BUFFER_SIZE
+#define DEEP_SLEEP_BUFFER_SIZE (DEEP_SLEEP_FLUSH_CYCLES * PLATFORM_MEASUREMENT_MAX_SENSORS)
+#endif
+#ifndef DEEP_SLEEP_CONNECT_TIMEOUT
+#define DEEP_SLEEP_CONNECT_TIMEOUT 15000
+#endif
+
+#ifdef MQTT_BATCH_SIZE
+// Each cycle stores one sample of every sensor, samples of one flush must fit one batch
+_Static_assert(DEEP_SLEEP_FLUSH_CYCLES <= MQTT_BATCH_SIZE, "DEEP_SLEEP_FLUSH_CYCLES exceeds MQTT_BATCH_SIZE");
+// Buffered samples are passed to MQTT handler in chunks which never overfill its batches
+#define DEEP_SLEEP_FLUSH_CHUNK MQTT_BATCH_SIZE
+#else
+#define DEEP_SLEEP_FLUSH_CHUNK DEEP_SLEEP_BUFFER_SIZE
+#endif
+
+/**
+ * Samples retained in RTC slow memory while the chip is in deep sleep
+ */
+static RTC_DATA_ATTR measurement_values_t deep_sleep_buffer[DEEP_SLEEP_BUFFER_SIZE];
+static RTC_DATA_ATTR size_t deep_sleep_count = 0;
+static RTC_DATA_ATTR uint32_t deep_sleep_cycles = 0;
+#endif
+
+#ifdef WIFI_FAST_RECONNECT
+/**
+ * Get system time in ms, it continues across deep sleep and software reset.
+ */
+static uint64_t wifi_time_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/**
+ * Store access point and IP configuration obtained by DHCP for the next connection.
+ */
+static void wifi_cache_save(const esp_netif_ip_info_t* ip_info)
+{
+    wifi_ap_record_t ap_info;
+    wifi_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK
+    		|| esp_netif_get_dns_info(wifi_netif, ESP_NETIF_DNS_MAIN, &cache.dns) != ESP_OK)
+    {
+        return;
+    }
+    cache.channel = ap_info.primary;
+    memcpy(cache.bssid, ap_info.bssid, sizeof(cache.bssid));
+    cache.ip_info = *ip_info;
+    cache.lease_expiry = wifi_time_ms() + WIFI_CACHE_LEASE_TIME;
+    wifi_cache_store(&cache);
+}
+
+/**
+ * Cached lease expired, obtain new lease by DHCP. It is stored to the cache when bound.
+ */
+static void wifi_lease_expired(void* arg)
+{
+    ESP_LOGI(TAG, "Cached DHCP lease expired, starting DHCP");
+    wifi_static_ip = false;
+    esp_netif_dhcpc_start(wifi_netif);
+}
+
+/**
+ * Set Wi-Fi and IP configuration. Cached access point is connected without scanning
+ * and cached IP configuration is used statically instead of DHCP until the lease expires.
+ */
+static void wifi_configure(const wifi_cache_t* cache)
+{
+    wifi_config_t wifi_config = {
+        .sta = {
+            .ssid = WIFI_SSID,
+            .password = WIFI_PASSWORD,
+			.listen_interval = 5 // Listen interval affects modem sleep period
+        }
+    };
+    uint64_t now = wifi_time_ms();
+    esp_timer_stop(wifi_lease_timer);
+    wifi_cached = cache != NULL;
+    wifi_static_ip = wifi_cached && cache->lease_expiry > now;
+    if (wifi_cached)
+    {
+        wifi_config.sta.channel = cache->channel;
+        memcpy(wifi_config.sta.bssid, cache->bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.bssid_set = true;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+    }
+    else
+    {
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    }
+    if (wifi_static_ip)
+    {
+        esp_netif_dhcpc_stop(wifi_netif);
+        esp_netif_set_ip_info(wifi_netif, &cache->ip_info);
+        esp_netif_dns_info_t dns = cache->dns;
+        esp_netif_set_dns_info(wifi_netif, ESP_NETIF_DNS_MAIN, &dns);
+        esp_timer_start_once(wifi_lease_timer, (cache->lease_expiry - now) * 1000);
+    }
+    else
+    {
+        esp_netif_dhcpc_start(wifi_netif);
+    }
+    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+}
+
+/**
+ * Drop cached configuration and connect again with full scan and DHCP. Called when
+ * the station is disconnected.
+ */
+static void wifi_fallback(void)
+{
+    ESP_LOGW(TAG, "Cached AP not available, falling back to scan and DHCP");
+    wifi_cache_invalidate();
+    wifi_configure(NULL);
+    esp_wifi_connect();
+}
+#endif
 
 static void event_handler(void* arg, esp_event_base_t event_base,
 		int32_t event_id, void* event_data)
@@ -64,6 +225,15 @@ static void event_handler(void* arg, esp_event_base_t event_base,
     }
     else if	(event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
     {
+#ifdef WIFI_FAST_RECONNECT
+        if (wifi_cached)
+        {
+            // Association with cached parameters failed, cached AP moved to other channel or it is gone
+            wifi_fallback();
+            xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
+            return;
+        }
+#endif
         esp_wifi_connect();
         xEventGroupClearBits(wifi_event_group, WIFI_CONNECTED_BIT);
         ESP_LOGI(TAG, "Retry to connect to the AP");
@@ -72,19 +242,50 @@ static void event_handler(void* arg, esp_event_base_t event_base,
     {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+#ifdef WIFI_FAST_RECONNECT
+        // Cached parameters worked, later disconnects only reconnect
+        wifi_cached = false;
+        // Every DHCP bind refreshes cached lease, static configuration does not
+        if (!wifi_static_ip)
+        {
+            wifi_cache_save(&event->ip_info);
+        }
+#endif
         xEventGroupSetBits(wifi_event_group, WIFI_CONNECTED_BIT);
     }
 }
 
 void wifi_init()
 {
+#ifdef WIFI_FAST_RECONNECT
+    wifi_netif = esp_netif_create_default_wifi_sta();
+#else
     esp_netif_create_default_wifi_sta();
+#endif
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &event_handler, NULL));
 
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+#ifdef WIFI_FAST_RECONNECT
+    esp_timer_create_args_t timer_args = {
+        .callback = wifi_lease_expired,
+        .name = "wifi_lease"
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &wifi_lease_timer));
+    wifi_cache_t cache;
+    if (wifi_cache_load(&cache))
+    {
+        ESP_LOGI(TAG, "Using cached AP on channel %u", cache.channel);
+        wifi_configure(&cache);
+    }
+    else
+    {
+        wifi_configure(NULL);
+    }
+#else
     wifi_config_t wifi_config = {
         .sta = {
             .ssid = WIFI_SSID,
@@ -92,8 +293,8 @@ void wifi_init()
 			.listen_interval = 5 // Listen interval affects modem sleep period
         }
     };
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+#endif
     // Enable modem sleep mode
     ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MAX_MODEM));
     ESP_ERROR_CHECK(esp_wifi_start());
@@ -102,6 +303,26 @@ void wifi_init()
     ESP_LOGI(TAG, "Connect to ap SSID:%s password:%s", WIFI_SSID, WIFI_PASSWORD);
 }
 
+/**
+ * Wait for IP connectivity at most timeout_ms. If cached AP was used, the cache is dropped
+ * and connection is attempted once more with full scan and DHCP.
+ */
+static bool wifi_wait_connected(uint32_t timeout_ms)
+{
+	EventBits_t bits = xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE,
+			pdFALSE, pdMS_TO_TICKS(timeout_ms));
+#ifdef WIFI_FAST_RECONNECT
+	if (!(bits & WIFI_CONNECTED_BIT) && wifi_cached)
+	{
+		// Abort the attempt with cached parameters, disconnected event falls back to scan and DHCP
+		esp_wifi_disconnect();
+		bits = xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE,
+				pdFALSE, pdMS_TO_TICKS(timeout_ms));
+	}
+#endif
+	return (bits & WIFI_CONNECTED_BIT) != 0;
+}
+
 static void nvs_init()
 {
     esp_err_t ret = nvs_flash_init();
@@ -117,6 +338,10 @@ void time_sync_notification_cb(struct timeval *tv)
 {
     uint64_t utcMs = ((uint64_t)tv->tv_sec) * 1000 + tv->tv_usec;
     ESP_LOGI(TAG, "UTC time synchronized: %llu", utcMs);
+    time_sync_update(tv);
+    measurement_task_time_synchronized(tv);
+    // Following synchronizations only slew the clock, so samples do not jump in time
+    sntp_set_sync_mode(SNTP_SYNC_MODE_SMOOTH);
     xEventGroupSetBits(wifi_event_group, SNTP_SYNCHRONIZED_BIT);
 }
 
@@ -126,7 +351,8 @@ static void initialize_sntp(void)
     sntp_setoperatingmode(SNTP_OPMODE_POLL);
     sntp_setservername(0, NTP_SERVER_IP);
     sntp_set_time_sync_notification_cb(time_sync_notification_cb);
-    //sntp_set_sync_mode(SNTP_SYNC_MODE_SMOOTH);
+    // Time is set immediately only when it is not known yet
+    sntp_set_sync_mode(time_sync_valid() ? SNTP_SYNC_MODE_SMOOTH : SNTP_SYNC_MODE_IMMED);
     sntp_init();
 }
 
@@ -139,15 +365,31 @@ static void measures_init()
 }
 
 /**
- * Publish measurement read by measurement task to MQTT broker.
+ * Publish measurement read by measurement task to MQTT broker. Measurements started before
+ * the network is up wait for MQTT client, meanwhile the samples are queued by measurement task.
  */
-static void measurements_sampled_cb(const measurement_values_t* measurement_values, void* context)
+static uint32_t measurements_sampled_cb(const measurement_values_t* measurement_values, size_t count, void* context)
 {
-	ESP_LOGI(TAG, "Measurements sampled: temperature=%f, humidity=%f, utc=%llu",
-			measurement_values->temperature, measurement_values->humidity,
-			measurement_values->utc_timestamp);
-	esp_err_t result = mqtt_handler_publish_values(measurement_values);
+	xEventGroupWaitBits(wifi_event_group, MQTT_STARTED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+	for (size_t i = 0; i < count; i++)
+	{
+		ESP_LOGI(TAG, "Measurements sampled: sensor=%u, temperature=%.1f, humidity=%.1f, utc=%llu",
+				measurement_values[i].sensor, measurement_values[i].temperature / 10.0f,
+				measurement_values[i].humidity / 10.0f, measurement_values[i].utc_timestamp);
+	}
+	ESP_LOGI(TAG, "Time uncertainty: %u ms", time_sync_uncertainty_ms());
+	esp_err_t result = mqtt_handler_publish_values(measurement_values, count);
 	ESP_LOGI(TAG, "Measurement publish result: %d", result);
+	// Called again without values when buffered samples expire
+	return mqtt_handler_get_flush_timeout();
+}
+
+static void measures_start(void)
+{
+	ESP_LOGI(TAG, "Measurement started");
+	measures_init();
+	// Run measurements task
+	measurement_task_start(measurements_sampled_cb, NULL);
 }
 
 static void mqtt_init(void)
@@ -168,6 +410,123 @@ static void power_mgmt_init(void)
 	ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
 }
 
+#ifdef DEEP_SLEEP_FLUSH_CYCLES
+/**
+ * Append samples to RTC buffer, the oldest samples are dropped when it is full.
+ */
+static void deep_sleep_store(const measurement_values_t* values, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (deep_sleep_count == DEEP_SLEEP_BUFFER_SIZE)
+		{
+			memmove(&deep_sleep_buffer[0], &deep_sleep_buffer[1],
+					(DEEP_SLEEP_BUFFER_SIZE - 1) * sizeof(measurement_values_t));
+			deep_sleep_count--;
+		}
+		deep_sleep_buffer[deep_sleep_count++] = values[i];
+	}
+}
+
+/**
+ * Bring up Wi-Fi, synchronize time and connect to MQTT broker. All waits are bounded,
+ * so the device goes back to sleep when the network is not available.
+ */
+static esp_err_t deep_sleep_connect(void)
+{
+	wifi_init();
+	if (!wifi_wait_connected(DEEP_SLEEP_CONNECT_TIMEOUT))
+	{
+		return ESP_ERR_TIMEOUT;
+	}
+	initialize_sntp();
+	// Restored time is synchronized in background while publishing
+	if (!time_sync_valid())
+	{
+		EventBits_t bits = xEventGroupWaitBits(wifi_event_group, SNTP_SYNCHRONIZED_BIT, pdFALSE,
+				pdFALSE, pdMS_TO_TICKS(DEEP_SLEEP_CONNECT_TIMEOUT));
+		if (!(bits & SNTP_SYNCHRONIZED_BIT))
+		{
+			ESP_LOGW(TAG, "SNTP not synchronized");
+		}
+	}
+	mqtt_init();
+	mqtt_handler_start();
+	return mqtt_handler_wait_connected(DEEP_SLEEP_CONNECT_TIMEOUT);
+}
+
+/**
+ * Publish all buffered samples and wait until the broker receives them.
+ */
+static esp_err_t deep_sleep_flush(void)
+{
+	esp_err_t result = ESP_OK;
+	for (size_t offset = 0; offset < deep_sleep_count && result == ESP_OK; offset += DEEP_SLEEP_FLUSH_CHUNK)
+	{
+		size_t count = deep_sleep_count - offset;
+		if (count > DEEP_SLEEP_FLUSH_CHUNK)
+		{
+			count = DEEP_SLEEP_FLUSH_CHUNK;
+		}
+		result = mqtt_handler_publish_values(&deep_sleep_buffer[offset], count);
+		if (result == ESP_OK)
+		{
+			result = mqtt_handler_flush();
+		}
+	}
+	// Samples are kept until all of them are queued and received by the broker
+	if (result == ESP_OK)
+	{
+		result = mqtt_handler_wait_published(DEEP_SLEEP_CONNECT_TIMEOUT);
+	}
+	if (result == ESP_OK)
+	{
+		ESP_LOGI(TAG, "Published %u buffered samples", (unsigned)deep_sleep_count);
+		deep_sleep_count = 0;
+	}
+	return result;
+}
+
+/**
+ * Run one duty cycle: read sensors after RTC timer wake-up, publish buffered samples every
+ * DEEP_SLEEP_FLUSH_CYCLES cycles and sleep until the next cycle start.
+ */
+static void deep_sleep_run(void)
+{
+	// Time is not known after power on, so connect immediately to synchronize it
+	bool cold_boot = !time_sync_restore();
+	measures_init();
+	if (!cold_boot)
+	{
+		measurement_values_t values[PLATFORM_MEASUREMENT_MAX_SENSORS];
+		size_t count = 0;
+		if (measurement_task_measure_once(values, &count) == ESP_OK)
+		{
+			deep_sleep_store(values, count);
+		}
+		deep_sleep_cycles++;
+	}
+	if (cold_boot || deep_sleep_cycles >= DEEP_SLEEP_FLUSH_CYCLES)
+	{
+		esp_err_t result = deep_sleep_connect();
+		if (result == ESP_OK && deep_sleep_count > 0)
+		{
+			result = deep_sleep_flush();
+		}
+		if (result != ESP_OK)
+		{
+			ESP_LOGW(TAG, "Flush failed: %s", esp_err_to_name(result));
+		}
+		deep_sleep_cycles = 0;
+		mqtt_handler_stop();
+		esp_wifi_stop();
+	}
+	uint64_t next_cycle = measurement_task_get_next_cycle();
+	ESP_LOGI(TAG, "Sleeping for %llu ms, %u samples buffered", next_cycle, (unsigned)deep_sleep_count);
+	esp_deep_sleep(next_cycle * 1000);
+}
+#endif
+
 void app_main(void)
 {
 	wifi_event_group = xEventGroupCreate();
@@ -175,33 +534,70 @@ void app_main(void)
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
+#ifdef DEEP_SLEEP_FLUSH_CYCLES
+    deep_sleep_run();
+#endif
+
+    // Time survives software reset in RTC, then sampling can start without waiting for network
+    bool time_restored = time_sync_restore();
+    if (time_restored)
+    {
+        measures_start();
+    }
+
     // Start Wi-Fi connection
     ESP_LOGI(TAG, "WiFi init");
     wifi_init();
     ESP_LOGI(TAG, "Connecting to WiFi...");
-    // Wait Wi-Fi to become connected
-	xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE,
-			pdFALSE, portMAX_DELAY);
-	ESP_LOGI(TAG, "Connected to WiFi");
+    // Wait Wi-Fi to become connected, reconnection continues in background after timeout
+	bool wifi_connected = false;
+	for (uint32_t i = 0; i < WIFI_CONNECT_RETRIES && !wifi_connected; i++)
+	{
+		wifi_connected = wifi_wait_connected(WIFI_CONNECT_TIMEOUT);
+		if (!wifi_connected)
+		{
+			ESP_LOGW(TAG, "WiFi not connected after %u ms", (unsigned)WIFI_CONNECT_TIMEOUT);
+		}
+	}
+	if (wifi_connected)
+	{
+		ESP_LOGI(TAG, "Connected to WiFi");
+	}
+	else if (time_restored)
+	{
+		// Samples are published or stored offline when the connection is established later
+		ESP_LOGW(TAG, "WiFi not available, measuring offline");
+	}
+	else
+	{
+		// Samples cannot be timestamped without time, try again in the next measurement period
+		ESP_LOGE(TAG, "WiFi not available and time unknown, sleeping");
+		esp_wifi_stop();
+		esp_deep_sleep((uint64_t)MEASUREMENT_INTERVAL * 1000);
+	}
 
 	// Initialize SNTP time synchronization
     ESP_LOGI(TAG, "SNTP init");
     initialize_sntp();
-    ESP_LOGI(TAG, "Waiting for SNTP synchronize...");
-    // Wait for SNTP got response with current time
-	xEventGroupWaitBits(wifi_event_group, SNTP_SYNCHRONIZED_BIT, pdFALSE,
-			pdFALSE, portMAX_DELAY);
-	ESP_LOGI(TAG, "SNTP synchronized");
+    if (!time_restored)
+    {
+        ESP_LOGI(TAG, "Waiting for SNTP synchronize...");
+        // Wait for SNTP got response with current time
+        xEventGroupWaitBits(wifi_event_group, SNTP_SYNCHRONIZED_BIT, pdFALSE,
+                pdFALSE, portMAX_DELAY);
+        ESP_LOGI(TAG, "SNTP synchronized");
+    }
 
 	// Init and connect to MQTT
 	ESP_LOGI(TAG, "Connecting to MQTT...");
 	mqtt_init();
 	mqtt_handler_start();
+	xEventGroupSetBits(wifi_event_group, MQTT_STARTED_BIT);
 
 	ESP_LOGI(TAG, "Power mgmt init");
 	power_mgmt_init();
-	ESP_LOGI(TAG, "Measurement started");
-	measures_init();
-	// Run measurements task
-	measurement_task_start(measurements_sampled_cb, NULL);
+	if (!time_restored)
+	{
+		measures_start();
+	}
 }
@@ -34,82 +34,432 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/event_groups.h>
 
 #include <inttypes.h>
 #include <esp_log.h>
 #include <esp_pm.h>
+#include <esp_timer.h>
 
 #include "algorithm.h"
 #include "measurement.h"
 #include "platform_measurement.h"
+#include "spsc_ring.h"
 #include "config.h"
 
 #define TAG "measurement"
 
+#if defined(MEDIAN_SAMPLES) && defined(MEDIAN_FILTER_WINDOW)
+#error "MEDIAN_SAMPLES and MEDIAN_FILTER_WINDOW cannot be used together"
+#endif
+
+#ifdef MEASUREMENT_READER_TASKS
+#define MEASUREMENT_READER_COUNT MEASUREMENT_READER_TASKS
+#else
+#define MEASUREMENT_READER_COUNT 1
+#endif
+
+// Capacity of reader ring, power of two for all sensors of one reader
+#define MEASUREMENT_READER_RING_SIZE 16
+
+_Static_assert(PLATFORM_MEASUREMENT_MAX_SENSORS <= MEASUREMENT_READER_RING_SIZE, "Reader ring is too small");
+
+/**
+ * Operations executed by readers
+ */
+typedef enum measurement_operation
+{
+	MEASUREMENT_OPERATION_READ = 1,
+	MEASUREMENT_OPERATION_SAMPLE = 2
+} measurement_operation_t;
+
+/**
+ * Result of reading one sensor passed from reader to the requesting task
+ */
+typedef struct measurement_reading
+{
+	esp_err_t result;
+	measurement_values_t values;
+} measurement_reading_t;
+
+/**
+ * Reader of sensors with index: index, index + MEASUREMENT_READER_COUNT, ...
+ * The reader is the only producer and the requesting task the only consumer of its ring.
+ */
+typedef struct measurement_reader
+{
+	size_t index;
+	spsc_ring_t ring;
+	measurement_reading_t readings[MEASUREMENT_READER_RING_SIZE];
+	TaskHandle_t task;
+} measurement_reader_t;
+
+static measurement_reader_t measurement_readers[MEASUREMENT_READER_COUNT];
+#ifdef MEASUREMENT_READER_TASKS
+static EventGroupHandle_t measurement_readers_done = NULL;
+#endif
+
 #ifdef MEDIAN_SAMPLES
-static int16_t measurements_temp[MEDIAN_SAMPLES];
-static int16_t measurements_hum[MEDIAN_SAMPLES];
+static int16_t measurements_temp[PLATFORM_MEASUREMENT_MAX_SENSORS][MEDIAN_SAMPLES];
+static int16_t measurements_hum[PLATFORM_MEASUREMENT_MAX_SENSORS][MEDIAN_SAMPLES];
+#endif
+
+#ifdef MEDIAN_FILTER_WINDOW
+static int16_t filter_temp_values[PLATFORM_MEASUREMENT_MAX_SENSORS][MEDIAN_FILTER_WINDOW];
+static int32_t filter_temp_positions[PLATFORM_MEASUREMENT_MAX_SENSORS][MEDIAN_FILTER_WINDOW];
+static int32_t filter_temp_heap[PLATFORM_MEASUREMENT_MAX_SENSORS][MEDIAN_FILTER_WINDOW];
+static int16_t filter_hum_values[PLATFORM_MEASUREMENT_MAX_SENSORS][MEDIAN_FILTER_WINDOW];
+static int32_t filter_hum_positions[PLATFORM_MEASUREMENT_MAX_SENSORS][MEDIAN_FILTER_WINDOW];
+static int32_t filter_hum_heap[PLATFORM_MEASUREMENT_MAX_SENSORS][MEDIAN_FILTER_WINDOW];
+static median_filter_t filter_temp[PLATFORM_MEASUREMENT_MAX_SENSORS];
+static median_filter_t filter_hum[PLATFORM_MEASUREMENT_MAX_SENSORS];
+#endif
+
+/**
+ * Power management lock held at maximal APB frequency only during sensor transactions.
+ * Readers on both cores share it, so time is accounted while at least one of them holds it.
+ */
+static esp_pm_lock_handle_t measurement_pm_lock = NULL;
+static portMUX_TYPE measurement_pm_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t measurement_pm_holders = 0;
+static int64_t measurement_pm_hold_start = 0;
+static int64_t measurement_pm_hold_total = 0;
+static int64_t measurement_pm_init_time = 0;
+
+#ifdef MEASUREMENT_READER_TASKS
+static void measurement_reader_run(void* pvParameters);
 #endif
 
+static void measurement_pm_acquire(void)
+{
+	if (measurement_pm_lock != NULL)
+	{
+		esp_pm_lock_acquire(measurement_pm_lock);
+	}
+	int64_t now = esp_timer_get_time();
+	portENTER_CRITICAL(&measurement_pm_mux);
+	if (measurement_pm_holders++ == 0)
+	{
+		measurement_pm_hold_start = now;
+	}
+	portEXIT_CRITICAL(&measurement_pm_mux);
+}
+
+static void measurement_pm_release(void)
+{
+	int64_t now = esp_timer_get_time();
+	portENTER_CRITICAL(&measurement_pm_mux);
+	if (--measurement_pm_holders == 0)
+	{
+		measurement_pm_hold_total += now - measurement_pm_hold_start;
+	}
+	portEXIT_CRITICAL(&measurement_pm_mux);
+	if (measurement_pm_lock != NULL)
+	{
+		esp_pm_lock_release(measurement_pm_lock);
+	}
+}
+
+uint32_t measurement_pm_lock_ms_per_hour(void)
+{
+	portENTER_CRITICAL(&measurement_pm_mux);
+	int64_t total = measurement_pm_hold_total;
+	portEXIT_CRITICAL(&measurement_pm_mux);
+	int64_t elapsed = esp_timer_get_time() - measurement_pm_init_time;
+	if (elapsed <= 0)
+	{
+		return 0;
+	}
+	// Both times are in us, scale the ratio to ms per hour
+	return (uint32_t)(total * 3600000 / elapsed);
+}
+
 esp_err_t measurement_init()
 {
+	if (measurement_pm_lock == NULL)
+	{
+		// The lock is created once and reused, creating it in each cycle is expensive
+		esp_err_t result = esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "measurement", &measurement_pm_lock);
+		if (result != ESP_OK)
+		{
+			// Power management is not enabled, sensors are read at fixed frequency
+			ESP_LOGW(TAG, "PM lock not available: %s", esp_err_to_name(result));
+			measurement_pm_lock = NULL;
+		}
+		measurement_pm_init_time = esp_timer_get_time();
+	}
+#ifdef MEDIAN_FILTER_WINDOW
+	for (size_t i = 0; i < PLATFORM_MEASUREMENT_MAX_SENSORS; i++)
+	{
+		median_filter_init(&filter_temp[i], filter_temp_values[i], filter_temp_positions[i],
+				filter_temp_heap[i], MEDIAN_FILTER_WINDOW);
+		median_filter_init(&filter_hum[i], filter_hum_values[i], filter_hum_positions[i],
+				filter_hum_heap[i], MEDIAN_FILTER_WINDOW);
+	}
+#endif
+	for (size_t i = 0; i < MEASUREMENT_READER_COUNT; i++)
+	{
+		measurement_reader_t* reader = &measurement_readers[i];
+		reader->index = i;
+		spsc_ring_init(&reader->ring, reader->readings, sizeof(measurement_reading_t),
+				MEASUREMENT_READER_RING_SIZE);
+	}
+#ifdef MEASUREMENT_READER_TASKS
+	if (measurement_readers_done == NULL)
+	{
+		measurement_readers_done = xEventGroupCreate();
+		if (measurement_readers_done == NULL)
+		{
+			return ESP_ERR_NO_MEM;
+		}
+		for (size_t i = 0; i < MEASUREMENT_READER_COUNT; i++)
+		{
+			// Spread readers over cores, so sensor transactions run in parallel
+			if (xTaskCreatePinnedToCore(measurement_reader_run, "measurement_reader", 4096,
+					&measurement_readers[i], MEASUREMENT_TASK_PRIORITY, &measurement_readers[i].task,
+					i % portNUM_PROCESSORS) != pdPASS)
+			{
+				return ESP_ERR_NO_MEM;
+			}
+		}
+	}
+#endif
 	return platform_measurement_init();
 }
 
-static esp_err_t measurement_read_raw(int16_t* temeprature, int16_t* humidity)
+size_t measurement_sensor_count(void)
+{
+	return platform_measurement_sensor_count();
+}
+
+const char* measurement_sensor_id(size_t sensor)
 {
-	esp_err_t result = platform_measurement_read(temeprature, humidity);
-	ESP_LOGI(TAG, ".measurement_read_raw(): temp: %d, hum: %d",
-			*temeprature, *humidity);
+	const platform_sensor_t* platform_sensor = platform_measurement_sensor(sensor);
+	return platform_sensor != NULL ? platform_sensor->id : NULL;
+}
+
+static esp_err_t measurement_read_raw(size_t sensor, int16_t* temeprature, int16_t* humidity)
+{
+	// Keep maximal frequency only for the timing critical sensor transaction
+	measurement_pm_acquire();
+	esp_err_t result = platform_measurement_read(sensor, temeprature, humidity);
+	measurement_pm_release();
+	ESP_LOGI(TAG, ".measurement_read_raw(): sensor: %u, temp: %d, hum: %d",
+			(unsigned)sensor, *temeprature, *humidity);
 	return result;
 }
 
 #ifdef MEDIAN_SAMPLES
-static esp_err_t measurement_read_median(float* temperature, float* humidity)
+static esp_err_t measurement_read_median(size_t sensor, int16_t* temperature, int16_t* humidity)
+{
+	*temperature = median(measurements_temp[sensor], MEDIAN_SAMPLES);
+	*humidity = median(measurements_hum[sensor], MEDIAN_SAMPLES);
+	return ESP_OK;
+}
+
+/**
+ * Read samples for median from all sensors of the reader, so all of them share the same delays.
+ */
+static void measurement_sample_median(const measurement_reader_t* reader, esp_err_t* results,
+		size_t sensor_count)
 {
-	esp_err_t result = ESP_OK;
 	for (int32_t i = 0; i < MEDIAN_SAMPLES; i++)
 	{
-		result = measurement_read_raw(&measurements_temp[i], &measurements_hum[i]);
-		if (result != ESP_OK)
+		for (size_t sensor = reader->index; sensor < sensor_count; sensor += MEASUREMENT_READER_COUNT)
 		{
-			return result;
+			if (results[sensor] == ESP_OK)
+			{
+				results[sensor] = measurement_read_raw(sensor, &measurements_temp[sensor][i],
+						&measurements_hum[sensor][i]);
+			}
 		}
 		vTaskDelay(MEDIAN_SAMPLES_DELAY / portTICK_PERIOD_MS);
 	}
-	int16_t temp_raw = median(measurements_temp, MEDIAN_SAMPLES);
-	int16_t hum_raw = median(measurements_hum, MEDIAN_SAMPLES);
-	*temperature = ((float)temp_raw) / 10;
-	*humidity = ((float)hum_raw) / 10;
-	return result;
 }
 #endif
 
-#ifndef MEDIAN_SAMPLES
-static esp_err_t measurement_read_single(float* temperature, float* humidity)
+#ifdef MEDIAN_FILTER_WINDOW
+static esp_err_t measurement_sample_filter(size_t sensor)
 {
 	int16_t temp_raw;
 	int16_t hum_raw;
-	esp_err_t result = measurement_read_raw(&temp_raw, &hum_raw);
+	esp_err_t result = measurement_read_raw(sensor, &temp_raw, &hum_raw);
 	if (result == ESP_OK)
 	{
-		*temperature = ((float)temp_raw) / 10;
-		*humidity = ((float)hum_raw) / 10;
+		median_filter_insert(&filter_temp[sensor], temp_raw);
+		median_filter_insert(&filter_hum[sensor], hum_raw);
 	}
 	return result;
 }
+
+static esp_err_t measurement_read_filter(size_t sensor, int16_t* temperature, int16_t* humidity)
+{
+	if (median_filter_count(&filter_temp[sensor]) == 0)
+	{
+		esp_err_t result = measurement_sample_filter(sensor);
+		if (result != ESP_OK)
+		{
+			return result;
+		}
+	}
+	*temperature = median_filter_get(&filter_temp[sensor]);
+	*humidity = median_filter_get(&filter_hum[sensor]);
+	return ESP_OK;
+}
 #endif
 
-esp_err_t measurement_read(float* temperature, float* humidity)
+#if !defined(MEDIAN_SAMPLES) && !defined(MEDIAN_FILTER_WINDOW)
+static esp_err_t measurement_read_single(size_t sensor, int16_t* temperature, int16_t* humidity)
 {
-	esp_pm_lock_handle_t lock_handle;
-	// Disable power management while reading measurements
-	esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "measurement", &lock_handle);
-	esp_pm_lock_acquire(lock_handle);
+	return measurement_read_raw(sensor, temperature, humidity);
+}
+#endif
+
+/**
+ * Read all sensors of the reader and pass results to its ring.
+ */
+static void measurement_reader_read(measurement_reader_t* reader)
+{
+	size_t sensor_count = platform_measurement_sensor_count();
+	esp_err_t results[PLATFORM_MEASUREMENT_MAX_SENSORS];
+	for (size_t sensor = reader->index; sensor < sensor_count; sensor += MEASUREMENT_READER_COUNT)
+	{
+		results[sensor] = ESP_OK;
+	}
 #ifdef MEDIAN_SAMPLES
-	return measurement_read_median(temperature, humidity);
+	measurement_sample_median(reader, results, sensor_count);
+#endif
+	for (size_t sensor = reader->index; sensor < sensor_count; sensor += MEASUREMENT_READER_COUNT)
+	{
+		measurement_reading_t reading;
+		reading.result = results[sensor];
+		reading.values.sensor = sensor;
+		reading.values.utc_timestamp = 0;
+		if (reading.result == ESP_OK)
+		{
+#if defined(MEDIAN_SAMPLES)
+			reading.result = measurement_read_median(sensor, &reading.values.temperature, &reading.values.humidity);
+#elif defined(MEDIAN_FILTER_WINDOW)
+			reading.result = measurement_read_filter(sensor, &reading.values.temperature, &reading.values.humidity);
 #else
-	return measurement_read_single(temperature, humidity);
+			reading.result = measurement_read_single(sensor, &reading.values.temperature, &reading.values.humidity);
 #endif
-	esp_pm_lock_release(lock_handle);
+		}
+		spsc_ring_push(&reader->ring, &reading);
+	}
+}
+
+/**
+ * Sample all sensors of the reader into running median filters and pass results to its ring.
+ */
+static void measurement_reader_sample(measurement_reader_t* reader)
+{
+#ifdef MEDIAN_FILTER_WINDOW
+	size_t sensor_count = platform_measurement_sensor_count();
+	for (size_t sensor = reader->index; sensor < sensor_count; sensor += MEASUREMENT_READER_COUNT)
+	{
+		measurement_reading_t reading;
+		reading.values.sensor = sensor;
+		reading.result = measurement_sample_filter(sensor);
+		spsc_ring_push(&reader->ring, &reading);
+	}
+#endif
+}
+
+static void measurement_reader_execute(measurement_reader_t* reader, measurement_operation_t operation)
+{
+	if (operation == MEASUREMENT_OPERATION_READ)
+	{
+		measurement_reader_read(reader);
+	}
+	else
+	{
+		measurement_reader_sample(reader);
+	}
+}
+
+#ifdef MEASUREMENT_READER_TASKS
+static void measurement_reader_run(void* pvParameters)
+{
+	measurement_reader_t* reader = (measurement_reader_t*)pvParameters;
+	for (;;)
+	{
+		uint32_t operation;
+		xTaskNotifyWait(0, UINT32_MAX, &operation, portMAX_DELAY);
+		measurement_reader_execute(reader, (measurement_operation_t)operation);
+		xEventGroupSetBits(measurement_readers_done, BIT(reader->index));
+	}
+}
+#endif
+
+/**
+ * Execute operation by all readers and wait until they finish.
+ */
+static void measurement_readers_execute(measurement_operation_t operation)
+{
+#ifdef MEASUREMENT_READER_TASKS
+	EventBits_t all_done = BIT(MEASUREMENT_READER_COUNT) - 1;
+	xEventGroupClearBits(measurement_readers_done, all_done);
+	for (size_t i = 0; i < MEASUREMENT_READER_COUNT; i++)
+	{
+		xTaskNotify(measurement_readers[i].task, operation, eSetValueWithOverwrite);
+	}
+	xEventGroupWaitBits(measurement_readers_done, all_done, pdTRUE, pdTRUE, portMAX_DELAY);
+#else
+	measurement_reader_execute(&measurement_readers[0], operation);
+#endif
+}
+
+#ifdef MEDIAN_FILTER_WINDOW
+esp_err_t measurement_sample(void)
+{
+	esp_err_t result = ESP_OK;
+	measurement_readers_execute(MEASUREMENT_OPERATION_SAMPLE);
+	for (size_t i = 0; i < MEASUREMENT_READER_COUNT; i++)
+	{
+		measurement_reading_t reading;
+		while (spsc_ring_pop(&measurement_readers[i].ring, &reading))
+		{
+			if (reading.result != ESP_OK)
+			{
+				result = reading.result;
+			}
+		}
+	}
+	return result;
+}
+#else
+esp_err_t measurement_sample(void)
+{
+	return ESP_ERR_NOT_SUPPORTED;
+}
+#endif
+
+esp_err_t measurement_read(measurement_values_t* values, size_t* count)
+{
+	esp_err_t error = ESP_OK;
+	*count = 0;
+	measurement_readers_execute(MEASUREMENT_OPERATION_READ);
+	ESP_LOGI(TAG, "PM lock held for %u ms per hour", measurement_pm_lock_ms_per_hour());
+	for (size_t i = 0; i < MEASUREMENT_READER_COUNT; i++)
+	{
+		measurement_reading_t reading;
+		while (spsc_ring_pop(&measurement_readers[i].ring, &reading))
+		{
+			if (reading.result == ESP_OK)
+			{
+				values[(*count)++] = reading.values;
+			}
+			else
+			{
+				ESP_LOGW(TAG, "Sensor %s read failed: %s", measurement_sensor_id(reading.values.sensor),
+						esp_err_to_name(reading.result));
+				if (error == ESP_OK)
+				{
+					error = reading.result;
+				}
+			}
+		}
+	}
+	return *count > 0 ? ESP_OK : error;
 }
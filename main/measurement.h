@@ -35,7 +35,9 @@
 #ifndef MAIN_MEASUREMENT_H_
 #define MAIN_MEASUREMENT_H_
 
+#include <stddef.h>
 #include <esp_err.h>
+#include "measurement_task.h"
 
 /**
  * Init measurement module.
@@ -43,10 +45,37 @@
 esp_err_t measurement_init();
 
 /**
- * Read measured values.
- * @param[out] temperature A pointer to temperature variable to be set.
- * @param[out] temperature A pointer to humidity variable to be set.
+ * Get number of registered sensors.
  */
-esp_err_t measurement_read(float* temperature, float* humidity);
+size_t measurement_sensor_count(void);
+
+/**
+ * Get ID of registered sensor.
+ * @param sensor  Index of the sensor
+ * @return ID of the sensor or NULL if the index is out of range.
+ */
+const char* measurement_sensor_id(size_t sensor);
+
+/**
+ * Read measured values of all registered sensors. With running median filter enabled the filtered
+ * values are returned immediately, the sensor is read only if there is no sample in the filter yet.
+ * Sensors which fail are skipped, UTC timestamp of values is not set.
+ * @param[out] values  Array with capacity for all registered sensors
+ * @param[out] count   Number of successfully read sensors stored in values
+ * @return ESP_OK if at least one sensor was read, otherwise error of the first sensor.
+ */
+esp_err_t measurement_read(measurement_values_t* values, size_t* count);
+
+/**
+ * Read raw sample from all sensors into running median filters. Only available when
+ * MEDIAN_FILTER_WINDOW is defined.
+ */
+esp_err_t measurement_sample(void);
+
+/**
+ * Get average time in ms per hour for which the CPU was held at maximal frequency
+ * by sensor reading since measurement_init().
+ */
+uint32_t measurement_pm_lock_ms_per_hour(void);
 
 #endif /* MAIN_MEASUREMENT_H_ */
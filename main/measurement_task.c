@@ -34,64 +34,183 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <time.h>
 #include <sys/time.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 
 #include "measurement_task.h"
 #include "measurement.h"
+#include "platform_measurement.h"
+#include "spsc_ring.h"
+#include "clock_drift.h"
+#include "config.h"
 
 #define TAG "measurement_task"
 
+// Number of values buffered for publisher task, power of two
+#ifndef MEASUREMENT_PUBLISH_QUEUE_SIZE
+#define MEASUREMENT_PUBLISH_QUEUE_SIZE 64
+#endif
+
+// Maximal number of values passed to callback at once
+#define MEASUREMENT_PUBLISH_BATCH 16
+
+// Remaining time in us considered as reached when the task is woken up
+#define MEASUREMENT_WAKE_TOLERANCE 100
+
+_Static_assert(PUBLISH_TASK_PRIORITY < MEASUREMENT_TASK_PRIORITY, "Publishing must not delay sampling");
+
 static measurement_config_t measurement_task_current_config;
 static measurement_task_cb_t measurement_task_callback = NULL;
 static void* measurement_task_context = NULL;
 static TaskHandle_t current_task = NULL;
+static TaskHandle_t publisher_task = NULL;
+static esp_timer_handle_t measurement_timer = NULL;
+
+/**
+ * Wake-up jitter statistics of measurement task
+ */
+static measurement_jitter_t measurement_jitter;
+static portMUX_TYPE measurement_jitter_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Values passed from measurement task (producer) to publisher task (consumer)
+ */
+static spsc_ring_t publish_queue;
+static measurement_values_t publish_queue_buffer[MEASUREMENT_PUBLISH_QUEUE_SIZE];
+
+/**
+ * Model of esp_timer drift against UTC fitted at SNTP synchronizations
+ */
+static clock_drift_t measurement_clock;
+static portMUX_TYPE measurement_clock_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool measurement_clock_initialized = false;
+
+/**
+ * Start of the last measured cycle in UTC ms
+ */
+static uint64_t measurement_last_cycle = 0;
+
+/**
+ * Get current UTC time in us. Drift model is used when it is fitted, so the time is continuous
+ * between synchronizations, otherwise system time synchronized by SNTP is used.
+ */
+static int64_t get_utc_now_us()
+{
+	clock_drift_t model;
+	portENTER_CRITICAL(&measurement_clock_mux);
+	model = measurement_clock;
+	portEXIT_CRITICAL(&measurement_clock_mux);
+	if (measurement_clock_initialized && clock_drift_ready(&model))
+	{
+		return clock_drift_to_utc(&model, esp_timer_get_time());
+	}
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
 
 /**
  * Get current UTC time in ms (synchronized by SNTP)
  */
 static uint64_t get_utc_now()
 {
-    struct timeval tv;
-    uint64_t millisecondsSinceEpoch = 0;
-    gettimeofday(&tv, NULL);
-    millisecondsSinceEpoch = (uint64_t) (tv.tv_sec) * 1000 + (uint64_t) (tv.tv_usec) / 1000;
-    return millisecondsSinceEpoch;
+	return (uint64_t)(get_utc_now_us() / 1000);
 }
 
 /**
- * Calculate time difference to next cycle from interval and offset
+ * Get start of the cycle nearest to UTC time in ms
  */
-static uint64_t get_next_cycle_start(uint64_t current_utc)
+static uint64_t get_nearest_cycle(uint64_t utc)
 {
 	uint64_t offset = measurement_task_current_config.utc_offset_ms;
 	uint64_t interval = measurement_task_current_config.interval_ms;
-	uint64_t difference = (current_utc + interval - offset) % interval;
-	uint64_t next_cycle = interval - difference;
-	// Avoid elapsing twice in the same cycle because of time shift
-	if (next_cycle < interval / 10)
+	uint64_t difference = (utc + interval - offset) % interval;
+	return difference < interval / 2 ? utc - difference : utc - difference + interval;
+}
+
+uint64_t measurement_task_next_cycle(const measurement_config_t* config, uint64_t utc, uint64_t last_cycle)
+{
+	uint64_t offset = config->utc_offset_ms;
+	uint64_t interval = config->interval_ms;
+	uint64_t difference = (utc + interval - offset) % interval;
+	uint64_t next_cycle = utc - difference + interval;
+	// Woken up before the cycle start, which was already measured
+	if (next_cycle == last_cycle)
 	{
 		next_cycle += interval;
 	}
 	return next_cycle;
 }
 
-static void measurement_task_measure()
+/**
+ * Calculate time difference to next cycle from interval and offset
+ */
+static uint64_t get_next_cycle_start(uint64_t current_utc)
+{
+	return measurement_task_next_cycle(&measurement_task_current_config, current_utc, measurement_last_cycle)
+			- current_utc;
+}
+
+void measurement_task_time_synchronized(const struct timeval* tv)
+{
+	int64_t local_us = esp_timer_get_time();
+	int64_t utc_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+	clock_drift_t model;
+	portENTER_CRITICAL(&measurement_clock_mux);
+	model = measurement_clock;
+	portEXIT_CRITICAL(&measurement_clock_mux);
+	if (!measurement_clock_initialized)
+	{
+		clock_drift_init(&model, MEASUREMENT_CLOCK_JUMP * 1000, TIME_SYNC_MAX_DRIFT);
+	}
+	if (!clock_drift_add(&model, local_us, utc_us))
+	{
+		ESP_LOGW(TAG, "Time jump detected, clock drift model restarted");
+	}
+	portENTER_CRITICAL(&measurement_clock_mux);
+	measurement_clock = model;
+	measurement_clock_initialized = true;
+	portEXIT_CRITICAL(&measurement_clock_mux);
+	ESP_LOGI(TAG, "Clock drift: %d ppb", model.drift_ppb);
+}
+
+esp_err_t measurement_task_measure_once(measurement_values_t* values, size_t* count)
 {
-	float temperature = 0;
-	float humidity = 0;
 	uint64_t utc_now = get_utc_now();
-	esp_err_t result = measurement_read(&temperature, &humidity);
-	if (result == ESP_OK)
+	measurement_last_cycle = get_nearest_cycle(utc_now);
+	esp_err_t result = measurement_read(values, count);
+	for (size_t i = 0; i < *count; i++)
 	{
-		measurement_values_t values;
-		values.humidity = humidity;
-		values.temperature = temperature;
-		values.utc_timestamp = utc_now;
+		values[i].utc_timestamp = utc_now;
+	}
+	return result;
+}
 
-		measurement_task_callback(&values, measurement_task_context);
+uint64_t measurement_task_get_next_cycle(void)
+{
+	return get_next_cycle_start(get_utc_now());
+}
+
+static void measurement_task_measure()
+{
+	measurement_values_t values[PLATFORM_MEASUREMENT_MAX_SENSORS];
+	size_t count = 0;
+	esp_err_t result = measurement_task_measure_once(values, &count);
+	if (result == ESP_OK)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!spsc_ring_push(&publish_queue, &values[i]))
+			{
+				ESP_LOGW(TAG, "Publish queue full, sample dropped");
+			}
+		}
+		// Publishing runs in publisher task so it cannot delay the next cycle
+		xTaskNotifyGive(publisher_task);
 	}
 	else
 	{
@@ -100,17 +219,71 @@ static void measurement_task_measure()
 	}
 }
 
+static void measurement_timer_cb(void* arg)
+{
+	xTaskNotifyGive(current_task);
+}
+
+static void measurement_jitter_record(int64_t jitter_us)
+{
+	int32_t jitter = (int32_t)jitter_us;
+	portENTER_CRITICAL(&measurement_jitter_mux);
+	if (measurement_jitter.count == 0 || jitter < measurement_jitter.min_us)
+	{
+		measurement_jitter.min_us = jitter;
+	}
+	if (measurement_jitter.count == 0 || jitter > measurement_jitter.max_us)
+	{
+		measurement_jitter.max_us = jitter;
+	}
+	measurement_jitter.sum_abs_us += jitter < 0 ? -jitter : jitter;
+	measurement_jitter.count++;
+	portEXIT_CRITICAL(&measurement_jitter_mux);
+}
+
+/**
+ * Sleep until UTC time in ms. The task is woken up by one-shot esp_timer with us resolution
+ * instead of tick quantized delay. Remaining time is evaluated again after each wake-up,
+ * since local clock drifts against UTC and the model can be updated while sleeping.
+ */
+static void delay_until_utc(uint64_t utc)
+{
+	int64_t target_us = (int64_t)utc * 1000;
+	int64_t remaining_us;
+	while ((remaining_us = target_us - get_utc_now_us()) > MEASUREMENT_WAKE_TOLERANCE)
+	{
+		if (esp_timer_start_once(measurement_timer, remaining_us) != ESP_OK)
+		{
+			vTaskDelay(remaining_us / 1000 / portTICK_PERIOD_MS + 1);
+			continue;
+		}
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+	measurement_jitter_record(-remaining_us);
+}
+
 /**
  * Wait for next measurements
  */
 static void wait_for_next_cycle(void)
 {
-	TickType_t xLastWakeTime = xTaskGetTickCount();
 	uint64_t utc_now = get_utc_now();
-	uint64_t next_cycle = get_next_cycle_start(utc_now);
-	ESP_LOGI(TAG, "Current time: %llu, next cycle: %llu", utc_now, utc_now + next_cycle);
-	// Check time iteratively since chip clock source and real time can be shifted after long intervals
-	vTaskDelayUntil(&xLastWakeTime, next_cycle / portTICK_PERIOD_MS);
+	uint64_t next_cycle = utc_now + get_next_cycle_start(utc_now);
+	ESP_LOGI(TAG, "Current time: %llu, next cycle: %llu", utc_now, next_cycle);
+#ifdef MEDIAN_FILTER_WINDOW
+	// Feed running median filter while waiting so the filtered value is ready at cycle start
+	for (uint64_t sample = utc_now + MEDIAN_FILTER_SAMPLE_INTERVAL; sample < next_cycle;
+			sample += MEDIAN_FILTER_SAMPLE_INTERVAL)
+	{
+		delay_until_utc(sample);
+		esp_err_t result = measurement_sample();
+		if (result != ESP_OK)
+		{
+			ESP_LOGW(TAG, "Filter sample read failed: %s", esp_err_to_name(result));
+		}
+	}
+#endif
+	delay_until_utc(next_cycle);
 }
 
 static void measurement_task_run(void* pvParameters)
@@ -118,8 +291,46 @@ static void measurement_task_run(void* pvParameters)
 	for (;;)
 	{
 		wait_for_next_cycle();
-		ESP_LOGI(TAG, "Taking measurement sample");
 		measurement_task_measure();
+		measurement_jitter_t jitter;
+		measurement_task_get_jitter(&jitter);
+		ESP_LOGI(TAG, "Measurement sample taken, wake-up jitter: min %d us, max %d us, mean %u us",
+				jitter.min_us, jitter.max_us, (uint32_t)(jitter.sum_abs_us / jitter.count));
+	}
+}
+
+/**
+ * Pass queued values to callback. All sensors of one cycle are passed together, so they are
+ * published in one network wake-up. When no values arrive within the timeout returned by
+ * the callback, it is called with no values.
+ */
+static void measurement_task_publish(void* pvParameters)
+{
+	measurement_values_t values[MEASUREMENT_PUBLISH_BATCH];
+	uint32_t timeout_ms = MEASUREMENT_TASK_WAIT_FOREVER;
+	for (;;)
+	{
+		ulTaskNotifyTake(pdTRUE, timeout_ms == MEASUREMENT_TASK_WAIT_FOREVER ? portMAX_DELAY
+				: timeout_ms / portTICK_PERIOD_MS + 1);
+		size_t count;
+		bool called = false;
+		do
+		{
+			count = 0;
+			while (count < MEASUREMENT_PUBLISH_BATCH && spsc_ring_pop(&publish_queue, &values[count]))
+			{
+				count++;
+			}
+			if (count > 0)
+			{
+				timeout_ms = measurement_task_callback(values, count, measurement_task_context);
+				called = true;
+			}
+		} while (count == MEASUREMENT_PUBLISH_BATCH);
+		if (!called)
+		{
+			timeout_ms = measurement_task_callback(values, 0, measurement_task_context);
+		}
 	}
 }
 
@@ -147,8 +358,27 @@ esp_err_t measurement_task_start(measurement_task_cb_t callback, void* context)
 	}
 	measurement_task_callback = callback;
 	measurement_task_context = context;
+	if (!spsc_ring_init(&publish_queue, publish_queue_buffer, sizeof(measurement_values_t),
+			MEASUREMENT_PUBLISH_QUEUE_SIZE))
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+	esp_timer_create_args_t timer_args = {
+		.callback = measurement_timer_cb,
+		.arg = NULL,
+		.dispatch_method = ESP_TIMER_TASK,
+		.name = "measurement"
+	};
+	esp_err_t result = esp_timer_create(&timer_args, &measurement_timer);
+	if (result != ESP_OK)
+	{
+		return result;
+	}
+	xTaskCreate(measurement_task_publish, "measurement_task_publish", 4096,
+			NULL, PUBLISH_TASK_PRIORITY, &publisher_task);
+	// Sampling has higher priority than publishing and other application tasks to keep cycles on time
 	xTaskCreate(measurement_task_run, "measurement_task_run", 4096,
-			NULL, tskIDLE_PRIORITY, &current_task);
+			NULL, MEASUREMENT_TASK_PRIORITY, &current_task);
 	return ESP_OK;
 }
 
@@ -157,7 +387,26 @@ void measurement_task_stop()
 	if (current_task != NULL)
 	{
 		vTaskDelete(current_task);
+		current_task = NULL;
+	}
+	if (publisher_task != NULL)
+	{
+		vTaskDelete(publisher_task);
+		publisher_task = NULL;
 	}
+	if (measurement_timer != NULL)
+	{
+		esp_timer_stop(measurement_timer);
+		esp_timer_delete(measurement_timer);
+		measurement_timer = NULL;
+	}
+}
+
+void measurement_task_get_jitter(measurement_jitter_t* jitter)
+{
+	portENTER_CRITICAL(&measurement_jitter_mux);
+	*jitter = measurement_jitter;
+	portEXIT_CRITICAL(&measurement_jitter_mux);
 }
 
 esp_err_t measurement_task_deinit()
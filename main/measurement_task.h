@@ -36,6 +36,8 @@
 #define MAIN_MEASUREMENT_TASK_H_
 
 #include <inttypes.h>
+#include <stddef.h>
+#include <sys/time.h>
 #include <driver/gpio.h>
 #include <esp_err.h>
 
@@ -60,23 +62,60 @@ typedef struct measurement_config
 typedef struct measurement_values
 {
 	/**
-	 * Temperature in C.
+	 * UTC timestamp in ms when the sample was taken
 	 */
-	float temperature;
+	uint64_t utc_timestamp;
 	/**
-	 * Humidity in %
+	 * Temperature in tenths of C as read from the sensor
 	 */
-	float humidity;
+	int16_t temperature;
 	/**
-	 * UTC timestamp in ms when the sample was taken
+	 * Humidity in tenths of %
 	 */
-	uint64_t utc_timestamp;
+	int16_t humidity;
+	/**
+	 * Index of the sensor in sensor registry
+	 */
+	uint8_t sensor;
 } measurement_values_t;
 
 /**
- * Call back for receiving measured values.
+ * Statistics of difference between scheduled and actual wake-up time of measurement task.
+ * Positive values mean late wake-ups.
+ */
+typedef struct measurement_jitter
+{
+	/**
+	 * Number of wake-ups, including wake-ups for filter samples
+	 */
+	uint32_t count;
+	/**
+	 * Minimal jitter in us
+	 */
+	int32_t min_us;
+	/**
+	 * Maximal jitter in us
+	 */
+	int32_t max_us;
+	/**
+	 * Sum of absolute jitters in us
+	 */
+	uint64_t sum_abs_us;
+} measurement_jitter_t;
+
+/**
+ * Timeout returned by callback when it needs to be called only with new values
  */
-typedef void (*measurement_task_cb_t)(const measurement_values_t* measurement_values, void* context);
+#define MEASUREMENT_TASK_WAIT_FOREVER UINT32_MAX
+
+/**
+ * Call back for receiving measured values. Values of all sensors read in one cycle are passed
+ * together, values of several cycles may be passed at once if publishing is late. The callback
+ * is called from separate publisher task, so it does not delay measurements.
+ * @return Time in ms after which the callback is called again with no values if no new values
+ *         arrive, so it can publish buffered values after timeout, or MEASUREMENT_TASK_WAIT_FOREVER.
+ */
+typedef uint32_t (*measurement_task_cb_t)(const measurement_values_t* measurement_values, size_t count, void* context);
 
 /**
  * Initialize measurement task functionality.
@@ -93,6 +132,42 @@ esp_err_t measurement_task_start(measurement_task_cb_t callback, void* context);
 
 void measurement_task_stop(void);
 
+/**
+ * Read all sensors once in the calling task. Used instead of periodical task when
+ * the device sleeps between measurements.
+ * @param[out] values  Array with capacity for all registered sensors
+ * @param[out] count   Number of read values
+ */
+esp_err_t measurement_task_measure_once(measurement_values_t* values, size_t* count);
+
+/**
+ * Get time in ms from now to the start of the next measurement cycle aligned by configured
+ * interval and offset.
+ */
+uint64_t measurement_task_get_next_cycle(void);
+
+/**
+ * Calculate start of the next measurement cycle used by the task, aligned by interval and offset.
+ * @param config      Measurement configuration
+ * @param utc         Current UTC time in ms
+ * @param last_cycle  Start of the last measured cycle in UTC ms, it is skipped when woken up early
+ * @return Start of the next cycle in UTC ms
+ */
+uint64_t measurement_task_next_cycle(const measurement_config_t* config, uint64_t utc, uint64_t last_cycle);
+
+/**
+ * Pass SNTP synchronized time to the clock drift model, which schedules cycles between
+ * synchronizations. Call it from SNTP notification callback.
+ * @param tv  Synchronized UTC time
+ */
+void measurement_task_time_synchronized(const struct timeval* tv);
+
+/**
+ * Get wake-up jitter statistics since the start of measurements.
+ * @param[out] jitter  Jitter statistics
+ */
+void measurement_task_get_jitter(measurement_jitter_t* jitter);
+
 /**
  * Stop periodical measurements.
  */
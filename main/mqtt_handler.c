@@ -34,17 +34,69 @@
 
 #include <stdbool.h>
 #include <string.h>
+#include <sys/time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/event_groups.h>
 #include <esp_log.h>
 #include <mqtt_client.h>
 
 #include "mqtt_handler.h"
-#include "parson.h"
+#include "measurement.h"
+#include "platform_measurement.h"
+#include "payload_encoder.h"
 #include "config.h"
+#ifdef OFFLINE_QUEUE_PARTITION
+#include "offline_queue.h"
+#endif
 
 #define TAG "mqtt_handler"
 
+// Enough for single sample payload in any format with device ID up to 32 characters
+#define MQTT_PAYLOAD_SIZE 128
+
+// Period of checking delivery of published messages
+#define MQTT_PUBLISHED_POLL_INTERVAL 10
+
+#define MQTT_CONNECTED_BIT BIT0
+
 static mqtt_handler_config_t mqtt_handler_config;
 static esp_mqtt_client_handle_t mqtt_client = NULL;
+static EventGroupHandle_t mqtt_event_group = NULL;
+
+/**
+ * Number of QoS 1 messages not acknowledged by the broker yet
+ */
+static portMUX_TYPE mqtt_pending_mux = portMUX_INITIALIZER_UNLOCKED;
+static int32_t mqtt_pending_count = 0;
+
+#ifdef MQTT_BATCH_SIZE
+// Payload header and the longest representation of each sample: "-3276.8,-3276.8,18446744073709551615,"
+#define MQTT_BATCH_PAYLOAD_SIZE (MQTT_PAYLOAD_SIZE + MQTT_BATCH_SIZE * 40)
+
+/**
+ * Buffered samples of each sensor, the oldest sample is dropped when publishing fails and the buffer is full.
+ */
+static measurement_values_t mqtt_batch[PLATFORM_MEASUREMENT_MAX_SENSORS][MQTT_BATCH_SIZE];
+static size_t mqtt_batch_count[PLATFORM_MEASUREMENT_MAX_SENSORS];
+static char mqtt_batch_payload[MQTT_BATCH_PAYLOAD_SIZE];
+#endif
+
+#ifdef OFFLINE_QUEUE_PARTITION
+#ifndef OFFLINE_QUEUE_DRAIN_BATCH
+#define OFFLINE_QUEUE_DRAIN_BATCH 20
+#endif
+#ifndef OFFLINE_QUEUE_DRAIN_INTERVAL
+#define OFFLINE_QUEUE_DRAIN_INTERVAL 500
+#endif
+
+#define OFFLINE_QUEUE_PAYLOAD_SIZE (MQTT_PAYLOAD_SIZE + OFFLINE_QUEUE_DRAIN_BATCH * 40)
+
+static TaskHandle_t offline_queue_task = NULL;
+static measurement_values_t offline_queue_batch[OFFLINE_QUEUE_DRAIN_BATCH];
+static measurement_values_t offline_queue_sensor_batch[OFFLINE_QUEUE_DRAIN_BATCH];
+static char offline_queue_payload[OFFLINE_QUEUE_PAYLOAD_SIZE];
+#endif
 
 /**
  * Handle MQTT events.
@@ -54,12 +106,21 @@ static esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event)
 	switch (event->event_id) {
 	case MQTT_EVENT_CONNECTED:
 		ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
+		xEventGroupSetBits(mqtt_event_group, MQTT_CONNECTED_BIT);
+#ifdef OFFLINE_QUEUE_PARTITION
+		// Start forwarding samples stored while offline
+		xTaskNotifyGive(offline_queue_task);
+#endif
 		break;
 	case MQTT_EVENT_DISCONNECTED:
 		ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
+		xEventGroupClearBits(mqtt_event_group, MQTT_CONNECTED_BIT);
 		break;
 	case MQTT_EVENT_PUBLISHED:
 		ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+		portENTER_CRITICAL(&mqtt_pending_mux);
+		mqtt_pending_count--;
+		portEXIT_CRITICAL(&mqtt_pending_mux);
 		break;
 	case MQTT_EVENT_ERROR:
 		ESP_LOGI(TAG, "MQTT_EVENT_ERROR");
@@ -70,8 +131,40 @@ static esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event)
     return ESP_OK;
 }
 
+#ifdef OFFLINE_QUEUE_PARTITION
+static void offline_queue_drain_task(void* arg);
+#endif
+
+/**
+ * Check if the client is connected to the broker.
+ */
+static inline bool mqtt_handler_connected(void)
+{
+	return (xEventGroupGetBits(mqtt_event_group) & MQTT_CONNECTED_BIT) != 0;
+}
+
 esp_err_t mqtt_handler_init(const mqtt_handler_config_t config)
 {
+	if (mqtt_event_group == NULL)
+	{
+		mqtt_event_group = xEventGroupCreate();
+		if (mqtt_event_group == NULL)
+		{
+			return ESP_ERR_NO_MEM;
+		}
+	}
+#ifdef OFFLINE_QUEUE_PARTITION
+	if (offline_queue_init(OFFLINE_QUEUE_PARTITION) != ESP_OK)
+	{
+		ESP_LOGW(TAG, "Offline queue is not available");
+	}
+	if (offline_queue_task == NULL
+			&& xTaskCreate(offline_queue_drain_task, "offline_queue", 4096, NULL, PUBLISH_TASK_PRIORITY,
+					&offline_queue_task) != pdPASS)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+#endif
 	esp_mqtt_client_config_t mqtt_cfg;
 	memset((void*)&mqtt_cfg, 0, sizeof(esp_mqtt_client_config_t));
 	mqtt_cfg.host = config.host;
@@ -91,33 +184,368 @@ esp_err_t mqtt_handler_start(void)
 	return esp_mqtt_client_start(mqtt_client);
 }
 
-esp_err_t mqtt_handler_publish_values(const measurement_values_t* values)
+#ifndef MQTT_BATCH_SIZE
+/**
+ * Encode single sample in configured payload format. Sensor ID is used as device ID.
+ */
+static size_t mqtt_handler_encode(const measurement_values_t* values, char* buffer, size_t size)
+{
+	const char* device_id = measurement_sensor_id(values->sensor);
+#if MQTT_PAYLOAD_FORMAT == PAYLOAD_FORMAT_CBOR
+	return payload_encode_cbor(values, device_id, (uint8_t*)buffer, size);
+#elif MQTT_PAYLOAD_FORMAT == PAYLOAD_FORMAT_BINARY
+	return payload_encode_binary(values, 1, device_id, (uint8_t*)buffer, size);
+#elif MQTT_PAYLOAD_FORMAT == PAYLOAD_FORMAT_DELTA
+	return payload_encode_delta(values, 1, device_id, (uint8_t*)buffer, size);
+#else
+	return payload_encode_json(values, device_id, buffer, size);
+#endif
+}
+#endif
+
+#if defined(MQTT_BATCH_SIZE) || defined(OFFLINE_QUEUE_PARTITION)
+/**
+ * Encode batch of samples from the same sensor in configured payload format.
+ */
+static size_t mqtt_handler_encode_batch(const measurement_values_t* values, size_t count,
+		char* buffer, size_t size)
+{
+	const char* device_id = measurement_sensor_id(values->sensor);
+#if MQTT_PAYLOAD_FORMAT == PAYLOAD_FORMAT_CBOR
+	return payload_encode_cbor_batch(values, count, device_id, (uint8_t*)buffer, size);
+#elif MQTT_PAYLOAD_FORMAT == PAYLOAD_FORMAT_BINARY
+	return payload_encode_binary(values, count, device_id, (uint8_t*)buffer, size);
+#elif MQTT_PAYLOAD_FORMAT == PAYLOAD_FORMAT_DELTA
+	return payload_encode_delta(values, count, device_id, (uint8_t*)buffer, size);
+#else
+	return payload_encode_json_batch(values, count, device_id, buffer, size);
+#endif
+}
+#endif
+
+static esp_err_t mqtt_handler_publish(const char* payload, size_t length)
 {
-	/*
-	Serialize measurement calues to JSON in format:
+	// Publish values to the configured topic
+	int msg_id = esp_mqtt_client_publish(mqtt_client, mqtt_handler_config.topic, payload, length, 1, false);
+	if (msg_id < 0)
 	{
-		"id": "SENSOR1",
-   		"temperature": 21.100000381469727,
- 		"humidity": 70.900001525878906,
-		"utc": 1572982980008
+		return ESP_FAIL;
 	}
-	*/
-	JSON_Value *root_value = json_value_init_object();
-	JSON_Object *root_object = json_value_get_object(root_value);
-	char *serialized_string = NULL;
-	json_object_set_string(root_object, "id", DEVICE_ID);
-	json_object_set_number(root_object, "temperature", values->temperature);
-	json_object_set_number(root_object, "humidity", values->humidity);
-	json_object_set_number(root_object, "utc", values->utc_timestamp);
-	serialized_string = json_serialize_to_string_pretty(root_value);
-	size_t length = strlen(serialized_string);
-	// Publish values to the configured topic
-	esp_mqtt_client_publish(mqtt_client, mqtt_handler_config.topic, serialized_string, length, 1, false);
-	json_free_serialized_string(serialized_string);
-	json_value_free(root_value);
+	portENTER_CRITICAL(&mqtt_pending_mux);
+	mqtt_pending_count++;
+	portEXIT_CRITICAL(&mqtt_pending_mux);
 	return ESP_OK;
 }
 
+#ifdef OFFLINE_QUEUE_PARTITION
+/**
+ * Publish stored samples in one message per sensor. Samples of unknown sensors are discarded.
+ */
+static esp_err_t offline_queue_forward(const measurement_values_t* values, size_t count)
+{
+	for (size_t sensor = 0; sensor < measurement_sensor_count(); sensor++)
+	{
+		size_t sensor_count = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (values[i].sensor == sensor)
+			{
+				offline_queue_sensor_batch[sensor_count++] = values[i];
+			}
+		}
+		if (sensor_count == 0)
+		{
+			continue;
+		}
+		size_t length = mqtt_handler_encode_batch(offline_queue_sensor_batch, sensor_count,
+				offline_queue_payload, sizeof(offline_queue_payload));
+		if (length == 0 || mqtt_handler_publish(offline_queue_payload, length) != ESP_OK)
+		{
+			return ESP_FAIL;
+		}
+	}
+	return ESP_OK;
+}
+
+/**
+ * Forward samples stored in offline queue in batches. Batches are rate limited so the backlog
+ * does not saturate the link after reconnecting.
+ */
+static void offline_queue_drain_task(void* arg)
+{
+	for (;;)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		while (mqtt_handler_connected() && offline_queue_count() > 0)
+		{
+			size_t count;
+			offline_queue_id_t last_id;
+			if (offline_queue_peek(offline_queue_batch, OFFLINE_QUEUE_DRAIN_BATCH, &count, &last_id) != ESP_OK
+					|| count == 0)
+			{
+				break;
+			}
+			if (offline_queue_forward(offline_queue_batch, count) != ESP_OK)
+			{
+				ESP_LOGW(TAG, "Failed to forward %u stored samples", (unsigned)count);
+				break;
+			}
+			offline_queue_pop(last_id);
+			ESP_LOGI(TAG, "Forwarded %u stored samples, %u remaining", (unsigned)count,
+					(unsigned)offline_queue_count());
+			vTaskDelay(pdMS_TO_TICKS(OFFLINE_QUEUE_DRAIN_INTERVAL));
+		}
+	}
+}
+
+/**
+ * Store samples which cannot be published now into offline queue.
+ */
+static esp_err_t mqtt_handler_store(const measurement_values_t* values, size_t count)
+{
+	esp_err_t result = ESP_OK;
+	for (size_t i = 0; i < count && result == ESP_OK; i++)
+	{
+		result = offline_queue_push(&values[i]);
+	}
+	if (result == ESP_OK && mqtt_handler_connected())
+	{
+		xTaskNotifyGive(offline_queue_task);
+	}
+	return result;
+}
+
+/**
+ * Check if samples must go through offline queue. Samples are queued while the broker is
+ * not connected and also while older queued samples are being forwarded to keep their order.
+ */
+static inline bool mqtt_handler_offline(void)
+{
+	return !mqtt_handler_connected() || offline_queue_count() > 0;
+}
+#endif
+
+#ifdef MQTT_BATCH_SIZE
+/**
+ * Publish buffered samples of one sensor.
+ */
+static esp_err_t mqtt_handler_flush_sensor(size_t sensor)
+{
+	if (mqtt_batch_count[sensor] == 0)
+	{
+		return ESP_OK;
+	}
+	esp_err_t result = ESP_FAIL;
+#ifdef OFFLINE_QUEUE_PARTITION
+	if (!mqtt_handler_offline())
+#endif
+	{
+		size_t length = mqtt_handler_encode_batch(mqtt_batch[sensor], mqtt_batch_count[sensor],
+				mqtt_batch_payload, sizeof(mqtt_batch_payload));
+		if (length == 0)
+		{
+			return ESP_ERR_INVALID_SIZE;
+		}
+		result = mqtt_handler_publish(mqtt_batch_payload, length);
+	}
+#ifdef OFFLINE_QUEUE_PARTITION
+	if (result != ESP_OK)
+	{
+		result = mqtt_handler_store(mqtt_batch[sensor], mqtt_batch_count[sensor]);
+	}
+#endif
+	if (result == ESP_OK)
+	{
+		mqtt_batch_count[sensor] = 0;
+	}
+	return result;
+}
+
+esp_err_t mqtt_handler_flush(void)
+{
+	esp_err_t result = ESP_OK;
+	// Batches of all sensors are published together
+	for (size_t sensor = 0; sensor < PLATFORM_MEASUREMENT_MAX_SENSORS; sensor++)
+	{
+		esp_err_t sensor_result = mqtt_handler_flush_sensor(sensor);
+		if (sensor_result != ESP_OK)
+		{
+			result = sensor_result;
+		}
+	}
+	return result;
+}
+
+#ifdef MQTT_BATCH_TIMEOUT
+/**
+ * Get current UTC time in ms, buffered samples are aged against it.
+ */
+static uint64_t mqtt_handler_get_utc_now(void)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (uint64_t)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+/**
+ * Get time in ms until the oldest buffered sample reaches MQTT_BATCH_TIMEOUT,
+ * UINT64_MAX if there is no buffered sample.
+ */
+static uint64_t mqtt_handler_get_batch_remaining(uint64_t utc_now)
+{
+	uint64_t remaining = UINT64_MAX;
+	for (size_t sensor = 0; sensor < PLATFORM_MEASUREMENT_MAX_SENSORS; sensor++)
+	{
+		if (mqtt_batch_count[sensor] == 0)
+		{
+			continue;
+		}
+		uint64_t oldest = mqtt_batch[sensor][0].utc_timestamp;
+		uint64_t age = utc_now > oldest ? utc_now - oldest : 0;
+		uint64_t sensor_remaining = age < MQTT_BATCH_TIMEOUT ? MQTT_BATCH_TIMEOUT - age : 0;
+		if (sensor_remaining < remaining)
+		{
+			remaining = sensor_remaining;
+		}
+	}
+	return remaining;
+}
+#endif
+
+uint32_t mqtt_handler_get_flush_timeout(void)
+{
+#ifdef MQTT_BATCH_TIMEOUT
+	uint64_t remaining = mqtt_handler_get_batch_remaining(mqtt_handler_get_utc_now());
+	return remaining < UINT32_MAX ? (uint32_t)remaining : UINT32_MAX;
+#else
+	return UINT32_MAX;
+#endif
+}
+
+esp_err_t mqtt_handler_publish_values(const measurement_values_t* values, size_t count)
+{
+	esp_err_t result = ESP_OK;
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t sensor = values[i].sensor;
+		if (sensor >= PLATFORM_MEASUREMENT_MAX_SENSORS)
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+		measurement_values_t* batch = mqtt_batch[sensor];
+		if (mqtt_batch_count[sensor] == MQTT_BATCH_SIZE)
+		{
+			// Previous flush failed, drop the oldest sample
+			memmove(&batch[0], &batch[1], (MQTT_BATCH_SIZE - 1) * sizeof(measurement_values_t));
+			mqtt_batch_count[sensor]--;
+			result = ESP_ERR_NO_MEM;
+		}
+		batch[mqtt_batch_count[sensor]++] = values[i];
+		// Flush before the next sample is added, values may contain more samples of one sensor than the batch
+		if (mqtt_batch_count[sensor] == MQTT_BATCH_SIZE)
+		{
+			esp_err_t flush_result = mqtt_handler_flush();
+			if (flush_result != ESP_OK && result == ESP_OK)
+			{
+				result = flush_result;
+			}
+		}
+	}
+#ifdef MQTT_BATCH_TIMEOUT
+	// Age is checked against the current time, so batches are published also when no samples arrive
+	if (mqtt_handler_get_batch_remaining(mqtt_handler_get_utc_now()) == 0)
+	{
+		esp_err_t flush_result = mqtt_handler_flush();
+		if (flush_result != ESP_OK && result == ESP_OK)
+		{
+			result = flush_result;
+		}
+	}
+#endif
+	return result;
+}
+#else
+esp_err_t mqtt_handler_flush(void)
+{
+	return ESP_OK;
+}
+
+uint32_t mqtt_handler_get_flush_timeout(void)
+{
+	return UINT32_MAX;
+}
+
+/**
+ * Publish single sample in its own message.
+ */
+static esp_err_t mqtt_handler_publish_sample(const measurement_values_t* values)
+{
+#ifdef OFFLINE_QUEUE_PARTITION
+	if (mqtt_handler_offline())
+	{
+		return mqtt_handler_store(values, 1);
+	}
+#endif
+	// Serialize into stack buffer without any heap allocation
+	char payload[MQTT_PAYLOAD_SIZE];
+	size_t length = mqtt_handler_encode(values, payload, sizeof(payload));
+	if (length == 0)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+	esp_err_t result = mqtt_handler_publish(payload, length);
+#ifdef OFFLINE_QUEUE_PARTITION
+	if (result != ESP_OK)
+	{
+		result = mqtt_handler_store(values, 1);
+	}
+#endif
+	return result;
+}
+
+esp_err_t mqtt_handler_publish_values(const measurement_values_t* values, size_t count)
+{
+	esp_err_t result = ESP_OK;
+	for (size_t i = 0; i < count; i++)
+	{
+		esp_err_t sample_result = mqtt_handler_publish_sample(&values[i]);
+		if (sample_result != ESP_OK)
+		{
+			result = sample_result;
+		}
+	}
+	return result;
+}
+#endif
+
+esp_err_t mqtt_handler_wait_connected(uint32_t timeout_ms)
+{
+	EventBits_t bits = xEventGroupWaitBits(mqtt_event_group, MQTT_CONNECTED_BIT, pdFALSE, pdFALSE,
+			pdMS_TO_TICKS(timeout_ms));
+	return (bits & MQTT_CONNECTED_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t mqtt_handler_wait_published(uint32_t timeout_ms)
+{
+	TickType_t start = xTaskGetTickCount();
+	for (;;)
+	{
+		portENTER_CRITICAL(&mqtt_pending_mux);
+		// Acknowledgement can be processed before the publishing call returns
+		bool published = mqtt_pending_count <= 0;
+		portEXIT_CRITICAL(&mqtt_pending_mux);
+		if (published)
+		{
+			return ESP_OK;
+		}
+		if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(timeout_ms))
+		{
+			return ESP_ERR_TIMEOUT;
+		}
+		vTaskDelay(pdMS_TO_TICKS(MQTT_PUBLISHED_POLL_INTERVAL));
+	}
+}
+
 void mqtt_handler_deinit(void)
 {
 	esp_mqtt_client_destroy(mqtt_client);
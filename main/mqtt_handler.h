@@ -65,10 +65,41 @@ esp_err_t mqtt_handler_init(mqtt_handler_config_t config);
 esp_err_t mqtt_handler_start(void);
 
 /**
- * Publish measured values serialized into JSON to configured topic.
+ * Publish measured values of sensors to configured topic, one message per sensor. If MQTT_BATCH_SIZE
+ * is defined the values are buffered and each batch is published as soon as it is full or its oldest
+ * sample reaches MQTT_BATCH_TIMEOUT. Call with no values after mqtt_handler_get_flush_timeout()
+ * to publish batches when no new samples arrive.
  * @param values  Measured values
+ * @param count   Number of measured values
+ * @return ESP_ERR_NO_MEM if buffered sample was dropped because previous batch was not published.
  */
-esp_err_t mqtt_handler_publish_values(const measurement_values_t* values);
+esp_err_t mqtt_handler_publish_values(const measurement_values_t* values, size_t count);
+
+/**
+ * Publish all buffered values immediately. Does nothing if batching is disabled
+ * or there are no buffered values.
+ */
+esp_err_t mqtt_handler_flush(void);
+
+/**
+ * Get time until the oldest buffered sample reaches MQTT_BATCH_TIMEOUT.
+ * @return Time in ms, UINT32_MAX if there is no buffered sample or the timeout is not defined.
+ */
+uint32_t mqtt_handler_get_flush_timeout(void);
+
+/**
+ * Wait until the client is connected to the broker.
+ * @param timeout_ms  Maximal waiting time in ms
+ * @return ESP_OK if connected or ESP_ERR_TIMEOUT.
+ */
+esp_err_t mqtt_handler_wait_connected(uint32_t timeout_ms);
+
+/**
+ * Wait until all published messages are acknowledged by the broker.
+ * @param timeout_ms  Maximal waiting time in ms
+ * @return ESP_OK if all messages were delivered or ESP_ERR_TIMEOUT.
+ */
+esp_err_t mqtt_handler_wait_published(uint32_t timeout_ms);
 
 /**
  * Deinitialize MQTT handler to free allocated resources
@@ -0,0 +1,507 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of persistent queue of samples as append only ring log in flash.
+ *
+ * Partition is divided into flash sectors. Each sector starts with header holding sequence
+ * number of the sector, followed by fixed size record slots. Records are only appended and
+ * removed records are marked by clearing consumed byte, so flash is never rewritten in place.
+ * Sectors are erased only when the ring wraps around, so all sectors wear evenly.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <esp_log.h>
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+
+#include "offline_queue.h"
+
+#define TAG "offline_queue"
+
+#define QUEUE_SECTOR_MAGIC 0x51474F4Cu
+#define QUEUE_HEADER_SIZE 16
+#define QUEUE_RECORD_SIZE 16
+#define QUEUE_RECORD_DATA_SIZE 13
+#define QUEUE_SLOTS_PER_SECTOR ((SPI_FLASH_SEC_SIZE - QUEUE_HEADER_SIZE) / QUEUE_RECORD_SIZE)
+
+// Bytes of record slot
+#define QUEUE_RECORD_SENSOR 12
+#define QUEUE_RECORD_CRC 13
+#define QUEUE_RECORD_WRITTEN 14
+#define QUEUE_RECORD_CONSUMED 15
+
+#define QUEUE_FLAG_SET 0x00
+#define QUEUE_FLAG_ERASED 0xFF
+
+/**
+ * Header at the beginning of each used sector
+ */
+typedef struct queue_sector_header
+{
+	uint32_t magic;
+	uint32_t sequence;
+	uint8_t reserved[QUEUE_HEADER_SIZE - 8];
+} queue_sector_header_t;
+
+/**
+ * Position of record slot in the partition
+ */
+typedef struct queue_position
+{
+	uint32_t sector;
+	uint32_t slot;
+} queue_position_t;
+
+static const esp_partition_t* queue_partition = NULL;
+static SemaphoreHandle_t queue_mutex = NULL;
+static uint32_t queue_sector_count = 0;
+static uint32_t queue_sequence = 0;
+static queue_position_t queue_head;
+static queue_position_t queue_tail;
+static size_t queue_count = 0;
+
+static uint8_t crc8(const uint8_t* data, size_t length)
+{
+	uint8_t crc = 0;
+	while (length--)
+	{
+		crc ^= *data++;
+		for (int i = 0; i < 8; i++)
+		{
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static void record_pack(const measurement_values_t* values, uint8_t* record)
+{
+	record[0] = (uint16_t)values->temperature;
+	record[1] = (uint16_t)values->temperature >> 8;
+	record[2] = (uint16_t)values->humidity;
+	record[3] = (uint16_t)values->humidity >> 8;
+	for (int i = 0; i < 8; i++)
+	{
+		record[4 + i] = values->utc_timestamp >> (8 * i);
+	}
+	record[QUEUE_RECORD_SENSOR] = values->sensor;
+}
+
+static void record_unpack(const uint8_t* record, measurement_values_t* values)
+{
+	values->temperature = (int16_t)(record[0] | (record[1] << 8));
+	values->humidity = (int16_t)(record[2] | (record[3] << 8));
+	values->utc_timestamp = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		values->utc_timestamp |= ((uint64_t)record[4 + i]) << (8 * i);
+	}
+	values->sensor = record[QUEUE_RECORD_SENSOR];
+}
+
+static inline size_t sector_offset(uint32_t sector)
+{
+	return sector * SPI_FLASH_SEC_SIZE;
+}
+
+static inline size_t slot_offset(const queue_position_t* position)
+{
+	return sector_offset(position->sector) + QUEUE_HEADER_SIZE + position->slot * QUEUE_RECORD_SIZE;
+}
+
+static void position_next(queue_position_t* position)
+{
+	if (++position->slot == QUEUE_SLOTS_PER_SECTOR)
+	{
+		position->slot = 0;
+		position->sector = (position->sector + 1) % queue_sector_count;
+	}
+}
+
+static bool record_valid(const uint8_t* record)
+{
+	return record[QUEUE_RECORD_WRITTEN] == QUEUE_FLAG_SET
+			&& record[QUEUE_RECORD_CRC] == crc8(record, QUEUE_RECORD_DATA_SIZE);
+}
+
+static bool record_pending(const uint8_t* record)
+{
+	return record_valid(record) && record[QUEUE_RECORD_CONSUMED] == QUEUE_FLAG_ERASED;
+}
+
+static esp_err_t sector_read_header(uint32_t sector, queue_sector_header_t* header)
+{
+	return esp_partition_read(queue_partition, sector_offset(sector), header, sizeof(*header));
+}
+
+/**
+ * Get identifier of record at position from sequence number of its sector, so identifiers
+ * grow along the ring and records of erased sectors are never matched.
+ * @param[in]     position  Record position
+ * @param[in,out] sector    Sector whose sequence is cached, UINT32_MAX if none
+ * @param[in,out] sequence  Cached sequence of the sector
+ */
+static esp_err_t record_id(const queue_position_t* position, uint32_t* sector, uint32_t* sequence,
+		offline_queue_id_t* id)
+{
+	if (*sector != position->sector)
+	{
+		queue_sector_header_t header;
+		esp_err_t result = sector_read_header(position->sector, &header);
+		if (result != ESP_OK)
+		{
+			return result;
+		}
+		if (header.magic != QUEUE_SECTOR_MAGIC)
+		{
+			return ESP_ERR_INVALID_STATE;
+		}
+		*sector = position->sector;
+		*sequence = header.sequence;
+	}
+	*id = ((offline_queue_id_t)*sequence << 32) | position->slot;
+	return ESP_OK;
+}
+
+/**
+ * Erase sector and mark it as the newest one.
+ */
+static esp_err_t sector_start(uint32_t sector)
+{
+	esp_err_t result = esp_partition_erase_range(queue_partition, sector_offset(sector), SPI_FLASH_SEC_SIZE);
+	if (result != ESP_OK)
+	{
+		return result;
+	}
+	queue_sector_header_t header;
+	memset(&header, 0xFF, sizeof(header));
+	header.magic = QUEUE_SECTOR_MAGIC;
+	header.sequence = ++queue_sequence;
+	return esp_partition_write(queue_partition, sector_offset(sector), &header, sizeof(header));
+}
+
+/**
+ * Find sectors with the oldest and the newest sequence number. Returns false if no sector is used.
+ */
+static bool queue_find_sectors(uint32_t* oldest, uint32_t* newest)
+{
+	bool found = false;
+	uint32_t oldest_sequence = 0;
+	for (uint32_t sector = 0; sector < queue_sector_count; sector++)
+	{
+		queue_sector_header_t header;
+		if (sector_read_header(sector, &header) != ESP_OK || header.magic != QUEUE_SECTOR_MAGIC)
+		{
+			continue;
+		}
+		if (!found || header.sequence > queue_sequence)
+		{
+			queue_sequence = header.sequence;
+			*newest = sector;
+		}
+		if (!found || header.sequence < oldest_sequence)
+		{
+			oldest_sequence = header.sequence;
+			*oldest = sector;
+		}
+		found = true;
+	}
+	return found;
+}
+
+/**
+ * Scan used sectors from the oldest one to restore head, tail and count of pending records.
+ */
+static esp_err_t queue_restore(void)
+{
+	uint32_t oldest = 0;
+	uint32_t newest = 0;
+	queue_sequence = 0;
+	queue_count = 0;
+	if (!queue_find_sectors(&oldest, &newest))
+	{
+		queue_head.sector = 0;
+		queue_head.slot = 0;
+		queue_tail = queue_head;
+		return ESP_OK;
+	}
+
+	bool tail_found = false;
+	queue_position_t position = { oldest, 0 };
+	queue_head = position;
+	queue_tail = position;
+	for (;;)
+	{
+		uint8_t record[QUEUE_RECORD_SIZE];
+		esp_err_t result = esp_partition_read(queue_partition, slot_offset(&position), record, sizeof(record));
+		if (result != ESP_OK)
+		{
+			return result;
+		}
+		bool erased = record[QUEUE_RECORD_WRITTEN] == QUEUE_FLAG_ERASED;
+		if (erased && position.sector == newest)
+		{
+			// First free slot of the newest sector is the head
+			queue_head = position;
+			break;
+		}
+		if (!erased && record_pending(record))
+		{
+			if (!tail_found)
+			{
+				queue_tail = position;
+				tail_found = true;
+			}
+			queue_count++;
+		}
+		if (position.sector == newest && position.slot == QUEUE_SLOTS_PER_SECTOR - 1)
+		{
+			// The newest sector is full, the next one is started by the next push
+			queue_head = position;
+			position_next(&queue_head);
+			break;
+		}
+		position_next(&position);
+	}
+	if (!tail_found)
+	{
+		queue_tail = queue_head;
+	}
+	ESP_LOGI(TAG, "Restored %u pending samples, head %u:%u, tail %u:%u", (unsigned)queue_count,
+			queue_head.sector, queue_head.slot, queue_tail.sector, queue_tail.slot);
+	return ESP_OK;
+}
+
+esp_err_t offline_queue_init(const char* partition_label)
+{
+	queue_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+	if (queue_partition == NULL)
+	{
+		ESP_LOGE(TAG, "Partition %s not found", partition_label);
+		return ESP_ERR_NOT_FOUND;
+	}
+	queue_sector_count = queue_partition->size / SPI_FLASH_SEC_SIZE;
+	if (queue_sector_count < 2)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+	if (queue_mutex == NULL)
+	{
+		queue_mutex = xSemaphoreCreateMutex();
+		if (queue_mutex == NULL)
+		{
+			return ESP_ERR_NO_MEM;
+		}
+	}
+	xSemaphoreTake(queue_mutex, portMAX_DELAY);
+	esp_err_t result = queue_restore();
+	xSemaphoreGive(queue_mutex);
+	return result;
+}
+
+/**
+ * Move tail to the next pending record or to the head.
+ */
+static esp_err_t queue_advance_tail(void)
+{
+	while (queue_tail.sector != queue_head.sector || queue_tail.slot != queue_head.slot)
+	{
+		uint8_t record[QUEUE_RECORD_SIZE];
+		esp_err_t result = esp_partition_read(queue_partition, slot_offset(&queue_tail), record, sizeof(record));
+		if (result != ESP_OK)
+		{
+			return result;
+		}
+		if (record_pending(record))
+		{
+			break;
+		}
+		position_next(&queue_tail);
+	}
+	return ESP_OK;
+}
+
+/**
+ * Ring is full, so drop pending records of the oldest sector which is going to be erased.
+ */
+static esp_err_t queue_drop_sector(void)
+{
+	ESP_LOGW(TAG, "Queue full, dropping oldest samples");
+	queue_position_t position = queue_tail;
+	while (position.sector == queue_head.sector)
+	{
+		uint8_t record[QUEUE_RECORD_SIZE];
+		esp_err_t result = esp_partition_read(queue_partition, slot_offset(&position), record, sizeof(record));
+		if (result != ESP_OK)
+		{
+			return result;
+		}
+		if (record_pending(record))
+		{
+			queue_count--;
+		}
+		position_next(&position);
+	}
+	queue_tail = position;
+	if (queue_count == 0)
+	{
+		queue_tail = queue_head;
+		return ESP_OK;
+	}
+	return queue_advance_tail();
+}
+
+esp_err_t offline_queue_push(const measurement_values_t* values)
+{
+	if (queue_partition == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+	uint8_t record[QUEUE_RECORD_SIZE];
+	memset(record, QUEUE_FLAG_ERASED, sizeof(record));
+	record_pack(values, record);
+	record[QUEUE_RECORD_CRC] = crc8(record, QUEUE_RECORD_DATA_SIZE);
+	record[QUEUE_RECORD_WRITTEN] = QUEUE_FLAG_SET;
+
+	xSemaphoreTake(queue_mutex, portMAX_DELAY);
+	esp_err_t result = ESP_OK;
+	if (queue_head.slot == 0)
+	{
+		if (queue_count > 0 && queue_tail.sector == queue_head.sector)
+		{
+			result = queue_drop_sector();
+		}
+		if (result == ESP_OK)
+		{
+			result = sector_start(queue_head.sector);
+		}
+	}
+	if (result == ESP_OK)
+	{
+		result = esp_partition_write(queue_partition, slot_offset(&queue_head), record, sizeof(record));
+	}
+	if (result == ESP_OK)
+	{
+		if (queue_count++ == 0)
+		{
+			queue_tail = queue_head;
+		}
+		position_next(&queue_head);
+	}
+	xSemaphoreGive(queue_mutex);
+	return result;
+}
+
+esp_err_t offline_queue_peek(measurement_values_t* values, size_t max_count, size_t* count,
+		offline_queue_id_t* last_id)
+{
+	*count = 0;
+	if (queue_partition == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+	xSemaphoreTake(queue_mutex, portMAX_DELAY);
+	esp_err_t result = ESP_OK;
+	uint32_t sector = UINT32_MAX;
+	uint32_t sequence = 0;
+	queue_position_t position = queue_tail;
+	while (*count < max_count && (position.sector != queue_head.sector || position.slot != queue_head.slot))
+	{
+		uint8_t record[QUEUE_RECORD_SIZE];
+		result = esp_partition_read(queue_partition, slot_offset(&position), record, sizeof(record));
+		if (result != ESP_OK)
+		{
+			break;
+		}
+		if (record_pending(record))
+		{
+			result = record_id(&position, &sector, &sequence, last_id);
+			if (result != ESP_OK)
+			{
+				break;
+			}
+			record_unpack(record, &values[(*count)++]);
+		}
+		position_next(&position);
+	}
+	xSemaphoreGive(queue_mutex);
+	return result;
+}
+
+esp_err_t offline_queue_pop(offline_queue_id_t last_id)
+{
+	if (queue_partition == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+	const uint8_t consumed = QUEUE_FLAG_SET;
+	xSemaphoreTake(queue_mutex, portMAX_DELAY);
+	esp_err_t result = ESP_OK;
+	uint32_t sector = UINT32_MAX;
+	uint32_t sequence = 0;
+	while (queue_count > 0)
+	{
+		result = queue_advance_tail();
+		if (result != ESP_OK)
+		{
+			break;
+		}
+		offline_queue_id_t id;
+		result = record_id(&queue_tail, &sector, &sequence, &id);
+		if (result != ESP_OK || id > last_id)
+		{
+			// The rest of the queue was stored after peek
+			break;
+		}
+		result = esp_partition_write(queue_partition, slot_offset(&queue_tail) + QUEUE_RECORD_CONSUMED,
+				&consumed, sizeof(consumed));
+		if (result != ESP_OK)
+		{
+			break;
+		}
+		position_next(&queue_tail);
+		queue_count--;
+	}
+	if (result == ESP_OK)
+	{
+		result = queue_advance_tail();
+	}
+	xSemaphoreGive(queue_mutex);
+	return result;
+}
+
+size_t offline_queue_count(void)
+{
+	return queue_count;
+}
@@ -0,0 +1,85 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief This file defines persistent queue of samples stored in flash partition. It keeps
+ * measurements which could not be published while the device was offline.
+ */
+
+#ifndef MAIN_OFFLINE_QUEUE_H_
+#define MAIN_OFFLINE_QUEUE_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <esp_err.h>
+#include "measurement_task.h"
+
+/**
+ * Open queue stored in data partition and restore its state.
+ * @param partition_label  Label of data partition used for the queue
+ */
+esp_err_t offline_queue_init(const char* partition_label);
+
+/**
+ * Append sample to the end of the queue. When the partition is full, the oldest
+ * flash sector is erased and its samples are lost.
+ * @param values  Measured values
+ */
+esp_err_t offline_queue_push(const measurement_values_t* values);
+
+/**
+ * Identifier of stored sample. Identifiers grow from the beginning to the end of the queue.
+ */
+typedef uint64_t offline_queue_id_t;
+
+/**
+ * Read samples from the beginning of the queue without removing them.
+ * @param[out] values     Array for read samples
+ * @param[in]  max_count  Size of values array
+ * @param[out] count      Number of read samples
+ * @param[out] last_id    Identifier of the last read sample, valid if count is not zero
+ */
+esp_err_t offline_queue_peek(measurement_values_t* values, size_t max_count, size_t* count,
+		offline_queue_id_t* last_id);
+
+/**
+ * Remove samples from the beginning of the queue up to the sample with given identifier.
+ * Samples dropped meanwhile because the queue was full are skipped, so samples stored
+ * after the peeked ones are never removed.
+ * @param last_id  Identifier of the last sample to remove returned by offline_queue_peek()
+ */
+esp_err_t offline_queue_pop(offline_queue_id_t last_id);
+
+/**
+ * Get number of samples in the queue.
+ */
+size_t offline_queue_count(void);
+
+#endif /* MAIN_OFFLINE_QUEUE_H_ */
@@ -0,0 +1,462 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of binary payload decoders.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "payload_decoder.h"
+
+// Nesting limit when skipping unknown CBOR items
+#define CBOR_MAX_DEPTH 8
+
+static uint64_t read_le(const uint8_t* data, size_t bytes)
+{
+	uint64_t value = 0;
+	for (size_t i = 0; i < bytes; i++)
+	{
+		value |= ((uint64_t)data[i]) << (8 * i);
+	}
+	return value;
+}
+
+static bool copy_device_id(const uint8_t* data, size_t length, char* device_id, size_t device_id_size)
+{
+	if (length >= device_id_size)
+	{
+		return false;
+	}
+	memcpy(device_id, data, length);
+	device_id[length] = '\0';
+	return true;
+}
+
+int32_t payload_decode_binary(const uint8_t* payload, size_t length, char* device_id,
+		size_t device_id_size, payload_sample_t* samples, size_t max_samples)
+{
+	if (length < 2 || payload[0] != PAYLOAD_BINARY_VERSION)
+	{
+		return -1;
+	}
+	size_t id_length = payload[1];
+	size_t position = 2;
+	if (length < position + id_length + 2
+			|| !copy_device_id(&payload[position], id_length, device_id, device_id_size))
+	{
+		return -1;
+	}
+	position += id_length;
+	size_t count = read_le(&payload[position], 2);
+	position += 2;
+	if (count > max_samples || length != position + count * PAYLOAD_BINARY_SAMPLE_SIZE)
+	{
+		return -1;
+	}
+	for (size_t i = 0; i < count; i++, position += PAYLOAD_BINARY_SAMPLE_SIZE)
+	{
+		samples[i].temperature = (int16_t)read_le(&payload[position], 2);
+		samples[i].humidity = (int16_t)read_le(&payload[position + 2], 2);
+		samples[i].utc_timestamp = read_le(&payload[position + 4], 8);
+	}
+	return count;
+}
+
+/**
+ * Read unsigned LEB128 varint at position and move position after it.
+ */
+static bool read_varint(const uint8_t* data, size_t length, size_t* position, uint64_t* value)
+{
+	*value = 0;
+	for (uint32_t shift = 0; shift < 64 && *position < length; shift += 7)
+	{
+		uint8_t byte = data[(*position)++];
+		*value |= ((uint64_t)(byte & 0x7F)) << shift;
+		if (!(byte & 0x80))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool read_svarint(const uint8_t* data, size_t length, size_t* position, int64_t* value)
+{
+	uint64_t zigzag;
+	if (!read_varint(data, length, position, &zigzag))
+	{
+		return false;
+	}
+	*value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+	return true;
+}
+
+/**
+ * Add difference to value in 0.1 units and check the result range. Difference is checked
+ * against the remaining range first, so the addition cannot overflow.
+ */
+static bool add_tenths(int16_t* value, int64_t difference)
+{
+	if (difference < INT16_MIN - (int64_t)*value || difference > INT16_MAX - (int64_t)*value)
+	{
+		return false;
+	}
+	*value = (int16_t)(*value + difference);
+	return true;
+}
+
+int32_t payload_decode_delta(const uint8_t* payload, size_t length, char* device_id,
+		size_t device_id_size, payload_sample_t* samples, size_t max_samples)
+{
+	if (length < 2 || payload[0] != PAYLOAD_DELTA_VERSION)
+	{
+		return -1;
+	}
+	size_t id_length = payload[1];
+	size_t position = 2;
+	if (length < position + id_length
+			|| !copy_device_id(&payload[position], id_length, device_id, device_id_size))
+	{
+		return -1;
+	}
+	position += id_length;
+	uint64_t count;
+	if (!read_varint(payload, length, &position, &count) || count > max_samples || count > INT32_MAX)
+	{
+		return -1;
+	}
+	uint64_t delta = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		int64_t timestamp;
+		int64_t temperature;
+		int64_t humidity;
+		if (i == 0)
+		{
+			samples[0].temperature = 0;
+			samples[0].humidity = 0;
+			if (!read_varint(payload, length, &position, &samples[0].utc_timestamp))
+			{
+				return -1;
+			}
+		}
+		else
+		{
+			if (!read_svarint(payload, length, &position, &timestamp))
+			{
+				return -1;
+			}
+			delta += timestamp;
+			samples[i] = samples[i - 1];
+			samples[i].utc_timestamp += delta;
+		}
+		if (!read_svarint(payload, length, &position, &temperature)
+				|| !read_svarint(payload, length, &position, &humidity)
+				|| !add_tenths(&samples[i].temperature, temperature)
+				|| !add_tenths(&samples[i].humidity, humidity))
+		{
+			return -1;
+		}
+	}
+	return position == length ? (int32_t)count : -1;
+}
+
+/**
+ * CBOR input with current position
+ */
+typedef struct cbor_reader
+{
+	const uint8_t* data;
+	size_t length;
+	size_t position;
+} cbor_reader_t;
+
+/**
+ * Read head of data item. Indefinite lengths are not supported.
+ */
+static bool cbor_read_head(cbor_reader_t* reader, uint8_t* major, uint64_t* argument)
+{
+	if (reader->position >= reader->length)
+	{
+		return false;
+	}
+	uint8_t initial = reader->data[reader->position++];
+	uint8_t info = initial & 0x1F;
+	*major = initial >> 5;
+	if (info < 24)
+	{
+		*argument = info;
+		return true;
+	}
+	if (info > 27)
+	{
+		return false;
+	}
+	size_t bytes = 1 << (info - 24);
+	if (reader->length - reader->position < bytes)
+	{
+		return false;
+	}
+	*argument = 0;
+	for (size_t i = 0; i < bytes; i++)
+	{
+		*argument = (*argument << 8) | reader->data[reader->position++];
+	}
+	return true;
+}
+
+static bool cbor_read_int(cbor_reader_t* reader, int64_t* value)
+{
+	uint8_t major;
+	uint64_t argument;
+	if (!cbor_read_head(reader, &major, &argument) || argument > INT64_MAX)
+	{
+		return false;
+	}
+	if (major == 0)
+	{
+		*value = argument;
+	}
+	else if (major == 1)
+	{
+		*value = -1 - (int64_t)argument;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Read value in 0.1 units stored as decimal fraction or integer.
+ */
+static bool cbor_read_tenths(cbor_reader_t* reader, int16_t* value)
+{
+	size_t start = reader->position;
+	uint8_t major;
+	uint64_t argument;
+	int64_t exponent = 0;
+	int64_t mantissa;
+	if (!cbor_read_head(reader, &major, &argument))
+	{
+		return false;
+	}
+	if (major == 6 && argument == 4)
+	{
+		if (!cbor_read_head(reader, &major, &argument) || major != 4 || argument != 2
+				|| !cbor_read_int(reader, &exponent) || !cbor_read_int(reader, &mantissa))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		reader->position = start;
+		if (!cbor_read_int(reader, &mantissa))
+		{
+			return false;
+		}
+	}
+	// Scale to exponent -1, scaling only grows magnitude, so the range is checked before each step
+	// and the multiplication cannot overflow
+	if (exponent < -1 || exponent > 4)
+	{
+		return false;
+	}
+	for (;; exponent--)
+	{
+		if (mantissa < INT16_MIN || mantissa > INT16_MAX)
+		{
+			return false;
+		}
+		if (exponent == -1)
+		{
+			break;
+		}
+		mantissa *= 10;
+	}
+	*value = (int16_t)mantissa;
+	return true;
+}
+
+static bool cbor_read_utc(cbor_reader_t* reader, uint64_t* value)
+{
+	uint8_t major;
+	return cbor_read_head(reader, &major, value) && major == 0;
+}
+
+static bool cbor_skip(cbor_reader_t* reader, uint32_t depth)
+{
+	uint8_t major;
+	uint64_t argument;
+	if (depth > CBOR_MAX_DEPTH || !cbor_read_head(reader, &major, &argument))
+	{
+		return false;
+	}
+	switch (major)
+	{
+	case 2:
+	case 3:
+		if (reader->length - reader->position < argument)
+		{
+			return false;
+		}
+		reader->position += argument;
+		return true;
+	case 4:
+	case 5:
+		for (uint64_t i = 0; i < (major == 5 ? 2 * argument : argument); i++)
+		{
+			if (!cbor_skip(reader, depth + 1))
+			{
+				return false;
+			}
+		}
+		return true;
+	case 6:
+		return cbor_skip(reader, depth + 1);
+	default:
+		return true;
+	}
+}
+
+/**
+ * Read value of one field, either single value or array of values for batch.
+ * Count of values must match count read from previous fields.
+ */
+static bool cbor_read_field(cbor_reader_t* reader, payload_cbor_key_t key, payload_sample_t* samples,
+		size_t max_samples, int64_t* count)
+{
+	size_t start = reader->position;
+	uint8_t major;
+	uint64_t argument;
+	if (!cbor_read_head(reader, &major, &argument))
+	{
+		return false;
+	}
+	uint64_t field_count = 1;
+	if (major == 4)
+	{
+		field_count = argument;
+	}
+	else
+	{
+		reader->position = start;
+	}
+	if (field_count > max_samples || (*count >= 0 && (uint64_t)*count != field_count))
+	{
+		return false;
+	}
+	*count = field_count;
+	for (uint64_t i = 0; i < field_count; i++)
+	{
+		bool valid;
+		switch (key)
+		{
+		case PAYLOAD_CBOR_KEY_TEMPERATURE:
+			valid = cbor_read_tenths(reader, &samples[i].temperature);
+			break;
+		case PAYLOAD_CBOR_KEY_HUMIDITY:
+			valid = cbor_read_tenths(reader, &samples[i].humidity);
+			break;
+		default:
+			valid = cbor_read_utc(reader, &samples[i].utc_timestamp);
+			break;
+		}
+		if (!valid)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+int32_t payload_decode_cbor(const uint8_t* payload, size_t length, char* device_id,
+		size_t device_id_size, payload_sample_t* samples, size_t max_samples)
+{
+	cbor_reader_t reader = { payload, length, 0 };
+	uint8_t major;
+	uint64_t pairs;
+	int64_t count = -1;
+	uint32_t fields = 0;
+	if (!cbor_read_head(&reader, &major, &pairs) || major != 5)
+	{
+		return -1;
+	}
+	for (uint64_t i = 0; i < pairs; i++)
+	{
+		int64_t key;
+		if (!cbor_read_int(&reader, &key))
+		{
+			return -1;
+		}
+		switch (key)
+		{
+		case PAYLOAD_CBOR_KEY_ID:
+		{
+			uint64_t id_length;
+			if (!cbor_read_head(&reader, &major, &id_length) || major != 3
+					|| reader.length - reader.position < id_length
+					|| !copy_device_id(&payload[reader.position], id_length, device_id, device_id_size))
+			{
+				return -1;
+			}
+			reader.position += id_length;
+			break;
+		}
+		case PAYLOAD_CBOR_KEY_TEMPERATURE:
+		case PAYLOAD_CBOR_KEY_HUMIDITY:
+		case PAYLOAD_CBOR_KEY_UTC:
+			if (!cbor_read_field(&reader, key, samples, max_samples, &count))
+			{
+				return -1;
+			}
+			break;
+		default:
+			// Ignore unknown fields added by newer encoders
+			if (!cbor_skip(&reader, 0))
+			{
+				return -1;
+			}
+			continue;
+		}
+		fields |= 1 << key;
+	}
+	uint32_t required = (1 << PAYLOAD_CBOR_KEY_ID) | (1 << PAYLOAD_CBOR_KEY_TEMPERATURE)
+			| (1 << PAYLOAD_CBOR_KEY_HUMIDITY) | (1 << PAYLOAD_CBOR_KEY_UTC);
+	if (fields != required || reader.position != reader.length)
+	{
+		return -1;
+	}
+	return count;
+}
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief This file defines decoders of binary payloads produced by payload encoder.
+ * Decoders depend only on C standard library, so they can be used also by data consumers.
+ */
+
+#ifndef MAIN_PAYLOAD_DECODER_H_
+#define MAIN_PAYLOAD_DECODER_H_
+
+#include <stddef.h>
+#include <inttypes.h>
+#include "payload_format.h"
+
+/**
+ * Decoded sample
+ */
+typedef struct payload_sample
+{
+	/**
+	 * Temperature in 0.1 C
+	 */
+	int16_t temperature;
+	/**
+	 * Humidity in 0.1 %
+	 */
+	int16_t humidity;
+	/**
+	 * UTC timestamp in ms when the sample was taken
+	 */
+	uint64_t utc_timestamp;
+} payload_sample_t;
+
+/**
+ * Decode packed binary payload.
+ * @param[in]  payload         Payload data
+ * @param[in]  length          Payload length
+ * @param[out] device_id       Buffer for null terminated device ID
+ * @param[in]  device_id_size  Size of device ID buffer
+ * @param[out] samples         Array for decoded samples
+ * @param[in]  max_samples     Size of samples array
+ * @return Number of decoded samples or -1 if the payload is malformed or does not fit into buffers.
+ */
+int32_t payload_decode_binary(const uint8_t* payload, size_t length, char* device_id,
+		size_t device_id_size, payload_sample_t* samples, size_t max_samples);
+
+/**
+ * Decode CBOR payload with single sample or batch.
+ * @param[in]  payload         Payload data
+ * @param[in]  length          Payload length
+ * @param[out] device_id       Buffer for null terminated device ID
+ * @param[in]  device_id_size  Size of device ID buffer
+ * @param[out] samples         Array for decoded samples
+ * @param[in]  max_samples     Size of samples array
+ * @return Number of decoded samples or -1 if the payload is malformed or does not fit into buffers.
+ */
+int32_t payload_decode_cbor(const uint8_t* payload, size_t length, char* device_id,
+		size_t device_id_size, payload_sample_t* samples, size_t max_samples);
+
+/**
+ * Decode delta compressed payload.
+ * @param[in]  payload         Payload data
+ * @param[in]  length          Payload length
+ * @param[out] device_id       Buffer for null terminated device ID
+ * @param[in]  device_id_size  Size of device ID buffer
+ * @param[out] samples         Array for decoded samples
+ * @param[in]  max_samples     Size of samples array
+ * @return Number of decoded samples or -1 if the payload is malformed or does not fit into buffers.
+ */
+int32_t payload_decode_delta(const uint8_t* payload, size_t length, char* device_id,
+		size_t device_id_size, payload_sample_t* samples, size_t max_samples);
+
+#endif /* MAIN_PAYLOAD_DECODER_H_ */
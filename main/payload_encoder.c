@@ -0,0 +1,430 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of allocation free payload encoders.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "payload_encoder.h"
+
+/**
+ * Output buffer with current position. Writes past the end are discarded and remembered.
+ */
+typedef struct payload_writer
+{
+	uint8_t* buffer;
+	size_t size;
+	size_t length;
+	/**
+	 * Number of bytes reserved at the end for null terminator
+	 */
+	size_t reserved;
+	bool overflow;
+} payload_writer_t;
+
+static void writer_init(payload_writer_t* writer, void* buffer, size_t size, bool text)
+{
+	writer->buffer = (uint8_t*)buffer;
+	writer->size = size;
+	writer->length = 0;
+	writer->reserved = text ? 1 : 0;
+	writer->overflow = size < writer->reserved;
+}
+
+static void writer_append_char(payload_writer_t* writer, char c)
+{
+	if (writer->length + writer->reserved < writer->size)
+	{
+		writer->buffer[writer->length++] = (uint8_t)c;
+	}
+	else
+	{
+		writer->overflow = true;
+	}
+}
+
+static void writer_append_raw(payload_writer_t* writer, const char* string)
+{
+	while (*string)
+	{
+		writer_append_char(writer, *string++);
+	}
+}
+
+static void writer_append_string(payload_writer_t* writer, const char* string)
+{
+	static const char hex[] = "0123456789abcdef";
+	writer_append_char(writer, '"');
+	for (; *string; string++)
+	{
+		unsigned char c = (unsigned char)*string;
+		if (c == '"' || c == '\\')
+		{
+			writer_append_char(writer, '\\');
+			writer_append_char(writer, c);
+		}
+		else if (c < 0x20)
+		{
+			writer_append_raw(writer, "\\u00");
+			writer_append_char(writer, hex[c >> 4]);
+			writer_append_char(writer, hex[c & 0xF]);
+		}
+		else
+		{
+			writer_append_char(writer, c);
+		}
+	}
+	writer_append_char(writer, '"');
+}
+
+static void writer_append_uint64(payload_writer_t* writer, uint64_t value)
+{
+	char digits[20];
+	size_t count = 0;
+	do
+	{
+		digits[count++] = '0' + value % 10;
+		value /= 10;
+	} while (value > 0);
+	while (count > 0)
+	{
+		writer_append_char(writer, digits[--count]);
+	}
+}
+
+/**
+ * Append value in tenths as fixed point number with one decimal place.
+ */
+static void writer_append_tenths(payload_writer_t* writer, int16_t tenths)
+{
+	uint32_t magnitude;
+	if (tenths < 0)
+	{
+		writer_append_char(writer, '-');
+		magnitude = -(uint32_t)tenths;
+	}
+	else
+	{
+		magnitude = tenths;
+	}
+	writer_append_uint64(writer, magnitude / 10);
+	writer_append_char(writer, '.');
+	writer_append_char(writer, '0' + magnitude % 10);
+}
+
+static size_t writer_finish(payload_writer_t* writer)
+{
+	if (writer->overflow)
+	{
+		if (writer->reserved && writer->size > 0)
+		{
+			writer->buffer[0] = '\0';
+		}
+		return 0;
+	}
+	if (writer->reserved)
+	{
+		writer->buffer[writer->length] = '\0';
+	}
+	return writer->length;
+}
+
+static void writer_append_le(payload_writer_t* writer, uint64_t value, size_t bytes)
+{
+	for (size_t i = 0; i < bytes; i++)
+	{
+		writer_append_char(writer, (char)(value >> (8 * i)));
+	}
+}
+
+/**
+ * Append unsigned LEB128 varint.
+ */
+static void writer_append_varint(payload_writer_t* writer, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		writer_append_char(writer, (char)(value | 0x80));
+		value >>= 7;
+	}
+	writer_append_char(writer, (char)value);
+}
+
+/**
+ * Append signed varint, zigzag encoding maps small magnitudes to short varints.
+ */
+static void writer_append_svarint(payload_writer_t* writer, int64_t value)
+{
+	writer_append_varint(writer, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+/**
+ * Append CBOR data item head with major type and argument in the shortest form.
+ */
+static void writer_append_cbor_head(payload_writer_t* writer, uint8_t major, uint64_t argument)
+{
+	size_t bytes;
+	uint8_t initial = major << 5;
+	if (argument < 24)
+	{
+		writer_append_char(writer, initial | argument);
+		return;
+	}
+	else if (argument <= UINT8_MAX)
+	{
+		initial |= 24;
+		bytes = 1;
+	}
+	else if (argument <= UINT16_MAX)
+	{
+		initial |= 25;
+		bytes = 2;
+	}
+	else if (argument <= UINT32_MAX)
+	{
+		initial |= 26;
+		bytes = 4;
+	}
+	else
+	{
+		initial |= 27;
+		bytes = 8;
+	}
+	writer_append_char(writer, initial);
+	while (bytes-- > 0)
+	{
+		writer_append_char(writer, (char)(argument >> (8 * bytes)));
+	}
+}
+
+static void writer_append_cbor_int(payload_writer_t* writer, int64_t value)
+{
+	if (value >= 0)
+	{
+		writer_append_cbor_head(writer, 0, value);
+	}
+	else
+	{
+		writer_append_cbor_head(writer, 1, -1 - value);
+	}
+}
+
+static void writer_append_cbor_string(payload_writer_t* writer, const char* string)
+{
+	size_t length = strlen(string);
+	writer_append_cbor_head(writer, 3, length);
+	for (size_t i = 0; i < length; i++)
+	{
+		writer_append_char(writer, string[i]);
+	}
+}
+
+/**
+ * Append value in tenths as CBOR decimal fraction 4([-1, tenths]).
+ */
+static void writer_append_cbor_tenths(payload_writer_t* writer, int16_t tenths)
+{
+	writer_append_cbor_head(writer, 6, 4);
+	writer_append_cbor_head(writer, 4, 2);
+	writer_append_cbor_int(writer, -1);
+	writer_append_cbor_int(writer, tenths);
+}
+
+size_t payload_encode_json(const measurement_values_t* values, const char* device_id,
+		char* buffer, size_t size)
+{
+	payload_writer_t writer;
+	writer_init(&writer, buffer, size, true);
+	writer_append_raw(&writer, "{\"id\":");
+	writer_append_string(&writer, device_id);
+	writer_append_raw(&writer, ",\"temperature\":");
+	writer_append_tenths(&writer, values->temperature);
+	writer_append_raw(&writer, ",\"humidity\":");
+	writer_append_tenths(&writer, values->humidity);
+	writer_append_raw(&writer, ",\"utc\":");
+	writer_append_uint64(&writer, values->utc_timestamp);
+	writer_append_char(&writer, '}');
+	return writer_finish(&writer);
+}
+
+size_t payload_encode_json_batch(const measurement_values_t* values, size_t count,
+		const char* device_id, char* buffer, size_t size)
+{
+	payload_writer_t writer;
+	writer_init(&writer, buffer, size, true);
+	writer_append_raw(&writer, "{\"id\":");
+	writer_append_string(&writer, device_id);
+	writer_append_raw(&writer, ",\"temperature\":[");
+	for (size_t i = 0; i < count; i++)
+	{
+		if (i > 0)
+		{
+			writer_append_char(&writer, ',');
+		}
+		writer_append_tenths(&writer, values[i].temperature);
+	}
+	writer_append_raw(&writer, "],\"humidity\":[");
+	for (size_t i = 0; i < count; i++)
+	{
+		if (i > 0)
+		{
+			writer_append_char(&writer, ',');
+		}
+		writer_append_tenths(&writer, values[i].humidity);
+	}
+	writer_append_raw(&writer, "],\"utc\":[");
+	for (size_t i = 0; i < count; i++)
+	{
+		if (i > 0)
+		{
+			writer_append_char(&writer, ',');
+		}
+		writer_append_uint64(&writer, values[i].utc_timestamp);
+	}
+	writer_append_raw(&writer, "]}");
+	return writer_finish(&writer);
+}
+
+size_t payload_encode_cbor(const measurement_values_t* values, const char* device_id,
+		uint8_t* buffer, size_t size)
+{
+	payload_writer_t writer;
+	writer_init(&writer, buffer, size, false);
+	writer_append_cbor_head(&writer, 5, 4);
+	writer_append_cbor_int(&writer, PAYLOAD_CBOR_KEY_ID);
+	writer_append_cbor_string(&writer, device_id);
+	writer_append_cbor_int(&writer, PAYLOAD_CBOR_KEY_TEMPERATURE);
+	writer_append_cbor_tenths(&writer, values->temperature);
+	writer_append_cbor_int(&writer, PAYLOAD_CBOR_KEY_HUMIDITY);
+	writer_append_cbor_tenths(&writer, values->humidity);
+	writer_append_cbor_int(&writer, PAYLOAD_CBOR_KEY_UTC);
+	writer_append_cbor_head(&writer, 0, values->utc_timestamp);
+	return writer_finish(&writer);
+}
+
+size_t payload_encode_cbor_batch(const measurement_values_t* values, size_t count,
+		const char* device_id, uint8_t* buffer, size_t size)
+{
+	payload_writer_t writer;
+	writer_init(&writer, buffer, size, false);
+	writer_append_cbor_head(&writer, 5, 4);
+	writer_append_cbor_int(&writer, PAYLOAD_CBOR_KEY_ID);
+	writer_append_cbor_string(&writer, device_id);
+	writer_append_cbor_int(&writer, PAYLOAD_CBOR_KEY_TEMPERATURE);
+	writer_append_cbor_head(&writer, 4, count);
+	for (size_t i = 0; i < count; i++)
+	{
+		writer_append_cbor_tenths(&writer, values[i].temperature);
+	}
+	writer_append_cbor_int(&writer, PAYLOAD_CBOR_KEY_HUMIDITY);
+	writer_append_cbor_head(&writer, 4, count);
+	for (size_t i = 0; i < count; i++)
+	{
+		writer_append_cbor_tenths(&writer, values[i].humidity);
+	}
+	writer_append_cbor_int(&writer, PAYLOAD_CBOR_KEY_UTC);
+	writer_append_cbor_head(&writer, 4, count);
+	for (size_t i = 0; i < count; i++)
+	{
+		writer_append_cbor_head(&writer, 0, values[i].utc_timestamp);
+	}
+	return writer_finish(&writer);
+}
+
+size_t payload_encode_binary(const measurement_values_t* values, size_t count,
+		const char* device_id, uint8_t* buffer, size_t size)
+{
+	size_t id_length = strlen(device_id);
+	if (id_length > UINT8_MAX || count > UINT16_MAX)
+	{
+		return 0;
+	}
+	payload_writer_t writer;
+	writer_init(&writer, buffer, size, false);
+	writer_append_char(&writer, PAYLOAD_BINARY_VERSION);
+	writer_append_char(&writer, (char)id_length);
+	for (size_t i = 0; i < id_length; i++)
+	{
+		writer_append_char(&writer, device_id[i]);
+	}
+	writer_append_le(&writer, count, 2);
+	for (size_t i = 0; i < count; i++)
+	{
+		writer_append_le(&writer, (uint16_t)values[i].temperature, 2);
+		writer_append_le(&writer, (uint16_t)values[i].humidity, 2);
+		writer_append_le(&writer, values[i].utc_timestamp, 8);
+	}
+	return writer_finish(&writer);
+}
+
+size_t payload_encode_delta(const measurement_values_t* values, size_t count,
+		const char* device_id, uint8_t* buffer, size_t size)
+{
+	size_t id_length = strlen(device_id);
+	if (id_length > UINT8_MAX)
+	{
+		return 0;
+	}
+	payload_writer_t writer;
+	writer_init(&writer, buffer, size, false);
+	writer_append_char(&writer, PAYLOAD_DELTA_VERSION);
+	writer_append_char(&writer, (char)id_length);
+	for (size_t i = 0; i < id_length; i++)
+	{
+		writer_append_char(&writer, device_id[i]);
+	}
+	writer_append_varint(&writer, count);
+	if (count == 0)
+	{
+		return writer_finish(&writer);
+	}
+	int32_t temperature = values[0].temperature;
+	int32_t humidity = values[0].humidity;
+	writer_append_varint(&writer, values[0].utc_timestamp);
+	writer_append_svarint(&writer, temperature);
+	writer_append_svarint(&writer, humidity);
+	uint64_t delta = 0;
+	for (size_t i = 1; i < count && !writer.overflow; i++)
+	{
+		uint64_t next_delta = values[i].utc_timestamp - values[i - 1].utc_timestamp;
+		int32_t next_temperature = values[i].temperature;
+		int32_t next_humidity = values[i].humidity;
+		writer_append_svarint(&writer, (int64_t)(next_delta - delta));
+		writer_append_svarint(&writer, next_temperature - temperature);
+		writer_append_svarint(&writer, next_humidity - humidity);
+		delta = next_delta;
+		temperature = next_temperature;
+		humidity = next_humidity;
+	}
+	return writer_finish(&writer);
+}
@@ -0,0 +1,115 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief This file defines encoders of measured values into message payloads.
+ */
+
+#ifndef MAIN_PAYLOAD_ENCODER_H_
+#define MAIN_PAYLOAD_ENCODER_H_
+
+#include <stddef.h>
+#include "measurement_task.h"
+#include "payload_format.h"
+
+/**
+ * Encode measured values into JSON object in format:
+ * {"id":"SENSOR1","temperature":21.1,"humidity":70.9,"utc":1572982980008}
+ * Values are encoded in 0.1 precision of the sensor. No memory is allocated.
+ * @param[in]  values     Measured values
+ * @param[in]  device_id  Device ID
+ * @param[out] buffer     Output buffer, the payload is null terminated
+ * @param[in]  size       Size of output buffer
+ * @return Length of the payload without null terminator or 0 if the buffer is too small.
+ */
+size_t payload_encode_json(const measurement_values_t* values, const char* device_id,
+		char* buffer, size_t size);
+
+/**
+ * Encode batch of measured values into JSON object with array for each value in format:
+ * {"id":"SENSOR1","temperature":[21.1,21.2],"humidity":[70.9,70.8],"utc":[1572982980008,1572983040008]}
+ * @param[in]  values     Array of measured values
+ * @param[in]  count      Number of measured values
+ * @param[in]  device_id  Device ID
+ * @param[out] buffer     Output buffer, the payload is null terminated
+ * @param[in]  size       Size of output buffer
+ * @return Length of the payload without null terminator or 0 if the buffer is too small.
+ */
+size_t payload_encode_json_batch(const measurement_values_t* values, size_t count,
+		const char* device_id, char* buffer, size_t size);
+
+/**
+ * Encode measured values into CBOR map described in payload_format.h.
+ * @param[in]  values     Measured values
+ * @param[in]  device_id  Device ID
+ * @param[out] buffer     Output buffer
+ * @param[in]  size       Size of output buffer
+ * @return Length of the payload or 0 if the buffer is too small.
+ */
+size_t payload_encode_cbor(const measurement_values_t* values, const char* device_id,
+		uint8_t* buffer, size_t size);
+
+/**
+ * Encode batch of measured values into CBOR map with array for each value.
+ * @param[in]  values     Array of measured values
+ * @param[in]  count      Number of measured values
+ * @param[in]  device_id  Device ID
+ * @param[out] buffer     Output buffer
+ * @param[in]  size       Size of output buffer
+ * @return Length of the payload or 0 if the buffer is too small.
+ */
+size_t payload_encode_cbor_batch(const measurement_values_t* values, size_t count,
+		const char* device_id, uint8_t* buffer, size_t size);
+
+/**
+ * Encode measured values into versioned packed binary record described in payload_format.h.
+ * @param[in]  values     Array of measured values
+ * @param[in]  count      Number of measured values (at most UINT16_MAX)
+ * @param[in]  device_id  Device ID (at most 255 characters)
+ * @param[out] buffer     Output buffer
+ * @param[in]  size       Size of output buffer
+ * @return Length of the payload or 0 if the buffer is too small or arguments are out of range.
+ */
+size_t payload_encode_binary(const measurement_values_t* values, size_t count,
+		const char* device_id, uint8_t* buffer, size_t size);
+
+/**
+ * Encode series of measured values into delta compressed format described in payload_format.h.
+ * @param[in]  values     Array of measured values ordered by time
+ * @param[in]  count      Number of measured values
+ * @param[in]  device_id  Device ID (at most 255 characters)
+ * @param[out] buffer     Output buffer
+ * @param[in]  size       Size of output buffer
+ * @return Length of the payload or 0 if the buffer is too small or arguments are out of range.
+ */
+size_t payload_encode_delta(const measurement_values_t* values, size_t count,
+		const char* device_id, uint8_t* buffer, size_t size);
+
+#endif /* MAIN_PAYLOAD_ENCODER_H_ */
@@ -0,0 +1,101 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief This file describes binary payload formats shared by encoders and decoders.
+ *
+ * Packed binary format (all integers little endian):
+ *   uint8   version (PAYLOAD_BINARY_VERSION)
+ *   uint8   device ID length
+ *   char[]  device ID without null terminator
+ *   uint16  number of samples
+ *   samples, each PAYLOAD_BINARY_SAMPLE_SIZE bytes:
+ *     int16   temperature in 0.1 C
+ *     int16   humidity in 0.1 %
+ *     uint64  UTC timestamp in ms
+ *
+ * Delta compressed format for series of samples (varints are LEB128, signed values zigzag encoded):
+ *   uint8   version (PAYLOAD_DELTA_VERSION)
+ *   uint8   device ID length
+ *   char[]  device ID without null terminator
+ *   varint  number of samples
+ *   first sample:
+ *     varint  UTC timestamp in ms
+ *     svarint temperature in 0.1 C
+ *     svarint humidity in 0.1 %
+ *   each following sample:
+ *     svarint difference of timestamp delta to previous timestamp delta (delta of delta)
+ *     svarint temperature difference to previous sample
+ *     svarint humidity difference to previous sample
+ * Samples taken in regular intervals with slowly changing values take 3 bytes each.
+ *
+ * CBOR format is a map with integer keys from payload_cbor_key. Temperature and humidity
+ * are decimal fractions (tag 4) with exponent -1, UTC timestamp is unsigned integer.
+ * Batches contain array of values for each key except device ID.
+ */
+
+#ifndef MAIN_PAYLOAD_FORMAT_H_
+#define MAIN_PAYLOAD_FORMAT_H_
+
+/**
+ * Payload format IDs for MQTT_PAYLOAD_FORMAT configuration
+ */
+#define PAYLOAD_FORMAT_JSON 0
+#define PAYLOAD_FORMAT_CBOR 1
+#define PAYLOAD_FORMAT_BINARY 2
+#define PAYLOAD_FORMAT_DELTA 3
+
+/**
+ * Version of packed binary format
+ */
+#define PAYLOAD_BINARY_VERSION 1
+
+/**
+ * Version of delta compressed format, it shares the first byte with packed binary format
+ */
+#define PAYLOAD_DELTA_VERSION 2
+
+/**
+ * Size of single sample record in packed binary format
+ */
+#define PAYLOAD_BINARY_SAMPLE_SIZE 12
+
+/**
+ * Keys of CBOR map
+ */
+typedef enum payload_cbor_key
+{
+	PAYLOAD_CBOR_KEY_ID = 0,
+	PAYLOAD_CBOR_KEY_TEMPERATURE = 1,
+	PAYLOAD_CBOR_KEY_HUMIDITY = 2,
+	PAYLOAD_CBOR_KEY_UTC = 3
+} payload_cbor_key_t;
+
+#endif /* MAIN_PAYLOAD_FORMAT_H_ */
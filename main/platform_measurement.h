@@ -38,17 +38,56 @@
 
 #include <esp_err.h>
 #include <inttypes.h>
+#include <stddef.h>
+
+/**
+ * Maximal number of sensors in registry
+ */
+#ifndef PLATFORM_MEASUREMENT_MAX_SENSORS
+#define PLATFORM_MEASUREMENT_MAX_SENSORS 8
+#endif
+
+/**
+ * Registry entry describing one connected sensor
+ */
+typedef struct platform_sensor
+{
+	/**
+	 * Platform specific sensor type
+	 */
+	int32_t type;
+	/**
+	 * GPIO pin where the sensor is connected
+	 */
+	int32_t pin;
+	/**
+	 * Unique sensor ID used as device ID in published data
+	 */
+	const char* id;
+} platform_sensor_t;
 
 /**
  * Initialize sensor for be able to read data.
  */
 esp_err_t platform_measurement_init();
 
+/**
+ * Get number of sensors in registry.
+ */
+size_t platform_measurement_sensor_count(void);
+
+/**
+ * Get registry entry of the sensor.
+ * @param sensor  Index of the sensor in registry
+ */
+const platform_sensor_t* platform_measurement_sensor(size_t sensor);
+
 /**
  * Read current measurement from the sensor.
+ * @param[in]  sensor       Index of the sensor in registry
  * @param[out] temperature  Pointer to integer where will be temperature value stored (0.1 units precision)
  * @param[out] humidity  Pointer to integer where will be humidity value stored (0.1 units precision)
  */
-esp_err_t platform_measurement_read(int16_t* temperature, int16_t* humidity);
+esp_err_t platform_measurement_read(size_t sensor, int16_t* temperature, int16_t* humidity);
 
 #endif /* MAIN_PLATFORM_MEASUREMENT_H_ */
@@ -33,18 +33,62 @@
  */
 
 #include "platform_measurement.h"
+#include "config.h"
+
+#ifndef PLATFORM_MEASUREMENT_SIM
+
 #include "dht.h"
 
-#define DHT_SENSOR_TYPE DHT_TYPE_AM2301
-#define DHT_GPIO_NUM GPIO_NUM_18
+#if defined(DHT_RMT_CHANNEL) && defined(MEASUREMENT_READER_TASKS)
+#include <freertos/FreeRTOS.h>
+
+/*
+ * Reader tasks capture concurrently, so each of them owns one RMT channel starting
+ * at DHT_RMT_CHANNEL. Sensors are assigned to readers by index modulo number of readers.
+ */
+#define DHT_RMT_CHANNEL_COUNT MEASUREMENT_READER_TASKS
+_Static_assert(DHT_RMT_CHANNEL + DHT_RMT_CHANNEL_COUNT <= RMT_CHANNEL_MAX, "Not enough RMT channels for readers");
+#define DHT_RMT_SENSOR_CHANNEL(sensor) ((rmt_channel_t)(DHT_RMT_CHANNEL + (sensor) % DHT_RMT_CHANNEL_COUNT))
+#elif defined(DHT_RMT_CHANNEL)
+#define DHT_RMT_SENSOR_CHANNEL(sensor) DHT_RMT_CHANNEL
+#endif
+
+static const platform_sensor_t platform_sensors[] = { PLATFORM_MEASUREMENT_SENSORS };
+
+#define PLATFORM_SENSOR_COUNT (sizeof(platform_sensors) / sizeof(platform_sensors[0]))
+
+_Static_assert(PLATFORM_SENSOR_COUNT <= PLATFORM_MEASUREMENT_MAX_SENSORS, "Too many sensors in registry");
 
-esp_err_t platform_measurement_init(int32_t gpio_num)
+esp_err_t platform_measurement_init()
 {
 	return ESP_OK;
 }
 
-esp_err_t platform_measurement_read(int16_t* temperature, int16_t* humidity)
+size_t platform_measurement_sensor_count(void)
 {
-	return dht_read_data(DHT_SENSOR_TYPE,
-			DHT_GPIO_NUM, humidity, temperature);
+	return PLATFORM_SENSOR_COUNT;
 }
+
+const platform_sensor_t* platform_measurement_sensor(size_t sensor)
+{
+	return sensor < PLATFORM_SENSOR_COUNT ? &platform_sensors[sensor] : NULL;
+}
+
+esp_err_t platform_measurement_read(size_t sensor, int16_t* temperature, int16_t* humidity)
+{
+	if (sensor >= PLATFORM_SENSOR_COUNT)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	dht_sensor_type_t type = (dht_sensor_type_t)platform_sensors[sensor].type;
+	gpio_num_t pin = (gpio_num_t)platform_sensors[sensor].pin;
+#ifdef DHT_RMT_CHANNEL
+	return dht_read_data_rmt(type, pin, DHT_RMT_SENSOR_CHANNEL(sensor), humidity, temperature);
+#elif defined(DHT_USE_GPIO_ISR)
+	return dht_read_data_isr(type, pin, humidity, temperature);
+#else
+	return dht_read_data(type, pin, humidity, temperature);
+#endif
+}
+
+#endif /* PLATFORM_MEASUREMENT_SIM */
@@ -0,0 +1,184 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Simulated temperature and humidity sensor. Values are replayed from recorded trace
+ * or generated synthetically, so the application can run without any sensor connected.
+ */
+
+#include <stddef.h>
+
+#include "platform_measurement.h"
+#include "config.h"
+
+#ifdef PLATFORM_MEASUREMENT_SIM
+
+// Sensor types are resolved for compatibility with registry of real sensors
+#include "dht.h"
+
+static const platform_sensor_t platform_sensors[] = { PLATFORM_MEASUREMENT_SENSORS };
+
+#define PLATFORM_SENSOR_COUNT (sizeof(platform_sensors) / sizeof(platform_sensors[0]))
+
+_Static_assert(PLATFORM_SENSOR_COUNT <= PLATFORM_MEASUREMENT_MAX_SENSORS, "Too many sensors in registry");
+
+/**
+ * Recorded sample of the trace in 0.1 units precision.
+ */
+typedef struct sim_sample
+{
+	int16_t temperature;
+	int16_t humidity;
+} sim_sample_t;
+
+#ifdef PLATFORM_MEASUREMENT_SIM_TRACE
+/*
+ * Trace file contains comma separated initializers of recorded samples, e.g.:
+ * {215, 702},
+ * {216, 701},
+ */
+static const sim_sample_t sim_trace[] = {
+#include PLATFORM_MEASUREMENT_SIM_TRACE
+};
+#define SIM_TRACE_LENGTH (sizeof(sim_trace) / sizeof(sim_trace[0]))
+static size_t sim_trace_position[PLATFORM_SENSOR_COUNT];
+#else
+#define SIM_TEMPERATURE_BASE 215
+#define SIM_HUMIDITY_BASE 650
+#define SIM_WALK_LIMIT 50
+// Every n-th sample is corrupted by a spike to exercise median filtering
+#define SIM_SPIKE_PERIOD 37
+#define SIM_SPIKE_AMPLITUDE 400
+// Each sensor has different base values
+#define SIM_SENSOR_OFFSET 10
+
+// State is kept per sensor, each sensor is read only by its reader task
+static uint32_t sim_random_state[PLATFORM_SENSOR_COUNT];
+static int16_t sim_temperature_walk[PLATFORM_SENSOR_COUNT];
+static int16_t sim_humidity_walk[PLATFORM_SENSOR_COUNT];
+static uint32_t sim_sample_counter[PLATFORM_SENSOR_COUNT];
+#endif
+
+#ifdef PLATFORM_MEASUREMENT_SIM_ERROR_PERIOD
+static uint32_t sim_read_counter[PLATFORM_SENSOR_COUNT];
+#endif
+
+#ifndef PLATFORM_MEASUREMENT_SIM_TRACE
+/**
+ * Simple linear congruential generator, good enough for the noise and deterministic across runs.
+ */
+static uint32_t sim_random(size_t sensor)
+{
+	sim_random_state[sensor] = sim_random_state[sensor] * 1103515245u + 12345u;
+	return sim_random_state[sensor] >> 16;
+}
+
+static int16_t sim_walk_step(size_t sensor, int16_t walk)
+{
+	// Step -1, 0 or +1 and bounce off the limits
+	walk += (int16_t)(sim_random(sensor) % 3) - 1;
+	if (walk > SIM_WALK_LIMIT)
+	{
+		walk = SIM_WALK_LIMIT;
+	}
+	else if (walk < -SIM_WALK_LIMIT)
+	{
+		walk = -SIM_WALK_LIMIT;
+	}
+	return walk;
+}
+
+static void sim_generate(size_t sensor, int16_t* temperature, int16_t* humidity)
+{
+	sim_temperature_walk[sensor] = sim_walk_step(sensor, sim_temperature_walk[sensor]);
+	sim_humidity_walk[sensor] = sim_walk_step(sensor, sim_humidity_walk[sensor]);
+	*temperature = SIM_TEMPERATURE_BASE + sensor * SIM_SENSOR_OFFSET + sim_temperature_walk[sensor];
+	*humidity = SIM_HUMIDITY_BASE - sensor * SIM_SENSOR_OFFSET + sim_humidity_walk[sensor];
+	if (++sim_sample_counter[sensor] % SIM_SPIKE_PERIOD == 0)
+	{
+		*temperature += SIM_SPIKE_AMPLITUDE;
+	}
+}
+#endif
+
+esp_err_t platform_measurement_init()
+{
+	for (size_t i = 0; i < PLATFORM_SENSOR_COUNT; i++)
+	{
+#ifdef PLATFORM_MEASUREMENT_SIM_TRACE
+		// Sensors replay the trace shifted against each other
+		sim_trace_position[i] = i % SIM_TRACE_LENGTH;
+#else
+		sim_random_state[i] = i + 1;
+		sim_temperature_walk[i] = 0;
+		sim_humidity_walk[i] = 0;
+		sim_sample_counter[i] = 0;
+#endif
+#ifdef PLATFORM_MEASUREMENT_SIM_ERROR_PERIOD
+		sim_read_counter[i] = 0;
+#endif
+	}
+	return ESP_OK;
+}
+
+size_t platform_measurement_sensor_count(void)
+{
+	return PLATFORM_SENSOR_COUNT;
+}
+
+const platform_sensor_t* platform_measurement_sensor(size_t sensor)
+{
+	return sensor < PLATFORM_SENSOR_COUNT ? &platform_sensors[sensor] : NULL;
+}
+
+esp_err_t platform_measurement_read(size_t sensor, int16_t* temperature, int16_t* humidity)
+{
+	if (sensor >= PLATFORM_SENSOR_COUNT)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+#ifdef PLATFORM_MEASUREMENT_SIM_ERROR_PERIOD
+	if (++sim_read_counter[sensor] % PLATFORM_MEASUREMENT_SIM_ERROR_PERIOD == 0)
+	{
+		return ESP_ERR_TIMEOUT;
+	}
+#endif
+#ifdef PLATFORM_MEASUREMENT_SIM_TRACE
+	// Replay the trace in the loop
+	*temperature = sim_trace[sim_trace_position[sensor]].temperature;
+	*humidity = sim_trace[sim_trace_position[sensor]].humidity;
+	sim_trace_position[sensor] = (sim_trace_position[sensor] + 1) % SIM_TRACE_LENGTH;
+#else
+	sim_generate(sensor, temperature, humidity);
+#endif
+	return ESP_OK;
+}
+
+#endif /* PLATFORM_MEASUREMENT_SIM */
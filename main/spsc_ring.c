@@ -0,0 +1,88 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of lock-free single producer single consumer ring buffer.
+ *
+ * Head and tail are free running counters, position in the buffer is counter masked by
+ * capacity. Producer publishes record by release store of head after copying the data and
+ * consumer frees the slot by release store of tail after copying it out.
+ */
+
+#include <string.h>
+
+#include "spsc_ring.h"
+
+bool spsc_ring_init(spsc_ring_t* ring, void* buffer, size_t item_size, size_t capacity)
+{
+	if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+	{
+		return false;
+	}
+	ring->buffer = (uint8_t*)buffer;
+	ring->item_size = item_size;
+	ring->capacity = capacity;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	return true;
+}
+
+bool spsc_ring_push(spsc_ring_t* ring, const void* item)
+{
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	if (head - tail == ring->capacity)
+	{
+		return false;
+	}
+	memcpy(&ring->buffer[(head & (ring->capacity - 1)) * ring->item_size], item, ring->item_size);
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	return true;
+}
+
+bool spsc_ring_pop(spsc_ring_t* ring, void* item)
+{
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	if (head == tail)
+	{
+		return false;
+	}
+	memcpy(item, &ring->buffer[(tail & (ring->capacity - 1)) * ring->item_size], ring->item_size);
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+size_t spsc_ring_count(const spsc_ring_t* ring)
+{
+	size_t tail = atomic_load_explicit(&((spsc_ring_t*)ring)->tail, memory_order_acquire);
+	size_t head = atomic_load_explicit(&((spsc_ring_t*)ring)->head, memory_order_acquire);
+	return head - tail;
+}
@@ -0,0 +1,87 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief This file defines lock-free ring buffer of fixed size records for passing data
+ * between exactly one producer and one consumer task. It depends only on C standard library.
+ */
+
+#ifndef MAIN_SPSC_RING_H_
+#define MAIN_SPSC_RING_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+/**
+ * Ring buffer state. Head is written only by producer and tail only by consumer.
+ */
+typedef struct spsc_ring
+{
+	uint8_t* buffer;
+	size_t item_size;
+	/**
+	 * Number of records, must be power of two
+	 */
+	size_t capacity;
+	atomic_size_t head;
+	atomic_size_t tail;
+} spsc_ring_t;
+
+/**
+ * Initialize ring buffer over provided memory.
+ * @param ring       Ring buffer
+ * @param buffer     Memory for capacity * item_size bytes
+ * @param item_size  Size of one record
+ * @param capacity   Number of records, must be power of two
+ * @return False if capacity is not power of two.
+ */
+bool spsc_ring_init(spsc_ring_t* ring, void* buffer, size_t item_size, size_t capacity);
+
+/**
+ * Append record to the ring. Called only by producer.
+ * @return False if the ring is full.
+ */
+bool spsc_ring_push(spsc_ring_t* ring, const void* item);
+
+/**
+ * Remove the oldest record from the ring. Called only by consumer.
+ * @return False if the ring is empty.
+ */
+bool spsc_ring_pop(spsc_ring_t* ring, void* item);
+
+/**
+ * Get number of records in the ring. The value is exact only when called by producer or consumer
+ * and the other side may change it concurrently.
+ */
+size_t spsc_ring_count(const spsc_ring_t* ring);
+
+#endif /* MAIN_SPSC_RING_H_ */
@@ -0,0 +1,278 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of time persistence with RTC counter anchors.
+ */
+
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_log.h>
+#include <esp32/clk.h>
+#include <nvs.h>
+
+#include "time_sync.h"
+#include "config.h"
+
+#define TAG "time_sync"
+
+#define TIME_SYNC_NAMESPACE "time_sync"
+#define TIME_SYNC_KEY_DRIFT "drift"
+#define TIME_SYNC_KEY_ERROR "drift_err"
+#define TIME_SYNC_MAGIC 0x54534e43u
+
+// Weight of new drift sample is 1/TIME_SYNC_DRIFT_WEIGHT
+#define TIME_SYNC_DRIFT_WEIGHT 4
+
+/**
+ * UTC time paired with RTC counter value at the moment of synchronization
+ */
+typedef struct time_sync_anchor
+{
+	int64_t utc_us;
+	uint64_t rtc_us;
+} time_sync_anchor_t;
+
+/**
+ * Synchronization state retained in RTC memory across software resets and deep sleep
+ */
+typedef struct time_sync_state
+{
+	uint32_t magic;
+	/**
+	 * The last synchronization, used for restoring time
+	 */
+	time_sync_anchor_t last;
+	/**
+	 * Synchronization at least TIME_SYNC_DRIFT_PERIOD old, used for drift measurement
+	 */
+	time_sync_anchor_t base;
+	uint32_t checksum;
+} time_sync_state_t;
+
+static RTC_NOINIT_ATTR time_sync_state_t time_sync_state;
+static portMUX_TYPE time_sync_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool time_sync_is_valid = false;
+static bool time_sync_drift_known = false;
+/**
+ * RTC counter drift against UTC and its estimated error in parts per billion
+ */
+static int32_t time_sync_drift_ppb = 0;
+static uint32_t time_sync_drift_error_ppb = TIME_SYNC_MAX_DRIFT * 1000;
+
+static uint32_t time_sync_checksum(const time_sync_state_t* state)
+{
+	const uint32_t* words = (const uint32_t*)state;
+	uint32_t checksum = 0;
+	for (size_t i = 0; i < offsetof(time_sync_state_t, checksum) / sizeof(uint32_t); i++)
+	{
+		checksum = (checksum << 5 | checksum >> 27) ^ words[i];
+	}
+	return checksum;
+}
+
+static bool time_sync_state_valid(void)
+{
+	return time_sync_state.magic == TIME_SYNC_MAGIC
+			&& time_sync_state.checksum == time_sync_checksum(&time_sync_state);
+}
+
+static void time_sync_load_drift(void)
+{
+	nvs_handle_t handle;
+	if (nvs_open(TIME_SYNC_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+	{
+		return;
+	}
+	int32_t drift;
+	uint32_t error;
+	if (nvs_get_i32(handle, TIME_SYNC_KEY_DRIFT, &drift) == ESP_OK
+			&& nvs_get_u32(handle, TIME_SYNC_KEY_ERROR, &error) == ESP_OK)
+	{
+		time_sync_drift_ppb = drift;
+		time_sync_drift_error_ppb = error;
+		time_sync_drift_known = true;
+	}
+	nvs_close(handle);
+}
+
+static void time_sync_store_drift(void)
+{
+	nvs_handle_t handle;
+	esp_err_t result = nvs_open(TIME_SYNC_NAMESPACE, NVS_READWRITE, &handle);
+	if (result == ESP_OK)
+	{
+		result = nvs_set_i32(handle, TIME_SYNC_KEY_DRIFT, time_sync_drift_ppb);
+		if (result == ESP_OK)
+		{
+			result = nvs_set_u32(handle, TIME_SYNC_KEY_ERROR, time_sync_drift_error_ppb);
+		}
+		if (result == ESP_OK)
+		{
+			result = nvs_commit(handle);
+		}
+		nvs_close(handle);
+	}
+	if (result != ESP_OK)
+	{
+		ESP_LOGW(TAG, "Failed to store drift: %s", esp_err_to_name(result));
+	}
+}
+
+/**
+ * Project UTC time of RTC counter value from the last anchor corrected by drift estimate
+ */
+static int64_t time_sync_project(uint64_t rtc_us)
+{
+	int64_t elapsed = (int64_t)(rtc_us - time_sync_state.last.rtc_us);
+	return time_sync_state.last.utc_us + elapsed + elapsed * time_sync_drift_ppb / 1000000000LL;
+}
+
+static uint32_t time_sync_uncertainty(uint64_t rtc_us)
+{
+	uint64_t elapsed = rtc_us - time_sync_state.last.rtc_us;
+	uint64_t drift_error_us = elapsed / 1000 * time_sync_drift_error_ppb / 1000000;
+	uint64_t uncertainty = TIME_SYNC_BASE_UNCERTAINTY + drift_error_us / 1000;
+	return uncertainty > UINT32_MAX ? UINT32_MAX : (uint32_t)uncertainty;
+}
+
+bool time_sync_restore(void)
+{
+	time_sync_load_drift();
+	esp_reset_reason_t reason = esp_reset_reason();
+	// RTC counter is reset together with RTC memory after power loss
+	if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT || !time_sync_state_valid())
+	{
+		time_sync_state.magic = 0;
+		return false;
+	}
+	uint64_t rtc_now = esp_clk_rtc_time();
+	if (rtc_now < time_sync_state.last.rtc_us)
+	{
+		return false;
+	}
+	uint32_t uncertainty = time_sync_uncertainty(rtc_now);
+	if (uncertainty > TIME_SYNC_MAX_UNCERTAINTY)
+	{
+		ESP_LOGI(TAG, "Stored time too uncertain: %u ms", uncertainty);
+		return false;
+	}
+	int64_t utc_us = time_sync_project(rtc_now);
+	struct timeval tv = {
+		.tv_sec = utc_us / 1000000,
+		.tv_usec = utc_us % 1000000
+	};
+	settimeofday(&tv, NULL);
+	time_sync_is_valid = true;
+	ESP_LOGI(TAG, "Time restored, uncertainty %u ms, drift %d ppb", uncertainty, time_sync_drift_ppb);
+	return true;
+}
+
+/**
+ * Update drift estimate from UTC and RTC time elapsed since base anchor. Samples outside
+ * of TIME_SYNC_MAX_DRIFT are considered time jumps and they restart the measurement.
+ * @return True if base anchor should be moved to the current synchronization.
+ */
+static bool time_sync_update_drift(int64_t utc_us, uint64_t rtc_us, bool* drift_changed)
+{
+	int64_t rtc_elapsed = (int64_t)(rtc_us - time_sync_state.base.rtc_us);
+	if (rtc_elapsed < (int64_t)TIME_SYNC_DRIFT_PERIOD * 1000)
+	{
+		return false;
+	}
+	int64_t error = (utc_us - time_sync_state.base.utc_us) - rtc_elapsed;
+	if (llabs(error) > rtc_elapsed / 1000000 * TIME_SYNC_MAX_DRIFT)
+	{
+		ESP_LOGW(TAG, "Time jump %lld us ignored", error);
+		return true;
+	}
+	int32_t sample = (int32_t)(error * 1000 / (rtc_elapsed / 1000000));
+	if (time_sync_drift_known)
+	{
+		uint32_t deviation = (uint32_t)abs(sample - time_sync_drift_ppb);
+		time_sync_drift_ppb += (sample - time_sync_drift_ppb) / TIME_SYNC_DRIFT_WEIGHT;
+		time_sync_drift_error_ppb += ((int32_t)deviation - (int32_t)time_sync_drift_error_ppb)
+				/ TIME_SYNC_DRIFT_WEIGHT;
+	}
+	else
+	{
+		time_sync_drift_ppb = sample;
+		time_sync_drift_known = true;
+	}
+	*drift_changed = true;
+	return true;
+}
+
+void time_sync_update(const struct timeval* tv)
+{
+	int64_t utc_us = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+	uint64_t rtc_us = esp_clk_rtc_time();
+	bool drift_changed = false;
+	// State is written only here, so it can be read without lock before the update
+	time_sync_state_t state = time_sync_state;
+	if (!time_sync_state_valid() || time_sync_update_drift(utc_us, rtc_us, &drift_changed))
+	{
+		state.base.utc_us = utc_us;
+		state.base.rtc_us = rtc_us;
+	}
+	state.last.utc_us = utc_us;
+	state.last.rtc_us = rtc_us;
+	state.magic = TIME_SYNC_MAGIC;
+	state.checksum = time_sync_checksum(&state);
+	portENTER_CRITICAL(&time_sync_mux);
+	time_sync_state = state;
+	time_sync_is_valid = true;
+	portEXIT_CRITICAL(&time_sync_mux);
+	if (drift_changed)
+	{
+		ESP_LOGI(TAG, "RTC drift %d ppb, error %u ppb", time_sync_drift_ppb, time_sync_drift_error_ppb);
+		time_sync_store_drift();
+	}
+}
+
+bool time_sync_valid(void)
+{
+	return time_sync_is_valid;
+}
+
+uint32_t time_sync_uncertainty_ms(void)
+{
+	if (!time_sync_is_valid)
+	{
+		return UINT32_MAX;
+	}
+	uint64_t rtc_now = esp_clk_rtc_time();
+	portENTER_CRITICAL(&time_sync_mux);
+	uint32_t uncertainty = time_sync_uncertainty(rtc_now);
+	portEXIT_CRITICAL(&time_sync_mux);
+	return uncertainty;
+}
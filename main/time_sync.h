@@ -0,0 +1,68 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief This file defines persistence of synchronized time across resets and deep sleep.
+ * The last SNTP synchronization is anchored to RTC counter, so the time can be restored
+ * after warm boot without waiting for SNTP. Estimated RTC drift is kept in NVS.
+ */
+
+#ifndef MAIN_TIME_SYNC_H_
+#define MAIN_TIME_SYNC_H_
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <sys/time.h>
+
+/**
+ * Restore system time from the last synchronization anchor. It must be called at boot before
+ * the time is used. It fails after power-on or when uncertainty exceeds TIME_SYNC_MAX_UNCERTAINTY.
+ * @return True if time was restored and it can be used without waiting for SNTP.
+ */
+bool time_sync_restore(void);
+
+/**
+ * Record new synchronization and update drift estimate. Call it from SNTP notification callback.
+ * @param tv  Synchronized UTC time
+ */
+void time_sync_update(const struct timeval* tv);
+
+/**
+ * @return True if time was synchronized or restored.
+ */
+bool time_sync_valid(void);
+
+/**
+ * Estimate maximal error of current time. It grows with time elapsed since the last synchronization.
+ * @return Uncertainty in ms, UINT32_MAX if time is not valid.
+ */
+uint32_t time_sync_uncertainty_ms(void);
+
+#endif /* MAIN_TIME_SYNC_H_ */
@@ -0,0 +1,126 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief Implementation of Wi-Fi connection cache in RTC memory and NVS.
+ */
+
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <esp_log.h>
+#include <nvs.h>
+
+#include "wifi_cache.h"
+
+#define TAG "wifi_cache"
+
+#define WIFI_CACHE_NAMESPACE "wifi_cache"
+#define WIFI_CACHE_KEY "ap"
+#define WIFI_CACHE_MAGIC 0x57434143u
+
+/**
+ * Copy of cache retained in RTC memory during deep sleep
+ */
+static RTC_DATA_ATTR uint32_t wifi_cache_rtc_magic = 0;
+static RTC_DATA_ATTR wifi_cache_t wifi_cache_rtc;
+
+static bool wifi_cache_load_nvs(wifi_cache_t* cache)
+{
+	nvs_handle_t handle;
+	if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+	{
+		return false;
+	}
+	size_t length = sizeof(*cache);
+	esp_err_t result = nvs_get_blob(handle, WIFI_CACHE_KEY, cache, &length);
+	nvs_close(handle);
+	cache->lease_expiry = 0;
+	return result == ESP_OK && length == sizeof(*cache);
+}
+
+bool wifi_cache_load(wifi_cache_t* cache)
+{
+	if (wifi_cache_rtc_magic == WIFI_CACHE_MAGIC)
+	{
+		*cache = wifi_cache_rtc;
+		return true;
+	}
+	if (wifi_cache_load_nvs(cache))
+	{
+		wifi_cache_rtc = *cache;
+		wifi_cache_rtc_magic = WIFI_CACHE_MAGIC;
+		return true;
+	}
+	return false;
+}
+
+void wifi_cache_store(const wifi_cache_t* cache)
+{
+	// Lease expiry changes with every DHCP bind, it is kept only in RTC memory
+	wifi_cache_t persistent = *cache;
+	persistent.lease_expiry = 0;
+	wifi_cache_t stored;
+	bool changed = !wifi_cache_load(&stored);
+	stored.lease_expiry = 0;
+	changed = changed || memcmp(&stored, &persistent, sizeof(stored)) != 0;
+	wifi_cache_rtc = *cache;
+	wifi_cache_rtc_magic = WIFI_CACHE_MAGIC;
+	if (!changed)
+	{
+		return;
+	}
+	nvs_handle_t handle;
+	esp_err_t result = nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &handle);
+	if (result == ESP_OK)
+	{
+		result = nvs_set_blob(handle, WIFI_CACHE_KEY, &persistent, sizeof(persistent));
+		if (result == ESP_OK)
+		{
+			result = nvs_commit(handle);
+		}
+		nvs_close(handle);
+	}
+	if (result != ESP_OK)
+	{
+		ESP_LOGW(TAG, "Failed to store cache: %s", esp_err_to_name(result));
+	}
+}
+
+void wifi_cache_invalidate(void)
+{
+	wifi_cache_rtc_magic = 0;
+	nvs_handle_t handle;
+	if (nvs_open(WIFI_CACHE_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK)
+	{
+		nvs_erase_key(handle, WIFI_CACHE_KEY);
+		nvs_commit(handle);
+		nvs_close(handle);
+	}
+}
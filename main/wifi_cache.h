@@ -0,0 +1,91 @@
+/*
+ *  Copyright (c) 2019, Vit Holasek.
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *  1. Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *  2. Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *  3. Neither the name of the copyright holder nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file
+ * @author Vit Holasek
+ * @brief This file defines cache of Wi-Fi access point and IP configuration from the last
+ * successful connection. The cache allows to connect without scanning and, until the lease
+ * expires, without DHCP.
+ */
+
+#ifndef MAIN_WIFI_CACHE_H_
+#define MAIN_WIFI_CACHE_H_
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <esp_netif.h>
+
+/**
+ * Cached connection parameters
+ */
+typedef struct wifi_cache
+{
+	/**
+	 * Channel of the access point
+	 */
+	uint8_t channel;
+	/**
+	 * MAC address of the access point
+	 */
+	uint8_t bssid[6];
+	/**
+	 * IP address, netmask and gateway leased by DHCP
+	 */
+	esp_netif_ip_info_t ip_info;
+	/**
+	 * Main DNS server
+	 */
+	esp_netif_dns_info_t dns;
+	/**
+	 * System time in ms when the cached lease expires, 0 if unknown
+	 */
+	uint64_t lease_expiry;
+} wifi_cache_t;
+
+/**
+ * Load cached parameters. RTC memory is used after deep sleep, NVS after reset or power loss.
+ * Lease expiry is not kept in NVS, system time does not survive power loss.
+ * @param[out] cache  Loaded parameters
+ * @return True if valid parameters were found.
+ */
+bool wifi_cache_load(wifi_cache_t* cache);
+
+/**
+ * Store parameters of the current connection to RTC memory and NVS. NVS is written
+ * only when the parameters other than lease expiry change to save flash.
+ * @param cache  Parameters to store
+ */
+void wifi_cache_store(const wifi_cache_t* cache);
+
+/**
+ * Remove cached parameters, the next connection uses full scan and DHCP.
+ */
+void wifi_cache_invalidate(void);
+
+#endif /* MAIN_WIFI_CACHE_H_ */